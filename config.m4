@@ -4,11 +4,45 @@ dnl config.m4 for extension jsonreader
 PHP_ARG_ENABLE(jsonreader, whether to enable jsonreader support,
  [  --enable-jsonreader           Enable jsonreader support])
 
+PHP_ARG_WITH(jsonreader-zlib, whether to enable reading compressed streams in jsonreader,
+ [  --with-jsonreader-zlib[=DIR]  jsonreader: Enable reading gzip / deflate compressed
+                                streams using zlib. DIR is the zlib install prefix], no, no)
   
 if test "$PHP_JSONREADER" != "no"; then
   if test "$ZEND_DEBUG" = "yes"; then
     AC_DEFINE(ENABLE_DEBUG, 1, [Enable debugging information])
   fi
 
-  PHP_NEW_EXTENSION(jsonreader, jsonreader.c libvktor/vktor_unicode.c libvktor/vktor.c, $ext_shared)
+  if test "$PHP_JSONREADER_ZLIB" != "no"; then
+    for i in $PHP_JSONREADER_ZLIB /usr/local /usr; do
+      if test -f $i/include/zlib.h; then
+        JSONREADER_ZLIB_DIR=$i
+        break
+      fi
+    done
+
+    if test -z "$JSONREADER_ZLIB_DIR"; then
+      AC_MSG_ERROR([Cannot find zlib.h, please specify the zlib install prefix])
+    fi
+
+    PHP_CHECK_LIBRARY(z, inflateInit2_, [
+      PHP_ADD_INCLUDE($JSONREADER_ZLIB_DIR/include)
+      PHP_ADD_LIBRARY_WITH_PATH(z, $JSONREADER_ZLIB_DIR/$PHP_LIBDIR, JSONREADER_SHARED_LIBADD)
+      AC_DEFINE(HAVE_JSONREADER_ZLIB, 1, [Whether jsonreader can read compressed streams])
+    ], [
+      AC_MSG_ERROR([zlib inflate functions not found, check config.log for details])
+    ], [
+      -L$JSONREADER_ZLIB_DIR/$PHP_LIBDIR
+    ])
+  fi
+
+  PHP_CHECK_LIBRARY(pthread, pthread_create, [
+    PHP_ADD_LIBRARY(pthread,, JSONREADER_SHARED_LIBADD)
+  ], [
+    AC_DEFINE(VKTOR_NO_THREADS, 1, [Whether libvktor parses arrays on the calling thread only])
+  ])
+
+  PHP_SUBST(JSONREADER_SHARED_LIBADD)
+
+  PHP_NEW_EXTENSION(jsonreader, jsonreader.c jsonwriter.c libvktor/vktor_unicode.c libvktor/vktor_scan.c libvktor/vktor.c, $ext_shared)
 fi
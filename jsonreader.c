@@ -25,11 +25,18 @@
 #include "php.h"
 #include "php_ini.h"
 #include "ext/standard/info.h"
+#include "ext/standard/php_smart_str.h"
 #include "php_jsonreader.h"
 #include "zend_exceptions.h"
 
+#ifdef HAVE_JSONREADER_ZLIB
+#include <zlib.h>
+#endif
+
 #include "libvktor/vktor.h"
 
+#include <float.h>
+
 ZEND_DECLARE_MODULE_GLOBALS(jsonreader)
 
 static zend_object_handlers  jsonreader_obj_handlers;
@@ -38,20 +45,124 @@ static zend_class_entry     *jsonreader_exception_ce;
 
 const HashTable jsonreader_prop_handlers;
 
+/* A compiled record schema, as set by JSONReader::setSchema(). Fields are kept
+   in schema order, and looked up by name through the lookup table */
+typedef struct _jsonreader_schema jsonreader_schema;
+
+typedef struct _jsonreader_schema_field {
+	char              *name;
+	int                name_len;
+	long               types;
+	jsonreader_schema *nested;
+} jsonreader_schema_field;
+
+struct _jsonreader_schema {
+	int                      count;
+	jsonreader_schema_field *fields;
+	HashTable                lookup;
+};
+
+/* A path segment - an object key, or an array index if key is NULL. In rule 
+   patterns, a segment with no key and an index of -1 is a wildcard, and keys 
+   which are numbers also match array indexes */
+typedef struct _jsonreader_path_seg {
+	char *key;
+	int   key_len;
+	long  index;
+} jsonreader_path_seg;
+
+/* A compiled rule of JSONReader::transformTo() */
+typedef struct _jsonreader_rule {
+	jsonreader_path_seg *segs;
+	int                  depth;
+	long                 action;
+	zval                *arg;
+} jsonreader_rule;
+
+/* State of base64 decoding in JSONReader::copyStringTo(), between chunks */
+typedef struct _jsonreader_base64 {
+	unsigned long bits;
+	int           digits;
+	zend_bool     padded;
+} jsonreader_base64;
+
+/* State of a running JSONReader::transformTo() call */
+typedef struct _jsonreader_transform {
+	jsonreader_rule     *rules;
+	int                  count;
+	jsonreader_path_seg *path;
+	jsonwriter_object   *writer;
+	int                  status;
+} jsonreader_transform;
+
+/* A token type handler of JSONReader::parse() */
+typedef struct _jsonreader_handler {
+	long  types;
+	zval *callback;
+} jsonreader_handler;
+
+/* State of a running JSONReader::parse() call - path handlers are compiled 
+   and matched like the callback rules of JSONReader::transformTo() */
+typedef struct _jsonreader_parse {
+	jsonreader_transform  t;
+	jsonreader_handler   *handlers;
+	int                   handler_count;
+	long                  calls;
+	zend_bool             stop;
+} jsonreader_parse;
+
 typedef struct _jsonreader_object { 
 	zend_object   std;
 	php_stream   *stream;
+	off_t         stream_start;
 	vktor_parser *parser;
+	vktor_parser *spare_parser;
 	zend_bool     close_stream;
 	long          max_depth;
 	long          read_buffer;
+	long          read_size;
+	char         *read_buf;
+	long          read_buf_len;
+	int           refills;
 	int           errmode;
+	zend_bool     nonblock;
+	long          validate_utf8;
+	long          encoding;
+	long          token_mask;
+	zend_bool     lazy_strings;
+	long          number_mode;
+	zend_bool     stream_strings;
+	long          max_token_size;
+	jsonreader_schema *schema;
+	long          compression;
+#ifdef HAVE_JSONREADER_ZLIB
+	z_stream     *zstream;
+	char         *zbuf;
+	long          zbuf_len;
+	zend_bool     zstream_end;
+#endif
+	zend_bool     need_data;
+	zend_bool     feeding;
+	zend_bool     fed_end;
+	zval         *chunks;
 } jsonreader_object;
 
 #define JSONREADER_REG_CLASS_CONST_L(name, value) \
 	zend_declare_class_constant_long(jsonreader_ce, name, sizeof(name) - 1, \
 	(long) value TSRMLS_CC)
 
+/* Status returned by jsonreader_read() and friends when a non-blocking stream 
+   has no data available right now */
+#define JSONREADER_NEED_DATA 1
+
+/* Parser functions advancing to the next token, used by jsonreader_step() */
+typedef vktor_status (*jsonreader_step_func)(vktor_parser *parser, vktor_error **error);
+
+/* Limits and initial read size used when the read buffer size is adaptive */
+#define JSONREADER_READ_BUFF_MIN  1024
+#define JSONREADER_READ_BUFF_INIT 8192
+#define JSONREADER_READ_BUFF_MAX  (1024 * 1024)
+
 #define JSONREADER_VALUE_TOKEN VKTOR_T_NULL  | \
                                VKTOR_T_TRUE  | \
 							   VKTOR_T_FALSE | \
@@ -59,16 +170,65 @@ typedef struct _jsonreader_object {
 							   VKTOR_T_FLOAT | \
 							   VKTOR_T_STRING
 
+/* Token types which may be given as the type of a schema field */
+#define JSONREADER_SCHEMA_TYPES (JSONREADER_VALUE_TOKEN | \
+                                 VKTOR_T_ARRAY_START    | \
+                                 VKTOR_T_OBJECT_START)
+
+/* Exception code used for values not matching the schema in readRecord() */
+#define JSONREADER_ERR_SCHEMA 100
+
+/* Status returned by jsonreader_schema_decode() when a value does not match 
+   the schema */
+#define JSONREADER_SCHEMA_MISMATCH 2
+
+/* Default chunk size of JSONReader::readStringChunk(), also used to copy or 
+   read whole streamed strings */
+#define JSONREADER_STRING_CHUNK 8192
+
+/* Value written in place of values redacted by JSONReader::transformTo() */
+#define JSONREADER_REDACTED "[REDACTED]"
+
 /* {{{ attribute keys and possible values */
 enum {
 	ATTR_MAX_DEPTH = 1,
 	ATTR_READ_BUFF,
 	ATTR_ERRMODE,
+	ATTR_NONBLOCK,
+	ATTR_VALIDATE_UTF8,
+	ATTR_ENCODING,
+	ATTR_TOKEN_MASK,
+	ATTR_COMPRESSION,
+	ATTR_LAZY_STRINGS,
+	ATTR_NUMBER_MODE,
+	ATTR_STREAM_STRINGS,
+	ATTR_MAX_TOKEN_SIZE,
 
 	ERRMODE_PHPERR,
 	ERRMODE_EXCEPT,
 	ERRMODE_INTERN
 };
+
+enum {
+	COMPRESSION_NONE = 0,
+	COMPRESSION_AUTO,
+	COMPRESSION_GZIP,
+	COMPRESSION_ZLIB,
+	COMPRESSION_DEFLATE
+};
+
+enum {
+	NUMBER_NATIVE = 0,
+	NUMBER_STRING,
+	NUMBER_AUTO
+};
+
+enum {
+	RULE_DROP = 1,
+	RULE_REDACT,
+	RULE_REPLACE,
+	RULE_CALLBACK /* not a constant, used for rules given as a callback */
+};
 /* }}} */
 
 /* }}} */
@@ -76,53 +236,89 @@ enum {
 /* {{{ Memory management functions wrapping emalloc etc. */
 
 /* {{{ jsr_malloc
-   Wrapper for PHP's emalloc, passed to libvktor as malloc alternative */
-static void *jsr_malloc(size_t size)
+   Wrapper for PHP's emalloc, used by the libvktor parser allocator */
+static void *jsr_malloc(void *ctx, size_t size)
 {
 	return emalloc(size);
 }
 /* }}} */
 
 /* {{{ jsr_realloc
-   Wrapper for PHP's erealloc, passed to libvktor as realloc alternative */
-static void *jsr_realloc(void *ptr, size_t size)
+   Wrapper for PHP's erealloc, used by the libvktor parser allocator */
+static void *jsr_realloc(void *ctx, void *ptr, size_t size)
 {
 	return erealloc(ptr, size);
 }
 /* }}} */
 
 /* {{{ jsr_free 
-   Wrapper for PHP's efree, passed to libvktor as free alternative */
-static void jsr_free(void *ptr)
+   Wrapper for PHP's efree, used by the libvktor parser allocator */
+static void jsr_free(void *ctx, void *ptr)
 {
 	efree(ptr);
 }
 /* }}} */
 
+/* Allocator passed to libvktor parsers, so all parser memory is managed by 
+   the Zend memory manager */
+static const vktor_allocator jsonreader_allocator = {
+	jsr_malloc,
+	jsr_realloc,
+	jsr_free,
+	NULL
+};
+
+#ifdef HAVE_JSONREADER_ZLIB
+/* {{{ jsr_zalloc
+   Allocation function for zlib, wrapping PHP's safe_emalloc */
+static voidpf jsr_zalloc(voidpf opaque, uInt items, uInt size)
+{
+	return (voidpf) safe_emalloc(items, size, 0);
+}
 /* }}} */
 
-/* {{{ jsonreader_handle_error
-   Handle a parser error - for now generate an E_WARNING, in the future this might
-   also do things like throw an exception or use an internal error handler */
-static void jsonreader_handle_error(vktor_error *err, jsonreader_object *obj TSRMLS_DC)
+/* {{{ jsr_zfree
+   Free function for zlib, wrapping PHP's efree */
+static void jsr_zfree(voidpf opaque, voidpf address)
+{
+	efree((void *) address);
+}
+/* }}} */
+#endif
+
+/* }}} */
+
+
+/* {{{ jsonreader_report_error
+   Report a parser error code and message according to the error mode - for 
+   now generate an E_WARNING or throw an exception */
+static void jsonreader_report_error(jsonreader_object *obj, int code, const char *message TSRMLS_DC)
 {
 	switch(obj->errmode) {
 		case ERRMODE_PHPERR:
 			php_error_docref(NULL TSRMLS_CC, E_WARNING, "parser error [#%d]: %s", 
-				err->code, err->message);
+				code, message);
 			break;
 
 		case ERRMODE_EXCEPT:
-			zend_throw_exception_ex(jsonreader_exception_ce, err->code TSRMLS_CC, 
-				err->message);
+			zend_throw_exception_ex(jsonreader_exception_ce, code TSRMLS_CC, 
+				"%s", message);
 			break;
 
 		default: // For now emit a PHP WARNING
 			php_error_docref(NULL TSRMLS_CC, E_WARNING, "parser error [#%d]: %s", 
-				err->code, err->message);
+				code, message);
 			break;
 	}
+}
+/* }}} */
 
+/* {{{ jsonreader_handle_error
+   Handle a parser error - for now generate an E_WARNING, in the future this might
+   also do things like throw an exception or use an internal error handler */
+static void jsonreader_handle_error(vktor_error *err, jsonreader_object *obj TSRMLS_DC)
+{
+	jsonreader_report_error(obj, err->code, err->message TSRMLS_CC);
 	vktor_error_free(err);
 }
 /* }}} */
@@ -282,81 +478,172 @@ static int jsonreader_get_token_type(jsonreader_object *obj, zval **retval TSRML
 }
 /* }}} */
 
-/* {{{ jsonreader_get_token_value
-   Get the value of the current token */
-static int jsonreader_get_token_value(jsonreader_object *obj, zval **retval TSRMLS_DC)
+/* {{{ jsonreader_double_is_exact
+   Check if a double converted from the text of a number token holds the value
+   written, to the precision it is written in: the text must have no more 
+   significant digits than a double can hold, and the value must not overflow 
+   or underflow */
+static int jsonreader_double_is_exact(const char *text, int text_len, double dval)
+{
+	const char *p, *end = text + text_len;
+	int         digits = 0, zeros = 0;
+
+	/* trailing zeros, as in 1.50, do not need to be kept */
+	for (p = text; p < end && *p != 'e' && *p != 'E'; p++) {
+		if (*p < '0' || *p > '9') {
+			continue;
+		}
+		if (*p == '0') {
+			if (digits > 0) {
+				zeros++;
+			}
+		} else {
+			digits += zeros + 1;
+			zeros = 0;
+		}
+	}
+
+	if (digits > DBL_DIG) {
+		return 0;
+	}
+
+	if (dval == 0) {
+		return (digits == 0);
+	}
+
+	return (zend_finite(dval) && (dval < 0 ? -dval : dval) >= DBL_MIN);
+}
+/* }}} */
+
+/* {{{ jsonreader_number_to_zval
+   Set a zval to the value of the current number token according to the number
+   mode - converted to an integer or a float, kept as the number text, or 
+   converted only if the value fits. Numbers are not converted at all in 
+   NUMBER_STRING mode */
+static int jsonreader_number_to_zval(jsonreader_object *obj, vktor_token t_type, zval *retval TSRMLS_DC)
 {
-	vktor_token  t_type;
 	vktor_error *err = NULL;
+	char        *text = NULL;
+	int          text_len = 0;
+	long         lval;
+	double       dval;
+
+	if (obj->number_mode != NUMBER_NATIVE) {
+		text_len = vktor_get_value_str(obj->parser, &text, &err);
+		if (err != NULL) {
+			ZVAL_NULL(retval);
+			jsonreader_handle_error(err, obj TSRMLS_CC);
+			return FAILURE;
+		}
 
-	ALLOC_ZVAL(*retval);
+		if (obj->number_mode == NUMBER_STRING) {
+			ZVAL_STRINGL(retval, text, text_len, 1);
+			return SUCCESS;
+		}
+	}
 
-	if (! obj->parser) {
-		ZVAL_NULL(*retval);
+	if (t_type == VKTOR_T_INT) {
+		lval = vktor_get_value_long(obj->parser, &err);
+		if (err == NULL) {
+			ZVAL_LONG(retval, lval);
+			return SUCCESS;
+		}
 
 	} else {
-		t_type = vktor_get_token_type(obj->parser);
-		switch(t_type) {
-			case VKTOR_T_NONE:
-			case VKTOR_T_NULL:
-			case VKTOR_T_ARRAY_START:
-			case VKTOR_T_ARRAY_END:
-			case VKTOR_T_OBJECT_START:
-			case VKTOR_T_OBJECT_END:
-				ZVAL_NULL(*retval);
-				break;
+		dval = vktor_get_value_double(obj->parser, &err);
+		if (err == NULL && (obj->number_mode == NUMBER_NATIVE || 
+			jsonreader_double_is_exact(text, text_len, dval))) {
+			ZVAL_DOUBLE(retval, dval);
+			return SUCCESS;
+		}
+	}
 
-			case VKTOR_T_FALSE:
-			case VKTOR_T_TRUE:
-				ZVAL_BOOL(*retval, (t_type == VKTOR_T_TRUE));
-				break;
+	/* NUMBER_AUTO - numbers which do not fit are returned as their text */
+	if (obj->number_mode == NUMBER_AUTO) {
+		if (err != NULL) {
+			vktor_error_free(err);
+		}
+		ZVAL_STRINGL(retval, text, text_len, 1);
+		return SUCCESS;
+	}
 
-			case VKTOR_T_OBJECT_KEY:
-			case VKTOR_T_STRING: {
-				char *strval;
-				int   strlen;
+	ZVAL_NULL(retval);
+	jsonreader_handle_error(err, obj TSRMLS_CC);
+	return FAILURE;
+}
+/* }}} */
 
-				strlen = vktor_get_value_str(obj->parser, &strval, &err);
-				if (err != NULL) {
-					ZVAL_NULL(*retval);
-					jsonreader_handle_error(err, obj TSRMLS_CC);
-					return FAILURE;
-				}
+/* {{{ jsonreader_token_to_zval
+   Set a zval to the value of the current token. Structs and other tokens 
+   without a value are converted to NULL */
+static int jsonreader_token_to_zval(jsonreader_object *obj, zval *retval TSRMLS_DC)
+{
+	vktor_token  t_type;
+	vktor_error *err = NULL;
 
-				ZVAL_STRINGL(*retval, strval, strlen, 1);
-				break;
-			}
-			
-			case VKTOR_T_INT:
-				ZVAL_LONG(*retval, vktor_get_value_long(obj->parser, &err));
-				if (err != NULL) {
-					ZVAL_NULL(*retval);
-					jsonreader_handle_error(err, obj TSRMLS_CC);
-					return FAILURE;
-				}
-				break;
+	t_type = vktor_get_token_type(obj->parser);
+	switch(t_type) {
+		case VKTOR_T_NONE:
+		case VKTOR_T_NULL:
+		case VKTOR_T_ARRAY_START:
+		case VKTOR_T_ARRAY_END:
+		case VKTOR_T_OBJECT_START:
+		case VKTOR_T_OBJECT_END:
+		case VKTOR_T_STRING_START:
+			ZVAL_NULL(retval);
+			break;
 
-			case VKTOR_T_FLOAT:
-				ZVAL_DOUBLE(*retval, vktor_get_value_double(obj->parser, &err));
-				if (err != NULL) {
-					ZVAL_NULL(*retval);
-					jsonreader_handle_error(err, obj TSRMLS_CC);
-					return FAILURE;
-				}
-				break;
+		case VKTOR_T_FALSE:
+		case VKTOR_T_TRUE:
+			ZVAL_BOOL(retval, (t_type == VKTOR_T_TRUE));
+			break;
+
+		case VKTOR_T_OBJECT_KEY:
+		case VKTOR_T_STRING: {
+			char *strval;
+			int   strlen;
 
-			default: /* should not happen */
-				php_error_docref(NULL TSRMLS_CC, E_ERROR, 
-					"internal error: unkown token type %d", t_type);
+			strlen = vktor_get_value_str(obj->parser, &strval, &err);
+			if (err != NULL) {
+				ZVAL_NULL(retval);
+				jsonreader_handle_error(err, obj TSRMLS_CC);
 				return FAILURE;
-				break;
+			}
+
+			ZVAL_STRINGL(retval, strval, strlen, 1);
+			break;
 		}
+		
+		case VKTOR_T_INT:
+		case VKTOR_T_FLOAT:
+			return jsonreader_number_to_zval(obj, t_type, retval TSRMLS_CC);
+
+		default: /* should not happen */
+			php_error_docref(NULL TSRMLS_CC, E_ERROR, 
+				"internal error: unkown token type %d", t_type);
+			return FAILURE;
+			break;
 	}
 
 	return SUCCESS;
 }
 /* }}} */
 
+/* {{{ jsonreader_get_token_value
+   Get the value of the current token */
+static int jsonreader_get_token_value(jsonreader_object *obj, zval **retval TSRMLS_DC)
+{
+	ALLOC_ZVAL(*retval);
+
+	if (! obj->parser) {
+		ZVAL_NULL(*retval);
+		return SUCCESS;
+	}
+
+	return jsonreader_token_to_zval(obj, *retval TSRMLS_CC);
+}
+/* }}} */
+
 /* {{{ jsonreader_get_current_struct 
    Get the type of the current JSON struct we are in (object, array or none) */
 static int jsonreader_get_current_struct(jsonreader_object *obj, zval **retval TSRMLS_DC)
@@ -401,318 +688,3052 @@ static int jsonreader_get_current_depth(jsonreader_object *obj, zval **retval TS
 }
 /* }}} */
 
+/* {{{ jsonreader_get_read_buffer_size
+   Get the current read buffer size, which may change if it is adaptive */
+static int jsonreader_get_read_buffer_size(jsonreader_object *obj, zval **retval TSRMLS_DC)
+{
+	ALLOC_ZVAL(*retval);
+	ZVAL_LONG(*retval, (obj->read_size > 0 ? obj->read_size : obj->read_buffer));
+
+	return SUCCESS;
+}
 /* }}} */
 
-/* {{{ jsonreader_object_free_storage 
-   C-level object destructor for JSONReader objects */
-static void jsonreader_object_free_storage(void *object TSRMLS_DC) 
-{
-	jsonreader_object *intern = (jsonreader_object *) object;
+/* }}} */
 
-	zend_object_std_dtor(&intern->std TSRMLS_CC);
+/* {{{ Schema related functions */
 
-	if (intern->parser) {
-		vktor_parser_free(intern->parser);
-	}
+/* {{{ jsonreader_schema_free
+   Free a compiled schema, including any nested schemas */
+static void jsonreader_schema_free(jsonreader_schema *schema)
+{
+	int i;
 
-	if (intern->stream && intern->close_stream) {
-		php_stream_close(intern->stream);
+	for (i = 0; i < schema->count; i++) {
+		efree(schema->fields[i].name);
+		if (schema->fields[i].nested) {
+			jsonreader_schema_free(schema->fields[i].nested);
+		}
 	}
 
-	efree(object);
+	efree(schema->fields);
+	zend_hash_destroy(&schema->lookup);
+	efree(schema);
 }
 /* }}} */
 
-/* {{{ jsonreader_object_new 
-   C-level constructor of JSONReader objects. Does not initialize the vktor 
-   parser - this will be initialized when needed, by calling jsonreader_init() */
-static zend_object_value jsonreader_object_new(zend_class_entry *ce TSRMLS_DC) 
+/* {{{ jsonreader_schema_compile
+   Compile a schema array, mapping field names to a mask of allowed token types
+   or to a nested schema array, into a jsonreader_schema struct. Nested schemas
+   may be up to depth levels deep. Returns NULL and emits a warning if the 
+   schema is invalid */
+static jsonreader_schema *jsonreader_schema_compile(HashTable *ht, long depth TSRMLS_DC)
 {
-	zend_object_value  retval;
-	jsonreader_object *intern;
+	jsonreader_schema       *schema;
+	jsonreader_schema_field *field;
+	zval                   **type;
+	char                    *key;
+	uint                     key_len;
+	ulong                    num_key;
+	long                     n;
+
+	if (depth < 1) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "schema is nested too deeply");
+		return NULL;
+	}
 
-	intern = ecalloc(1, sizeof(jsonreader_object));
-	intern->max_depth = JSONREADER_G(max_depth);
-	intern->read_buffer = JSONREADER_G(read_buffer);
-	intern->errmode = ERRMODE_PHPERR;
+	if (zend_hash_num_elements(ht) == 0) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "schema must have at least one field");
+		return NULL;
+	}
 
-	zend_object_std_init(&(intern->std), ce TSRMLS_CC);
-  
-#if PHP_VERSION_ID < 50399
-	zend_hash_copy(intern->std.properties, &ce->default_properties, 
-		(copy_ctor_func_t) zval_add_ref, NULL, sizeof(zval *));
-#else
-  object_properties_init(&(intern->std), ce);
-#endif
+	schema = ecalloc(1, sizeof(jsonreader_schema));
+	schema->fields = safe_emalloc(zend_hash_num_elements(ht), sizeof(jsonreader_schema_field), 0);
+	zend_hash_init(&schema->lookup, zend_hash_num_elements(ht), NULL, NULL, 0);
 
-	retval.handle = zend_objects_store_put(intern, 
-		(zend_objects_store_dtor_t) zend_objects_destroy_object, 
-		(zend_objects_free_object_storage_t) jsonreader_object_free_storage, 
-		NULL TSRMLS_CC);
+	for (zend_hash_internal_pointer_reset(ht);
+		zend_hash_get_current_data(ht, (void **) &type) == SUCCESS;
+		zend_hash_move_forward(ht)) {
+		field = &schema->fields[schema->count++];
+		field->types = 0;
+		field->nested = NULL;
 
-	retval.handlers = &jsonreader_obj_handlers;
+		if (zend_hash_get_current_key_ex(ht, &key, &key_len, &num_key, 0, NULL) == HASH_KEY_IS_STRING) {
+			field->name = estrndup(key, key_len - 1);
+			field->name_len = key_len - 1;
+		} else {
+			field->name_len = spprintf(&field->name, 0, "%ld", (long) num_key);
+		}
 
-	return retval;
+		if (Z_TYPE_PP(type) == IS_ARRAY) {
+			field->nested = jsonreader_schema_compile(Z_ARRVAL_PP(type), depth - 1 TSRMLS_CC);
+			if (! field->nested) {
+				jsonreader_schema_free(schema);
+				return NULL;
+			}
+			field->types = VKTOR_T_OBJECT_START;
+
+		} else if (Z_TYPE_PP(type) == IS_LONG && Z_LVAL_PP(type) != 0 &&
+		           ! (Z_LVAL_PP(type) & ~JSONREADER_SCHEMA_TYPES)) {
+			field->types = Z_LVAL_PP(type);
+
+		} else {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+				"invalid type for schema field '%s'", field->name);
+			jsonreader_schema_free(schema);
+			return NULL;
+		}
+
+		n = schema->count - 1;
+		zend_hash_add(&schema->lookup, field->name, field->name_len + 1, 
+			(void *) &n, sizeof(long), NULL);
+	}
+
+	return schema;
 }
 /* }}} */
 
-/* {{{ jsonreader_init 
-   Initialize or reset an internal jsonreader object struct. Will close & free
-   any stream opened by the reader, and initialize the associated vktor parser 
-   (and free the old parser, if exists) */
-static void jsonreader_init(jsonreader_object *obj TSRMLS_DC)
+/* }}} */
+
+/* {{{ Transform rule related functions */
+
+/* {{{ jsonreader_rules_free
+   Free count compiled transform rules */
+static void jsonreader_rules_free(jsonreader_rule *rules, int count)
 {
-	if (obj->parser) {
-		vktor_parser_free(obj->parser);
-	}
-	obj->parser = vktor_parser_init(obj->max_depth);
+	int i, j;
 
-	if (obj->stream) {
-		php_stream_close(obj->stream);
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < rules[i].depth; j++) {
+			if (rules[i].segs[j].key) {
+				efree(rules[i].segs[j].key);
+			}
+		}
+		if (rules[i].segs) {
+			efree(rules[i].segs);
+		}
 	}
+
+	efree(rules);
 }
 /* }}} */
 
-/* {{{ jsonreader_read_more_data 
-   Read more data from the stream and pass it to the parser  */
-static int jsonreader_read_more_data(jsonreader_object *obj TSRMLS_DC)
+/* {{{ jsonreader_rule_parse_path
+   Parse a path pattern - a JSON pointer such as "/users/0/name", in which a 
+   "*" segment matches any object key or array index - into the segments of a
+   rule. Returns FAILURE and emits a warning if the pattern is invalid */
+static int jsonreader_rule_parse_path(jsonreader_rule *rule, const char *path, int path_len TSRMLS_DC)
 {
-	char         *buffer;
-	int           read;
-	vktor_status  status;
-	vktor_error  *err;
-	
-	buffer = emalloc(sizeof(char) * obj->read_buffer);
+	const char          *p, *seg_end, *end = path + path_len;
+	jsonreader_path_seg *seg;
+	int                  depth = 0;
 
-	read = php_stream_read(obj->stream, buffer, obj->read_buffer);
-	if (read <= 0) {
-		/* done reading or error */
-		php_error_docref(NULL TSRMLS_CC, E_WARNING, "JSON stream ended while expecting more data");
+	if (path_len > 0 && path[0] != '/') {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"invalid path '%s', paths must be empty or start with '/'", path);
 		return FAILURE;
 	}
 
-	status = vktor_feed(obj->parser, buffer, read, 1, &err);
-	if (status == VKTOR_ERROR) {
-		jsonreader_handle_error(err, obj TSRMLS_CC);
-		return FAILURE;
+	for (p = path; p < end; p++) {
+		if (*p == '/') {
+			depth++;
+		}
+	}
+	rule->segs = (depth ? safe_emalloc(depth, sizeof(jsonreader_path_seg), 0) : NULL);
+
+	for (p = path; p < end; p = seg_end) {
+		p++;
+		if ((seg_end = memchr(p, '/', end - p)) == NULL) {
+			seg_end = end;
+		}
+
+		seg = &rule->segs[rule->depth++];
+		seg->key = NULL;
+		seg->key_len = 0;
+		seg->index = -1;
+
+		if (seg_end - p == 1 && *p == '*') {
+			continue;
+		}
+
+		/* decode the ~0 and ~1 escape sequences of "~" and "/" */
+		seg->key = emalloc(seg_end - p + 1);
+		for (; p < seg_end; p++) {
+			if (*p == '~') {
+				if (p + 1 == seg_end || (p[1] != '0' && p[1] != '1')) {
+					php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+						"invalid path '%s', '~' must be followed by '0' or '1'", path);
+					return FAILURE;
+				}
+				seg->key[seg->key_len++] = (p[1] == '0' ? '~' : '/');
+				p++;
+			} else {
+				seg->key[seg->key_len++] = *p;
+			}
+		}
+		seg->key[seg->key_len] = '\0';
+
+		if (seg->key_len > 0 && seg->key_len < 10 && 
+			(int) strspn(seg->key, "0123456789") == seg->key_len &&
+			(seg->key[0] != '0' || seg->key_len == 1)) {
+			seg->index = atol(seg->key);
+		}
 	}
 
 	return SUCCESS;
 }
 /* }}} */
 
-/* {{{ jsonreader_read
-   Read the next token from the JSON stream */
-static int jsonreader_read(jsonreader_object *obj TSRMLS_DC)
+/* {{{ jsonreader_rules_compile
+   Compile the rules passed to JSONReader::transformTo(), mapping path patterns
+   to RULE_DROP, RULE_REDACT, array(RULE_REPLACE, value) or a callback. Returns
+   NULL and emits a warning if a rule is invalid */
+static jsonreader_rule *jsonreader_rules_compile(HashTable *ht, int *count TSRMLS_DC)
 {
-	vktor_status  status = VKTOR_OK;
-	vktor_error  *err;
-	int           retval;
+	jsonreader_rule  *rules, *rule;
+	zval            **action, **replace, **value;
+	char             *path;
+	uint              path_len;
+	ulong             num_key;
+
+	*count = 0;
+	rules = safe_emalloc(zend_hash_num_elements(ht), sizeof(jsonreader_rule), 0);
+
+	for (zend_hash_internal_pointer_reset(ht);
+		zend_hash_get_current_data(ht, (void **) &action) == SUCCESS;
+		zend_hash_move_forward(ht)) {
+		rule = &rules[(*count)++];
+		rule->segs = NULL;
+		rule->depth = 0;
+		rule->arg = NULL;
+
+		if (zend_hash_get_current_key_ex(ht, &path, &path_len, &num_key, 0, NULL) != HASH_KEY_IS_STRING) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+				"invalid path '%ld', paths must be empty or start with '/'", (long) num_key);
+			goto failure;
+		}
 
-	do {
-		status = vktor_parse(obj->parser, &err);
+		if (jsonreader_rule_parse_path(rule, path, path_len - 1 TSRMLS_CC) != SUCCESS) {
+			goto failure;
+		}
 
-		switch(status) {
-			case VKTOR_OK:
-				retval = SUCCESS;
-				break;
+		if (Z_TYPE_PP(action) == IS_LONG && 
+			(Z_LVAL_PP(action) == RULE_DROP || Z_LVAL_PP(action) == RULE_REDACT)) {
+			rule->action = Z_LVAL_PP(action);
 
-			case VKTOR_COMPLETE:
-				retval = FAILURE; /* done, not really a failure */
-				break;
+		} else if (Z_TYPE_PP(action) == IS_ARRAY && zend_hash_num_elements(Z_ARRVAL_PP(action)) == 2 &&
+			zend_hash_index_find(Z_ARRVAL_PP(action), 0, (void **) &replace) == SUCCESS &&
+			Z_TYPE_PP(replace) == IS_LONG && Z_LVAL_PP(replace) == RULE_REPLACE &&
+			zend_hash_index_find(Z_ARRVAL_PP(action), 1, (void **) &value) == SUCCESS) {
+			rule->action = RULE_REPLACE;
+			rule->arg = *value;
 
-			case VKTOR_ERROR:
-				jsonreader_handle_error(err, obj TSRMLS_CC);
-				retval = FAILURE; 
-				break;
+		} else if (zend_is_callable(*action, 0, NULL TSRMLS_CC)) {
+			rule->action = RULE_CALLBACK;
+			rule->arg = *action;
 
-			case VKTOR_MORE_DATA:
-				if (jsonreader_read_more_data(obj TSRMLS_CC) == FAILURE) {
-					retval = FAILURE;
-					status = VKTOR_ERROR;
-				}
-				break;
+		} else {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "invalid rule for path '%s'", path);
+			goto failure;
+		}
 
-			default:
-				/* should not happen! */
-				php_error_docref(NULL TSRMLS_CC, E_ERROR, "invalid status from internal JSON parser");
-				retval = FAILURE;
-				break;
+		if (rule->action == RULE_DROP && rule->depth == 0) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "the root value can not be dropped");
+			goto failure;
+		}
+	}
+
+	return rules;
+
+failure:
+	jsonreader_rules_free(rules, *count);
+	return NULL;
+}
+/* }}} */
+
+/* {{{ jsonreader_handlers_compile
+   Compile the handlers passed to JSONReader::parse(), keyed either by a 
+   bitmask of token types or by a path pattern. Returns FAILURE and emits a 
+   warning if a handler is invalid */
+static int jsonreader_handlers_compile(HashTable *ht, jsonreader_parse *p TSRMLS_DC)
+{
+	jsonreader_rule     *rule;
+	jsonreader_handler  *handler;
+	zval               **callback;
+	char                *path;
+	uint                 path_len;
+	ulong                num_key;
+	int                  count = zend_hash_num_elements(ht);
+
+	p->t.rules = safe_emalloc(count, sizeof(jsonreader_rule), 0);
+	p->t.count = 0;
+	p->handlers = safe_emalloc(count, sizeof(jsonreader_handler), 0);
+	p->handler_count = 0;
+
+	for (zend_hash_internal_pointer_reset(ht);
+		zend_hash_get_current_data(ht, (void **) &callback) == SUCCESS;
+		zend_hash_move_forward(ht)) {
+
+		if (zend_hash_get_current_key_ex(ht, &path, &path_len, &num_key, 0, NULL) != HASH_KEY_IS_STRING) {
+			if (num_key == 0 || (num_key & ~VKTOR_T_ALL)) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+					"invalid token type %ld", (long) num_key);
+				return FAILURE;
+			}
+			if (! zend_is_callable(*callback, 0, NULL TSRMLS_CC)) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+					"invalid handler for token type %ld", (long) num_key);
+				return FAILURE;
+			}
+
+			handler = &p->handlers[p->handler_count++];
+			handler->types = (long) num_key;
+			handler->callback = *callback;
+			continue;
+		}
+
+		rule = &p->t.rules[p->t.count++];
+		rule->segs = NULL;
+		rule->depth = 0;
+		rule->action = RULE_CALLBACK;
+		rule->arg = *callback;
+
+		if (jsonreader_rule_parse_path(rule, path, path_len - 1 TSRMLS_CC) != SUCCESS) {
+			return FAILURE;
+		}
+
+		if (! zend_is_callable(*callback, 0, NULL TSRMLS_CC)) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "invalid handler for path '%s'", path);
+			return FAILURE;
+		}
+	}
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* }}} */
+
+#ifdef HAVE_JSONREADER_ZLIB
+/* {{{ Compression related functions */
+
+/* {{{ jsonreader_inflate_init
+   Set up decompression of the stream, according to the compression attribute.
+   Returns SUCCESS or FAILURE */
+static int jsonreader_inflate_init(jsonreader_object *obj TSRMLS_DC)
+{
+	int window_bits;
+
+	switch(obj->compression) {
+		case COMPRESSION_GZIP:
+			window_bits = MAX_WBITS + 16;
+			break;
+
+		case COMPRESSION_ZLIB:
+			window_bits = MAX_WBITS;
+			break;
+
+		case COMPRESSION_DEFLATE:
+			window_bits = -MAX_WBITS;
+			break;
+
+		default: /* detect gzip or zlib header */
+			window_bits = MAX_WBITS + 32;
+			break;
+	}
+
+	obj->zstream = ecalloc(1, sizeof(z_stream));
+	obj->zstream->zalloc = jsr_zalloc;
+	obj->zstream->zfree = jsr_zfree;
+	obj->zstream->opaque = Z_NULL;
+	obj->zstream_end = 0;
+
+	if (inflateInit2(obj->zstream, window_bits) != Z_OK) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "unable to initialize decompression: %s",
+			obj->zstream->msg ? obj->zstream->msg : "unknown error");
+		efree(obj->zstream);
+		obj->zstream = NULL;
+		return FAILURE;
+	}
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ jsonreader_inflate_end
+   Free the decompression state and buffer, if any */
+static void jsonreader_inflate_end(jsonreader_object *obj)
+{
+	if (obj->zstream) {
+		inflateEnd(obj->zstream);
+		efree(obj->zstream);
+		obj->zstream = NULL;
+	}
+
+	if (obj->zbuf) {
+		efree(obj->zbuf);
+		obj->zbuf = NULL;
+		obj->zbuf_len = 0;
+	}
+}
+/* }}} */
+
+/* {{{ jsonreader_inflate
+   Decompress data from the stream straight into buffer, reading compressed 
+   data in chunks of the current read size as needed. Stops as soon as some 
+   output was produced, so each call fills at most one parser buffer. 
+   Concatenated gzip members are read one after the other. Returns the number 
+   of bytes produced, 0 if no more data is available, or -1 on error */
+static int jsonreader_inflate(jsonreader_object *obj, char *buffer, int size TSRMLS_DC)
+{
+	z_stream *zs = obj->zstream;
+	int       read, zret;
+
+	zs->next_out = (Bytef *) buffer;
+	zs->avail_out = size;
+
+	while (zs->avail_out == (uInt) size) {
+		if (zs->avail_in == 0) {
+			/* all compressed input was consumed, so the buffer may be resized */
+			if (obj->zbuf_len < obj->read_size || obj->zbuf_len > obj->read_size * 2) {
+				if (obj->zbuf) {
+					efree(obj->zbuf);
+				}
+				obj->zbuf = emalloc(sizeof(char) * obj->read_size);
+				obj->zbuf_len = obj->read_size;
+			}
+
+			read = php_stream_read(obj->stream, obj->zbuf, obj->zbuf_len);
+			if (read <= 0) {
+				if (! obj->zstream_end && php_stream_eof(obj->stream)) {
+					php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+						"unexpected end of compressed stream");
+					return -1;
+				}
+				break;
+			}
+			zs->next_in = (Bytef *) obj->zbuf;
+			zs->avail_in = read;
+		}
+
+		if (obj->zstream_end) {
+			/* only gzip data may continue after the end of compressed data */
+			if (obj->compression != COMPRESSION_GZIP && obj->compression != COMPRESSION_AUTO) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+					"unexpected data after the end of compressed stream");
+				return -1;
+			}
+			inflateReset(zs);
+			obj->zstream_end = 0;
+		}
+
+		zret = inflate(zs, Z_NO_FLUSH);
+		if (zret == Z_STREAM_END) {
+			obj->zstream_end = 1;
+		} else if (zret != Z_OK && zret != Z_BUF_ERROR) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "unable to decompress JSON stream: %s",
+				zs->msg ? zs->msg : "unknown error");
+			return -1;
+		}
+	}
+
+	return size - zs->avail_out;
+}
+/* }}} */
+
+/* {{{ jsonreader_inflate_rest
+   Decompress what is left of the stream once the parser is done, so that a 
+   truncated or corrupt stream is reported. Any data left is fed to the parser,
+   which only accepts whitespace after the JSON value. Returns SUCCESS if data
+   was fed, FAILURE at the end of the stream or on error, or 
+   JSONREADER_NEED_DATA if a non-blocking stream has no data available */
+static int jsonreader_inflate_rest(jsonreader_object *obj TSRMLS_DC)
+{
+	vktor_error *err;
+	int          read;
+
+	read = jsonreader_inflate(obj, obj->read_buf, (int) obj->read_buf_len TSRMLS_CC);
+	if (read < 0) {
+		return FAILURE;
+	}
+
+	if (read == 0) {
+		if (obj->nonblock && ! php_stream_eof(obj->stream)) {
+			return JSONREADER_NEED_DATA;
+		}
+		return FAILURE;
+	}
+
+	if (vktor_feed(obj->parser, obj->read_buf, read, 0, &err) == VKTOR_ERROR) {
+		jsonreader_handle_error(err, obj TSRMLS_CC);
+		return FAILURE;
+	}
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* }}} */
+#endif
+
+/* {{{ jsonreader_object_free_storage 
+   C-level object destructor for JSONReader objects */
+static void jsonreader_object_free_storage(void *object TSRMLS_DC) 
+{
+	jsonreader_object *intern = (jsonreader_object *) object;
+
+	zend_object_std_dtor(&intern->std TSRMLS_CC);
+
+	if (intern->parser) {
+		vktor_parser_free(intern->parser);
+	}
+
+	if (intern->spare_parser) {
+		vktor_parser_free(intern->spare_parser);
+	}
+
+	if (intern->stream && intern->close_stream) {
+		php_stream_close(intern->stream);
+	}
+
+	if (intern->chunks) {
+		zval_ptr_dtor(&intern->chunks);
+	}
+
+	if (intern->read_buf) {
+		efree(intern->read_buf);
+	}
+
+	if (intern->schema) {
+		jsonreader_schema_free(intern->schema);
+	}
+
+#ifdef HAVE_JSONREADER_ZLIB
+	jsonreader_inflate_end(intern);
+#endif
+
+	efree(object);
+}
+/* }}} */
+
+/* {{{ jsonreader_object_new 
+   C-level constructor of JSONReader objects. Does not initialize the vktor 
+   parser - this will be initialized when needed, by calling jsonreader_init() */
+static zend_object_value jsonreader_object_new(zend_class_entry *ce TSRMLS_DC) 
+{
+	zend_object_value  retval;
+	jsonreader_object *intern;
+
+	intern = ecalloc(1, sizeof(jsonreader_object));
+	intern->max_depth = JSONREADER_G(max_depth);
+	intern->read_buffer = JSONREADER_G(read_buffer);
+	intern->errmode = ERRMODE_PHPERR;
+	intern->token_mask = VKTOR_T_ALL;
+
+	zend_object_std_init(&(intern->std), ce TSRMLS_CC);
+  
+#if PHP_VERSION_ID < 50399
+	zend_hash_copy(intern->std.properties, &ce->default_properties, 
+		(copy_ctor_func_t) zval_add_ref, NULL, sizeof(zval *));
+#else
+  object_properties_init(&(intern->std), ce);
+#endif
+
+	retval.handle = zend_objects_store_put(intern, 
+		(zend_objects_store_dtor_t) zend_objects_destroy_object, 
+		(zend_objects_free_object_storage_t) jsonreader_object_free_storage, 
+		NULL TSRMLS_CC);
+
+	retval.handlers = &jsonreader_obj_handlers;
+
+	return retval;
+}
+/* }}} */
+
+/* {{{ jsonreader_init 
+   Initialize or reset an internal jsonreader object struct. Will close & free
+   any stream opened by the reader, and initialize the associated vktor parser 
+   (or reset the old parser or the one kept by close(), reusing its memory) */
+static void jsonreader_init(jsonreader_object *obj TSRMLS_DC)
+{
+	if (! obj->parser) {
+		obj->parser = obj->spare_parser;
+		obj->spare_parser = NULL;
+	}
+	if (obj->parser) {
+		vktor_parser_reset(obj->parser, obj->max_depth);
+	} else {
+		obj->parser = vktor_parser_init_ex(obj->max_depth, &jsonreader_allocator);
+	}
+	if (obj->validate_utf8 != VKTOR_UTF8_IGNORE) {
+		vktor_set_option(obj->parser, VKTOR_OPT_VALIDATE_UTF8, obj->validate_utf8, NULL);
+	}
+	if (obj->encoding != VKTOR_ENC_AUTO) {
+		vktor_set_option(obj->parser, VKTOR_OPT_ENCODING, obj->encoding, NULL);
+	}
+	if (obj->token_mask != VKTOR_T_ALL) {
+		vktor_set_option(obj->parser, VKTOR_OPT_TOKEN_MASK, obj->token_mask, NULL);
+	}
+	if (obj->lazy_strings) {
+		vktor_set_option(obj->parser, VKTOR_OPT_LAZY_STRINGS, 1, NULL);
+	}
+	if (obj->stream_strings) {
+		vktor_set_option(obj->parser, VKTOR_OPT_STREAM_STRINGS, 1, NULL);
+	}
+	if (obj->max_token_size > 0) {
+		vktor_set_option(obj->parser, VKTOR_OPT_MAX_TOKEN_SIZE, obj->max_token_size, NULL);
+	}
+	obj->need_data = 0;
+
+	if (obj->stream) {
+		php_stream_close(obj->stream);
+		obj->stream = NULL;
+	}
+
+#ifdef HAVE_JSONREADER_ZLIB
+	jsonreader_inflate_end(obj);
+#endif
+
+	if (obj->chunks) {
+		zval_ptr_dtor(&obj->chunks);
+		obj->chunks = NULL;
+	}
+	obj->feeding = 0;
+	obj->fed_end = 0;
+}
+/* }}} */
+
+/* {{{ jsonreader_content_length
+   Get the Content-Length header of an HTTP stream, or 0 if not known */
+static long jsonreader_content_length(php_stream *stream TSRMLS_DC)
+{
+	zval  **header;
+	long    length = 0;
+
+	if (! stream->wrapperdata || Z_TYPE_P(stream->wrapperdata) != IS_ARRAY) {
+		return 0;
+	}
+
+	/* Use the last header, in case of redirects */
+	zend_hash_internal_pointer_reset(Z_ARRVAL_P(stream->wrapperdata));
+	while (zend_hash_get_current_data(Z_ARRVAL_P(stream->wrapperdata), (void **) &header) == SUCCESS) {
+		if (Z_TYPE_PP(header) == IS_STRING && Z_STRLEN_PP(header) > 15 &&
+			strncasecmp(Z_STRVAL_PP(header), "Content-Length:", 15) == 0) {
+			length = strtol(Z_STRVAL_PP(header) + 15, NULL, 10);
+		}
+		zend_hash_move_forward(Z_ARRVAL_P(stream->wrapperdata));
+	}
+
+	return length;
+}
+/* }}} */
+
+/* {{{ jsonreader_init_read_size
+   Set the initial read size for a newly opened stream. If the read buffer size
+   is adaptive, start from the stream size when it is known, within the limits
+   of adaptive sizes */
+static void jsonreader_init_read_size(jsonreader_object *obj TSRMLS_DC)
+{
+	php_stream_statbuf ssb;
+	long               hint = 0;
+
+	if (obj->read_buffer > 0) {
+		obj->read_size = obj->read_buffer;
+		return;
+	}
+
+	if (php_stream_stat(obj->stream, &ssb) == 0 && S_ISREG(ssb.sb.st_mode)) {
+		hint = (long) ssb.sb.st_size - (long) obj->stream_start;
+	} else {
+		hint = jsonreader_content_length(obj->stream TSRMLS_CC);
+	}
+
+	if (hint <= 0) {
+		obj->read_size = JSONREADER_READ_BUFF_INIT;
+	} else if (hint < JSONREADER_READ_BUFF_MIN) {
+		obj->read_size = JSONREADER_READ_BUFF_MIN;
+	} else if (hint > JSONREADER_READ_BUFF_MAX) {
+		obj->read_size = JSONREADER_READ_BUFF_MAX;
+	} else {
+		obj->read_size = hint;
+	}
+}
+/* }}} */
+
+/* {{{ jsonreader_adapt_read_size
+   Adjust an adaptive read size after reading from the stream: grow it while 
+   the stream fills the buffer or tokens span more than one buffer, and shrink 
+   it when reads come back mostly empty or memory is running low */
+static void jsonreader_adapt_read_size(jsonreader_object *obj, int read TSRMLS_DC)
+{
+	long size = obj->read_size;
+
+	if (obj->read_buffer > 0) {
+		return;
+	}
+
+	if (PG(memory_limit) > 0 && zend_memory_usage(0 TSRMLS_CC) > PG(memory_limit) / 2) {
+		size = size / 2;
+	} else if (read == size || obj->refills > 1) {
+		size = size * 2;
+	} else if (read < size / 4) {
+		size = size / 2;
+	}
+
+	if (size < JSONREADER_READ_BUFF_MIN) {
+		size = JSONREADER_READ_BUFF_MIN;
+	} else if (size > JSONREADER_READ_BUFF_MAX) {
+		size = JSONREADER_READ_BUFF_MAX;
+	}
+
+	obj->read_size = size;
+}
+/* }}} */
+
+/* {{{ jsonreader_read_more_data 
+   Read more data from the stream and pass it to the parser. In non-blocking 
+   mode, will return JSONREADER_NEED_DATA if no data is available yet */
+static int jsonreader_read_more_data(jsonreader_object *obj TSRMLS_DC)
+{
+	char         *buffer;
+	int           read;
+	vktor_status  status;
+	vktor_error  *err;
+	
+	if (obj->feeding) {
+		/* all fed chunks were consumed by the parser and can be released */
+		if (obj->chunks) {
+			zend_hash_clean(Z_ARRVAL_P(obj->chunks));
+		}
+
+		if (! obj->fed_end) {
+			obj->need_data = 1;
+			return JSONREADER_NEED_DATA;
+		}
+
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "JSON data ended while expecting more data");
+		return FAILURE;
+	}
+
+	/* The parser only asks for more data once it is done with all buffers fed
+	   to it, so the same read buffer is reused as long as its size fits */
+	if (obj->read_buf_len < obj->read_size || obj->read_buf_len > obj->read_size * 2) {
+		if (obj->read_buf) {
+			efree(obj->read_buf);
+		}
+		obj->read_buf = emalloc(sizeof(char) * obj->read_size);
+		obj->read_buf_len = obj->read_size;
+	}
+	buffer = obj->read_buf;
+
+	obj->refills++;
+#ifdef HAVE_JSONREADER_ZLIB
+	if (obj->zstream) {
+		read = jsonreader_inflate(obj, buffer, obj->read_size TSRMLS_CC);
+		if (read < 0) {
+			return FAILURE;
+		}
+	} else
+#endif
+	read = php_stream_read(obj->stream, buffer, obj->read_size);
+	jsonreader_adapt_read_size(obj, read TSRMLS_CC);
+	if (read <= 0) {
+		if (obj->nonblock && ! php_stream_eof(obj->stream)) {
+			/* nothing to read yet, parser state is kept until next time */
+			obj->need_data = 1;
+			return JSONREADER_NEED_DATA;
+		}
+
+		/* done reading or error */
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "JSON stream ended while expecting more data");
+		return FAILURE;
+	}
+
+	obj->need_data = 0;
+
+	status = vktor_feed(obj->parser, buffer, read, 0, &err);
+	if (status == VKTOR_ERROR) {
+		jsonreader_handle_error(err, obj TSRMLS_CC);
+		return FAILURE;
+	}
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ jsonreader_step
+   Advance the parser using one of vktor_parse(), vktor_skip_value() or 
+   vktor_skip_struct(), reading more data as needed. Returns SUCCESS, FAILURE,
+   or JSONREADER_NEED_DATA if a non-blocking stream has no data available */
+static int jsonreader_step(jsonreader_object *obj, jsonreader_step_func step TSRMLS_DC)
+{
+	vktor_status  status = VKTOR_OK;
+	vktor_error  *err;
+	int           retval;
+
+	obj->refills = 0;
+
+	/* previous read ran out of data - the parser is waiting for more */
+	if (obj->need_data) {
+		retval = jsonreader_read_more_data(obj TSRMLS_CC);
+		if (retval != SUCCESS) {
+			return retval;
+		}
+	}
+
+	do {
+		status = step(obj->parser, &err);
+
+		switch(status) {
+			case VKTOR_OK:
+				retval = SUCCESS;
+				break;
+
+			case VKTOR_COMPLETE:
+				retval = FAILURE; /* done, not really a failure */
+#ifdef HAVE_JSONREADER_ZLIB
+				/* the rest of a compressed stream still has to be checked */
+				if (obj->zstream) {
+					retval = jsonreader_inflate_rest(obj TSRMLS_CC);
+					if (retval == SUCCESS) {
+						status = VKTOR_MORE_DATA;
+					}
+				}
+#endif
+				break;
+
+			case VKTOR_ERROR:
+				jsonreader_handle_error(err, obj TSRMLS_CC);
+				retval = FAILURE; 
+				break;
+
+			case VKTOR_MORE_DATA:
+				retval = jsonreader_read_more_data(obj TSRMLS_CC);
+				if (retval != SUCCESS) {
+					status = VKTOR_ERROR;
+				}
+				break;
+
+			default:
+				/* should not happen! */
+				php_error_docref(NULL TSRMLS_CC, E_ERROR, "invalid status from internal JSON parser");
+				retval = FAILURE;
+				break;
 		}
 
 	} while (status == VKTOR_MORE_DATA);
 
-	return retval; 
+	return retval; 
+}
+/* }}} */
+
+/* {{{ jsonreader_read
+   Read the next token from the JSON stream. Returns SUCCESS, FAILURE, or
+   JSONREADER_NEED_DATA if a non-blocking stream has no data available */
+static int jsonreader_read(jsonreader_object *obj TSRMLS_DC)
+{
+	return jsonreader_step(obj, vktor_parse TSRMLS_CC);
+}
+/* }}} */
+
+/* {{{ jsonreader_string_chunk
+   Read the next chunk of up to max bytes of the streamed string at the current
+   STRING_START token, reading more data as needed. done is set once the 
+   string has ended, and the chunk is then its last part, which may be empty. 
+   Returns SUCCESS, FAILURE, or JSONREADER_NEED_DATA if a non-blocking stream
+   has no data available */
+static int jsonreader_string_chunk(jsonreader_object *obj, long max, char **chunk, long *chunk_len, zend_bool *done TSRMLS_DC)
+{
+	vktor_status  status;
+	vktor_error  *err;
+	int           retval;
+
+	obj->refills = 0;
+
+	if (obj->need_data) {
+		retval = jsonreader_read_more_data(obj TSRMLS_CC);
+		if (retval != SUCCESS) {
+			return retval;
+		}
+	}
+
+	while ((status = vktor_read_string_chunk(obj->parser, max, chunk, chunk_len, &err)) == VKTOR_MORE_DATA) {
+		retval = jsonreader_read_more_data(obj TSRMLS_CC);
+		if (retval != SUCCESS) {
+			return retval;
+		}
+	}
+
+	if (status == VKTOR_ERROR) {
+		jsonreader_handle_error(err, obj TSRMLS_CC);
+		return FAILURE;
+	}
+
+	*done = (status == VKTOR_COMPLETE);
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ jsonreader_string_value
+   Set a zval to the rest of the streamed string at the current STRING_START 
+   token, read as a whole - the string is then subject to the max token size,
+   like any other token */
+static int jsonreader_string_value(jsonreader_object *obj, zval *value TSRMLS_DC)
+{
+	smart_str  str = {0};
+	char      *chunk, *msg;
+	long       chunk_len;
+	zend_bool  done = 0;
+
+	while (! done) {
+		if (jsonreader_string_chunk(obj, JSONREADER_STRING_CHUNK, &chunk, &chunk_len, &done TSRMLS_CC) != SUCCESS) {
+			smart_str_free(&str);
+			ZVAL_NULL(value);
+			return FAILURE;
+		}
+
+		if (obj->max_token_size > 0 && (long) str.len + chunk_len > obj->max_token_size) {
+			spprintf(&msg, 0, "token is larger than the maximal token size of %ld bytes", 
+				obj->max_token_size);
+			jsonreader_report_error(obj, VKTOR_ERR_TOKEN_TOO_LARGE, msg TSRMLS_CC);
+			efree(msg);
+			smart_str_free(&str);
+			ZVAL_NULL(value);
+			return FAILURE;
+		}
+
+		smart_str_appendl(&str, chunk, chunk_len);
+	}
+
+	if (str.c) {
+		smart_str_0(&str);
+		ZVAL_STRINGL(value, str.c, str.len, 0);
+	} else {
+		ZVAL_EMPTY_STRING(value);
+	}
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ jsonreader_string_skip
+   Read the rest of the streamed string at the current STRING_START token 
+   without keeping it, for example while its raw input is captured */
+static int jsonreader_string_skip(jsonreader_object *obj TSRMLS_DC)
+{
+	char      *chunk;
+	long       chunk_len;
+	zend_bool  done = 0;
+
+	while (! done) {
+		if (jsonreader_string_chunk(obj, JSONREADER_STRING_CHUNK, &chunk, &chunk_len, &done TSRMLS_CC) != SUCCESS) {
+			return FAILURE;
+		}
+	}
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ jsonreader_base64_value
+   Get the value of a base64 digit, accepting both the standard and the URL 
+   safe alphabet, or -1 if c is not a base64 digit */
+static int jsonreader_base64_value(unsigned char c)
+{
+	if (c >= 'A' && c <= 'Z') {
+		return c - 'A';
+	} else if (c >= 'a' && c <= 'z') {
+		return c - 'a' + 26;
+	} else if (c >= '0' && c <= '9') {
+		return c - '0' + 52;
+	} else if (c == '+' || c == '-') {
+		return 62;
+	} else if (c == '/' || c == '_') {
+		return 63;
+	}
+
+	return -1;
+}
+/* }}} */
+
+/* {{{ jsonreader_base64_end
+   Decode the incomplete group of digits left at the end of base64 data or 
+   before padding into out, which must have room for 2 bytes. Returns the 
+   decoded length, or -1 if the group is not valid */
+static long jsonreader_base64_end(jsonreader_base64 *b64, unsigned char *out)
+{
+	long n = 0;
+
+	if (b64->digits == 1) {
+		return -1;
+	}
+	if (b64->digits > 1) {
+		out[n++] = (unsigned char) (b64->bits >> (b64->digits == 2 ? 4 : 10));
+	}
+	if (b64->digits == 3) {
+		out[n++] = (unsigned char) (b64->bits >> 2);
+	}
+
+	b64->digits = 0;
+	b64->bits = 0;
+	return n;
+}
+/* }}} */
+
+/* {{{ jsonreader_base64_decode
+   Decode a piece of base64 data into out, which must have room for 3 bytes 
+   per 4 input bytes plus 2, keeping any incomplete group of digits in the 
+   state for the next piece. Whitespace is ignored. Returns the decoded 
+   length, or -1 if the data is not valid base64 */
+static long jsonreader_base64_decode(jsonreader_base64 *b64, const char *in, long in_len, unsigned char *out)
+{
+	long i, n = 0, len;
+	int  v;
+
+	for (i = 0; i < in_len; i++) {
+		switch (in[i]) {
+			case ' ':
+			case '\t':
+			case '\r':
+			case '\n':
+				continue;
+
+			case '=':
+				/* padding completes the last group, and ends the data */
+				if (b64->digits > 0) {
+					if ((len = jsonreader_base64_end(b64, out + n)) < 0) {
+						return -1;
+					}
+					n += len;
+					b64->padded = 1;
+				} else if (! b64->padded) {
+					return -1;
+				}
+				continue;
+		}
+
+		if (b64->padded || (v = jsonreader_base64_value((unsigned char) in[i])) < 0) {
+			return -1;
+		}
+
+		b64->bits = (b64->bits << 6) | v;
+		if (++b64->digits == 4) {
+			out[n++] = (unsigned char) (b64->bits >> 16);
+			out[n++] = (unsigned char) (b64->bits >> 8);
+			out[n++] = (unsigned char) b64->bits;
+			b64->digits = 0;
+			b64->bits = 0;
+		}
+	}
+
+	return n;
+}
+/* }}} */
+
+/* {{{ jsonreader_build_value
+   Set a zval to the value starting at the current token. Arrays and objects 
+   are read entirely and converted to PHP arrays, with object members as 
+   associative array elements */
+static int jsonreader_build_value(jsonreader_object *obj, zval *value TSRMLS_DC)
+{
+	vktor_token  t_type;
+	zval        *child;
+	char        *key = NULL;
+	int          key_len = 0;
+	vktor_error *err = NULL;
+
+	t_type = vktor_get_token_type(obj->parser);
+	if (t_type == VKTOR_T_STRING_START) {
+		return jsonreader_string_value(obj, value TSRMLS_CC);
+	}
+	if (t_type != VKTOR_T_ARRAY_START && t_type != VKTOR_T_OBJECT_START) {
+		return jsonreader_token_to_zval(obj, value TSRMLS_CC);
+	}
+
+	array_init(value);
+
+	while (jsonreader_read(obj TSRMLS_CC) == SUCCESS) {
+		t_type = vktor_get_token_type(obj->parser);
+		if (t_type == VKTOR_T_ARRAY_END || t_type == VKTOR_T_OBJECT_END) {
+			return SUCCESS;
+		}
+
+		/* the key must be copied before reading the member value */
+		if (t_type == VKTOR_T_OBJECT_KEY) {
+			key_len = vktor_get_value_str(obj->parser, &key, &err);
+			if (err != NULL) {
+				jsonreader_handle_error(err, obj TSRMLS_CC);
+				return FAILURE;
+			}
+			key = estrndup(key, key_len);
+
+			if (jsonreader_read(obj TSRMLS_CC) != SUCCESS) {
+				efree(key);
+				return FAILURE;
+			}
+		}
+
+		MAKE_STD_ZVAL(child);
+		if (jsonreader_build_value(obj, child TSRMLS_CC) != SUCCESS) {
+			zval_ptr_dtor(&child);
+			if (key) {
+				efree(key);
+			}
+			return FAILURE;
+		}
+
+		if (key) {
+			zend_symtable_update(Z_ARRVAL_P(value), key, key_len + 1, 
+				(void *) &child, sizeof(zval *), NULL);
+			efree(key);
+			key = NULL;
+		} else {
+			add_next_index_zval(value, child);
+		}
+	}
+
+	return FAILURE;
+}
+/* }}} */
+
+/* {{{ jsonreader_schema_mismatch
+   Report a value of type t_type not matching the schema, either as the value 
+   of a field or, if field is NULL, as a record. The reported offset is the 
+   one right after the mismatching token. Returns JSONREADER_SCHEMA_MISMATCH */
+static int jsonreader_schema_mismatch(jsonreader_object *obj, jsonreader_schema_field *field, vktor_token t_type TSRMLS_DC)
+{
+	char *msg, *type_name;
+
+	switch(t_type) {
+		case VKTOR_T_NULL:         type_name = "null";    break;
+		case VKTOR_T_FALSE:
+		case VKTOR_T_TRUE:         type_name = "boolean"; break;
+		case VKTOR_T_INT:          type_name = "integer"; break;
+		case VKTOR_T_FLOAT:        type_name = "float";   break;
+		case VKTOR_T_STRING:       type_name = "string";  break;
+		case VKTOR_T_ARRAY_START:  type_name = "array";   break;
+		case VKTOR_T_OBJECT_START: type_name = "object";  break;
+		default:                   type_name = "token";   break;
+	}
+
+	if (field) {
+		spprintf(&msg, 0, "schema mismatch at offset %ld: unexpected %s value for field '%s'",
+			vktor_get_offset(obj->parser), type_name, field->name);
+	} else {
+		spprintf(&msg, 0, "schema mismatch at offset %ld: unexpected %s value for record",
+			vktor_get_offset(obj->parser), type_name);
+	}
+
+	if (obj->errmode == ERRMODE_EXCEPT) {
+		zend_throw_exception(jsonreader_exception_ce, msg, JSONREADER_ERR_SCHEMA TSRMLS_CC);
+	} else {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "%s", msg);
+	}
+
+	efree(msg);
+	return JSONREADER_SCHEMA_MISMATCH;
+}
+/* }}} */
+
+static int jsonreader_schema_decode(jsonreader_object *obj, jsonreader_schema *schema, zval *value TSRMLS_DC);
+
+/* {{{ jsonreader_schema_value
+   Set a zval to the value of a schema field, starting at the current token. 
+   Integers are converted if the field only allows floats. Returns SUCCESS, 
+   FAILURE or JSONREADER_SCHEMA_MISMATCH */
+static int jsonreader_schema_value(jsonreader_object *obj, jsonreader_schema_field *field, zval *value TSRMLS_DC)
+{
+	vktor_token  t_type;
+	vktor_error *err = NULL;
+
+	t_type = vktor_get_token_type(obj->parser);
+	if (t_type == VKTOR_T_STRING_START) {
+		t_type = VKTOR_T_STRING;
+	}
+
+	if (field->nested && t_type == VKTOR_T_OBJECT_START) {
+		return jsonreader_schema_decode(obj, field->nested, value TSRMLS_CC);
+	}
+
+	if (t_type == VKTOR_T_INT && (field->types & (VKTOR_T_INT | VKTOR_T_FLOAT)) == VKTOR_T_FLOAT) {
+		if (obj->number_mode != NUMBER_NATIVE) {
+			return jsonreader_number_to_zval(obj, VKTOR_T_FLOAT, value TSRMLS_CC);
+		}
+		ZVAL_DOUBLE(value, vktor_get_value_double(obj->parser, &err));
+		if (err != NULL) {
+			ZVAL_NULL(value);
+			jsonreader_handle_error(err, obj TSRMLS_CC);
+			return FAILURE;
+		}
+		return SUCCESS;
+	}
+
+	if (! (field->types & t_type)) {
+		return jsonreader_schema_mismatch(obj, field, t_type TSRMLS_CC);
+	}
+
+	return jsonreader_build_value(obj, value TSRMLS_CC);
+}
+/* }}} */
+
+/* {{{ jsonreader_schema_decode
+   Decode the object starting at the current token according to a schema, 
+   setting value to an array with one element per schema field, in schema 
+   order. Members not in the schema are skipped without being decoded, and 
+   missing fields are set to NULL; with duplicate keys, the first value wins. 
+   Returns SUCCESS, FAILURE or JSONREADER_SCHEMA_MISMATCH */
+static int jsonreader_schema_decode(jsonreader_object *obj, jsonreader_schema *schema, zval *value TSRMLS_DC)
+{
+	zval        **row;
+	long         *idx, i;
+	int           next = 0, found = 0, status, retval = SUCCESS;
+	char         *key;
+	int           key_len;
+	vktor_error  *err = NULL;
+
+	row = ecalloc(schema->count, sizeof(zval *));
+
+	while ((status = jsonreader_read(obj TSRMLS_CC)) == SUCCESS) {
+		if (vktor_get_token_type(obj->parser) == VKTOR_T_OBJECT_END) {
+			break;
+		}
+
+		key_len = vktor_get_value_str(obj->parser, &key, &err);
+		if (err != NULL) {
+			jsonreader_handle_error(err, obj TSRMLS_CC);
+			retval = FAILURE;
+			break;
+		}
+
+		/* members usually come in schema order, so try the next field first */
+		if (next < schema->count && schema->fields[next].name_len == key_len &&
+			memcmp(schema->fields[next].name, key, key_len) == 0) {
+			i = next;
+		} else if (zend_hash_find(&schema->lookup, key, key_len + 1, (void **) &idx) == SUCCESS) {
+			i = *idx;
+		} else {
+			i = -1;
+		}
+
+		if (i < 0 || row[i] != NULL) {
+			if (jsonreader_step(obj, vktor_skip_value TSRMLS_CC) != SUCCESS) {
+				retval = FAILURE;
+				break;
+			}
+			continue;
+		}
+
+		if (jsonreader_read(obj TSRMLS_CC) != SUCCESS) {
+			retval = FAILURE;
+			break;
+		}
+
+		next = i + 1;
+		MAKE_STD_ZVAL(row[i]);
+		ZVAL_NULL(row[i]);
+		retval = jsonreader_schema_value(obj, &schema->fields[i], row[i] TSRMLS_CC);
+		if (retval != SUCCESS) {
+			break;
+		}
+
+		/* once all fields are found, skip the rest of the object */
+		if (++found == schema->count) {
+			if (jsonreader_step(obj, vktor_skip_struct TSRMLS_CC) != SUCCESS) {
+				retval = FAILURE;
+			}
+			break;
+		}
+	}
+
+	if (status != SUCCESS) {
+		retval = FAILURE;
+	}
+
+	if (retval == SUCCESS) {
+		array_init(value);
+		for (i = 0; i < schema->count; i++) {
+			if (! row[i]) {
+				MAKE_STD_ZVAL(row[i]);
+				ZVAL_NULL(row[i]);
+			}
+			zend_symtable_update(Z_ARRVAL_P(value), schema->fields[i].name, 
+				schema->fields[i].name_len + 1, (void *) &row[i], sizeof(zval *), NULL);
+		}
+
+	} else {
+		for (i = 0; i < schema->count; i++) {
+			if (row[i]) {
+				zval_ptr_dtor(&row[i]);
+			}
+		}
+	}
+
+	efree(row);
+	return retval;
+}
+/* }}} */
+
+/* {{{ jsonreader_transform_match
+   Find the rule matching the path of the value at depth. Returns the first 
+   rule matching exactly, or NULL, in which case descend is set if some rule 
+   may match a value nested in it */
+static jsonreader_rule *jsonreader_transform_match(jsonreader_transform *t, int depth, int *descend)
+{
+	jsonreader_rule     *rule;
+	jsonreader_path_seg *seg, *elem;
+	int                  i, j;
+
+	*descend = 0;
+
+	for (i = 0; i < t->count; i++) {
+		rule = &t->rules[i];
+		if (rule->depth < depth) {
+			continue;
+		}
+
+		for (j = 0; j < depth; j++) {
+			seg  = &rule->segs[j];
+			elem = &t->path[j];
+
+			if (seg->key == NULL && seg->index == -1) {
+				continue;
+			}
+
+			if (elem->key) {
+				if (seg->key == NULL || seg->key_len != elem->key_len || 
+					memcmp(seg->key, elem->key, elem->key_len) != 0) {
+					break;
+				}
+			} else if (seg->index != elem->index) {
+				break;
+			}
+		}
+
+		if (j < depth) {
+			continue;
+		}
+
+		if (rule->depth == depth) {
+			return rule;
+		}
+		*descend = 1;
+	}
+
+	return NULL;
+}
+/* }}} */
+
+/* {{{ jsonreader_transform_capture
+   Raw input handler writing the input captured by jsonreader_transform_copy() 
+   to the writer */
+static void jsonreader_transform_capture(void *ctx, const char *text, long text_len)
+{
+	jsonreader_transform *t = (jsonreader_transform *) ctx;
+	TSRMLS_FETCH();
+
+	if (t->status == SUCCESS && 
+		jsonwriter_append(t->writer, text, text_len TSRMLS_CC) != SUCCESS) {
+		t->status = FAILURE;
+	}
+}
+/* }}} */
+
+/* {{{ jsonreader_transform_copy
+   Copy the value starting at the current token to the writer as is. Arrays, 
+   objects and streamed strings are copied from the raw input while skipping 
+   them, without being decoded */
+static int jsonreader_transform_copy(jsonreader_object *obj, jsonreader_transform *t TSRMLS_DC)
+{
+	vktor_token  t_type;
+	vktor_error *err = NULL;
+	int          retval = SUCCESS;
+
+	if (jsonwriter_before_value(t->writer TSRMLS_CC) != SUCCESS) {
+		return FAILURE;
+	}
+
+	t->status = SUCCESS;
+	if (vktor_capture_start(obj->parser, jsonreader_transform_capture, t, &err) != VKTOR_OK) {
+		jsonreader_handle_error(err, obj TSRMLS_CC);
+		return FAILURE;
+	}
+
+	t_type = vktor_get_token_type(obj->parser);
+	if (t_type == VKTOR_T_ARRAY_START || t_type == VKTOR_T_OBJECT_START) {
+		retval = jsonreader_step(obj, vktor_skip_struct TSRMLS_CC);
+	} else if (t_type == VKTOR_T_STRING_START) {
+		retval = jsonreader_string_skip(obj TSRMLS_CC);
+	}
+
+	/* capturing is always ended, as the handler context is about to go away */
+	if (retval != SUCCESS) {
+		t->status = FAILURE;
+	}
+	vktor_capture_end(obj->parser, NULL);
+
+	if (t->status != SUCCESS) {
+		return FAILURE;
+	}
+
+	jsonwriter_after_value(t->writer);
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ jsonreader_transform_skip
+   Skip the value starting at the current token */
+static int jsonreader_transform_skip(jsonreader_object *obj TSRMLS_DC)
+{
+	vktor_token t_type = vktor_get_token_type(obj->parser);
+
+	if (t_type == VKTOR_T_ARRAY_START || t_type == VKTOR_T_OBJECT_START) {
+		return jsonreader_step(obj, vktor_skip_struct TSRMLS_CC);
+	}
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ jsonreader_transform_path
+   Set a zval to the JSON pointer of the value at depth, such as "/users/0" */
+static void jsonreader_transform_path(jsonreader_transform *t, int depth, zval *path)
+{
+	smart_str  str = {0};
+	int        i, j;
+
+	for (i = 0; i < depth; i++) {
+		smart_str_appendc(&str, '/');
+		if (! t->path[i].key) {
+			smart_str_append_long(&str, t->path[i].index);
+			continue;
+		}
+
+		for (j = 0; j < t->path[i].key_len; j++) {
+			switch(t->path[i].key[j]) {
+				case '~':
+					smart_str_appendl(&str, "~0", 2);
+					break;
+
+				case '/':
+					smart_str_appendl(&str, "~1", 2);
+					break;
+
+				default:
+					smart_str_appendc(&str, t->path[i].key[j]);
+					break;
+			}
+		}
+	}
+
+	if (str.c) {
+		smart_str_0(&str);
+		ZVAL_STRINGL(path, str.c, str.len, 0);
+	} else {
+		ZVAL_EMPTY_STRING(path);
+	}
+}
+/* }}} */
+
+/* {{{ jsonreader_transform_apply
+   Apply a matching rule other than RULE_DROP to the value starting at the 
+   current token, writing the value it is replaced with */
+static int jsonreader_transform_apply(jsonreader_object *obj, jsonreader_transform *t, int depth, jsonreader_rule *rule TSRMLS_DC)
+{
+	zval  redacted, *value, *path, *result = NULL, **args[2];
+	int   retval;
+
+	switch(rule->action) {
+		case RULE_REDACT:
+			if (jsonreader_transform_skip(obj TSRMLS_CC) != SUCCESS) {
+				return FAILURE;
+			}
+			ZVAL_STRINGL(&redacted, JSONREADER_REDACTED, sizeof(JSONREADER_REDACTED) - 1, 0);
+			return jsonwriter_value(t->writer, &redacted TSRMLS_CC);
+
+		case RULE_REPLACE:
+			if (jsonreader_transform_skip(obj TSRMLS_CC) != SUCCESS) {
+				return FAILURE;
+			}
+			return jsonwriter_value(t->writer, rule->arg TSRMLS_CC);
+	}
+
+	/* RULE_CALLBACK - pass the decoded value and its path to the callback */
+	MAKE_STD_ZVAL(value);
+	ZVAL_NULL(value);
+	if (jsonreader_build_value(obj, value TSRMLS_CC) != SUCCESS) {
+		zval_ptr_dtor(&value);
+		return FAILURE;
+	}
+
+	MAKE_STD_ZVAL(path);
+	jsonreader_transform_path(t, depth, path);
+
+	args[0] = &value;
+	args[1] = &path;
+
+	if (call_user_function_ex(EG(function_table), NULL, rule->arg, &result, 
+		2, args, 0, NULL TSRMLS_CC) != SUCCESS || ! result) {
+		if (! EG(exception)) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+				"unable to call the callback for path '%s'", Z_STRVAL_P(path));
+		}
+		retval = FAILURE;
+
+	} else if (EG(exception)) {
+		retval = FAILURE;
+
+	} else if (! obj->parser) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"the reader was closed by the callback for path '%s'", Z_STRVAL_P(path));
+		retval = FAILURE;
+
+	} else {
+		retval = jsonwriter_value(t->writer, result TSRMLS_CC);
+	}
+
+	if (result) {
+		zval_ptr_dtor(&result);
+	}
+	zval_ptr_dtor(&path);
+	zval_ptr_dtor(&value);
+
+	return retval;
+}
+/* }}} */
+
+/* {{{ jsonreader_transform_value
+   Transform the value starting at the current token, found at depth, to the 
+   writer. A matching rule is applied to it. Otherwise, arrays and objects 
+   holding values some rule may match are entered and their members written 
+   one by one, and anything else is copied as is */
+static int jsonreader_transform_value(jsonreader_object *obj, jsonreader_transform *t, int depth, jsonreader_rule *rule, int descend TSRMLS_DC)
+{
+	jsonreader_path_seg *elem;
+	jsonreader_rule     *child_rule;
+	vktor_token          t_type;
+	vktor_error         *err = NULL;
+	char                *key;
+	int                  key_len, child_descend, retval = SUCCESS;
+
+	if (rule) {
+		return jsonreader_transform_apply(obj, t, depth, rule TSRMLS_CC);
+	}
+
+	t_type = vktor_get_token_type(obj->parser);
+	if (! descend || (t_type != VKTOR_T_ARRAY_START && t_type != VKTOR_T_OBJECT_START)) {
+		return jsonreader_transform_copy(obj, t TSRMLS_CC);
+	}
+
+	if (jsonwriter_start(t->writer, (t_type == VKTOR_T_OBJECT_START) TSRMLS_CC) != SUCCESS) {
+		return FAILURE;
+	}
+
+	elem = &t->path[depth];
+	elem->key = NULL;
+	elem->key_len = 0;
+	elem->index = -1;
+
+	while (retval == SUCCESS) {
+		if (jsonreader_read(obj TSRMLS_CC) != SUCCESS) {
+			retval = FAILURE;
+			break;
+		}
+
+		t_type = vktor_get_token_type(obj->parser);
+		if (t_type == VKTOR_T_ARRAY_END || t_type == VKTOR_T_OBJECT_END) {
+			retval = jsonwriter_end(t->writer TSRMLS_CC);
+			break;
+		}
+
+		/* the key must be copied before reading the member value */
+		if (t_type == VKTOR_T_OBJECT_KEY) {
+			key_len = vktor_get_value_str(obj->parser, &key, &err);
+			if (err != NULL) {
+				jsonreader_handle_error(err, obj TSRMLS_CC);
+				retval = FAILURE;
+				break;
+			}
+			if (elem->key) {
+				efree(elem->key);
+			}
+			elem->key = estrndup(key, key_len);
+			elem->key_len = key_len;
+
+			if (jsonreader_read(obj TSRMLS_CC) != SUCCESS) {
+				retval = FAILURE;
+				break;
+			}
+		} else {
+			elem->index++;
+		}
+
+		child_rule = jsonreader_transform_match(t, depth + 1, &child_descend);
+		if (child_rule && child_rule->action == RULE_DROP) {
+			retval = jsonreader_transform_skip(obj TSRMLS_CC);
+			continue;
+		}
+
+		if (elem->key && jsonwriter_key(t->writer, elem->key, elem->key_len TSRMLS_CC) != SUCCESS) {
+			retval = FAILURE;
+			break;
+		}
+
+		retval = jsonreader_transform_value(obj, t, depth + 1, child_rule, child_descend TSRMLS_CC);
+	}
+
+	if (elem->key) {
+		efree(elem->key);
+		elem->key = NULL;
+	}
+
+	return retval;
+}
+/* }}} */
+
+/* {{{ jsonreader_parse_call
+   Call a handler of JSONReader::parse() with a value, the path of the value 
+   at depth and a token type. A handler returning FALSE stops parsing */
+static int jsonreader_parse_call(jsonreader_object *obj, jsonreader_parse *p, zval *callback, zval *value, int depth, vktor_token t_type TSRMLS_DC)
+{
+	zval  *path, *type, *result = NULL, **args[3];
+	int    retval = SUCCESS;
+
+	MAKE_STD_ZVAL(path);
+	jsonreader_transform_path(&p->t, depth, path);
+	MAKE_STD_ZVAL(type);
+	ZVAL_LONG(type, t_type);
+
+	args[0] = &value;
+	args[1] = &path;
+	args[2] = &type;
+
+	p->calls++;
+	if (call_user_function_ex(EG(function_table), NULL, callback, &result, 
+		3, args, 0, NULL TSRMLS_CC) != SUCCESS || ! result) {
+		if (! EG(exception)) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+				"unable to call the handler for path '%s'", Z_STRVAL_P(path));
+		}
+		retval = FAILURE;
+
+	} else if (EG(exception)) {
+		retval = FAILURE;
+
+	} else if (! obj->parser) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"the reader was closed by the handler for path '%s'", Z_STRVAL_P(path));
+		retval = FAILURE;
+
+	} else if (Z_TYPE_P(result) == IS_BOOL && ! Z_BVAL_P(result)) {
+		p->stop = 1;
+	}
+
+	if (result) {
+		zval_ptr_dtor(&result);
+	}
+	zval_ptr_dtor(&type);
+	zval_ptr_dtor(&path);
+
+	return retval;
+}
+/* }}} */
+
+/* {{{ jsonreader_parse_token
+   Call the first token type handler matching the current token, if any, with
+   the token value and the path of the value at depth */
+static int jsonreader_parse_token(jsonreader_object *obj, jsonreader_parse *p, int depth TSRMLS_DC)
+{
+	vktor_token  t_type;
+	zval        *value;
+	int          i, retval;
+
+	t_type = vktor_get_token_type(obj->parser);
+	for (i = 0; i < p->handler_count; i++) {
+		if (p->handlers[i].types & t_type) {
+			break;
+		}
+	}
+	if (i == p->handler_count) {
+		return SUCCESS;
+	}
+
+	MAKE_STD_ZVAL(value);
+	if (jsonreader_token_to_zval(obj, value TSRMLS_CC) != SUCCESS) {
+		zval_ptr_dtor(&value);
+		return FAILURE;
+	}
+
+	retval = jsonreader_parse_call(obj, p, p->handlers[i].callback, value, depth, t_type TSRMLS_CC);
+	zval_ptr_dtor(&value);
+
+	return retval;
+}
+/* }}} */
+
+/* {{{ jsonreader_parse_value
+   Parse the value starting at the current token, found at depth, for 
+   JSONReader::parse(). A value matching a path handler is decoded and passed
+   to it as a whole. Otherwise, its tokens are passed to the token type 
+   handlers, and arrays and objects are entered if any handler may match 
+   something in them, or skipped without being decoded */
+static int jsonreader_parse_value(jsonreader_object *obj, jsonreader_parse *p, int depth, jsonreader_rule *rule, int descend TSRMLS_DC)
+{
+	jsonreader_path_seg *elem;
+	jsonreader_rule     *child_rule;
+	vktor_token          t_type;
+	vktor_error         *err = NULL;
+	zval                *value;
+	char                *key;
+	int                  key_len, child_descend, retval = SUCCESS;
+
+	t_type = vktor_get_token_type(obj->parser);
+
+	if (rule) {
+		MAKE_STD_ZVAL(value);
+		ZVAL_NULL(value);
+		if (jsonreader_build_value(obj, value TSRMLS_CC) != SUCCESS) {
+			zval_ptr_dtor(&value);
+			return FAILURE;
+		}
+
+		/* streamed strings are passed whole, like any other string */
+		if (t_type == VKTOR_T_STRING_START) {
+			t_type = VKTOR_T_STRING;
+		}
+
+		retval = jsonreader_parse_call(obj, p, rule->arg, value, depth, t_type TSRMLS_CC);
+		zval_ptr_dtor(&value);
+		return retval;
+	}
+
+	if (p->handler_count && jsonreader_parse_token(obj, p, depth TSRMLS_CC) != SUCCESS) {
+		return FAILURE;
+	}
+	if (p->stop || (t_type != VKTOR_T_ARRAY_START && t_type != VKTOR_T_OBJECT_START)) {
+		return SUCCESS;
+	}
+
+	if (! descend && ! p->handler_count) {
+		return jsonreader_step(obj, vktor_skip_struct TSRMLS_CC);
+	}
+
+	elem = &p->t.path[depth];
+	elem->key = NULL;
+	elem->key_len = 0;
+	elem->index = -1;
+
+	while (retval == SUCCESS && ! p->stop) {
+		if (jsonreader_read(obj TSRMLS_CC) != SUCCESS) {
+			retval = FAILURE;
+			break;
+		}
+
+		t_type = vktor_get_token_type(obj->parser);
+		if (t_type == VKTOR_T_ARRAY_END || t_type == VKTOR_T_OBJECT_END) {
+			if (p->handler_count) {
+				retval = jsonreader_parse_token(obj, p, depth TSRMLS_CC);
+			}
+			break;
+		}
+
+		/* the key must be copied before reading the member value */
+		if (t_type == VKTOR_T_OBJECT_KEY) {
+			key_len = vktor_get_value_str(obj->parser, &key, &err);
+			if (err != NULL) {
+				jsonreader_handle_error(err, obj TSRMLS_CC);
+				retval = FAILURE;
+				break;
+			}
+			if (elem->key) {
+				efree(elem->key);
+			}
+			elem->key = estrndup(key, key_len);
+			elem->key_len = key_len;
+
+			if (p->handler_count) {
+				if (jsonreader_parse_token(obj, p, depth + 1 TSRMLS_CC) != SUCCESS) {
+					retval = FAILURE;
+					break;
+				}
+				if (p->stop) {
+					break;
+				}
+			}
+
+			if (jsonreader_read(obj TSRMLS_CC) != SUCCESS) {
+				retval = FAILURE;
+				break;
+			}
+		} else {
+			elem->index++;
+		}
+
+		child_rule = jsonreader_transform_match(&p->t, depth + 1, &child_descend);
+		retval = jsonreader_parse_value(obj, p, depth + 1, child_rule, child_descend TSRMLS_CC);
+	}
+
+	if (elem->key) {
+		efree(elem->key);
+		elem->key = NULL;
+	}
+
+	return retval;
+}
+/* }}} */
+
+/* {{{ jsonreader_raw_append
+   Raw input handler appending the captured input to a smart_str */
+static void jsonreader_raw_append(void *ctx, const char *text, long text_len)
+{
+	smart_str_appendl((smart_str *) ctx, text, text_len);
+}
+/* }}} */
+
+/* {{{ jsonreader_set_attribute 
+   set an attribute of the JSONReader object */
+static void jsonreader_set_attribute(jsonreader_object *obj, ulong attr_key, zval *attr_value TSRMLS_DC)
+{
+	long lval = Z_LVAL_P(attr_value);
+
+	switch(attr_key) {
+		case ATTR_MAX_DEPTH:
+			if (lval < 1) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, "maximal nesting level must be more than 0, %ld given", lval);
+			} else {
+				obj->max_depth = lval;
+			}
+			break;
+
+		case ATTR_READ_BUFF:
+			if (lval < 0) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, "read buffer size must be 0 (adaptive) or more, %ld given", lval);
+			} else {
+				obj->read_buffer = lval;
+			}
+			break;
+
+		case ATTR_NONBLOCK:
+			obj->nonblock = (lval ? 1 : 0);
+			break;
+
+		case ATTR_VALIDATE_UTF8:
+			switch(lval) {
+				case VKTOR_UTF8_IGNORE:
+				case VKTOR_UTF8_REJECT:
+				case VKTOR_UTF8_REPLACE:
+					obj->validate_utf8 = lval;
+					break;
+
+				default:
+					php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+						"invalid UTF-8 validation attribute value: %ld", lval);
+					break;
+			}
+			break;
+
+		case ATTR_ENCODING:
+			if (lval < VKTOR_ENC_AUTO || lval > VKTOR_ENC_UTF32BE) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+					"invalid encoding attribute value: %ld", lval);
+			} else {
+				obj->encoding = lval;
+			}
+			break;
+
+		case ATTR_TOKEN_MASK:
+			if (lval & ~VKTOR_T_ALL) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+					"invalid token mask attribute value: %ld", lval);
+			} else {
+				obj->token_mask = lval;
+			}
+			break;
+
+		case ATTR_LAZY_STRINGS:
+			obj->lazy_strings = (lval ? 1 : 0);
+			break;
+
+		case ATTR_STREAM_STRINGS:
+			obj->stream_strings = (lval ? 1 : 0);
+			break;
+
+		case ATTR_MAX_TOKEN_SIZE:
+			if (lval < 0) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+					"max token size must be 0 (no limit) or more, %ld given", lval);
+			} else {
+				obj->max_token_size = lval;
+			}
+			break;
+
+		case ATTR_NUMBER_MODE:
+			if (lval < NUMBER_NATIVE || lval > NUMBER_AUTO) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+					"invalid number mode attribute value: %ld", lval);
+			} else {
+				obj->number_mode = lval;
+			}
+			break;
+
+		case ATTR_COMPRESSION:
+			if (lval < COMPRESSION_NONE || lval > COMPRESSION_DEFLATE) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+					"invalid compression attribute value: %ld", lval);
+#ifndef HAVE_JSONREADER_ZLIB
+			} else if (lval != COMPRESSION_NONE) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+					"compression support is not available, jsonreader was built without zlib");
+#endif
+			} else {
+				obj->compression = lval;
+			}
+			break;
+
+		case ATTR_ERRMODE:
+			switch(lval) {
+				case ERRMODE_PHPERR:
+				case ERRMODE_EXCEPT:
+				case ERRMODE_INTERN:
+					obj->errmode = (int) lval;
+					break;
+
+				default:
+					php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+						"invalid error handler attribute value: %ld", lval);
+					break;
+			}
+			break;
+	}
+}
+
+/* {{{ proto void JSONReader::__construct([array options])
+   Create a new JSONReader object, potentially setting some local attributes */
+PHP_METHOD(jsonreader, __construct)
+{
+	zval *object = getThis();
+	zval *options = NULL;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|a", &options) == FAILURE) {
+		ZVAL_NULL(object);
+		return;
+	}
+
+	/* got attributes - set them */
+	if (options != NULL) {
+		jsonreader_object  *intern;
+		zval              **attr_value;
+		char               *str_key;
+		ulong               long_key;
+
+		intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
+		zend_hash_internal_pointer_reset(Z_ARRVAL_P(options));
+		while (zend_hash_get_current_data(Z_ARRVAL_P(options), (void **) &attr_value) == SUCCESS &&
+			zend_hash_get_current_key(Z_ARRVAL_P(options), &str_key, &long_key, 0) == HASH_KEY_IS_LONG) {
+
+			jsonreader_set_attribute(intern, long_key, *attr_value TSRMLS_CC);
+			zend_hash_move_forward(Z_ARRVAL_P(options));
+		}
+	}
+}
+/* }}} */
+
+/* {{{ proto boolean JSONReader::open(mixed URI)
+   Opens the URI (any valid PHP stream URI) that JSONReader will read
+   from. Can accept either a URI as a string, or an already-open stream 
+   resource. Returns TRUE on success or FALSE on failure. */
+PHP_METHOD(jsonreader, open)
+{
+	zval               *object, *arg;
+	jsonreader_object  *intern;
+	php_stream         *tmp_stream;
+	int                 options = ENFORCE_SAFE_MODE | REPORT_ERRORS;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &arg) == FAILURE) {
+		return;
+	}
+
+	object = getThis();
+	intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
+
+	switch(Z_TYPE_P(arg)) {
+		case IS_STRING:
+			tmp_stream = php_stream_open_wrapper(Z_STRVAL_P(arg), "r", options, NULL);
+			intern->close_stream = 1;
+			break;
+
+		case IS_RESOURCE:
+			php_stream_from_zval(tmp_stream, &arg);
+			intern->close_stream = 0;
+			break;
+
+		default:
+			php_error_docref(NULL TSRMLS_CC, E_ERROR, 
+				"argument is expected to be a resource of type stream or a string, %s given",
+				zend_zval_type_name(arg));
+			RETURN_FALSE;
+			break;
+
+	}
+
+	if (! tmp_stream) {
+		RETURN_FALSE;
+	}
+
+	/* Streams opened by the reader are read directly into the reader's buffer
+	   instead of being copied through the stream's own read buffer */
+	if (intern->close_stream) {
+		php_stream_set_option(tmp_stream, PHP_STREAM_OPTION_READ_BUFFER, 
+			PHP_STREAM_BUFFER_NONE, NULL);
+	}
+
+	jsonreader_init(intern TSRMLS_CC);
+	intern->stream = tmp_stream;
+	intern->stream_start = php_stream_tell(tmp_stream);
+	jsonreader_init_read_size(intern TSRMLS_CC);
+
+#ifdef HAVE_JSONREADER_ZLIB
+	if (intern->compression != COMPRESSION_NONE && 
+		jsonreader_inflate_init(intern TSRMLS_CC) != SUCCESS) {
+		if (intern->close_stream) {
+			php_stream_close(tmp_stream);
+		}
+		intern->stream = NULL;
+		RETURN_FALSE;
+	}
+#endif
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto boolean JSONReader::close()
+   Close the currently open JSON stream and free related resources */
+PHP_METHOD(jsonreader, close)
+{
+	zval              *object;
+	jsonreader_object *intern;
+
+	object = getThis();
+	intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
+
+	/* Close stream, if open */
+	if (intern->stream) {
+		php_stream_close(intern->stream);
+		intern->stream = NULL;
+	}
+
+#ifdef HAVE_JSONREADER_ZLIB
+	jsonreader_inflate_end(intern);
+#endif
+
+	/* Reset the parser, if created, and keep it for reuse by the next open()
+	   or feed() */
+	if (intern->parser) {
+		if (intern->spare_parser == NULL) {
+			vktor_parser_reset(intern->parser, intern->max_depth);
+			intern->spare_parser = intern->parser;
+		} else {
+			vktor_parser_free(intern->parser);
+		}
+		intern->parser = NULL;
+	}
+
+	/* Release any fed data */
+	if (intern->chunks) {
+		zval_ptr_dtor(&intern->chunks);
+		intern->chunks = NULL;
+	}
+	intern->feeding = 0;
+
+	if (intern->read_buf) {
+		efree(intern->read_buf);
+		intern->read_buf = NULL;
+		intern->read_buf_len = 0;
+	}
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto mixed JSONReader::read() 
+   Read the next token from the JSON stream. Retuns TRUE as long as something is
+   read, or FALSE when there is nothing left to read, or when an error occured. 
+   In non-blocking mode, returns JSONReader::NEED_DATA if the stream has no data
+   available yet. */
+PHP_METHOD(jsonreader, read)
+{
+	zval              *object;
+	jsonreader_object *intern;
+
+	RETVAL_TRUE;
+
+	object = getThis();
+	intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
+
+	if (! (intern->stream || intern->feeding)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"trying to read but no stream was opened");
+		RETURN_FALSE;
+	}
+
+	/* TODO: replace assertion with an if(!) and init parser (?) */
+	assert(intern->parser != NULL);
+
+	switch (jsonreader_read(intern TSRMLS_CC)) {
+		case SUCCESS:
+			break;
+
+		case JSONREADER_NEED_DATA:
+			RETVAL_LONG(0);
+			break;
+
+		default:
+			RETVAL_FALSE;
+			break;
+	}
+}
+/* }}} */
+
+/* {{{ proto boolean JSONReader::feed(string chunk)
+   Push a chunk of JSON data to the reader, instead of reading from a stream.
+   The chunk is referenced rather than copied, and released once parsed. Call 
+   JSONReader::end() after the last chunk. Returns TRUE on success or FALSE on
+   failure. */
+PHP_METHOD(jsonreader, feed)
+{
+	zval              *object, *chunk;
+	jsonreader_object *intern;
+	vktor_error       *err = NULL;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &chunk) == FAILURE) {
+		return;
+	}
+
+	object = getThis();
+	intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
+
+	if (intern->stream) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"cannot feed data to a reader which is reading from a stream");
+		RETURN_FALSE;
+	}
+
+	if (! intern->feeding) {
+		jsonreader_init(intern TSRMLS_CC);
+		intern->feeding = 1;
+
+		/* Fed chunks are in memory as a whole, so skipping can index them */
+		vktor_set_option(intern->parser, VKTOR_OPT_STRUCTURAL_INDEX, 1, NULL);
+	}
+
+	if (intern->fed_end) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"cannot feed more data after end() was called");
+		RETURN_FALSE;
+	}
+
+	/* Hold a reference to the chunk until the parser is done with it */
+	if (Z_TYPE_P(chunk) == IS_STRING) {
+		Z_ADDREF_P(chunk);
+	} else {
+		zval *tmp;
+
+		MAKE_STD_ZVAL(tmp);
+		*tmp = *chunk;
+		zval_copy_ctor(tmp);
+		INIT_PZVAL(tmp);
+		convert_to_string(tmp);
+		chunk = tmp;
+	}
+
+	if (! intern->chunks) {
+		MAKE_STD_ZVAL(intern->chunks);
+		array_init(intern->chunks);
+	}
+	add_next_index_zval(intern->chunks, chunk);
+
+	if (Z_STRLEN_P(chunk) > 0) {
+		if (vktor_feed(intern->parser, Z_STRVAL_P(chunk), Z_STRLEN_P(chunk), 0, &err) == VKTOR_ERROR) {
+			jsonreader_handle_error(err, intern TSRMLS_CC);
+			RETURN_FALSE;
+		}
+		intern->need_data = 0;
+	}
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto boolean JSONReader::end()
+   Signal that all data was pushed to the reader using JSONReader::feed(). 
+   Returns TRUE on success or FALSE on failure. */
+PHP_METHOD(jsonreader, end)
+{
+	zval              *object;
+	jsonreader_object *intern;
+	vktor_error       *err = NULL;
+	char              *terminator;
+	long               terminator_len;
+
+	object = getThis();
+	intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
+
+	if (! intern->feeding) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"trying to end input but no data was fed");
+		RETURN_FALSE;
+	}
+
+	if (! intern->fed_end) {
+		/* trailing whitespace lets the parser finish a top level number, and
+		   has to be in the input encoding to be read as such */
+		switch (vktor_get_encoding(intern->parser)) {
+			case VKTOR_ENC_UTF16LE:
+				terminator = " \0";
+				terminator_len = 2;
+				break;
+
+			case VKTOR_ENC_UTF16BE:
+				terminator = "\0 ";
+				terminator_len = 2;
+				break;
+
+			case VKTOR_ENC_UTF32LE:
+				terminator = " \0\0\0";
+				terminator_len = 4;
+				break;
+
+			case VKTOR_ENC_UTF32BE:
+				terminator = "\0\0\0 ";
+				terminator_len = 4;
+				break;
+
+			default:
+				terminator = " ";
+				terminator_len = 1;
+				break;
+		}
+
+		if (vktor_feed(intern->parser, terminator, terminator_len, 0, &err) == VKTOR_ERROR) {
+			jsonreader_handle_error(err, intern TSRMLS_CC);
+			RETURN_FALSE;
+		}
+		intern->fed_end = 1;
+		intern->need_data = 0;
+	}
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto string JSONReader::checkpoint()
+   Get an opaque checkpoint string representing the current parser state. The 
+   checkpoint can later be passed to JSONReader::resume(), possibly in another
+   process, to continue reading from the same point in the same stream. 
+   Returns FALSE on failure. */
+PHP_METHOD(jsonreader, checkpoint)
+{
+	zval              *object;
+	jsonreader_object *intern;
+	char              *snapshot;
+	long               snapshot_len;
+	vktor_error       *err = NULL;
+
+	object = getThis();
+	intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
+
+	if (! intern->parser) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"trying to create a checkpoint but no stream was opened");
+		RETURN_FALSE;
+	}
+
+	snapshot_len = vktor_parser_snapshot(intern->parser, &snapshot, &err);
+	if (err != NULL) {
+		jsonreader_handle_error(err, intern TSRMLS_CC);
+		RETURN_FALSE;
+	}
+
+	RETVAL_STRINGL(snapshot, snapshot_len, 1);
+	efree(snapshot);
+}
+/* }}} */
+
+/* {{{ proto boolean JSONReader::resume(string checkpoint)
+   Restore the parser state from a checkpoint created by JSONReader::checkpoint()
+   and seek the open stream to the position the checkpoint was created at, 
+   relative to the stream position when it was opened. The stream must be 
+   seekable. Returns TRUE on success or FALSE on failure. */
+PHP_METHOD(jsonreader, resume)
+{
+	zval              *object;
+	jsonreader_object *intern;
+	char              *snapshot;
+	int                snapshot_len;
+	vktor_error       *err = NULL;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &snapshot, &snapshot_len) == FAILURE) {
+		return;
+	}
+
+	object = getThis();
+	intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
+
+	if (! intern->stream) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"trying to resume but no stream was opened");
+		RETURN_FALSE;
+	}
+
+	assert(intern->parser != NULL);
+
+#ifdef HAVE_JSONREADER_ZLIB
+	/* Offsets are positions in the decompressed data, which can't be sought */
+	if (intern->zstream) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"cannot resume reading a compressed stream");
+		RETURN_FALSE;
+	}
+#endif
+
+	if (vktor_parser_restore(intern->parser, snapshot, snapshot_len, &err) == VKTOR_ERROR) {
+		jsonreader_handle_error(err, intern TSRMLS_CC);
+		RETURN_FALSE;
+	}
+
+	if (php_stream_seek(intern->stream, 
+			intern->stream_start + vktor_get_offset(intern->parser), SEEK_SET) != 0) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"unable to seek stream to checkpoint offset %ld", 
+			vktor_get_offset(intern->parser));
+		RETURN_FALSE;
+	}
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto array JSONReader::readColumns(array fields[, int maxRows])
+   Read the records of the array the reader is at, which are expected to be 
+   objects, and return an array holding one array of values per requested 
+   field, in row order. Members not in fields are skipped without being 
+   decoded, and rows without some field get NULL for it. Reads up to maxRows 
+   records, or all remaining records if maxRows is 0. Once the end of the 
+   array is reached, the reader is left on its end token. Returns FALSE on 
+   failure. */
+PHP_METHOD(jsonreader, readColumns)
+{
+	zval              *object, *fields, **field, **columns = NULL, **row = NULL;
+	jsonreader_object *intern;
+	HashTable          lookup;
+	long               max_rows = 0, rows = 0, *idx;
+	long               saved_mask;
+	int                count = 0, found, status, i;
+	char              *key;
+	int                key_len;
+	vktor_token        t_type;
+	vktor_error       *err = NULL;
+	zend_bool          ok = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|l", &fields, &max_rows) == FAILURE) {
+		return;
+	}
+
+	object = getThis();
+	intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
+
+	if (! (intern->stream || intern->feeding)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"trying to read but no stream was opened");
+		RETURN_FALSE;
+	}
+
+	/* Records must be read entirely, so all data has to be available */
+	if (intern->nonblock || (intern->feeding && ! intern->fed_end)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"cannot read columns from a non-blocking stream or before end() is called");
+		RETURN_FALSE;
+	}
+
+	if (zend_hash_num_elements(Z_ARRVAL_P(fields)) == 0) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "no fields to read were given");
+		RETURN_FALSE;
+	}
+
+	/* Map field names to column numbers, and set up the returned columns */
+	array_init(return_value);
+	zend_hash_init(&lookup, zend_hash_num_elements(Z_ARRVAL_P(fields)), NULL, NULL, 0);
+	columns = safe_emalloc(zend_hash_num_elements(Z_ARRVAL_P(fields)), sizeof(zval *), 0);
+	row = safe_emalloc(zend_hash_num_elements(Z_ARRVAL_P(fields)), sizeof(zval *), 0);
+
+	for (zend_hash_internal_pointer_reset(Z_ARRVAL_P(fields));
+		zend_hash_get_current_data(Z_ARRVAL_P(fields), (void **) &field) == SUCCESS;
+		zend_hash_move_forward(Z_ARRVAL_P(fields))) {
+		zval name = **field;
+
+		zval_copy_ctor(&name);
+		convert_to_string(&name);
+
+		if (! zend_hash_exists(&lookup, Z_STRVAL(name), Z_STRLEN(name) + 1)) {
+			long n = count;
+
+			zend_hash_add(&lookup, Z_STRVAL(name), Z_STRLEN(name) + 1, 
+				(void *) &n, sizeof(long), NULL);
+			MAKE_STD_ZVAL(columns[count]);
+			array_init(columns[count]);
+			zend_symtable_update(Z_ARRVAL_P(return_value), Z_STRVAL(name), 
+				Z_STRLEN(name) + 1, (void *) &columns[count], sizeof(zval *), NULL);
+			row[count] = NULL;
+			count++;
+		}
+
+		zval_dtor(&name);
+	}
+
+	/* All tokens are needed here, regardless of the token mask */
+	saved_mask = intern->token_mask;
+	if (saved_mask != VKTOR_T_ALL) {
+		vktor_set_option(intern->parser, VKTOR_OPT_TOKEN_MASK, VKTOR_T_ALL, NULL);
+	}
+
+	/* Start reading the array, unless the reader is already in it */
+	if (vktor_get_token_type(intern->parser) == VKTOR_T_NONE && 
+		jsonreader_read(intern TSRMLS_CC) != SUCCESS) {
+		goto cleanup;
+	}
+
+	t_type = vktor_get_token_type(intern->parser);
+	if (t_type == VKTOR_T_ARRAY_END) {
+		ok = 1;
+		goto cleanup;
+	}
+
+	if (vktor_get_current_struct(intern->parser) != VKTOR_STRUCT_ARRAY) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"columns can only be read from an array of records");
+		goto cleanup;
+	}
+
+	while (max_rows <= 0 || rows < max_rows) {
+		if (jsonreader_read(intern TSRMLS_CC) != SUCCESS) {
+			goto cleanup;
+		}
+
+		t_type = vktor_get_token_type(intern->parser);
+		if (t_type == VKTOR_T_ARRAY_END) {
+			break;
+		}
+
+		if (t_type == VKTOR_T_OBJECT_START) {
+			found = 0;
+			while ((status = jsonreader_read(intern TSRMLS_CC)) == SUCCESS) {
+				t_type = vktor_get_token_type(intern->parser);
+				if (t_type == VKTOR_T_OBJECT_END) {
+					break;
+				}
+
+				key_len = vktor_get_value_str(intern->parser, &key, &err);
+				if (err != NULL) {
+					jsonreader_handle_error(err, intern TSRMLS_CC);
+					goto cleanup;
+				}
+
+				/* skip members which were not requested, or which were 
+				   already read - with duplicate keys, the first value wins */
+				if (zend_hash_find(&lookup, key, key_len + 1, (void **) &idx) != SUCCESS ||
+					row[*idx] != NULL) {
+					if (jsonreader_step(intern, vktor_skip_value TSRMLS_CC) != SUCCESS) {
+						goto cleanup;
+					}
+					continue;
+				}
+
+				if (jsonreader_read(intern TSRMLS_CC) != SUCCESS) {
+					goto cleanup;
+				}
+
+				found++;
+				MAKE_STD_ZVAL(row[*idx]);
+				if (jsonreader_build_value(intern, row[*idx] TSRMLS_CC) != SUCCESS) {
+					goto cleanup;
+				}
+
+				/* once all fields are found, skip the rest of the record */
+				if (found == count) {
+					if (jsonreader_step(intern, vktor_skip_struct TSRMLS_CC) != SUCCESS) {
+						goto cleanup;
+					}
+					break;
+				}
+			}
+
+			if (status != SUCCESS) {
+				goto cleanup;
+			}
+
+		} else if (t_type == VKTOR_T_ARRAY_START) {
+			if (jsonreader_step(intern, vktor_skip_struct TSRMLS_CC) != SUCCESS) {
+				goto cleanup;
+			}
+		}
+
+		for (i = 0; i < count; i++) {
+			if (row[i]) {
+				add_next_index_zval(columns[i], row[i]);
+				row[i] = NULL;
+			} else {
+				add_next_index_null(columns[i]);
+			}
+		}
+		rows++;
+	}
+
+	ok = 1;
+
+cleanup:
+	for (i = 0; i < count; i++) {
+		if (row[i]) {
+			zval_ptr_dtor(&row[i]);
+		}
+	}
+	efree(row);
+	efree(columns);
+	zend_hash_destroy(&lookup);
+
+	if (saved_mask != VKTOR_T_ALL && intern->parser) {
+		vktor_set_option(intern->parser, VKTOR_OPT_TOKEN_MASK, saved_mask, NULL);
+	}
+
+	if (! ok) {
+		zval_dtor(return_value);
+		RETURN_FALSE;
+	}
+}
+/* }}} */
+
+/* {{{ proto boolean JSONReader::setSchema(array schema)
+   Set the schema used by JSONReader::readRecord(). The schema maps field 
+   names to the allowed types of their values - a mask of token type constants
+   such as JSONReader::INT | JSONReader::NULL - or to a nested schema array, 
+   for fields holding an object. The schema is compiled once, and used for 
+   all following records. Passing NULL removes the schema. Returns TRUE on 
+   success or FALSE if the schema is invalid. */
+PHP_METHOD(jsonreader, setSchema)
+{
+	zval              *object, *schema_arr = NULL;
+	jsonreader_object *intern;
+	jsonreader_schema *schema = NULL;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a!", &schema_arr) == FAILURE) {
+		return;
+	}
+
+	object = getThis();
+	intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
+
+	if (schema_arr) {
+		schema = jsonreader_schema_compile(Z_ARRVAL_P(schema_arr), intern->max_depth TSRMLS_CC);
+		if (! schema) {
+			RETURN_FALSE;
+		}
+	}
+
+	if (intern->schema) {
+		jsonreader_schema_free(intern->schema);
+	}
+	intern->schema = schema;
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto mixed JSONReader::readRecord()
+   Read the next record - an object - and decode it according to the schema 
+   set by JSONReader::setSchema(), checking the type of each field as it is 
+   read. Arrays around records are entered, so records can be read one by one
+   from an array of records. Returns an array with one element per schema 
+   field, or FALSE once there are no more records or on failure. A record not
+   matching the schema is skipped, and the mismatch is reported according to
+   the error mode. */
+PHP_METHOD(jsonreader, readRecord)
+{
+	zval              *object;
+	jsonreader_object *intern;
+	long               saved_mask;
+	int                depth = 0, retval;
+	vktor_token        t_type = VKTOR_T_NONE;
+
+	object = getThis();
+	intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
+
+	if (! (intern->stream || intern->feeding)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"trying to read but no stream was opened");
+		RETURN_FALSE;
+	}
+
+	/* Records must be read entirely, so all data has to be available */
+	if (intern->nonblock || (intern->feeding && ! intern->fed_end)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"cannot read records from a non-blocking stream or before end() is called");
+		RETURN_FALSE;
+	}
+
+	if (! intern->schema) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"no schema was set, call setSchema() first");
+		RETURN_FALSE;
+	}
+
+	/* All tokens are needed here, regardless of the token mask */
+	saved_mask = intern->token_mask;
+	if (saved_mask != VKTOR_T_ALL) {
+		vktor_set_option(intern->parser, VKTOR_OPT_TOKEN_MASK, VKTOR_T_ALL, NULL);
+	}
+
+	/* Find the next record, entering any arrays or object members on the way */
+	do {
+		retval = jsonreader_read(intern TSRMLS_CC);
+		if (retval != SUCCESS) {
+			break;
+		}
+		t_type = vktor_get_token_type(intern->parser);
+	} while (t_type == VKTOR_T_ARRAY_START || t_type == VKTOR_T_OBJECT_KEY);
+
+	if (retval == SUCCESS) {
+		if (t_type == VKTOR_T_ARRAY_END || t_type == VKTOR_T_OBJECT_END) {
+			/* no more records */
+			retval = FAILURE;
+
+		} else if (t_type == VKTOR_T_OBJECT_START) {
+			depth = vktor_get_depth(intern->parser);
+			retval = jsonreader_schema_decode(intern, intern->schema, return_value TSRMLS_CC);
+
+		} else {
+			retval = jsonreader_schema_mismatch(intern, NULL, t_type TSRMLS_CC);
+		}
+	}
+
+	/* Skip the rest of a mismatching record, so reading can go on after it */
+	if (retval == JSONREADER_SCHEMA_MISMATCH) {
+		while (depth > 0 && vktor_get_depth(intern->parser) >= depth) {
+			if (jsonreader_step(intern, vktor_skip_struct TSRMLS_CC) != SUCCESS) {
+				break;
+			}
+		}
+		retval = FAILURE;
+	}
+
+	if (saved_mask != VKTOR_T_ALL && intern->parser) {
+		vktor_set_option(intern->parser, VKTOR_OPT_TOKEN_MASK, saved_mask, NULL);
+	}
+
+	if (retval != SUCCESS) {
+		RETURN_FALSE;
+	}
 }
 /* }}} */
 
-/* {{{ jsonreader_set_attribute 
-   set an attribute of the JSONReader object */
-static void jsonreader_set_attribute(jsonreader_object *obj, ulong attr_key, zval *attr_value TSRMLS_DC)
+/* {{{ proto boolean JSONReader::transformTo(JSONWriter writer, array rules)
+   Write the value the reader is at to a JSONWriter, transformed according to
+   rules. Rules map paths - JSON pointers such as "/users/0/password", where 
+   "*" matches any key or index - to JSONReader::RULE_DROP, to remove the 
+   value, JSONReader::RULE_REDACT, to replace it with "[REDACTED]", an array 
+   of JSONReader::RULE_REPLACE and a value to replace it with, or a callback 
+   called with the decoded value and its path, returning the value to write. 
+   Parts of the document no rule applies to are copied from the raw input 
+   without being decoded. If no token was read yet, the whole document is 
+   transformed. Returns TRUE on success or FALSE on failure. */
+PHP_METHOD(jsonreader, transformTo)
 {
-	long lval = Z_LVAL_P(attr_value);
+	zval                 *object, *writer, *rules_arr;
+	jsonreader_object    *intern;
+	jsonreader_transform  t;
+	jsonreader_rule      *rule;
+	long                  saved_mask;
+	int                   descend, retval = SUCCESS;
+	vktor_token           t_type;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "oa", &writer, &rules_arr) == FAILURE) {
+		return;
+	}
 
-	switch(attr_key) {
-		case ATTR_MAX_DEPTH:
-			if (lval < 1) {
-				php_error_docref(NULL TSRMLS_CC, E_WARNING, "maximal nesting level must be more than 0, %ld given", lval);
-			} else {
-				obj->max_depth = lval;
-			}
-			break;
+	object = getThis();
+	intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
 
-		case ATTR_READ_BUFF:
-			if (lval < 1) {
-				php_error_docref(NULL TSRMLS_CC, E_WARNING, "read buffer size must be more than 0, %ld given", lval);
-			} else {
-				obj->read_buffer = lval;
-			}
-			break;
+	if (! (intern->stream || intern->feeding)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"trying to read but no stream was opened");
+		RETURN_FALSE;
+	}
 
-		case ATTR_ERRMODE:
-			switch(lval) {
-				case ERRMODE_PHPERR:
-				case ERRMODE_EXCEPT:
-				case ERRMODE_INTERN:
-					obj->errmode = (int) lval;
-					break;
+	/* Values are transformed entirely, so all data has to be available */
+	if (intern->nonblock || (intern->feeding && ! intern->fed_end)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"cannot transform from a non-blocking stream or before end() is called");
+		RETURN_FALSE;
+	}
 
-				default:
-					php_error_docref(NULL TSRMLS_CC, E_WARNING, 
-						"invalid error handler attribute value: %ld", lval);
-					break;
-			}
-			break;
+	t.writer = jsonwriter_from_zval(writer TSRMLS_CC);
+	if (! t.writer) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "expecting a JSONWriter object");
+		RETURN_FALSE;
+	}
+
+	t.rules = jsonreader_rules_compile(Z_ARRVAL_P(rules_arr), &t.count TSRMLS_CC);
+	if (! t.rules) {
+		RETURN_FALSE;
+	}
+	t.path = ecalloc(intern->max_depth + 1, sizeof(jsonreader_path_seg));
+	t.status = SUCCESS;
+
+	/* All tokens are needed here, regardless of the token mask */
+	saved_mask = intern->token_mask;
+	if (saved_mask != VKTOR_T_ALL) {
+		vktor_set_option(intern->parser, VKTOR_OPT_TOKEN_MASK, VKTOR_T_ALL, NULL);
+	}
+
+	/* Start at the first value, or at the value of the current object key */
+	t_type = vktor_get_token_type(intern->parser);
+	if (t_type == VKTOR_T_NONE || t_type == VKTOR_T_OBJECT_KEY) {
+		retval = jsonreader_read(intern TSRMLS_CC);
+		t_type = vktor_get_token_type(intern->parser);
+	}
+
+	if (retval == SUCCESS) {
+		if (t_type == VKTOR_T_NONE || t_type == VKTOR_T_ARRAY_END || 
+			t_type == VKTOR_T_OBJECT_END || t_type == VKTOR_T_OBJECT_KEY) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+				"the reader is not at the start of a value");
+			retval = FAILURE;
+
+		} else {
+			rule = jsonreader_transform_match(&t, 0, &descend);
+			retval = jsonreader_transform_value(intern, &t, 0, rule, descend TSRMLS_CC);
+		}
+	}
+
+	if (saved_mask != VKTOR_T_ALL && intern->parser) {
+		vktor_set_option(intern->parser, VKTOR_OPT_TOKEN_MASK, saved_mask, NULL);
+	}
+
+	efree(t.path);
+	jsonreader_rules_free(t.rules, t.count);
+
+	if (retval != SUCCESS) {
+		RETURN_FALSE;
 	}
+
+	RETURN_TRUE;
 }
+/* }}} */
 
-/* {{{ proto void JSONReader::__construct([array options])
-   Create a new JSONReader object, potentially setting some local attributes */
-PHP_METHOD(jsonreader, __construct)
+/* {{{ proto string JSONReader::readRaw()
+   Get the JSON text of the value the reader is at, exactly as it appears in 
+   the input. Arrays and objects are skipped without being decoded, leaving 
+   the reader on their end token, and streamed strings are read to their end.
+   Returns FALSE on failure. */
+PHP_METHOD(jsonreader, readRaw)
 {
-	zval *object = getThis();
-	zval *options = NULL;
+	zval              *object;
+	jsonreader_object *intern;
+	vktor_token        t_type;
+	vktor_error       *err = NULL;
+	smart_str          str = {0};
+	char              *raw;
+	long               raw_len;
+	int                retval;
 
-	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|a", &options) == FAILURE) {
-		ZVAL_NULL(object);
-		return;
-	}
+	object = getThis();
+	intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
 
-	/* got attributes - set them */
-	if (options != NULL) {
-		jsonreader_object  *intern;
-		zval              **attr_value;
-		char               *str_key;
-		ulong               long_key;
+	if (! (intern->stream || intern->feeding)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"trying to read but no stream was opened");
+		RETURN_FALSE;
+	}
 
-		intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
-		zend_hash_internal_pointer_reset(Z_ARRVAL_P(options));
-		while (zend_hash_get_current_data(Z_ARRVAL_P(options), (void **) &attr_value) == SUCCESS &&
-			zend_hash_get_current_key(Z_ARRVAL_P(options), &str_key, &long_key, 0) == HASH_KEY_IS_LONG) {
+	t_type = vktor_get_token_type(intern->parser);
+	if (! (t_type & (JSONREADER_VALUE_TOKEN | VKTOR_T_STRING_START | 
+		VKTOR_T_ARRAY_START | VKTOR_T_OBJECT_START))) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"the reader is not at the start of a value");
+		RETURN_FALSE;
+	}
 
-			jsonreader_set_attribute(intern, long_key, *attr_value TSRMLS_CC);
-			zend_hash_move_forward(Z_ARRVAL_P(options));
+	/* Scalars are complete tokens, and are returned straight from the buffer */
+	if (t_type & (JSONREADER_VALUE_TOKEN)) {
+		raw_len = vktor_get_token_raw(intern->parser, &raw, &err);
+		if (raw_len < 0) {
+			jsonreader_handle_error(err, intern TSRMLS_CC);
+			RETURN_FALSE;
 		}
+		RETURN_STRINGL(raw, raw_len, 1);
+	}
+
+	/* Arrays, objects and streamed strings are read entirely, so all data has
+	   to be available */
+	if (intern->nonblock || (intern->feeding && ! intern->fed_end)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"cannot read raw arrays, objects or streamed strings from a non-blocking stream or before end() is called");
+		RETURN_FALSE;
+	}
+
+	if (vktor_capture_start(intern->parser, jsonreader_raw_append, &str, &err) != VKTOR_OK) {
+		jsonreader_handle_error(err, intern TSRMLS_CC);
+		RETURN_FALSE;
+	}
+
+	if (t_type == VKTOR_T_STRING_START) {
+		retval = jsonreader_string_skip(intern TSRMLS_CC);
+	} else {
+		retval = jsonreader_step(intern, vktor_skip_struct TSRMLS_CC);
+	}
+	vktor_capture_end(intern->parser, NULL);
+
+	if (retval != SUCCESS) {
+		smart_str_free(&str);
+		RETURN_FALSE;
 	}
+
+	smart_str_0(&str);
+	RETURN_STRINGL(str.c, str.len, 0);
 }
 /* }}} */
 
-/* {{{ proto boolean JSONReader::open(mixed URI)
-   Opens the URI (any valid PHP stream URI) that JSONReader will read
-   from. Can accept either a URI as a string, or an already-open stream 
-   resource. Returns TRUE on success or FALSE on failure. */
-PHP_METHOD(jsonreader, open)
+/* {{{ proto mixed JSONReader::readStringChunk([int max])
+   Read the next chunk of up to max bytes of the string value at the current
+   STRING_START token, as returned with ATTR_STREAM_STRINGS. Returns FALSE 
+   once the whole string was read or on failure, and JSONReader::NEED_DATA
+   in non-blocking mode if no more data is available yet */
+PHP_METHOD(jsonreader, readStringChunk)
 {
-	zval               *object, *arg;
-	jsonreader_object  *intern;
-	php_stream         *tmp_stream;
-	int                 options = ENFORCE_SAFE_MODE | REPORT_ERRORS;
+	zval              *object;
+	jsonreader_object *intern;
+	long               max = JSONREADER_STRING_CHUNK, chunk_len;
+	char              *chunk;
+	zend_bool          done = 0;
 
-	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &arg) == FAILURE) {
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|l", &max) == FAILURE) {
 		return;
 	}
 
 	object = getThis();
 	intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
 
-	switch(Z_TYPE_P(arg)) {
-		case IS_STRING:
-			tmp_stream = php_stream_open_wrapper(Z_STRVAL_P(arg), "r", options, NULL);
-			intern->close_stream = 1;
+	if (! (intern->stream || intern->feeding)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"trying to read but no stream was opened");
+		RETURN_FALSE;
+	}
+
+	if (max < 1) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"chunk size must be greater than 0, %ld given", max);
+		RETURN_FALSE;
+	}
+
+	if (vktor_get_token_type(intern->parser) != VKTOR_T_STRING_START) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"the reader is not at the start of a streamed string");
+		RETURN_FALSE;
+	}
+
+	switch (jsonreader_string_chunk(intern, max, &chunk, &chunk_len, &done TSRMLS_CC)) {
+		case SUCCESS:
 			break;
 
-		case IS_RESOURCE:
-			php_stream_from_zval(tmp_stream, &arg);
-			intern->close_stream = 0;
+		case JSONREADER_NEED_DATA:
+			RETURN_LONG(0);
 			break;
 
 		default:
-			php_error_docref(NULL TSRMLS_CC, E_ERROR, 
-				"argument is expected to be a resource of type stream or a string, %s given",
-				zend_zval_type_name(arg));
 			RETURN_FALSE;
 			break;
-
 	}
 
-	jsonreader_init(intern TSRMLS_CC);
-	intern->stream = tmp_stream;
+	if (done && chunk_len == 0) {
+		RETURN_FALSE;
+	}
 
-	RETURN_TRUE;
+	RETURN_STRINGL(chunk, chunk_len, 1);
 }
 /* }}} */
 
-/* {{{ proto boolean JSONReader::close()
-   Close the currently open JSON stream and free related resources */
-PHP_METHOD(jsonreader, close)
+/* {{{ proto int JSONReader::copyStringTo(resource stream[, bool decodeBase64])
+   Write the rest of the string value at the current STRING_START token to a
+   stream chunk by chunk, optionally decoding it from base64 on the way, so
+   that large strings never have to be held in memory. Returns the number of
+   bytes written, or FALSE on failure */
+PHP_METHOD(jsonreader, copyStringTo)
 {
-	zval              *object;
+	zval              *object, *zstream;
 	jsonreader_object *intern;
+	php_stream        *stream;
+	jsonreader_base64  b64 = {0, 0, 0};
+	unsigned char     *decoded = NULL;
+	char              *chunk;
+	long               chunk_len, len, written = 0;
+	zend_bool          decode = 0, done = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r|b", &zstream, &decode) == FAILURE) {
+		return;
+	}
+
+	php_stream_from_zval(stream, &zstream);
 
 	object = getThis();
 	intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
 
-	/* Close stream, if open */
-	if (intern->stream) {
-		php_stream_close(intern->stream);
-		intern->stream = NULL;
+	if (! (intern->stream || intern->feeding)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"trying to read but no stream was opened");
+		RETURN_FALSE;
 	}
 
-	/* Free parser, if created */
-	if (intern->parser) {
-		vktor_parser_free(intern->parser);
-		intern->parser = NULL;
+	if (vktor_get_token_type(intern->parser) != VKTOR_T_STRING_START) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"the reader is not at the start of a streamed string");
+		RETURN_FALSE;
 	}
 
-	RETURN_TRUE;
+	/* The string is copied in one go, so all data has to be available */
+	if (intern->nonblock || (intern->feeding && ! intern->fed_end)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"cannot copy strings from a non-blocking stream or before end() is called");
+		RETURN_FALSE;
+	}
+
+	if (decode) {
+		decoded = emalloc(JSONREADER_STRING_CHUNK / 4 * 3 + 5);
+	}
+
+	while (! done) {
+		if (jsonreader_string_chunk(intern, JSONREADER_STRING_CHUNK, &chunk, &chunk_len, &done TSRMLS_CC) != SUCCESS) {
+			written = -1;
+			break;
+		}
+
+		if (decode) {
+			len = jsonreader_base64_decode(&b64, chunk, chunk_len, decoded);
+			if (len >= 0 && done) {
+				chunk_len = jsonreader_base64_end(&b64, decoded + len);
+				len = (chunk_len < 0 ? -1 : len + chunk_len);
+			}
+			if (len < 0) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+					"the string is not valid base64 data");
+				written = -1;
+				break;
+			}
+			chunk = (char *) decoded;
+			chunk_len = len;
+		}
+
+		if (chunk_len > 0 && php_stream_write(stream, chunk, chunk_len) != chunk_len) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+				"unable to write to the stream");
+			written = -1;
+			break;
+		}
+		written += chunk_len;
+	}
+
+	if (decoded) {
+		efree(decoded);
+	}
+
+	if (written < 0) {
+		RETURN_FALSE;
+	}
+
+	RETURN_LONG(written);
 }
 /* }}} */
 
-/* {{{ proto boolean JSONReader::read() 
-   Read the next token from the JSON stream. Retuns TRUE as long as something is
-   read, or FALSE when there is nothing left to read, or when an error occured. */
-PHP_METHOD(jsonreader, read)
+/* {{{ proto int JSONReader::parse(array handlers)
+   Parse the value the reader is at, or the whole document if reading has not
+   started yet, calling handlers keyed by path pattern for the values at these 
+   paths, and handlers keyed by token types for the tokens of other values. 
+   Anything no handler may match is skipped without calling into PHP. Returns
+   the number of handler calls, or FALSE on failure */
+PHP_METHOD(jsonreader, parse)
 {
-	zval              *object;
+	zval              *object, *handlers_arr;
 	jsonreader_object *intern;
+	jsonreader_parse   p;
+	jsonreader_rule   *rule;
+	long               saved_mask;
+	int                descend, retval = SUCCESS;
+	vktor_token        t_type;
 
-	RETVAL_TRUE;
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &handlers_arr) == FAILURE) {
+		return;
+	}
 
 	object = getThis();
 	intern = (jsonreader_object *) zend_object_store_get_object(object TSRMLS_CC);
 
-	if (! intern->stream) {
+	if (! (intern->stream || intern->feeding)) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
 			"trying to read but no stream was opened");
 		RETURN_FALSE;
 	}
 
-	/* TODO: replace assertion with an if(!) and init parser (?) */
-	assert(intern->parser != NULL);
+	/* Values are parsed entirely, so all data has to be available */
+	if (intern->nonblock || (intern->feeding && ! intern->fed_end)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+			"cannot parse from a non-blocking stream or before end() is called");
+		RETURN_FALSE;
+	}
+
+	memset(&p, 0, sizeof(p));
+	if (jsonreader_handlers_compile(Z_ARRVAL_P(handlers_arr), &p TSRMLS_CC) != SUCCESS) {
+		jsonreader_rules_free(p.t.rules, p.t.count);
+		efree(p.handlers);
+		RETURN_FALSE;
+	}
+	p.t.path = ecalloc(intern->max_depth + 1, sizeof(jsonreader_path_seg));
+
+	/* All tokens are needed to track paths, regardless of the token mask */
+	saved_mask = intern->token_mask;
+	if (saved_mask != VKTOR_T_ALL) {
+		vktor_set_option(intern->parser, VKTOR_OPT_TOKEN_MASK, VKTOR_T_ALL, NULL);
+	}
+
+	/* Start at the first value, or at the value of the current object key */
+	t_type = vktor_get_token_type(intern->parser);
+	if (t_type == VKTOR_T_NONE || t_type == VKTOR_T_OBJECT_KEY) {
+		retval = jsonreader_read(intern TSRMLS_CC);
+		t_type = vktor_get_token_type(intern->parser);
+	}
+
+	if (retval == SUCCESS) {
+		if (t_type == VKTOR_T_NONE || t_type == VKTOR_T_ARRAY_END || 
+			t_type == VKTOR_T_OBJECT_END || t_type == VKTOR_T_OBJECT_KEY) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, 
+				"the reader is not at the start of a value");
+			retval = FAILURE;
+
+		} else {
+			rule = jsonreader_transform_match(&p.t, 0, &descend);
+			retval = jsonreader_parse_value(intern, &p, 0, rule, descend TSRMLS_CC);
+		}
+	}
+
+	if (saved_mask != VKTOR_T_ALL && intern->parser) {
+		vktor_set_option(intern->parser, VKTOR_OPT_TOKEN_MASK, saved_mask, NULL);
+	}
+
+	efree(p.t.path);
+	jsonreader_rules_free(p.t.rules, p.t.count);
+	efree(p.handlers);
 
-	if (jsonreader_read(intern TSRMLS_CC) != SUCCESS) {
-		RETVAL_FALSE;
+	if (retval != SUCCESS) {
+		RETURN_FALSE;
 	}
+
+	RETURN_LONG(p.calls);
 }
 /* }}} */
 
@@ -730,6 +3751,53 @@ ZEND_END_ARG_INFO()
 
 ZEND_BEGIN_ARG_INFO(arginfo_jsonreader_read, 0)
 ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO(arginfo_jsonreader_feed, 0)
+	ZEND_ARG_INFO(0, chunk)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO(arginfo_jsonreader_end, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO(arginfo_jsonreader_checkpoint, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO(arginfo_jsonreader_resume, 0)
+	ZEND_ARG_INFO(0, checkpoint)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_jsonreader_readcolumns, 0, 0, 1)
+	ZEND_ARG_INFO(0, fields)
+	ZEND_ARG_INFO(0, maxRows)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO(arginfo_jsonreader_setschema, 0)
+	ZEND_ARG_INFO(0, schema)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO(arginfo_jsonreader_readrecord, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO(arginfo_jsonreader_transformto, 0)
+	ZEND_ARG_INFO(0, writer)
+	ZEND_ARG_INFO(0, rules)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO(arginfo_jsonreader_readraw, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_jsonreader_readstringchunk, 0, 0, 0)
+	ZEND_ARG_INFO(0, max)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_jsonreader_copystringto, 0, 0, 1)
+	ZEND_ARG_INFO(0, stream)
+	ZEND_ARG_INFO(0, decodeBase64)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO(arginfo_jsonreader_parse, 0)
+	ZEND_ARG_INFO(0, handlers)
+ZEND_END_ARG_INFO()
 /* }}} */
 
 /* {{{ zend_function_entry jsonreader_class_methods */
@@ -738,6 +3806,18 @@ static const zend_function_entry jsonreader_class_methods[] = {
 	PHP_ME(jsonreader, open,  arginfo_jsonreader_open,  ZEND_ACC_PUBLIC)
 	PHP_ME(jsonreader, close, arginfo_jsonreader_close, ZEND_ACC_PUBLIC)
 	PHP_ME(jsonreader, read,  arginfo_jsonreader_read,  ZEND_ACC_PUBLIC)
+	PHP_ME(jsonreader, feed,  arginfo_jsonreader_feed,  ZEND_ACC_PUBLIC)
+	PHP_ME(jsonreader, end,   arginfo_jsonreader_end,   ZEND_ACC_PUBLIC)
+	PHP_ME(jsonreader, checkpoint, arginfo_jsonreader_checkpoint, ZEND_ACC_PUBLIC)
+	PHP_ME(jsonreader, resume,     arginfo_jsonreader_resume,     ZEND_ACC_PUBLIC)
+	PHP_ME(jsonreader, readColumns, arginfo_jsonreader_readcolumns, ZEND_ACC_PUBLIC)
+	PHP_ME(jsonreader, setSchema,   arginfo_jsonreader_setschema,   ZEND_ACC_PUBLIC)
+	PHP_ME(jsonreader, readRecord,  arginfo_jsonreader_readrecord,  ZEND_ACC_PUBLIC)
+	PHP_ME(jsonreader, transformTo, arginfo_jsonreader_transformto, ZEND_ACC_PUBLIC)
+	PHP_ME(jsonreader, readRaw,     arginfo_jsonreader_readraw,     ZEND_ACC_PUBLIC)
+	PHP_ME(jsonreader, readStringChunk, arginfo_jsonreader_readstringchunk, ZEND_ACC_PUBLIC)
+	PHP_ME(jsonreader, copyStringTo,    arginfo_jsonreader_copystringto,    ZEND_ACC_PUBLIC)
+	PHP_ME(jsonreader, parse,           arginfo_jsonreader_parse,           ZEND_ACC_PUBLIC)
 	{NULL, NULL, NULL}
 };
 /* }}} */
@@ -789,9 +3869,38 @@ PHP_MINIT_FUNCTION(jsonreader)
 	JSONREADER_REG_CLASS_CONST_L("ATTR_MAX_DEPTH", ATTR_MAX_DEPTH);
 	JSONREADER_REG_CLASS_CONST_L("ATTR_READ_BUFF", ATTR_READ_BUFF);
 	JSONREADER_REG_CLASS_CONST_L("ATTR_ERRMODE",   ATTR_ERRMODE);
+	JSONREADER_REG_CLASS_CONST_L("ATTR_NONBLOCK",  ATTR_NONBLOCK);
+	JSONREADER_REG_CLASS_CONST_L("ATTR_VALIDATE_UTF8", ATTR_VALIDATE_UTF8);
+	JSONREADER_REG_CLASS_CONST_L("ATTR_ENCODING",  ATTR_ENCODING);
+	JSONREADER_REG_CLASS_CONST_L("ATTR_TOKEN_MASK", ATTR_TOKEN_MASK);
+	JSONREADER_REG_CLASS_CONST_L("ATTR_COMPRESSION", ATTR_COMPRESSION);
+	JSONREADER_REG_CLASS_CONST_L("ATTR_LAZY_STRINGS", ATTR_LAZY_STRINGS);
+	JSONREADER_REG_CLASS_CONST_L("ATTR_NUMBER_MODE", ATTR_NUMBER_MODE);
+	JSONREADER_REG_CLASS_CONST_L("ATTR_STREAM_STRINGS", ATTR_STREAM_STRINGS);
+	JSONREADER_REG_CLASS_CONST_L("ATTR_MAX_TOKEN_SIZE", ATTR_MAX_TOKEN_SIZE);
 	JSONREADER_REG_CLASS_CONST_L("ERRMODE_PHPERR", ERRMODE_PHPERR);
 	JSONREADER_REG_CLASS_CONST_L("ERRMODE_EXCEPT", ERRMODE_EXCEPT);
 	JSONREADER_REG_CLASS_CONST_L("ERRMODE_INTERN", ERRMODE_INTERN);
+	JSONREADER_REG_CLASS_CONST_L("ERR_SCHEMA",     JSONREADER_ERR_SCHEMA);
+	JSONREADER_REG_CLASS_CONST_L("NEED_DATA",      0);
+	JSONREADER_REG_CLASS_CONST_L("READ_BUFF_ADAPTIVE", 0);
+	JSONREADER_REG_CLASS_CONST_L("UTF8_IGNORE",    VKTOR_UTF8_IGNORE);
+	JSONREADER_REG_CLASS_CONST_L("UTF8_REJECT",    VKTOR_UTF8_REJECT);
+	JSONREADER_REG_CLASS_CONST_L("UTF8_REPLACE",   VKTOR_UTF8_REPLACE);
+	JSONREADER_REG_CLASS_CONST_L("ENCODING_AUTO",    VKTOR_ENC_AUTO);
+	JSONREADER_REG_CLASS_CONST_L("ENCODING_UTF8",    VKTOR_ENC_UTF8);
+	JSONREADER_REG_CLASS_CONST_L("ENCODING_UTF16LE", VKTOR_ENC_UTF16LE);
+	JSONREADER_REG_CLASS_CONST_L("ENCODING_UTF16BE", VKTOR_ENC_UTF16BE);
+	JSONREADER_REG_CLASS_CONST_L("ENCODING_UTF32LE", VKTOR_ENC_UTF32LE);
+	JSONREADER_REG_CLASS_CONST_L("ENCODING_UTF32BE", VKTOR_ENC_UTF32BE);
+	JSONREADER_REG_CLASS_CONST_L("COMPRESSION_NONE",    COMPRESSION_NONE);
+	JSONREADER_REG_CLASS_CONST_L("COMPRESSION_AUTO",    COMPRESSION_AUTO);
+	JSONREADER_REG_CLASS_CONST_L("COMPRESSION_GZIP",    COMPRESSION_GZIP);
+	JSONREADER_REG_CLASS_CONST_L("COMPRESSION_ZLIB",    COMPRESSION_ZLIB);
+	JSONREADER_REG_CLASS_CONST_L("COMPRESSION_DEFLATE", COMPRESSION_DEFLATE);
+	JSONREADER_REG_CLASS_CONST_L("NUMBER_NATIVE",       NUMBER_NATIVE);
+	JSONREADER_REG_CLASS_CONST_L("NUMBER_STRING",       NUMBER_STRING);
+	JSONREADER_REG_CLASS_CONST_L("NUMBER_AUTO",         NUMBER_AUTO);
 
 	JSONREADER_REG_CLASS_CONST_L("NULL",         VKTOR_T_NULL);
 	JSONREADER_REG_CLASS_CONST_L("FALSE",        VKTOR_T_FALSE);
@@ -801,6 +3910,7 @@ PHP_MINIT_FUNCTION(jsonreader)
 	JSONREADER_REG_CLASS_CONST_L("FLOAT",        VKTOR_T_FLOAT);
 	JSONREADER_REG_CLASS_CONST_L("NUMBER",       VKTOR_T_INT | VKTOR_T_FLOAT);
 	JSONREADER_REG_CLASS_CONST_L("STRING",       VKTOR_T_STRING);
+	JSONREADER_REG_CLASS_CONST_L("STRING_START", VKTOR_T_STRING_START);
 	JSONREADER_REG_CLASS_CONST_L("VALUE",        JSONREADER_VALUE_TOKEN);
 	JSONREADER_REG_CLASS_CONST_L("ARRAY_START",  VKTOR_T_ARRAY_START);
 	JSONREADER_REG_CLASS_CONST_L("ARRAY_END",    VKTOR_T_ARRAY_END);
@@ -811,11 +3921,16 @@ PHP_MINIT_FUNCTION(jsonreader)
 	JSONREADER_REG_CLASS_CONST_L("ARRAY",        VKTOR_STRUCT_ARRAY);
 	JSONREADER_REG_CLASS_CONST_L("OBJECT",       VKTOR_STRUCT_OBJECT);
 
+	JSONREADER_REG_CLASS_CONST_L("RULE_DROP",    RULE_DROP);
+	JSONREADER_REG_CLASS_CONST_L("RULE_REDACT",  RULE_REDACT);
+	JSONREADER_REG_CLASS_CONST_L("RULE_REPLACE", RULE_REPLACE);
+
 	/* Register property handlers */
 	jsonreader_register_prop_handler("tokenType", jsonreader_get_token_type, NULL TSRMLS_CC);
 	jsonreader_register_prop_handler("value", jsonreader_get_token_value, NULL TSRMLS_CC);
 	jsonreader_register_prop_handler("currentStruct", jsonreader_get_current_struct, NULL TSRMLS_CC);
 	jsonreader_register_prop_handler("currentDepth", jsonreader_get_current_depth, NULL TSRMLS_CC);
+	jsonreader_register_prop_handler("readBufferSize", jsonreader_get_read_buffer_size, NULL TSRMLS_CC);
 
 	/**
 	 * Declare the JSONReaderException class
@@ -824,10 +3939,10 @@ PHP_MINIT_FUNCTION(jsonreader)
 	jsonreader_exception_ce = zend_register_internal_class_ex(&ce, 
 		zend_exception_get_default(TSRMLS_C), NULL TSRMLS_CC);
 
-	/** 
-	 * Set libvktor to use PHP memory allocation functions
+	/**
+	 * Declare the JSONWriter class
 	 */
-	vktor_set_memory_handlers(jsr_malloc, jsr_realloc, jsr_free);
+	PHP_MINIT(jsonwriter)(INIT_FUNC_ARGS_PASSTHRU);
 
 	return SUCCESS;
 }
@@ -847,6 +3962,11 @@ PHP_MINFO_FUNCTION(jsonreader)
 {
 	php_info_print_table_start();
 	php_info_print_table_header(2, "jsonreader support", "enabled");
+#ifdef HAVE_JSONREADER_ZLIB
+	php_info_print_table_row(2, "compressed stream support", "enabled");
+#else
+	php_info_print_table_row(2, "compressed stream support", "disabled");
+#endif
 	php_info_print_table_end();
 
 	DISPLAY_INI_ENTRIES();
@@ -0,0 +1,1118 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 5                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2008 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Shahar Evron, shahar@prematureoptimization.org               |
+  +----------------------------------------------------------------------+
+*/
+
+/* $Id: header,v 1.16.2.1.2.1.2.1 2008/02/07 19:39:50 iliaa Exp $ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_ini.h"
+#include "php_jsonreader.h"
+
+#include "libvktor/vktor_scan.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(jsonreader)
+
+static zend_object_handlers  jsonwriter_obj_handlers;
+static zend_class_entry     *jsonwriter_ce;
+
+struct _jsonwriter_object {
+	zend_object    std;
+	php_stream    *stream;
+	zend_bool      close_stream;
+	zend_bool      memory;
+	char          *buf;
+	long           buf_len;
+	long           buf_size;
+	long           flushed;
+	long           write_buffer;
+	long           max_depth;
+	unsigned char *nest_stack;
+	long           nest_size;
+	long           depth;
+	int            state;
+	zend_bool      need_comma;
+};
+
+#define JSONWRITER_REG_CLASS_CONST_L(name, value) \
+	zend_declare_class_constant_long(jsonwriter_ce, name, sizeof(name) - 1, \
+	(long) value TSRMLS_CC)
+
+/* Default size of the write buffer, which is flushed to the stream when full */
+#define JSONWRITER_WRITE_BUFF_DEFAULT (64 * 1024)
+
+/* Initial size of the nesting stack in bytes, each byte holding 8 levels */
+#define JSONWRITER_NEST_MEMCHUNK 8
+
+/* Whether the struct at nesting level l is an object (otherwise an array) */
+#define jsonwriter_nest_is_object(o, l) \
+	((o)->nest_stack[(l) >> 3] & (1 << ((l) & 7)))
+
+/* Buffer size large enough for any formatted long or double */
+#define JSONWRITER_NUM_BUF_SIZE 64
+
+/* {{{ attribute keys and writer states */
+enum {
+	ATTR_MAX_DEPTH = 1,
+	ATTR_WRITE_BUFF
+};
+
+enum {
+	STATE_VALUE,  /* a value is expected: at the root, in an array or after a key */
+	STATE_KEY,    /* in an object, a key or the end of the object is expected */
+	STATE_DONE    /* the root value was written */
+};
+/* }}} */
+
+/* {{{ Output buffer functions */
+
+/* {{{ jsonwriter_flush
+   Write the contents of the buffer to the stream. Returns SUCCESS or FAILURE */
+static int jsonwriter_flush(jsonwriter_object *obj TSRMLS_DC)
+{
+	if (obj->memory || obj->buf_len == 0) {
+		return SUCCESS;
+	}
+
+	if (! obj->stream) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "trying to write but no stream was opened");
+		return FAILURE;
+	}
+
+	if (php_stream_write(obj->stream, obj->buf, obj->buf_len) != obj->buf_len) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "unable to write %ld bytes to stream", obj->buf_len);
+		return FAILURE;
+	}
+
+	obj->flushed += obj->buf_len;
+	obj->buf_len = 0;
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ jsonwriter_reserve
+   Make room for len more bytes in the buffer, flushing it to the stream or
+   growing it when writing to memory. Returns a pointer to the free space, or
+   NULL on failure */
+static char *jsonwriter_reserve(jsonwriter_object *obj, long len TSRMLS_DC)
+{
+	long size;
+
+	if (obj->buf_len + len <= obj->buf_size) {
+		return obj->buf + obj->buf_len;
+	}
+
+	if (! obj->memory) {
+		if (jsonwriter_flush(obj TSRMLS_CC) != SUCCESS) {
+			return NULL;
+		}
+		if (len <= obj->buf_size) {
+			return obj->buf;
+		}
+	}
+
+	size = (obj->buf_size > 0 ? obj->buf_size : JSONWRITER_WRITE_BUFF_DEFAULT);
+	while (size < obj->buf_len + len) {
+		size = size * 2;
+	}
+	obj->buf = erealloc(obj->buf, size);
+	obj->buf_size = size;
+
+	return obj->buf + obj->buf_len;
+}
+/* }}} */
+
+/* {{{ jsonwriter_append
+   Append len bytes to the buffer. Data larger than the buffer of a stream is
+   written directly. Returns SUCCESS or FAILURE */
+int jsonwriter_append(jsonwriter_object *obj, const char *data, long len TSRMLS_DC)
+{
+	char *ptr;
+
+	if (! obj->memory && len > obj->buf_size) {
+		if (jsonwriter_flush(obj TSRMLS_CC) != SUCCESS) {
+			return FAILURE;
+		}
+		if (php_stream_write(obj->stream, data, len) != len) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "unable to write %ld bytes to stream", len);
+			return FAILURE;
+		}
+		obj->flushed += len;
+		return SUCCESS;
+	}
+
+	if ((ptr = jsonwriter_reserve(obj, len TSRMLS_CC)) == NULL) {
+		return FAILURE;
+	}
+
+	memcpy(ptr, data, len);
+	obj->buf_len += len;
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ jsonwriter_append_char
+   Append a single byte to the buffer. Returns SUCCESS or FAILURE */
+static inline int jsonwriter_append_char(jsonwriter_object *obj, char c TSRMLS_DC)
+{
+	if (obj->buf_len < obj->buf_size) {
+		obj->buf[obj->buf_len++] = c;
+		return SUCCESS;
+	}
+
+	return jsonwriter_append(obj, &c, 1 TSRMLS_CC);
+}
+/* }}} */
+
+/* }}} */
+
+/* {{{ Value encoding functions */
+
+/* {{{ jsonwriter_write_string
+   Write a string as a quoted and escaped JSON string. Runs of bytes which
+   need no escaping are found using the same block scanner the parser uses
+   for reading strings, and copied at once. Non-ASCII bytes are copied as-is,
+   so strings are expected to be UTF-8 encoded */
+static int jsonwriter_write_string(jsonwriter_object *obj, const char *str, long len TSRMLS_DC)
+{
+	static const char hex[] = "0123456789abcdef";
+	char              esc[6];
+	long              run;
+	int               esc_len;
+	unsigned char     c;
+
+	if (jsonwriter_append_char(obj, '"' TSRMLS_CC) != SUCCESS) {
+		return FAILURE;
+	}
+
+	while (len > 0) {
+		run = vktor_scan_string(str, len, 0);
+		if (run > 0) {
+			if (jsonwriter_append(obj, str, run TSRMLS_CC) != SUCCESS) {
+				return FAILURE;
+			}
+			str += run;
+			len -= run;
+			if (len == 0) {
+				break;
+			}
+		}
+
+		c = (unsigned char) *str;
+		esc[0] = '\\';
+		esc_len = 2;
+		switch(c) {
+			case '"':  esc[1] = '"';  break;
+			case '\\': esc[1] = '\\'; break;
+			case '\b': esc[1] = 'b';  break;
+			case '\f': esc[1] = 'f';  break;
+			case '\n': esc[1] = 'n';  break;
+			case '\r': esc[1] = 'r';  break;
+			case '\t': esc[1] = 't';  break;
+			default:
+				esc[1] = 'u';
+				esc[2] = '0';
+				esc[3] = '0';
+				esc[4] = hex[c >> 4];
+				esc[5] = hex[c & 0x0f];
+				esc_len = 6;
+				break;
+		}
+
+		if (jsonwriter_append(obj, esc, esc_len TSRMLS_CC) != SUCCESS) {
+			return FAILURE;
+		}
+		str++;
+		len--;
+	}
+
+	return jsonwriter_append_char(obj, '"' TSRMLS_CC);
+}
+/* }}} */
+
+/* {{{ jsonwriter_write_long
+   Write an integer, formatting its digits directly */
+static int jsonwriter_write_long(jsonwriter_object *obj, long lval TSRMLS_DC)
+{
+	char          buf[JSONWRITER_NUM_BUF_SIZE];
+	char         *ptr = buf + sizeof(buf);
+	unsigned long uval;
+
+	uval = (lval < 0 ? - (unsigned long) lval : (unsigned long) lval);
+	do {
+		*--ptr = (char) ('0' + uval % 10);
+		uval /= 10;
+	} while (uval > 0);
+
+	if (lval < 0) {
+		*--ptr = '-';
+	}
+
+	return jsonwriter_append(obj, ptr, buf + sizeof(buf) - ptr TSRMLS_CC);
+}
+/* }}} */
+
+/* {{{ jsonwriter_write_double
+   Write a floating point number using the shortest digits which read back as
+   the same value, as found by zend_dtoa() mode 0. Like php_gcvt(), exponent 
+   notation is used for exponents below -4 or above 14. Integral values get a
+   ".0" suffix, so they are read back as floats */
+static int jsonwriter_write_double(jsonwriter_object *obj, double dval TSRMLS_DC)
+{
+	char  buf[JSONWRITER_NUM_BUF_SIZE];
+	char *digits, *end, *src, *ptr = buf;
+	int   decpt, sign, exp, i;
+
+	if (zend_isinf(dval) || zend_isnan(dval)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "infinite or NaN values can not be written as JSON");
+		return FAILURE;
+	}
+
+	digits = zend_dtoa(dval, 0, 0, &decpt, &sign, &end);
+	if (sign) {
+		*ptr++ = '-';
+	}
+
+	if (decpt < -3 || decpt > 15) {
+		/* d.ddde[+-]x */
+		exp = decpt - 1;
+		*ptr++ = digits[0];
+		*ptr++ = '.';
+		if (end - digits > 1) {
+			memcpy(ptr, digits + 1, end - digits - 1);
+			ptr += end - digits - 1;
+		} else {
+			*ptr++ = '0';
+		}
+		*ptr++ = 'e';
+		*ptr++ = (exp < 0 ? '-' : '+');
+		exp = (exp < 0 ? -exp : exp);
+		for (i = (exp >= 100 ? 100 : (exp >= 10 ? 10 : 1)); i > 0; i /= 10) {
+			*ptr++ = (char) ('0' + exp / i % 10);
+		}
+
+	} else if (decpt <= 0) {
+		/* 0.000ddd */
+		*ptr++ = '0';
+		*ptr++ = '.';
+		for (i = decpt; i < 0; i++) {
+			*ptr++ = '0';
+		}
+		memcpy(ptr, digits, end - digits);
+		ptr += end - digits;
+
+	} else {
+		/* ddd.ddd, padded with zeros up to the decimal point */
+		for (i = 0, src = digits; i < decpt; i++) {
+			*ptr++ = (src < end ? *src++ : '0');
+		}
+		*ptr++ = '.';
+		if (src < end) {
+			memcpy(ptr, src, end - src);
+			ptr += end - src;
+		} else {
+			*ptr++ = '0';
+		}
+	}
+
+	zend_freedtoa(digits);
+
+	return jsonwriter_append(obj, buf, ptr - buf TSRMLS_CC);
+}
+/* }}} */
+
+/* {{{ jsonwriter_array_is_list
+   Check if the keys of an array are 0, 1, 2... in order, in which case it is
+   written as a JSON array rather than an object */
+static int jsonwriter_array_is_list(HashTable *ht)
+{
+	HashPosition pos;
+	char        *key;
+	uint         key_len;
+	ulong        index, expected = 0;
+
+	for (zend_hash_internal_pointer_reset_ex(ht, &pos);
+		zend_hash_get_current_key_type_ex(ht, &pos) != HASH_KEY_NON_EXISTANT;
+		zend_hash_move_forward_ex(ht, &pos)) {
+		if (zend_hash_get_current_key_ex(ht, &key, &key_len, &index, 0, &pos) != HASH_KEY_IS_LONG ||
+			index != expected) {
+			return 0;
+		}
+		expected++;
+	}
+
+	return 1;
+}
+/* }}} */
+
+static int jsonwriter_write_zval(jsonwriter_object *obj, zval *value, long depth TSRMLS_DC);
+
+/* {{{ jsonwriter_write_hash
+   Write the elements of an array, or the public properties of an object, as a
+   JSON array or object. depth is the nesting level of the written struct */
+static int jsonwriter_write_hash(jsonwriter_object *obj, HashTable *ht, int as_object, long depth TSRMLS_DC)
+{
+	HashPosition   pos;
+	zval         **data;
+	char          *key;
+	uint           key_len;
+	ulong          index;
+	int            first = 1, key_type = HASH_KEY_IS_LONG, retval = SUCCESS;
+
+	if (depth > obj->max_depth) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING,
+			"maximal nesting level of %ld reached", obj->max_depth);
+		return FAILURE;
+	}
+
+	if (ht->nApplyCount > 0) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "recursive arrays or objects can not be written");
+		return FAILURE;
+	}
+
+	if (jsonwriter_append_char(obj, (as_object ? '{' : '[') TSRMLS_CC) != SUCCESS) {
+		return FAILURE;
+	}
+
+	ht->nApplyCount++;
+
+	for (zend_hash_internal_pointer_reset_ex(ht, &pos);
+		zend_hash_get_current_data_ex(ht, (void **) &data, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(ht, &pos)) {
+		if (as_object) {
+			key_type = zend_hash_get_current_key_ex(ht, &key, &key_len, &index, 0, &pos);
+
+			/* skip private and protected properties */
+			if (key_type == HASH_KEY_IS_STRING && key_len > 1 && key[0] == '\0') {
+				continue;
+			}
+		}
+
+		if (! first && jsonwriter_append_char(obj, ',' TSRMLS_CC) != SUCCESS) {
+			retval = FAILURE;
+			break;
+		}
+		first = 0;
+
+		if (as_object) {
+			if (key_type == HASH_KEY_IS_STRING) {
+				retval = jsonwriter_write_string(obj, key, key_len - 1 TSRMLS_CC);
+			} else {
+				char num_key[JSONWRITER_NUM_BUF_SIZE];
+				int  num_len = snprintf(num_key, sizeof(num_key), "%ld", (long) index);
+
+				retval = jsonwriter_write_string(obj, num_key, num_len TSRMLS_CC);
+			}
+			if (retval != SUCCESS || jsonwriter_append_char(obj, ':' TSRMLS_CC) != SUCCESS) {
+				retval = FAILURE;
+				break;
+			}
+		}
+
+		if (jsonwriter_write_zval(obj, *data, depth TSRMLS_CC) != SUCCESS) {
+			retval = FAILURE;
+			break;
+		}
+	}
+
+	ht->nApplyCount--;
+
+	if (retval == SUCCESS) {
+		retval = jsonwriter_append_char(obj, (as_object ? '}' : ']') TSRMLS_CC);
+	}
+
+	return retval;
+}
+/* }}} */
+
+/* {{{ jsonwriter_write_zval
+   Write any PHP value. Arrays with keys 0, 1, 2... are written as JSON arrays,
+   other arrays and objects as JSON objects. depth is the nesting level the
+   value is written at */
+static int jsonwriter_write_zval(jsonwriter_object *obj, zval *value, long depth TSRMLS_DC)
+{
+	switch(Z_TYPE_P(value)) {
+		case IS_NULL:
+			return jsonwriter_append(obj, "null", 4 TSRMLS_CC);
+
+		case IS_BOOL:
+			if (Z_BVAL_P(value)) {
+				return jsonwriter_append(obj, "true", 4 TSRMLS_CC);
+			}
+			return jsonwriter_append(obj, "false", 5 TSRMLS_CC);
+
+		case IS_LONG:
+			return jsonwriter_write_long(obj, Z_LVAL_P(value) TSRMLS_CC);
+
+		case IS_DOUBLE:
+			return jsonwriter_write_double(obj, Z_DVAL_P(value) TSRMLS_CC);
+
+		case IS_STRING:
+			return jsonwriter_write_string(obj, Z_STRVAL_P(value), Z_STRLEN_P(value) TSRMLS_CC);
+
+		case IS_ARRAY:
+			return jsonwriter_write_hash(obj, Z_ARRVAL_P(value),
+				! jsonwriter_array_is_list(Z_ARRVAL_P(value)), depth + 1 TSRMLS_CC);
+
+		case IS_OBJECT:
+			return jsonwriter_write_hash(obj, Z_OBJPROP_P(value), 1, depth + 1 TSRMLS_CC);
+
+		default:
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "values of type %s can not be written as JSON",
+				zend_zval_type_name(value));
+			return FAILURE;
+	}
+}
+/* }}} */
+
+/* }}} */
+
+/* {{{ Structure functions */
+
+/* {{{ jsonwriter_before_value
+   Check that a value may be written now, and write the separating comma if
+   needed. Returns SUCCESS or FAILURE */
+int jsonwriter_before_value(jsonwriter_object *obj TSRMLS_DC)
+{
+	if (! (obj->stream || obj->memory)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "trying to write but no stream was opened");
+		return FAILURE;
+	}
+
+	switch(obj->state) {
+		case STATE_DONE:
+			php_error_docref(NULL TSRMLS_CC, E_WARNING,
+				"trying to write a value after the end of the JSON document");
+			return FAILURE;
+
+		case STATE_KEY:
+			php_error_docref(NULL TSRMLS_CC, E_WARNING,
+				"trying to write a value in an object without a key, call writeKey() first");
+			return FAILURE;
+	}
+
+	/* values in arrays are separated by commas - in objects, keys are */
+	if (obj->need_comma && obj->depth > 0 && ! jsonwriter_nest_is_object(obj, obj->depth)) {
+		return jsonwriter_append_char(obj, ',' TSRMLS_CC);
+	}
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ jsonwriter_after_value
+   Update the writer state after a complete value was written */
+void jsonwriter_after_value(jsonwriter_object *obj)
+{
+	if (obj->depth == 0) {
+		obj->state = STATE_DONE;
+	} else {
+		obj->state = (jsonwriter_nest_is_object(obj, obj->depth) ? STATE_KEY : STATE_VALUE);
+		obj->need_comma = 1;
+	}
+}
+/* }}} */
+
+/* {{{ jsonwriter_nest_push
+   Push an array or object to the nesting stack, growing it as needed. Returns
+   SUCCESS, or FAILURE if the maximal nesting level is reached */
+static int jsonwriter_nest_push(jsonwriter_object *obj, int is_object TSRMLS_DC)
+{
+	long level = obj->depth + 1;
+	long size;
+
+	if (level > obj->max_depth) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING,
+			"maximal nesting level of %ld reached", obj->max_depth);
+		return FAILURE;
+	}
+
+	if ((level >> 3) >= obj->nest_size) {
+		size = (obj->nest_size > 0 ? obj->nest_size : JSONWRITER_NEST_MEMCHUNK);
+		while ((level >> 3) >= size) {
+			size = size * 2;
+		}
+		obj->nest_stack = erealloc(obj->nest_stack, size);
+		memset(obj->nest_stack + obj->nest_size, 0, size - obj->nest_size);
+		obj->nest_size = size;
+	}
+
+	if (is_object) {
+		obj->nest_stack[level >> 3] |= (1 << (level & 7));
+	} else {
+		obj->nest_stack[level >> 3] &= ~(1 << (level & 7));
+	}
+
+	obj->depth = level;
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ jsonwriter_start
+   Start writing an array or an object */
+int jsonwriter_start(jsonwriter_object *obj, int is_object TSRMLS_DC)
+{
+	if (jsonwriter_before_value(obj TSRMLS_CC) != SUCCESS ||
+		jsonwriter_nest_push(obj, is_object TSRMLS_CC) != SUCCESS) {
+		return FAILURE;
+	}
+
+	obj->state = (is_object ? STATE_KEY : STATE_VALUE);
+	obj->need_comma = 0;
+
+	return jsonwriter_append_char(obj, (is_object ? '{' : '[') TSRMLS_CC);
+}
+/* }}} */
+
+/* {{{ jsonwriter_key
+   Write the key of the next object member */
+int jsonwriter_key(jsonwriter_object *obj, const char *key, long key_len TSRMLS_DC)
+{
+	if (obj->state != STATE_KEY) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "%s", (obj->depth > 0 &&
+			jsonwriter_nest_is_object(obj, obj->depth) ?
+			"trying to write a key before the value of the previous key" :
+			"trying to write a key outside of an object"));
+		return FAILURE;
+	}
+
+	if ((obj->need_comma && jsonwriter_append_char(obj, ',' TSRMLS_CC) != SUCCESS) ||
+		jsonwriter_write_string(obj, key, key_len TSRMLS_CC) != SUCCESS ||
+		jsonwriter_append_char(obj, ':' TSRMLS_CC) != SUCCESS) {
+		return FAILURE;
+	}
+
+	obj->state = STATE_VALUE;
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ jsonwriter_value
+   Write a complete value. If writing fails half way, the partially written
+   value is dropped, unless it already reached the stream */
+int jsonwriter_value(jsonwriter_object *obj, zval *value TSRMLS_DC)
+{
+	long mark    = obj->buf_len;
+	long flushed = obj->flushed;
+
+	if (jsonwriter_before_value(obj TSRMLS_CC) != SUCCESS ||
+		jsonwriter_write_zval(obj, value, obj->depth TSRMLS_CC) != SUCCESS) {
+		if (obj->flushed == flushed) {
+			obj->buf_len = mark;
+		}
+		return FAILURE;
+	}
+
+	jsonwriter_after_value(obj);
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ jsonwriter_end
+   End the current array or object */
+int jsonwriter_end(jsonwriter_object *obj TSRMLS_DC)
+{
+	int is_object;
+
+	if (obj->depth == 0) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "there is no array or object to end");
+		return FAILURE;
+	}
+
+	is_object = jsonwriter_nest_is_object(obj, obj->depth);
+	if (is_object && obj->state == STATE_VALUE) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "trying to end an object after a key without a value");
+		return FAILURE;
+	}
+
+	if (jsonwriter_append_char(obj, (is_object ? '}' : ']') TSRMLS_CC) != SUCCESS) {
+		return FAILURE;
+	}
+
+	obj->depth--;
+	jsonwriter_after_value(obj);
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ jsonwriter_reset
+   Reset the writer state before writing a new document, releasing any stream
+   opened by the writer. Buffered output should be flushed before */
+static void jsonwriter_reset(jsonwriter_object *obj TSRMLS_DC)
+{
+	if (obj->stream && obj->close_stream) {
+		php_stream_close(obj->stream);
+	}
+	obj->stream = NULL;
+	obj->memory = 0;
+	obj->buf_len = 0;
+	obj->depth = 0;
+	obj->state = STATE_VALUE;
+	obj->need_comma = 0;
+}
+/* }}} */
+
+/* }}} */
+
+/* {{{ jsonwriter_object_dtor
+   Flush any buffered output when the object is destroyed, while the stream
+   is still available */
+static void jsonwriter_object_dtor(void *object, zend_object_handle handle TSRMLS_DC)
+{
+	jsonwriter_object *intern = (jsonwriter_object *) object;
+
+	if (intern->stream) {
+		jsonwriter_flush(intern TSRMLS_CC);
+	}
+
+	zend_objects_destroy_object(object, handle TSRMLS_CC);
+}
+/* }}} */
+
+/* {{{ jsonwriter_object_free_storage
+   C-level object destructor for JSONWriter objects */
+static void jsonwriter_object_free_storage(void *object TSRMLS_DC)
+{
+	jsonwriter_object *intern = (jsonwriter_object *) object;
+
+	zend_object_std_dtor(&intern->std TSRMLS_CC);
+
+	if (intern->stream && intern->close_stream) {
+		php_stream_close(intern->stream);
+	}
+
+	if (intern->buf) {
+		efree(intern->buf);
+	}
+
+	if (intern->nest_stack) {
+		efree(intern->nest_stack);
+	}
+
+	efree(object);
+}
+/* }}} */
+
+/* {{{ jsonwriter_object_new
+   C-level constructor of JSONWriter objects. The write buffer is allocated
+   when a stream is opened */
+static zend_object_value jsonwriter_object_new(zend_class_entry *ce TSRMLS_DC)
+{
+	zend_object_value  retval;
+	jsonwriter_object *intern;
+
+	intern = ecalloc(1, sizeof(jsonwriter_object));
+	intern->max_depth = JSONREADER_G(max_depth);
+	intern->write_buffer = JSONWRITER_WRITE_BUFF_DEFAULT;
+	intern->state = STATE_VALUE;
+
+	zend_object_std_init(&(intern->std), ce TSRMLS_CC);
+
+#if PHP_VERSION_ID < 50399
+	zend_hash_copy(intern->std.properties, &ce->default_properties,
+		(copy_ctor_func_t) zval_add_ref, NULL, sizeof(zval *));
+#else
+  object_properties_init(&(intern->std), ce);
+#endif
+
+	retval.handle = zend_objects_store_put(intern,
+		(zend_objects_store_dtor_t) jsonwriter_object_dtor,
+		(zend_objects_free_object_storage_t) jsonwriter_object_free_storage,
+		NULL TSRMLS_CC);
+
+	retval.handlers = &jsonwriter_obj_handlers;
+
+	return retval;
+}
+/* }}} */
+
+/* {{{ jsonwriter_set_attribute
+   set an attribute of the JSONWriter object */
+static void jsonwriter_set_attribute(jsonwriter_object *obj, ulong attr_key, zval *attr_value TSRMLS_DC)
+{
+	long lval = Z_LVAL_P(attr_value);
+
+	switch(attr_key) {
+		case ATTR_MAX_DEPTH:
+			if (lval < 1) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, "maximal nesting level must be more than 0, %ld given", lval);
+			} else {
+				obj->max_depth = lval;
+			}
+			break;
+
+		case ATTR_WRITE_BUFF:
+			if (lval < 1) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, "write buffer size must be more than 0, %ld given", lval);
+			} else {
+				obj->write_buffer = lval;
+			}
+			break;
+
+		default:
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "invalid attribute: %lu", attr_key);
+			break;
+	}
+}
+/* }}} */
+
+/* {{{ jsonwriter_get_object
+   Get the internal object of $this */
+#define jsonwriter_get_object() \
+	((jsonwriter_object *) zend_object_store_get_object(getThis() TSRMLS_CC))
+/* }}} */
+
+/* {{{ jsonwriter_from_zval
+   Get the internal object of a JSONWriter zval, or NULL if the zval is not a
+   JSONWriter object */
+jsonwriter_object *jsonwriter_from_zval(zval *object TSRMLS_DC)
+{
+	if (Z_TYPE_P(object) != IS_OBJECT || ! instanceof_function(Z_OBJCE_P(object), jsonwriter_ce TSRMLS_CC)) {
+		return NULL;
+	}
+
+	return (jsonwriter_object *) zend_object_store_get_object(object TSRMLS_CC);
+}
+/* }}} */
+
+/* {{{ proto void JSONWriter::__construct([array attributes])
+   Create a new JSONWriter object, optionally setting some attributes */
+PHP_METHOD(jsonwriter, __construct)
+{
+	zval *object = getThis();
+	zval *options = NULL;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|a", &options) == FAILURE) {
+		ZVAL_NULL(object);
+		return;
+	}
+
+	/* got attributes - set them */
+	if (options != NULL) {
+		jsonwriter_object  *intern;
+		zval              **attr_value;
+		char               *str_key;
+		ulong               long_key;
+
+		intern = (jsonwriter_object *) zend_object_store_get_object(object TSRMLS_CC);
+		zend_hash_internal_pointer_reset(Z_ARRVAL_P(options));
+		while (zend_hash_get_current_data(Z_ARRVAL_P(options), (void **) &attr_value) == SUCCESS &&
+			zend_hash_get_current_key(Z_ARRVAL_P(options), &str_key, &long_key, 0) == HASH_KEY_IS_LONG) {
+
+			jsonwriter_set_attribute(intern, long_key, *attr_value TSRMLS_CC);
+			zend_hash_move_forward(Z_ARRVAL_P(options));
+		}
+	}
+}
+/* }}} */
+
+/* {{{ proto boolean JSONWriter::open(mixed URI)
+   Open the URI (any valid PHP stream URI) that JSONWriter will write to. Can
+   accept either a URI as a string, or an already-open stream resource. Any
+   previously open stream is flushed and released. Returns TRUE on success or
+   FALSE on failure. */
+PHP_METHOD(jsonwriter, open)
+{
+	zval              *arg;
+	jsonwriter_object *intern;
+	php_stream        *tmp_stream;
+	zend_bool          close_stream;
+	int                options = ENFORCE_SAFE_MODE | REPORT_ERRORS;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &arg) == FAILURE) {
+		return;
+	}
+
+	intern = jsonwriter_get_object();
+
+	switch(Z_TYPE_P(arg)) {
+		case IS_STRING:
+			tmp_stream = php_stream_open_wrapper(Z_STRVAL_P(arg), "wb", options, NULL);
+			close_stream = 1;
+			break;
+
+		case IS_RESOURCE:
+			php_stream_from_zval(tmp_stream, &arg);
+			close_stream = 0;
+			break;
+
+		default:
+			php_error_docref(NULL TSRMLS_CC, E_WARNING,
+				"argument is expected to be a resource of type stream or a string, %s given",
+				zend_zval_type_name(arg));
+			RETURN_FALSE;
+			break;
+	}
+
+	if (! tmp_stream) {
+		RETURN_FALSE;
+	}
+
+	if (intern->stream) {
+		jsonwriter_flush(intern TSRMLS_CC);
+	}
+	jsonwriter_reset(intern TSRMLS_CC);
+
+	/* the buffer is used for stream writes, so it has a fixed size */
+	if (intern->buf_size != intern->write_buffer) {
+		if (intern->buf) {
+			efree(intern->buf);
+		}
+		intern->buf = emalloc(intern->write_buffer);
+		intern->buf_size = intern->write_buffer;
+	}
+
+	intern->stream = tmp_stream;
+	intern->close_stream = close_stream;
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto boolean JSONWriter::openMemory()
+   Start writing to memory. The written JSON is returned by
+   JSONWriter::outputMemory(). Any previously open stream is flushed and
+   released. */
+PHP_METHOD(jsonwriter, openMemory)
+{
+	jsonwriter_object *intern = jsonwriter_get_object();
+
+	if (intern->stream) {
+		jsonwriter_flush(intern TSRMLS_CC);
+	}
+	jsonwriter_reset(intern TSRMLS_CC);
+	intern->memory = 1;
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto string JSONWriter::outputMemory([boolean flush])
+   Return the JSON written to memory so far. Unless flush is FALSE, the
+   returned output is removed from the buffer. */
+PHP_METHOD(jsonwriter, outputMemory)
+{
+	jsonwriter_object *intern;
+	zend_bool          flush = 1;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|b", &flush) == FAILURE) {
+		return;
+	}
+
+	intern = jsonwriter_get_object();
+
+	if (! intern->memory) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "not writing to memory, call openMemory() first");
+		RETURN_FALSE;
+	}
+
+	RETVAL_STRINGL((intern->buf ? intern->buf : ""), intern->buf_len, 1);
+	if (flush) {
+		intern->buf_len = 0;
+	}
+}
+/* }}} */
+
+/* {{{ proto boolean JSONWriter::flush()
+   Write all buffered output to the stream. Returns TRUE on success or FALSE
+   on failure. */
+PHP_METHOD(jsonwriter, flush)
+{
+	jsonwriter_object *intern = jsonwriter_get_object();
+
+	if (! intern->stream) {
+		RETURN_BOOL(intern->memory);
+	}
+
+	if (jsonwriter_flush(intern TSRMLS_CC) != SUCCESS) {
+		RETURN_FALSE;
+	}
+
+	php_stream_flush(intern->stream);
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto boolean JSONWriter::close()
+   Flush buffered output and close the stream, if it was opened by the
+   writer. Returns FALSE if output could not be written, or if the JSON
+   document was not complete. */
+PHP_METHOD(jsonwriter, close)
+{
+	jsonwriter_object *intern = jsonwriter_get_object();
+	zend_bool          complete;
+
+	if (! (intern->stream || intern->memory)) {
+		RETURN_TRUE;
+	}
+
+	complete = (intern->state == STATE_DONE);
+	if (jsonwriter_flush(intern TSRMLS_CC) != SUCCESS) {
+		complete = 0;
+	}
+	jsonwriter_reset(intern TSRMLS_CC);
+
+	if (intern->buf_size > intern->write_buffer * 2) {
+		efree(intern->buf);
+		intern->buf = NULL;
+		intern->buf_size = 0;
+	}
+
+	if (! complete) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "closing an incomplete JSON document");
+		RETURN_FALSE;
+	}
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto boolean JSONWriter::startArray()
+   Start writing an array */
+PHP_METHOD(jsonwriter, startArray)
+{
+	RETURN_BOOL(jsonwriter_start(jsonwriter_get_object(), 0 TSRMLS_CC) == SUCCESS);
+}
+/* }}} */
+
+/* {{{ proto boolean JSONWriter::startObject()
+   Start writing an object. Each member is written by calling writeKey()
+   followed by writing a value */
+PHP_METHOD(jsonwriter, startObject)
+{
+	RETURN_BOOL(jsonwriter_start(jsonwriter_get_object(), 1 TSRMLS_CC) == SUCCESS);
+}
+/* }}} */
+
+/* {{{ proto boolean JSONWriter::writeKey(string key)
+   Write the key of the next object member */
+PHP_METHOD(jsonwriter, writeKey)
+{
+	jsonwriter_object *intern;
+	char              *key;
+	int                key_len;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &key, &key_len) == FAILURE) {
+		return;
+	}
+
+	intern = jsonwriter_get_object();
+	RETURN_BOOL(jsonwriter_key(intern, key, key_len TSRMLS_CC) == SUCCESS);
+}
+/* }}} */
+
+/* {{{ proto boolean JSONWriter::writeValue(mixed value)
+   Write a value. Arrays with keys 0, 1, 2... are written as JSON arrays,
+   other arrays and objects (their public properties) as JSON objects */
+PHP_METHOD(jsonwriter, writeValue)
+{
+	jsonwriter_object *intern;
+	zval              *value;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &value) == FAILURE) {
+		return;
+	}
+
+	intern = jsonwriter_get_object();
+	RETURN_BOOL(jsonwriter_value(intern, value TSRMLS_CC) == SUCCESS);
+}
+/* }}} */
+
+/* {{{ proto boolean JSONWriter::end()
+   End the current array or object */
+PHP_METHOD(jsonwriter, end)
+{
+	RETURN_BOOL(jsonwriter_end(jsonwriter_get_object() TSRMLS_CC) == SUCCESS);
+}
+/* }}} */
+
+/* {{{ ARG_INFO */
+ZEND_BEGIN_ARG_INFO(arginfo_jsonwriter___construct, 0)
+	ZEND_ARG_INFO(0, attributes)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO(arginfo_jsonwriter_open, 0)
+	ZEND_ARG_INFO(0, URI)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO(arginfo_jsonwriter_none, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_jsonwriter_outputmemory, 0, 0, 0)
+	ZEND_ARG_INFO(0, flush)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO(arginfo_jsonwriter_writekey, 0)
+	ZEND_ARG_INFO(0, key)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO(arginfo_jsonwriter_writevalue, 0)
+	ZEND_ARG_INFO(0, value)
+ZEND_END_ARG_INFO()
+/* }}} */
+
+/* {{{ zend_function_entry jsonwriter_class_methods */
+static const zend_function_entry jsonwriter_class_methods[] = {
+	PHP_ME(jsonwriter, __construct,  arginfo_jsonwriter___construct,  ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+	PHP_ME(jsonwriter, open,         arginfo_jsonwriter_open,         ZEND_ACC_PUBLIC)
+	PHP_ME(jsonwriter, openMemory,   arginfo_jsonwriter_none,         ZEND_ACC_PUBLIC)
+	PHP_ME(jsonwriter, outputMemory, arginfo_jsonwriter_outputmemory, ZEND_ACC_PUBLIC)
+	PHP_ME(jsonwriter, flush,        arginfo_jsonwriter_none,         ZEND_ACC_PUBLIC)
+	PHP_ME(jsonwriter, close,        arginfo_jsonwriter_none,         ZEND_ACC_PUBLIC)
+	PHP_ME(jsonwriter, startArray,   arginfo_jsonwriter_none,         ZEND_ACC_PUBLIC)
+	PHP_ME(jsonwriter, startObject,  arginfo_jsonwriter_none,         ZEND_ACC_PUBLIC)
+	PHP_ME(jsonwriter, writeKey,     arginfo_jsonwriter_writekey,     ZEND_ACC_PUBLIC)
+	PHP_ME(jsonwriter, writeValue,   arginfo_jsonwriter_writevalue,   ZEND_ACC_PUBLIC)
+	PHP_ME(jsonwriter, end,          arginfo_jsonwriter_none,         ZEND_ACC_PUBLIC)
+	{NULL, NULL, NULL}
+};
+/* }}} */
+
+/* {{{ PHP_MINIT_FUNCTION
+   Declare the JSONWriter class, called from the jsonreader MINIT function */
+PHP_MINIT_FUNCTION(jsonwriter)
+{
+	zend_class_entry ce;
+
+	memcpy(&jsonwriter_obj_handlers, zend_get_std_object_handlers(),
+		sizeof(zend_object_handlers));
+	jsonwriter_obj_handlers.clone_obj = NULL;
+
+	INIT_CLASS_ENTRY(ce, "JSONWriter", jsonwriter_class_methods);
+	ce.create_object = jsonwriter_object_new;
+
+	jsonwriter_ce = zend_register_internal_class(&ce TSRMLS_CC);
+
+	JSONWRITER_REG_CLASS_CONST_L("ATTR_MAX_DEPTH",  ATTR_MAX_DEPTH);
+	JSONWRITER_REG_CLASS_CONST_L("ATTR_WRITE_BUFF", ATTR_WRITE_BUFF);
+
+	return SUCCESS;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
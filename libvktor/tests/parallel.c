@@ -0,0 +1,352 @@
+/*
+ * vktor_parse_array() test: parse JSON arrays split into chunks on worker 
+ * threads and compare the tokens of all chunks, in order, to the tokens read
+ * by a single parser using vktor_parse(). 
+ *
+ * Built with VKTOR_PARALLEL_MINCHUNK set to 1, so that even small arrays are
+ * split into as many chunks as requested. Run using "make check".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "vktor.h"
+
+#define MAX_CHUNKS 8
+#define MAX_NEST   64
+
+typedef struct {
+	char *data;
+	long  len;
+	long  size;
+} buf;
+
+static pthread_mutex_t alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+static long            alloc_live = 0;
+static int             failures   = 0;
+
+/* Thread safe allocator counting live allocations */
+
+static void *
+count_malloc(void *ctx, size_t size)
+{
+	pthread_mutex_lock(&alloc_lock);
+	alloc_live++;
+	pthread_mutex_unlock(&alloc_lock);
+	return malloc(size);
+}
+
+static void *
+count_realloc(void *ctx, void *pointer, size_t size)
+{
+	if (pointer == NULL) {
+		return count_malloc(ctx, size);
+	}
+	return realloc(pointer, size);
+}
+
+static void
+count_free(void *ctx, void *pointer)
+{
+	if (pointer == NULL) return;
+	pthread_mutex_lock(&alloc_lock);
+	alloc_live--;
+	pthread_mutex_unlock(&alloc_lock);
+	free(pointer);
+}
+
+static const vktor_allocator count_allocator = {
+	count_malloc, count_realloc, count_free, NULL
+};
+
+static void
+buf_append(buf *b, const char *data, long len)
+{
+	if (b->len + len + 1 > b->size) {
+		b->size = (b->len + len + 1) * 2;
+		b->data = realloc(b->data, b->size);
+	}
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+	b->data[b->len] = '\0';
+}
+
+static void
+buf_appends(buf *b, const char *str)
+{
+	buf_append(b, str, strlen(str));
+}
+
+/* Dump all tokens read by a parser, one per line, leaving out the first and
+ * last ones: the brackets of the top level array */
+static vktor_status
+dump_tokens(vktor_parser *parser, buf *out, vktor_error **error)
+{
+	vktor_status status;
+	vktor_token  type;
+	char        *value, line[64];
+	long         start = -1, last = 0;
+	int          len;
+	
+	while ((status = vktor_parse(parser, error)) == VKTOR_OK) {
+		last = out->len;
+		type = vktor_get_token_type(parser);
+		sprintf(line, "%d %d ", (int) type, vktor_get_depth(parser));
+		buf_appends(out, line);
+		
+		if (type & (VKTOR_T_STRING | VKTOR_T_OBJECT_KEY | VKTOR_T_INT | VKTOR_T_FLOAT)) {
+			if ((len = vktor_get_value_str(parser, &value, error)) < 0) {
+				return VKTOR_ERROR;
+			}
+			buf_append(out, value, len);
+		}
+		buf_appends(out, "\n");
+		
+		if (start < 0) {
+			start = out->len;
+		}
+	}
+	
+	if (status == VKTOR_MORE_DATA) {
+		return VKTOR_ERROR;
+	}
+	
+	if (status == VKTOR_COMPLETE && start >= 0) {
+		memmove(out->data, out->data + start, last - start);
+		out->len = last - start;
+		out->data[out->len] = '\0';
+		return VKTOR_OK;
+	}
+	
+	return status;
+}
+
+static vktor_status
+dump_chunk(void *ctx, vktor_parser *parser, void **result, vktor_error **error)
+{
+	buf out = { NULL, 0, 0 };
+	
+	buf_appends(&out, "");
+	*result = out.data;
+	
+	if (dump_tokens(parser, &out, error) != VKTOR_OK) {
+		*result = out.data;
+		return VKTOR_ERROR;
+	}
+	
+	*result = out.data;
+	return VKTOR_OK;
+}
+
+static void
+check(int ok, const char *what, const char *json, int chunks)
+{
+	if (! ok) {
+		fprintf(stderr, "FAIL: %s (%d chunks): %.200s\n", what, chunks, json);
+		failures++;
+	}
+}
+
+/* Parse an array with every chunk count and compare to a plain parse, 
+ * returning the number of chunks of the last run */
+static int
+test_array(const char *json)
+{
+	vktor_parser *parser;
+	vktor_error  *error = NULL;
+	buf           plain = { NULL, 0, 0 }, joined;
+	void         *results[MAX_CHUNKS];
+	int           chunks, count, i;
+	
+	parser = vktor_parser_init(MAX_NEST);
+	vktor_feed(parser, (char *) json, strlen(json), 0, NULL);
+	buf_appends(&plain, "");
+	if (dump_tokens(parser, &plain, &error) != VKTOR_OK) {
+		check(0, error ? error->message : "plain parse failed", json, 0);
+		vktor_error_free(error);
+		vktor_parser_free(parser);
+		free(plain.data);
+		return -1;
+	}
+	vktor_parser_free(parser);
+	
+	for (chunks = 1; chunks <= MAX_CHUNKS; chunks++) {
+		count = vktor_parse_array(json, strlen(json), chunks, MAX_NEST + 1,
+			&count_allocator, dump_chunk, NULL, results, &error);
+		if (count < 0) {
+			check(0, error ? error->message : "parallel parse failed", json, chunks);
+			vktor_error_free(error);
+			error = NULL;
+		}
+		check(count <= chunks, "too many chunks", json, chunks);
+		
+		joined.data = NULL;
+		joined.len  = 0;
+		joined.size = 0;
+		buf_appends(&joined, "");
+		for (i = 0; i < chunks; i++) {
+			if (results[i] != NULL) {
+				buf_appends(&joined, results[i]);
+				free(results[i]);
+			}
+		}
+		
+		check(count < 0 || strcmp(joined.data, plain.data) == 0, 
+			"tokens differ from plain parse", json, chunks);
+		check(alloc_live == 0, "parser memory leaked", json, chunks);
+		free(joined.data);
+	}
+	
+	free(plain.data);
+	return count;
+}
+
+/* Check that an invalid document fails with any chunk count */
+static void
+test_invalid(const char *json)
+{
+	vktor_error *error = NULL;
+	void        *results[MAX_CHUNKS];
+	int          chunks, count, i;
+	
+	for (chunks = 1; chunks <= MAX_CHUNKS; chunks++) {
+		count = vktor_parse_array(json, strlen(json), chunks, MAX_NEST,
+			&count_allocator, dump_chunk, NULL, results, &error);
+		check(count == -1 && error != NULL, "invalid document accepted", json, chunks);
+		vktor_error_free(error);
+		error = NULL;
+		
+		for (i = 0; i < chunks; i++) {
+			free(results[i]);
+		}
+		check(alloc_live == 0, "parser memory leaked", json, chunks);
+	}
+}
+
+/* Pseudo random JSON generator, with strings full of structural characters */
+
+static unsigned long seed = 1;
+
+static int
+rnd(int n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (int) ((seed >> 16) % n);
+}
+
+static void
+gen_value(buf *out, int depth)
+{
+	static const char *strings[] = {
+		"\"\"", "\"a, b\"", "\"[{\"", "\"}]\"", "\"\\\"\"", "\"\\\\\"", 
+		"\"\\\\\\\"],\"", "\"x\\\\\"", "\"\\u005b\\\"{\"", "\"d\xc3\xa9j\xc3\xa0\""
+	};
+	static const char *scalars[] = {
+		"0", "-12", "3.25e2", "true", "false", "null"
+	};
+	int i, n;
+	
+	switch (depth < 5 ? rnd(4) : 2) {
+		case 0:
+			n = rnd(5);
+			buf_appends(out, "[");
+			for (i = 0; i < n; i++) {
+				if (i) buf_appends(out, rnd(2) ? "," : " ,\n ");
+				gen_value(out, depth + 1);
+			}
+			buf_appends(out, "]");
+			break;
+			
+		case 1:
+			n = rnd(5);
+			buf_appends(out, "{");
+			for (i = 0; i < n; i++) {
+				if (i) buf_appends(out, ", ");
+				buf_appends(out, strings[rnd(10)]);
+				buf_appends(out, ":");
+				gen_value(out, depth + 1);
+			}
+			buf_appends(out, "}");
+			break;
+			
+		case 2:
+			buf_appends(out, strings[rnd(10)]);
+			break;
+			
+		default:
+			buf_appends(out, scalars[rnd(6)]);
+			break;
+	}
+}
+
+int
+main(void)
+{
+	static const char *arrays[] = {
+		"[]", 
+		" [ ] ", 
+		"[1]", 
+		"\n[1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12]\n", 
+		"[\"a,b\", \"c\\\",d\", \"\\\\\", [1, [2, [3]]], {\"x\": [\",\"]}]", 
+		"[{\"a\": 1}, {\"b\": {\"c\": [true, false, null]}}, 1.5e3, \"]\"]", 
+		"[[[[[[[[[[]]]]]]]]]]", 
+		NULL
+	};
+	static const char *invalid[] = {
+		"", 
+		"   ", 
+		"{}", 
+		"[", 
+		"[1, 2", 
+		"[1, 2] x", 
+		"[1, 2] ]", 
+		"[1, 2]]", 
+		"[1,]", 
+		"[,1]", 
+		"[1,,2]", 
+		"[1 2, 3]", 
+		"[\"abc, 1]", 
+		"[1], [2]", 
+		"[{\"a\": 1], 2]", 
+		"[\"a\\\", \"b\"]", 
+		"[1, \\\"2\", 3]", 
+		NULL
+	};
+	buf json;
+	int i;
+	
+	for (i = 0; arrays[i] != NULL; i++) {
+		test_array(arrays[i]);
+	}
+	
+	/* 12 elements of 3 bytes each are split into as many chunks as asked */
+	check(test_array(arrays[3]) == MAX_CHUNKS, "array not split", arrays[3], MAX_CHUNKS);
+	
+	for (i = 0; invalid[i] != NULL; i++) {
+		test_invalid(invalid[i]);
+	}
+	
+	for (i = 0; i < 500; i++) {
+		json.data = NULL;
+		json.len  = 0;
+		json.size = 0;
+		buf_appends(&json, "[");
+		while (rnd(8)) {
+			if (json.len > 1) buf_appends(&json, rnd(2) ? "," : " ,\n");
+			gen_value(&json, 1);
+		}
+		buf_appends(&json, "]");
+		test_array(json.data);
+		free(json.data);
+	}
+	
+	if (failures) {
+		fprintf(stderr, "%d failures\n", failures);
+		return 1;
+	}
+	
+	printf("ok\n");
+	return 0;
+}
@@ -47,10 +47,15 @@
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 #include <assert.h>
+#ifndef VKTOR_NO_THREADS
+#include <pthread.h>
+#endif
 
 #include "vktor.h"
 #include "vktor_unicode.h"
+#include "vktor_scan.h"
 
 /**
  * Maximal error string length (mostly for internal use). 
@@ -65,6 +70,13 @@
 #define VKTOR_STR_MEMCHUNK 128
 #endif
 
+/**
+ * Chunk size used when skipping the rest of a streamed string
+ */
+#ifndef VKTOR_STR_SKIPCHUNK
+#define VKTOR_STR_SKIPCHUNK 8192
+#endif
+
 /**
  * Memory allocation chunk size used when reading numbers
  */
@@ -72,11 +84,66 @@
 #define VKTOR_NUM_MEMCHUNK 32
 #endif
 
+/**
+ * Initial size in bytes of the nesting stack, which holds one bit per level
+ * and grows as needed up to the maximal nesting level
+ */
+#ifndef VKTOR_NEST_MEMCHUNK
+#define VKTOR_NEST_MEMCHUNK 8
+#endif
+
+/**
+ * Minimal size in bytes of the array piece handled by each worker thread of 
+ * vktor_parse_array()
+ */
+#ifndef VKTOR_PARALLEL_MINCHUNK
+#define VKTOR_PARALLEL_MINCHUNK 65536
+#endif
+
+/**
+ * Minimal number of bytes left in a buffer for it to be worth building a 
+ * structural index for
+ */
+#ifndef VKTOR_INDEX_MINSIZE
+#define VKTOR_INDEX_MINSIZE 1024
+#endif
+
+/**
+ * Snapshot format identifier and version, written at the beginning of every 
+ * parser snapshot. The version must be bumped whenever the layout changes. 
+ */
+#define VKTOR_SNAPSHOT_MAGIC   "vkS"
+#define VKTOR_SNAPSHOT_VERSION 5
+
+/**
+ * Number of integer fields in a snapshot header, each stored as 8 bytes
+ */
+#define VKTOR_SNAPSHOT_FIELDS  10
+
+/**
+ * Size of a snapshot header: magic, version byte and integer fields
+ */
+#define VKTOR_SNAPSHOT_HDR_LEN (4 + (8 * VKTOR_SNAPSHOT_FIELDS))
+
+/**
+ * Maximal size of a half-read token accepted when restoring a snapshot, so 
+ * that its scratch memory size still fits in an int
+ */
+#define VKTOR_SNAPSHOT_MAX_TOKEN ((long) (INT_MAX - VKTOR_STR_MEMCHUNK))
+
 /**
  * Convenience macro to check if we are at the end of a buffer
  */
 #define eobuffer(b) (b->ptr >= b->size)
 
+/**
+ * Convenience macros to allocate, reallocate and free memory using the 
+ * allocator of a parser
+ */
+#define pmalloc(p, size)       ((p)->allocator.malloc_fn((p)->allocator.ctx, (size)))
+#define prealloc(p, ptr, size) ((p)->allocator.realloc_fn((p)->allocator.ctx, (ptr), (size)))
+#define pfree(p, ptr)          ((p)->allocator.free_fn((p)->allocator.ctx, (ptr)))
+
 /**
  * Set some macros depending on whether byte counting is enabled or not 
  */
@@ -113,7 +180,7 @@
  * Convenience macro to set an 'unexpected character' error
  */
 #define set_error_unexpected_c(e, c)                                      \
-	set_error(e, VKTOR_ERR_UNEXPECTED_INPUT,                          \
+	set_error(parser, e, VKTOR_ERR_UNEXPECTED_INPUT,                  \
 		LINEINFO "Unexpected character in input: '%c' (0x%02hhx)" \
 		BYTECOUNT_TPL, c, c BYTECOUNT_VAL)
 
@@ -129,17 +196,42 @@
                           VKTOR_T_ARRAY_START  | \
                           VKTOR_T_OBJECT_START
 
+/**
+ * Number of bytes needed for a nesting stack holding levels up to n
+ */
+#define nest_stack_bytes(n) (((n) >> 3) + 1)
+
+/**
+ * Get the struct type of nesting level l from the nesting stack bits, in 
+ * which a set bit marks an object and a clear bit marks an array
+ */
+#define nest_stack_get(p, l)                                        \
+	((p->nest_stack[(l) >> 3] & (1 << ((l) & 7))) ?             \
+		VKTOR_STRUCT_OBJECT : VKTOR_STRUCT_ARRAY)
+
 /**
  * Convenience macro to check if we are in a specific type of JSON struct
  */
-#define nest_stack_in(p, c) (p->nest_stack[p->nest_ptr] == c)
+#define nest_stack_in(p, c) (p->nest_current == c)
+
+/**
+ * Mark the current buffer position as the start of a new token, so that its
+ * raw text can be returned by vktor_get_token_raw(). While capturing, raw 
+ * input is tracked from the capture start instead.
+ */
+#define mark_token_start(p)                          \
+	if (p->capture_fn == NULL) {                 \
+		p->raw_start = p->buffer->ptr;       \
+		p->raw_end   = -1;                   \
+		p->raw_len   = 0;                    \
+	}
 
 /**
  * Convenience macro to easily set the expected next token map after a value
  * token, taking current struct struct (if any) into account.
  */
 #define expect_next_value_token(p)                        \
-	switch(p->nest_stack[p->nest_ptr]) {              \
+	switch(p->nest_current) {                         \
 		case VKTOR_STRUCT_OBJECT:                 \
 			p->expected = VKTOR_C_COMMA |     \
 			              VKTOR_T_OBJECT_END; \
@@ -161,13 +253,38 @@
  */
 #define check_reallocate_token_memory(cs)                                              \
 	if ((ptr + 5) >= maxlen) {                                                     \
+		if (parser_check_token_size(parser, ptr, error) == VKTOR_ERROR) {      \
+			return VKTOR_ERROR;                                            \
+		}                                                                      \
 		maxlen = maxlen + cs;                                                  \
-		if ((token = vrealloc(token, maxlen * sizeof(char))) == NULL) {         \
-			set_error(error, VKTOR_ERR_OUT_OF_MEMORY,                      \
+		if ((token = prealloc(parser, token, maxlen * sizeof(char))) == NULL) { \
+			set_error(parser, error, VKTOR_ERR_OUT_OF_MEMORY,              \
 				"unable to allocate %d more bytes for string parsing"  \
 				LINEINFO, cs);                                         \
 			return VKTOR_ERROR;                                            \
 		}                                                                      \
+		parser->scratch      = token;                                          \
+		parser->scratch_size = maxlen;                                         \
+	}
+
+/**
+ * Convenience macro to make sure there is room for n more bytes in the token 
+ * being read, reallocating token memory if needed 
+ */
+#define ensure_token_memory(n, cs)                                                     \
+	if ((ptr + (n) + 5) >= maxlen) {                                               \
+		if (parser_check_token_size(parser, ptr + (n), error) == VKTOR_ERROR) { \
+			return VKTOR_ERROR;                                            \
+		}                                                                      \
+		maxlen = ptr + (n) + cs;                                               \
+		if ((token = prealloc(parser, token, maxlen * sizeof(char))) == NULL) { \
+			set_error(parser, error, VKTOR_ERR_OUT_OF_MEMORY,              \
+				"unable to allocate %ld more bytes for string parsing" \
+				LINEINFO, (long) (n) + cs);                            \
+			return VKTOR_ERROR;                                            \
+		}                                                                      \
+		parser->scratch      = token;                                          \
+		parser->scratch_size = maxlen;                                         \
 	}
 
 /**
@@ -186,6 +303,9 @@ typedef struct _vktor_buffer_struct {
 	long                         size;      /**< buffer size */
 	long                         ptr;       /**< internal buffer position */
 	char                         free;      /**< free the bffer when done */
+	char                         indexed;   /**< structural index was tried */
+	uint64_t                    *index;     /**< structural index, or NULL */
+	long                         index_start; /**< first indexed position */
 	struct _vktor_buffer_struct *next_buff;	/**< pointer to the next buffer */
 } vktor_buffer;
 
@@ -200,11 +320,45 @@ struct _vktor_parser_struct {
 	void           *token_value;  /**< current token value, if any */
 	int             token_size;   /**< current token value length, if any */
 	char            token_resume; /**< current token is only half read */  
+	char            token_lazy;   /**< current string is not decoded yet */
+	char            token_escaped;/**< lazy string has escape sequences */
+	char            lazy_strings; /**< only decode strings on demand */
+	char            stream_strings; /**< return string values in chunks */
+	char            structural_index; /**< index buffers when skipping */
+	char            str_open;     /**< streamed string not read to its end */
+	char            str_started;  /**< streamed string was partly read */
+	long            str_chunk;    /**< maximal length of the chunk being read */
+	long            max_token;    /**< maximal token size, 0 for no limit */
 	long            expected;     /**< bitmask of possible expected tokens */
-	vktor_struct   *nest_stack;   /**< array holding current nesting stack */
+	unsigned char  *nest_stack;   /**< nesting stack, one bit per level */
 	int             nest_ptr;     /**< pointer to the current nesting level */
 	int             max_nest;     /**< maximal nesting level */
+	int             nest_size;    /**< allocated bytes of the nesting stack */
+	vktor_struct    nest_current; /**< struct type of the current level */
 	unsigned long   unicode_c;    /**< temp container for unicode characters */
+	long            offset;       /**< absolute offset of the current buffer */
+	vktor_utf8_mode utf8_mode;    /**< UTF-8 validation mode */
+	unsigned char   utf8_need;    /**< continuation bytes still expected */
+	unsigned char   utf8_len;     /**< bytes of current sequence read so far */
+	unsigned char   utf8_lo;      /**< lowest valid next continuation byte */
+	unsigned char   utf8_hi;      /**< highest valid next continuation byte */
+	vktor_encoding  encoding;     /**< input encoding, or auto if not known */
+	long            token_mask;   /**< token types returned by vktor_parse() */
+	long            skip_depth;   /**< nesting depth of a struct being skipped */
+	unsigned char   skip_string;  /**< skipping a string (1) or escape (2) */
+	unsigned char   enc_carry[4]; /**< partial code unit of last buffer */
+	unsigned char   enc_carry_len;/**< length of partial code unit */
+	unsigned long   enc_high;     /**< pending UTF-16 high surrogate */
+	char           *scratch;      /**< memory for reading tokens, reused */
+	int             scratch_size; /**< size of the scratch memory */
+	long            raw_start;    /**< raw token or capture start in buffer */
+	long            raw_end;      /**< end of a finished token in buffer, or -1 */
+	char           *raw;          /**< raw token text from previous buffers */
+	long            raw_len;      /**< length of the raw token text */
+	long            raw_size;     /**< size of the raw token text memory */
+	vktor_raw_handler capture_fn; /**< captured input handler, if capturing */
+	void           *capture_ctx;  /**< context passed to the capture handler */
+	vktor_allocator allocator;    /**< allocator managing parser memory */
 #ifdef BYTECOUNTER
 	/** Total bytes parsed counter, only enabled if BYTECOUNTER is defined **/
 	unsigned long   bytecounter;  
@@ -229,28 +383,172 @@ typedef enum {
 	VKTOR_C_UNIC3   = 1 << 24, /**< Unicode encoded character (3rd byte) */
 	VKTOR_C_UNIC4   = 1 << 25, /**< Unicode encoded character (4th byte) */
 	VKTOR_C_UNIC_LS = 1 << 26, /**< Unicode low surrogate */
+	VKTOR_C_WS      = 1 << 27, /**< Whitespace, which is always accepted */
 } vktor_specialchar;
 
+/**
+ * @enum vktor_charclass
+ * 
+ * Character classes used by vktor_parse() to dispatch on the first 
+ * character of a token. 
+ */
+typedef enum {
+	VKTOR_CC_INVALID,      /**< not valid outside of strings */
+	VKTOR_CC_WS,           /**< whitespace */
+	VKTOR_CC_OBJECT_START, /**< "{" */
+	VKTOR_CC_OBJECT_END,   /**< "}" */
+	VKTOR_CC_ARRAY_START,  /**< "[" */
+	VKTOR_CC_ARRAY_END,    /**< "]" */
+	VKTOR_CC_QUOTE,        /**< '"', starting a string or object key */
+	VKTOR_CC_COMMA,        /**< "," */
+	VKTOR_CC_COLON,        /**< ":" */
+	VKTOR_CC_TRUE,         /**< "t", starting true */
+	VKTOR_CC_FALSE,        /**< "f", starting false */
+	VKTOR_CC_NULL,         /**< "n", starting null */
+	VKTOR_CC_NUMBER,       /**< digit or sign, starting a number */
+	VKTOR_CC_COUNT         /**< number of character classes */
+} vktor_charclass;
+
+/**
+ * Character class (vktor_charclass) of each byte 
+ */
+static const unsigned char char_classes[256] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  1,  1,  1,  0,  0, // 0x00
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0x10
+	 1,  0,  6,  0,  0,  0,  0,  0,  0,  0,  0, 12,  7, 12,  0,  0, // 0x20
+	12, 12, 12, 12, 12, 12, 12, 12, 12, 12,  8,  0,  0,  0,  0,  0, // 0x30
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0x40
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  4,  0,  5,  0,  0, // 0x50
+	 0,  0,  0,  0,  0,  0, 10,  0,  0,  0,  0,  0,  0,  0, 11,  0, // 0x60
+	 0,  0,  0,  0,  9,  0,  0,  0,  0,  0,  0,  2,  0,  3,  0,  0, // 0x70
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0x80
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0x90
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0xa0
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0xb0
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0xc0
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0xd0
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0xe0
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0  // 0xf0
+};
+
+/**
+ * Expected token or special character map of each character class - a 
+ * character is only accepted if the parser expects one of these. Whitespace
+ * is accepted in any state, so VKTOR_C_WS is always added to the expected 
+ * map before checking.
+ */
+static const long class_expected[VKTOR_CC_COUNT] = {
+	0,                                   // VKTOR_CC_INVALID
+	VKTOR_C_WS,                          // VKTOR_CC_WS
+	VKTOR_T_OBJECT_START,                // VKTOR_CC_OBJECT_START
+	VKTOR_T_OBJECT_END,                  // VKTOR_CC_OBJECT_END
+	VKTOR_T_ARRAY_START,                 // VKTOR_CC_ARRAY_START
+	VKTOR_T_ARRAY_END,                   // VKTOR_CC_ARRAY_END
+	VKTOR_T_STRING | VKTOR_T_OBJECT_KEY, // VKTOR_CC_QUOTE
+	VKTOR_C_COMMA,                       // VKTOR_CC_COMMA
+	VKTOR_C_COLON,                       // VKTOR_CC_COLON
+	VKTOR_T_TRUE,                        // VKTOR_CC_TRUE
+	VKTOR_T_FALSE,                       // VKTOR_CC_FALSE
+	VKTOR_T_NULL,                        // VKTOR_CC_NULL
+	VKTOR_T_INT | VKTOR_T_FLOAT          // VKTOR_CC_NUMBER
+};
+
+/**
+ * Expected token map after a comma, by the type of the containing struct 
+ */
+static const long comma_next_expected[] = {
+	0,                  // VKTOR_STRUCT_NONE
+	VKTOR_VALUE_TOKEN,  // VKTOR_STRUCT_ARRAY
+	VKTOR_T_OBJECT_KEY  // VKTOR_STRUCT_OBJECT
+};
+
+/**
+ * Expected token map after the end of an array or object, by whether the 
+ * new nesting level is the top level (0) or not (1)
+ */
+static const long end_next_expected[] = {
+	VKTOR_T_NONE,
+	VKTOR_C_COMMA | VKTOR_T_OBJECT_END | VKTOR_T_ARRAY_END
+};
+
+/**
+ * Use computed goto to dispatch on character classes where supported, and 
+ * a switch statement otherwise. Handlers must end with goto next_char. 
+ */
+#if defined(__GNUC__) && ! defined(VKTOR_NO_COMPUTED_GOTO)
+#define VKTOR_COMPUTED_GOTO 1
+#define dispatch_char_class(cc) goto *class_labels[cc];
+#define char_class_handler(cc)  label_ ## cc
+#else
+#define dispatch_char_class(cc) switch (cc)
+#define char_class_handler(cc)  case cc
+#endif
+
 static vktor_malloc  vmalloc  = malloc;
 static vktor_free    vfree    = free;
 static vktor_realloc vrealloc = realloc;
 
+/**
+ * @brief malloc of the default allocator, using the global memory handlers
+ */
+static void *
+default_malloc(void *ctx, size_t size)
+{
+	return vmalloc(size);
+}
+
+/**
+ * @brief realloc of the default allocator, using the global memory handlers
+ */
+static void *
+default_realloc(void *ctx, void *pointer, size_t size)
+{
+	return vrealloc(pointer, size);
+}
+
+/**
+ * @brief free of the default allocator, using the global memory handlers
+ */
+static void
+default_free(void *ctx, void *pointer)
+{
+	vfree(pointer);
+}
+
+/**
+ * Default allocator, used by parsers created without an allocator and for 
+ * errors not related to a parser
+ */
+static const vktor_allocator default_allocator = {
+	default_malloc, 
+	default_realloc, 
+	default_free, 
+	NULL
+};
+
 /**
  * @brief Free a vktor_buffer struct
  * 
  * Free a vktor_buffer struct without following any next buffers in the chain. 
- * Call buffer_free_all() to free an entire chain of buffers.
+ * The buffer text is only freed if the buffer owns it. Call buffer_free_all() 
+ * to free an entire chain of buffers.
  * 
+ * @param[in]    parser the parser owning the buffer
  * @param[in,out] buffer the buffer to free
  */
 static void 
-buffer_free(vktor_buffer *buffer)
+buffer_free(vktor_parser *parser, vktor_buffer *buffer)
 {
 	assert(buffer != NULL);
 	assert(buffer->text != NULL);
 	
-	vfree(buffer->text);
-	vfree(buffer);
+	if (buffer->free) {
+		pfree(parser, buffer->text);
+	}
+	if (buffer->index != NULL) {
+		pfree(parser, buffer->index);
+	}
+	pfree(parser, buffer);
 }
 
 /**
@@ -259,18 +557,17 @@ buffer_free(vktor_buffer *buffer)
  * Free an entire linked list of vktor buffers. Will usually be called by 
  * vktor_parser_free() to free all buffers attached to a parser. 
  * 
+ * @param[in]    parser the parser owning the buffers
  * @param[in,out] buffer the first buffer in the list to free
  */
 static void 
-buffer_free_all(vktor_buffer *buffer)
+buffer_free_all(vktor_parser *parser, vktor_buffer *buffer)
 {
 	vktor_buffer *next;
 	
 	while (buffer != NULL) {
 		next = buffer->next_buff;
-		if (buffer->free) {
-			buffer_free(buffer);
-		}
+		buffer_free(parser, buffer);
 		buffer = next;
 	}
 }
@@ -286,25 +583,31 @@ buffer_free_all(vktor_buffer *buffer)
  * 
  * Used internally to pass error messages back to the user. 
  * 
+ * @param [in]     parser parser to use the allocator of, or NULL to use the
+ *                        default allocator
  * @param [in,out] eptr error struct pointer-pointer to populate or NULL
  * @param [in]     code error code
  * @param [in]     msg  error message (sprintf-style format)
  */
 static void 
-set_error(vktor_error **eptr, vktor_errcode code, const char *msg, ...)
+set_error(vktor_parser *parser, vktor_error **eptr, vktor_errcode code, 
+	const char *msg, ...)
 {
-	vktor_error *err;
+	const vktor_allocator *allocator;
+	vktor_error           *err;
 	
 	if (eptr == NULL) {
 		return;
 	}
 	
-	if ((err = vmalloc(sizeof(vktor_error))) == NULL) {
+	allocator = (parser == NULL ? &default_allocator : &parser->allocator);
+	if ((err = allocator->malloc_fn(allocator->ctx, sizeof(vktor_error))) == NULL) {
 		return;
 	}
 	
-	err->code = code;
-	err->message = vmalloc(VKTOR_MAX_E_LEN * sizeof(char));
+	err->code      = code;
+	err->allocator = *allocator;
+	err->message   = allocator->malloc_fn(allocator->ctx, VKTOR_MAX_E_LEN * sizeof(char));
 	if (err->message != NULL) {
 		va_list ap;
 		      
@@ -328,11 +631,11 @@ set_error(vktor_error **eptr, vktor_errcode code, const char *msg, ...)
  * @return A newly-allocated buffer struct
  */
 static vktor_buffer*
-buffer_init(char *text, long text_len, char free)
+buffer_init(vktor_parser *parser, char *text, long text_len, char free)
 {
 	vktor_buffer *buffer;
 	
-	if ((buffer = vmalloc(sizeof(vktor_buffer))) == NULL) {
+	if ((buffer = pmalloc(parser, sizeof(vktor_buffer))) == NULL) {
 		return NULL;
 	}
 	
@@ -340,11 +643,81 @@ buffer_init(char *text, long text_len, char free)
 	buffer->size      = text_len;
 	buffer->ptr       = 0;
 	buffer->free      = free;
+	buffer->indexed   = 0;
+	buffer->index     = NULL;
 	buffer->next_buff = NULL;
 	
 	return buffer;
 }
 
+/**
+ * @brief Build the structural index of the current buffer
+ * 
+ * Index the rest of the current buffer using vktor_scan_index(), if the 
+ * structural index is enabled and the buffer was not tried yet. Called when 
+ * a struct is skipped, where walking the index pays off the most, and must 
+ * not be called inside a string. Once built, the index is also used to find
+ * the end of strings and whitespace for the rest of the buffer. Buffers 
+ * which are too short, can not be indexed or can not be allocated an index 
+ * are simply parsed without one.
+ * 
+ * @param [in,out] parser Parser object
+ */
+static void
+parser_index_buffer(vktor_parser *parser)
+{
+	vktor_buffer *buffer = parser->buffer;
+	long          len;
+	
+	if (! parser->structural_index || buffer->indexed) {
+		return;
+	}
+	
+	buffer->indexed = 1;
+	len = buffer->size - buffer->ptr;
+	if (len < VKTOR_INDEX_MINSIZE) {
+		return;
+	}
+	
+	if ((buffer->index = pmalloc(parser, ((len + 63) / 64) * sizeof(uint64_t))) == NULL) {
+		return;
+	}
+	
+	if (vktor_scan_index(buffer->text + buffer->ptr, len, buffer->index) != 0) {
+		pfree(parser, buffer->index);
+		buffer->index = NULL;
+		return;
+	}
+	
+	buffer->index_start = buffer->ptr;
+}
+
+/**
+ * Whether the structural index of a buffer covers its current position
+ */
+#define buffer_has_index(b) ((b)->index != NULL && (b)->ptr >= (b)->index_start)
+
+/**
+ * @brief Find the next byte marked in the structural index of a buffer
+ * 
+ * Only to be used if buffer_has_index() is true. Inside strings, this is 
+ * where vktor_scan_string() stops, as long as the buffer position is not on
+ * an escaped character. Outside of them, it is the first byte of anything 
+ * but whitespace.
+ * 
+ * @param [in] buffer Buffer to look in
+ * @param [in] len    Maximal number of bytes to look at
+ * 
+ * @return Number of bytes from the buffer position to the next marked byte, 
+ *         or len if there is none
+ */
+static long
+buffer_next_mark(vktor_buffer *buffer, long len)
+{
+	return vktor_index_next(buffer->index, buffer->ptr - buffer->index_start, 
+		buffer->ptr - buffer->index_start + len) - (buffer->ptr - buffer->index_start);
+}
+
 /**
  * @brief Advance the parser to the next buffer
  * 
@@ -364,10 +737,20 @@ parser_advance_buffer(vktor_parser *parser)
 	assert(parser->buffer != NULL);
 	assert(eobuffer(parser->buffer));
 	
-	next = parser->buffer->next_buff;
-	if (parser->buffer->free) {
-		buffer_free(parser->buffer);
+	// Pass the rest of the buffer on before it is freed, when capturing
+	if (parser->capture_fn != NULL && parser->raw_start < parser->buffer->size) {
+		parser->capture_fn(parser->capture_ctx, 
+			parser->buffer->text + parser->raw_start, 
+			parser->buffer->size - parser->raw_start);
 	}
+	parser->raw_start = 0;
+	if (parser->raw_end >= 0) {
+		parser->raw_end = 0;
+	}
+	
+	next = parser->buffer->next_buff;
+	parser->offset += parser->buffer->size;
+	buffer_free(parser, parser->buffer);
 	parser->buffer = next;
 	
 	if (parser->buffer == NULL) {
@@ -375,13 +758,127 @@ parser_advance_buffer(vktor_parser *parser)
 	}
 }
 
+/**
+ * @brief Check the size of the token being read
+ * 
+ * Check a token size against the VKTOR_OPT_MAX_TOKEN_SIZE option. Called as 
+ * token memory grows and when tokens are complete, so that oversized tokens 
+ * are an error before using up memory. Chunks of streamed strings are 
+ * bounded by the chunk size instead, and are not checked.
+ * 
+ * @param [in]  parser Parser object
+ * @param [in]  size   Size of the token read so far
+ * @param [out] error  Error object pointer pointer or NULL
+ * 
+ * @return Status code - VKTOR_OK or VKTOR_ERROR
+ */
+static vktor_status
+parser_check_token_size(vktor_parser *parser, long size, vktor_error **error)
+{
+	if (parser->max_token > 0 && size > parser->max_token && ! parser->str_open) {
+		set_error(parser, error, VKTOR_ERR_TOKEN_TOO_LARGE, 
+			"token is larger than the maximal token size of %ld bytes" 
+			BYTECOUNT_TPL, parser->max_token BYTECOUNT_VAL);
+		return VKTOR_ERROR;
+	}
+	
+	return VKTOR_OK;
+}
+
+/**
+ * @brief Keep the raw text of a token spanning buffers
+ * 
+ * Called before advancing to the next buffer in the middle of a token, or 
+ * after a token when no other token started in its buffer, to copy the part of
+ * the token in the current buffer to the raw token memory, from which 
+ * vktor_get_token_raw() can return it after the buffer is freed. Does 
+ * nothing when capturing, as the handler gets the input instead, or when 
+ * reading a streamed string, which is never kept as a whole.
+ * 
+ * @param [in,out] parser Parser object
+ * @param [out]    error  Error object pointer pointer or NULL
+ * 
+ * @return Status code - VKTOR_OK or VKTOR_ERROR
+ */
+static vktor_status
+parser_keep_token_raw(vktor_parser *parser, vktor_error **error)
+{
+	long  len, size, end;
+	char *raw;
+	
+	if (parser->capture_fn != NULL || parser->str_open || parser->buffer == NULL) {
+		return VKTOR_OK;
+	}
+	
+	end = (parser->raw_end >= 0 ? parser->raw_end : parser->buffer->ptr);
+	if (parser->raw_start >= end) {
+		return VKTOR_OK;
+	}
+	
+	// The raw text of strings includes the quotes
+	len = end - parser->raw_start;
+	if (parser_check_token_size(parser, parser->raw_len + len - 2, error) == VKTOR_ERROR) {
+		return VKTOR_ERROR;
+	}
+	
+	if (parser->raw_len + len > parser->raw_size) {
+		size = (parser->raw_size > 0 ? parser->raw_size : VKTOR_STR_MEMCHUNK);
+		while (size < parser->raw_len + len) {
+			size = size * 2;
+		}
+		if ((raw = prealloc(parser, parser->raw, size)) == NULL) {
+			set_error(parser, error, VKTOR_ERR_OUT_OF_MEMORY, 
+				"unable to allocate %ld bytes for raw token text", size);
+			return VKTOR_ERROR;
+		}
+		parser->raw      = raw;
+		parser->raw_size = size;
+	}
+	
+	memcpy(parser->raw + parser->raw_len, 
+		parser->buffer->text + parser->raw_start, len);
+	parser->raw_len  += len;
+	parser->raw_start = end;
+	
+	return VKTOR_OK;
+}
+
+/**
+ * @brief Get scratch memory for reading a token
+ * 
+ * Tokens are read into scratch memory owned by the parser, which is reused 
+ * for all tokens and only grows to the size of the largest token, instead of
+ * allocating memory for each token. Makes sure the scratch memory is at least
+ * size bytes long, preserving its content.
+ * 
+ * @param [in,out] parser Parser object
+ * @param [in]     size   Minimal size required
+ * 
+ * @return Scratch memory pointer, or NULL if memory can't be allocated
+ */
+static char *
+parser_scratch(vktor_parser *parser, int size)
+{
+	char *scratch;
+	
+	if (size > parser->scratch_size) {
+		if ((scratch = prealloc(parser, parser->scratch, sizeof(char) * size)) == NULL) {
+			return NULL;
+		}
+		parser->scratch      = scratch;
+		parser->scratch_size = size;
+	}
+	
+	return parser->scratch;
+}
+
 /**
  * @brief Set the current token just read by the parser
  * 
  * Set the current token just read by the parser. Called when a token is 
  * encountered, before returning from vktor_parse(). The user can then access
- * the token information. Will also take care of freeing any previous token
- * held by the parser.
+ * the token information. Token values are held in the parser's scratch 
+ * memory, so there is nothing to free.
  * 
  * @param [in,out] parser Parser object
  * @param [in]     token  New token type
@@ -390,11 +887,48 @@ parser_advance_buffer(vktor_parser *parser)
 static void
 parser_set_token(vktor_parser *parser, vktor_token token, void *value)
 {
-	parser->token_type = token;
-	if (parser->token_value != NULL) {
-		vfree(parser->token_value);
-	}
+	parser->token_type  = token;
 	parser->token_value = value;
+	parser->token_lazy  = 0;
+}
+
+/**
+ * @brief Grow the nesting stack to hold a specific nesting level
+ * 
+ * Grow the nesting stack memory so that it can hold at least the given 
+ * nesting level. The stack is grown by doubling its size, but is never made
+ * larger than needed for the maximal nesting level. 
+ * 
+ * @param [in,out] parser Parser object
+ * @param [in]     level  Nesting level that must fit in the stack
+ * @param [out]    error  an error struct pointer pointer or NULL
+ * 
+ * @return Status code - VKTOR_OK or VKTOR_ERROR
+ */
+static vktor_status
+nest_stack_grow(vktor_parser *parser, int level, vktor_error **error)
+{
+	unsigned char *stack;
+	int            size;
+	
+	size = parser->nest_size * 2;
+	if (size < nest_stack_bytes(level)) {
+		size = nest_stack_bytes(level);
+	}
+	if (size > nest_stack_bytes(parser->max_nest)) {
+		size = nest_stack_bytes(parser->max_nest);
+	}
+	
+	if ((stack = prealloc(parser, parser->nest_stack, size)) == NULL) {
+		set_error(parser, error, VKTOR_ERR_OUT_OF_MEMORY, 
+			"unable to allocate %d bytes for nesting stack", size);
+		return VKTOR_ERROR;
+	}
+	
+	parser->nest_stack = stack;
+	parser->nest_size  = size;
+	
+	return VKTOR_OK;
 }
 
 /**
@@ -414,16 +948,30 @@ static vktor_status
 nest_stack_add(vktor_parser *parser, vktor_struct nest_type, 
 	vktor_error **error)
 {
+	int level;
+	
 	assert(parser != NULL);
 	
-	parser->nest_ptr++;
-	if (parser->nest_ptr >= parser->max_nest) {
-		set_error(error, VKTOR_ERR_MAX_NEST, 
+	level = parser->nest_ptr + 1;
+	if (level >= parser->max_nest) {
+		set_error(parser, error, VKTOR_ERR_MAX_NEST, 
 			"maximal nesting level of %d reached", parser->max_nest);
 		return VKTOR_ERROR;
 	}
 	
-	parser->nest_stack[parser->nest_ptr] = nest_type;
+	if ((level >> 3) >= parser->nest_size && 
+	    nest_stack_grow(parser, level, error) == VKTOR_ERROR) {
+		return VKTOR_ERROR;
+	}
+	
+	if (nest_type == VKTOR_STRUCT_OBJECT) {
+		parser->nest_stack[level >> 3] |= (1 << (level & 7));
+	} else {
+		parser->nest_stack[level >> 3] &= ~(1 << (level & 7));
+	}
+	
+	parser->nest_ptr     = level;
+	parser->nest_current = nest_type;
 	
 	return VKTOR_OK;
 }
@@ -443,75 +991,465 @@ static vktor_status
 nest_stack_pop(vktor_parser *parser, vktor_error **error)
 {
 	assert(parser != NULL);
-	assert(parser->nest_stack[parser->nest_ptr]);
+	assert(parser->nest_current != VKTOR_STRUCT_NONE);
 	
 	parser->nest_ptr--;
 	if (parser->nest_ptr < 0) {
-		set_error(error, VKTOR_ERR_INTERNAL_ERR, 
+		set_error(parser, error, VKTOR_ERR_INTERNAL_ERR, 
 			"internal parser error: nesting stack pointer underflow");
 		return VKTOR_ERROR;
 	}
 	
+	if (parser->nest_ptr == 0) {
+		parser->nest_current = VKTOR_STRUCT_NONE;
+	} else {
+		parser->nest_current = nest_stack_get(parser, parser->nest_ptr);
+	}
+	
 	return VKTOR_OK;
 }
 
 /**
- * @brief Read a string token
+ * @brief Decode a complete escaped Unicode sequence at once
  * 
- * Read a string token until the ending double-quote. Will decode any special
- * escaped characters found along the way, and will gracefully handle buffer 
- * replacement. 
+ * Called when reading the 'u' of an escaped Unicode sequence. If all 4 hex
+ * digits - and for a high surrogate, the complete escaped low surrogate 
+ * following it - are in the current buffer, decode them at once, add the 
+ * UTF-8 encoded character to the token and advance the buffer to the last 
+ * hex digit. 
  * 
- * Used by parser_read_string_token() and parser_read_objkey_token()
+ * Otherwise, or if the sequence is invalid, nothing is done, and the 
+ * sequence is read one character at a time, which also takes care of 
+ * reporting errors.
  * 
  * @param [in,out] parser Parser object
- * @param [out]    error  Error object pointer pointer or NULL
- * 
- * @return Status code
+ * @param [in,out] token  Token being read, with room for 4 more bytes
+ * @param [in,out] ptr    Token length
  * 
- * @todo Handle control characters and unicode 
- * @todo Handle quoted special characters 
+ * @return 1 if the sequence was decoded, 0 otherwise
  */
-static vktor_status
-parser_read_string(vktor_parser *parser, vktor_error **error)
+static int
+parser_read_unicode_escape(vktor_parser *parser, char *token, int *ptr)
 {
-	char           c;
-	char          *token;
-	int            ptr, maxlen;
-	int            done = 0;
-	
-	assert(parser != NULL);
+	const char    *hex   = parser->buffer->text + parser->buffer->ptr + 1;
+	long           avail = parser->buffer->size - parser->buffer->ptr - 1;
+	long           cp, low;
+	unsigned char  utf8[5];
+	short          l, i;
 	
-	// Allocate memory for reading the string
+	if (avail < 4 || (cp = vktor_unicode_hex4_to_int(hex)) < 0) {
+		return 0;
+	}
 	
-	if (parser->token_resume) {
-		ptr = parser->token_size;
-		if (ptr < VKTOR_STR_MEMCHUNK) {
-			maxlen = VKTOR_STR_MEMCHUNK;
-			token = (void *) parser->token_value;
-			assert(token != NULL);
-		} else {
-			maxlen = ptr + VKTOR_STR_MEMCHUNK;
-			token = vrealloc(parser->token_value, sizeof(char) * maxlen);
-		}	
+	if (VKTOR_UNICODE_HIGH_SURROGATE(cp)) {
+		if (avail < 10 || hex[4] != '\\' || hex[5] != 'u') {
+			return 0;
+		}
+		
+		low = vktor_unicode_hex4_to_int(hex + 6);
+		if (! VKTOR_UNICODE_LOW_SURROGATE(low)) {
+			return 0;
+		}
+		
+		l = vktor_unicode_sp_to_utf8((unsigned short) cp, (unsigned short) low, utf8);
+		avail = 10;
 		
 	} else {
-		token  = vmalloc(VKTOR_STR_MEMCHUNK * sizeof(char));
-		maxlen = VKTOR_STR_MEMCHUNK;
-		ptr    = 0;
+		l = vktor_unicode_cp_to_utf8((unsigned short) cp, utf8);
+		avail = 4;
 	}
 	
-	if (token == NULL) {
-		set_error(error, VKTOR_ERR_OUT_OF_MEMORY, 
-			"unable to allocate %d bytes for string parsing", 
-			VKTOR_STR_MEMCHUNK);
-		return VKTOR_ERROR;
+	if (l == 0) {
+		return 0;
+	}
+	
+	for (i = 0; i < l; i++) {
+		token[(*ptr)++] = utf8[i];
+	}
+	
+	parser->buffer->ptr += avail;
+#ifdef BYTECOUNTER
+	parser->bytecounter += avail;
+#endif
+	
+	return 1;
+}
+
+/**
+ * @brief Handle an invalid UTF-8 sequence in a string
+ * 
+ * Depending on the UTF-8 validation mode, either set an error or replace the
+ * part of the invalid sequence already added to the token with U+FFFD.
+ * 
+ * @param [in,out] parser Parser object
+ * @param [in,out] token  Token being read, with room for 3 more bytes
+ * @param [in,out] ptr    Token length
+ * @param [out]    error  Error object pointer pointer or NULL
+ * 
+ * @return Status code - VKTOR_OK or VKTOR_ERROR
+ */
+static vktor_status
+parser_utf8_invalid(vktor_parser *parser, char *token, int *ptr, 
+	vktor_error **error)
+{
+	if (parser->utf8_mode == VKTOR_UTF8_REJECT) {
+		set_error(parser, error, VKTOR_ERR_INVALID_UTF8, 
+			LINEINFO "Invalid UTF-8 sequence in string" BYTECOUNT_TPL 
+			BYTECOUNT_VAL);
+		return VKTOR_ERROR;
+	}
+	
+	*ptr -= parser->utf8_len;
+	token[(*ptr)++] = (char) 0xef;
+	token[(*ptr)++] = (char) 0xbf;
+	token[(*ptr)++] = (char) 0xbd;
+	
+	parser->utf8_need = 0;
+	parser->utf8_len  = 0;
+	
+	return VKTOR_OK;
+}
+
+/**
+ * @brief Validate a string byte as part of a UTF-8 sequence
+ * 
+ * Validate a string byte which is either non-ASCII or comes after the lead
+ * byte of a multi-byte UTF-8 sequence, and add it to the token. Tracks the 
+ * sequence state in the parser so that sequences can span buffers. Overlong 
+ * forms, surrogates and code points above U+10FFFF are invalid.
+ * 
+ * @param [in,out] parser Parser object
+ * @param [in]     c      Byte to validate
+ * @param [in,out] token  Token being read, with room for 3 more bytes
+ * @param [in,out] ptr    Token length
+ * @param [out]    error  Error object pointer pointer or NULL
+ * 
+ * @return 1 if the byte was consumed, 0 if it is an ASCII byte which should 
+ *         be handled as usual, 2 if it cut a sequence short which was replaced
+ *         and should be handled again, -1 on error
+ */
+static int
+parser_utf8_byte(vktor_parser *parser, unsigned char c, char *token, int *ptr,
+	vktor_error **error)
+{
+	if (parser->utf8_need > 0) {
+		if (c >= parser->utf8_lo && c <= parser->utf8_hi) {
+			token[(*ptr)++] = (char) c;
+			parser->utf8_need--;
+			parser->utf8_len++;
+			parser->utf8_lo = 0x80;
+			parser->utf8_hi = 0xbf;
+			return 1;
+		}
+		
+		// Sequence was cut short - handle it, and let c be handled again
+		// on its own
+		if (parser_utf8_invalid(parser, token, ptr, error) == VKTOR_ERROR) {
+			return -1;
+		}
+		return 2;
+	}
+	
+	if (c < 0x80) {
+		return 0;
+	}
+	
+	parser->utf8_lo = 0x80;
+	parser->utf8_hi = 0xbf;
+	
+	if (c >= 0xc2 && c <= 0xdf) {
+		parser->utf8_need = 1;
+		
+	} else if (c >= 0xe0 && c <= 0xef) {
+		parser->utf8_need = 2;
+		if (c == 0xe0) {
+			parser->utf8_lo = 0xa0; // overlong
+		} else if (c == 0xed) {
+			parser->utf8_hi = 0x9f; // surrogates
+		}
+		
+	} else if (c >= 0xf0 && c <= 0xf4) {
+		parser->utf8_need = 3;
+		if (c == 0xf0) {
+			parser->utf8_lo = 0x90; // overlong
+		} else if (c == 0xf4) {
+			parser->utf8_hi = 0x8f; // above U+10FFFF
+		}
+		
+	} else {
+		// Not a valid lead byte
+		parser->utf8_len = 0;
+		if (parser_utf8_invalid(parser, token, ptr, error) == VKTOR_ERROR) {
+			return -1;
+		}
+		return 1;
+	}
+	
+	token[(*ptr)++] = (char) c;
+	parser->utf8_len = 1;
+	
+	return 1;
+}
+
+/**
+ * @brief Get the number of bytes missing from the last character of a string
+ * 
+ * Used when reading unvalidated UTF-8 strings in chunks, which should only 
+ * be cut where a character starts. Only the lead byte of the character is 
+ * looked at, so invalid UTF-8 may be cut anywhere.
+ * 
+ * @param [in] str String
+ * @param [in] len String length
+ * 
+ * @return Number of continuation bytes still expected, 0 if the last 
+ *         character is complete
+ */
+static int
+parser_utf8_missing(const char *str, long len)
+{
+	long          i = len;
+	unsigned char lead;
+	int           clen;
+	
+	while (i > 0 && len - i < 3 && ((unsigned char) str[i - 1] & 0xc0) == 0x80) {
+		i--;
+	}
+	if (i == 0) {
+		return 0;
+	}
+	
+	lead = (unsigned char) str[i - 1];
+	clen = (lead >= 0xf0 ? 4 : (lead >= 0xe0 ? 3 : (lead >= 0xc0 ? 2 : 1)));
+	
+	return (clen > len - i + 1 ? clen - (len - i + 1) : 0);
+}
+
+/**
+ * @brief Find the end of a string without decoding it
+ * 
+ * Used instead of parser_read_string() with the VKTOR_OPT_LAZY_STRINGS option,
+ * and for strings and object keys left out by the token mask. Only the 
+ * closing quote is looked for, noting whether there are any escape 
+ * sequences, and the string is left in the input as the raw token text, to be
+ * decoded by parser_decode_string() if its value is asked for. Control 
+ * characters are rejected right away, while escape sequences and UTF-8 are 
+ * only checked when decoding. 
+ * 
+ * @param [in,out] parser Parser object
+ * @param [out]    error  Error object pointer pointer or NULL
+ * 
+ * @return Status code
+ */
+static vktor_status
+parser_scan_string(vktor_parser *parser, vktor_error **error)
+{
+	vktor_buffer *buffer;
+	char          c;
+	long          run;
+	
+	if (! parser->token_resume) {
+		parser->token_lazy    = 1;
+		parser->token_escaped = 0;
+		parser->token_size    = 0;
+	}
+	
+	while (parser->buffer != NULL) {
+		buffer = parser->buffer;
+		
+		while (! eobuffer(buffer)) {
+			// The escaped character is checked when decoding
+			if (parser->expected == VKTOR_C_ESCAPED) {
+				parser->expected = VKTOR_T_STRING;
+				INCREMENT_BUFFER_PTR(parser);
+				continue;
+			}
+			
+			if (buffer_has_index(buffer)) {
+				run = buffer_next_mark(buffer, buffer->size - buffer->ptr);
+			} else {
+				run = vktor_scan_string(buffer->text + buffer->ptr, 
+					buffer->size - buffer->ptr, 0);
+			}
+			buffer->ptr += run;
+#ifdef BYTECOUNTER
+			parser->bytecounter += run;
+#endif
+			if (eobuffer(buffer)) break;
+			
+			c = buffer->text[buffer->ptr];
+			if (c == '"') {
+				INCREMENT_BUFFER_PTR(parser);
+				parser->token_resume = 0;
+				if (parser->capture_fn == NULL) {
+					return parser_check_token_size(parser, parser->raw_len + 
+						buffer->ptr - parser->raw_start - 2, error);
+				}
+				return VKTOR_OK;
+			}
+			
+			if (c != '\\') {
+				// Unicode control characters must be escaped
+				set_error_unexpected_c(error, c);
+				return VKTOR_ERROR;
+			}
+			
+			parser->token_escaped = 1;
+			parser->expected = VKTOR_C_ESCAPED;
+			INCREMENT_BUFFER_PTR(parser);
+		}
+		
+		if (parser_keep_token_raw(parser, error) == VKTOR_ERROR) {
+			return VKTOR_ERROR;
+		}
+		parser_advance_buffer(parser);
+	}
+	
+	parser->token_resume = 1;
+	return VKTOR_MORE_DATA;
+}
+
+/**
+ * @brief Read a string token
+ * 
+ * Read a string token until the ending double-quote. Will decode any special
+ * escaped characters found along the way, and will gracefully handle buffer 
+ * replacement. 
+ * 
+ * Used by parser_read_string_token() and parser_read_objkey_token(), and to 
+ * read the chunks of streamed strings - then, the string is read into the 
+ * start of the token memory until the chunk is full, and VKTOR_OK is returned
+ * for a full chunk and VKTOR_COMPLETE at the end of the string.
+ * 
+ * @param [in,out] parser Parser object
+ * @param [out]    error  Error object pointer pointer or NULL
+ * 
+ * @return Status code
+ * 
+ * @todo Handle control characters and unicode 
+ * @todo Handle quoted special characters 
+ */
+static vktor_status
+parser_read_string(vktor_parser *parser, vktor_error **error)
+{
+	char           c;
+	char          *token;
+	int            ptr, maxlen;
+	int            done = 0, full = 0;
+	
+	assert(parser != NULL);
+	
+	// Only find the end of the string, if it is to be decoded on demand
+	if (parser->token_resume ? parser->token_lazy : 
+	    (parser->lazy_strings && parser->capture_fn == NULL && ! parser->str_open)) {
+		return parser_scan_string(parser, error);
+	}
+	
+	// Allocate memory for reading the string
+	
+	if (parser->str_open) {
+		// Continue the current chunk, which may have run out of data
+		ptr = parser->token_size;
+		
+	} else if (parser->token_resume) {
+		ptr = parser->token_size;
+		assert(parser->token_value == parser->scratch);
+		
+	} else {
+		ptr = 0;
+		
+		parser->utf8_need = 0;
+		parser->utf8_len  = 0;
+	}
+	
+	if ((token = parser_scratch(parser, ptr + VKTOR_STR_MEMCHUNK)) == NULL) {
+		set_error(parser, error, VKTOR_ERR_OUT_OF_MEMORY, 
+			"unable to allocate %d bytes for string parsing", 
+			ptr + VKTOR_STR_MEMCHUNK);
+		return VKTOR_ERROR;
 	}
+	maxlen = parser->scratch_size;
 	
 	// Read string from buffer
 	
 	while (parser->buffer != NULL) {
 		while (! eobuffer(parser->buffer)) {
+			
+			// A streamed string chunk is full when the next character may 
+			// not fit in it - chunks never end in the middle of a character
+			if (parser->str_open && ptr > 0 && parser->utf8_need == 0) {
+				unsigned char next = (unsigned char) parser->buffer->text[parser->buffer->ptr];
+				int           room = 4;
+				
+				if (parser->expected & VKTOR_T_STRING) {
+					if (next < 0x80) {
+						room = (next == '"' || next == '\\' ? 0 : 1);
+					} else if (parser->utf8_mode == VKTOR_UTF8_IGNORE) {
+						// The rest of a character always goes with it
+						room = (parser_utf8_missing(token, ptr) > 0 ? 0 : 
+							1 + parser_utf8_missing((char *) &next, 1));
+					} else {
+						// Invalid sequences are replaced by U+FFFD
+						room = 1 + parser_utf8_missing((char *) &next, 1);
+						if (room < 3) {
+							room = 3;
+						}
+					}
+				} else if (parser->expected == VKTOR_C_ESCAPED && next != 'u') {
+					room = 1;
+				}
+				
+				if (room > 0 && ptr + room > parser->str_chunk) {
+					full = 1;
+					break;
+				}
+			}
+			
+			// Copy any run of plain characters at once - when validating 
+			// UTF-8, only ASCII characters are copied this way
+			if (parser->expected & VKTOR_T_STRING && parser->utf8_need == 0) {
+				long avail = parser->buffer->size - parser->buffer->ptr;
+				long run;
+				
+				if (parser->str_open && avail > parser->str_chunk - ptr) {
+					avail = (ptr < parser->str_chunk ? parser->str_chunk - ptr : 0);
+				}
+				
+				if (buffer_has_index(parser->buffer) && 
+				    parser->utf8_mode == VKTOR_UTF8_IGNORE) {
+					run = buffer_next_mark(parser->buffer, avail);
+				} else {
+					run = vktor_scan_string(
+						parser->buffer->text + parser->buffer->ptr, avail,
+						parser->utf8_mode != VKTOR_UTF8_IGNORE);
+				}
+				
+				// Unvalidated UTF-8 is only cut where a character starts, and
+				// a character is only started if all of it fits in the chunk
+				if (parser->str_open && run > 0 && 
+				    parser->utf8_mode == VKTOR_UTF8_IGNORE && 
+				    ptr + run + parser_utf8_missing(parser->buffer->text + parser->buffer->ptr, run) > parser->str_chunk) {
+					while (run > 0 && ((unsigned char) parser->buffer->text[
+						parser->buffer->ptr + run - 1] & 0xc0) == 0x80) {
+						run--;
+					}
+					if (run > 0) {
+						run--;
+					}
+				}
+				
+				if (run > 0) {
+					ensure_token_memory(run, VKTOR_STR_MEMCHUNK);
+					memcpy(token + ptr, parser->buffer->text + parser->buffer->ptr, run);
+					ptr += run;
+					parser->buffer->ptr += run;
+#ifdef BYTECOUNTER
+					parser->bytecounter += run;
+#endif
+					if (eobuffer(parser->buffer)) break;
+					if (parser->str_open) continue;
+				}
+			}
+			
 			c = parser->buffer->text[parser->buffer->ptr];
 			
 			// Read an escaped character (previous char was '/')
@@ -556,8 +1494,14 @@ parser_read_string(vktor_parser *parser, vktor_error **error)
 						break;
 						
 					case 'u':
-						// Read an escaped unicode character
-						parser->expected = VKTOR_C_UNIC1;
+						// Read an escaped unicode character, at once if 
+						// possible
+						if (parser_read_unicode_escape(parser, token, &ptr)) {
+							check_reallocate_token_memory(VKTOR_STR_MEMCHUNK);
+							parser->expected = VKTOR_T_STRING;
+						} else {
+							parser->expected = VKTOR_C_UNIC1;
+						}
 						break;
 						
 					default:
@@ -574,7 +1518,13 @@ parser_read_string(vktor_parser *parser, vktor_error **error)
 						       VKTOR_C_UNIC4)) {
 				
 				// Read an escaped unicode sequence
-				c = vktor_unicode_hex_to_int((unsigned char) c);
+				int digit = vktor_unicode_hex_to_int((unsigned char) c);
+				if (digit < 0) {
+					set_error_unexpected_c(error, c);
+					return VKTOR_ERROR;
+				}
+				c = (char) digit;
+				
 				switch(parser->expected) {
 					
 					case VKTOR_C_UNIC1:
@@ -594,7 +1544,7 @@ parser_read_string(vktor_parser *parser, vktor_error **error)
 						
 					case VKTOR_C_UNIC4: 
 						parser->unicode_c = parser->unicode_c | c;
-						parser->expected = parser->expected = VKTOR_T_STRING;
+						parser->expected = VKTOR_T_STRING;
 						
 						if (VKTOR_UNICODE_HIGH_SURROGATE(parser->unicode_c)) {
 							// Expecting a low surrogate
@@ -605,7 +1555,10 @@ parser_read_string(vktor_parser *parser, vktor_error **error)
 							// Found the low surrogate pair?
 							if (! VKTOR_UNICODE_LOW_SURROGATE((parser->unicode_c & 0x0000ffff))) {
 								// invalid low surrogate
-								set_error_unexpected_c(error, c);
+								set_error(parser, error, VKTOR_ERR_UNEXPECTED_INPUT, 
+									LINEINFO "expected a low surrogate after \\u%04lX, got \\u%04lX"
+									BYTECOUNT_TPL, parser->unicode_c >> 16, 
+									parser->unicode_c & 0xffff BYTECOUNT_VAL);
 								return VKTOR_ERROR;
 								
 							}
@@ -620,7 +1573,10 @@ parser_read_string(vktor_parser *parser, vktor_error **error)
 									utf8);
 							if (l == 0) {
 								// invalid surrogate pair
-								set_error_unexpected_c(error, c);
+								set_error(parser, error, VKTOR_ERR_UNEXPECTED_INPUT, 
+									LINEINFO "invalid surrogate pair \\u%04lX\\u%04lX"
+									BYTECOUNT_TPL, parser->unicode_c >> 16, 
+									parser->unicode_c & 0xffff BYTECOUNT_VAL);
 								return VKTOR_ERROR;
 							}
 							                         
@@ -638,8 +1594,10 @@ parser_read_string(vktor_parser *parser, vktor_error **error)
 							// Get the character as UTF8 and add it to the string
 							l = vktor_unicode_cp_to_utf8((unsigned short) parser->unicode_c, utf8);
 							if (l == 0) {
-								// invalid Unicode character
-								set_error_unexpected_c(error, c);
+								// unpaired low surrogate
+								set_error(parser, error, VKTOR_ERR_UNEXPECTED_INPUT, 
+									LINEINFO "unexpected low surrogate \\u%04lX"
+									BYTECOUNT_TPL, parser->unicode_c BYTECOUNT_VAL);
 								return VKTOR_ERROR;
 							}
 							
@@ -654,7 +1612,7 @@ parser_read_string(vktor_parser *parser, vktor_error **error)
 						break;
 						
 					default: // should not happen
-						set_error(error, VKTOR_ERR_INTERNAL_ERR, 
+						set_error(parser, error, VKTOR_ERR_INTERNAL_ERR, 
 							"internal parser error: expecing a Unicode sequence character");
 						return VKTOR_ERROR;
 						break;
@@ -677,6 +1635,34 @@ parser_read_string(vktor_parser *parser, vktor_error **error)
 				}
 				
 			} else {
+				if (parser->utf8_mode != VKTOR_UTF8_IGNORE && 
+				    (parser->utf8_need > 0 || (unsigned char) c >= 0x80)) {
+					
+					// Validate a UTF-8 sequence byte
+					switch (parser_utf8_byte(parser, (unsigned char) c, token, &ptr, error)) {
+						case -1:
+							return VKTOR_ERROR;
+							break;
+							
+						case 1:
+							check_reallocate_token_memory(VKTOR_STR_MEMCHUNK);
+							INCREMENT_BUFFER_PTR(parser);
+							continue;
+							break;
+							
+						case 2:
+							// An invalid sequence was replaced, the byte
+							// which ended it is read again on its own
+							check_reallocate_token_memory(VKTOR_STR_MEMCHUNK);
+							continue;
+							break;
+							
+						default:
+							// ASCII character
+							break;
+					}
+				}
+				
 				switch (c) {
 					case '"':
 						// end of string;
@@ -716,10 +1702,23 @@ parser_read_string(vktor_parser *parser, vktor_error **error)
 			if (done) break;
 		}
 		
-		if (done) break;
+		if (done || full) break;
+		if (parser_keep_token_raw(parser, error) == VKTOR_ERROR) {
+			return VKTOR_ERROR;
+		}
 		parser_advance_buffer(parser);
 	}
 	
+	// Chunks of streamed strings are not token values
+	if (parser->str_open) {
+		token[ptr] = '\0';
+		parser->token_size = ptr;
+		if (done) {
+			return VKTOR_COMPLETE;
+		}
+		return (full ? VKTOR_OK : VKTOR_MORE_DATA);
+	}
+	
 	parser->token_value = (void *) token;
 	parser->token_size  = ptr;
 	
@@ -730,7 +1729,7 @@ parser_read_string(vktor_parser *parser, vktor_error **error)
 	} else {
 		token[ptr] = '\0';
 		parser->token_resume = 0;
-		return VKTOR_OK;
+		return parser_check_token_size(parser, ptr, error);
 	}
 }
 
@@ -754,8 +1753,13 @@ parser_read_string_token(vktor_parser *parser, vktor_error **error)
 		parser_set_token(parser, VKTOR_T_STRING, NULL);
 	}
 	
-	// Read string	
-	status = parser_read_string(parser, error);
+	// Read string, or only find its end if it is not returned
+	if (! parser->token_resume && ! (parser->token_mask & VKTOR_T_STRING) && 
+	    parser->capture_fn == NULL) {
+		status = parser_scan_string(parser, error);
+	} else {
+		status = parser_read_string(parser, error);
+	}
 	
 	// Set next expected token
 	if (status == VKTOR_OK) {
@@ -783,15 +1787,19 @@ parser_read_objkey_token(vktor_parser *parser, vktor_error **error)
 	
 	assert(nest_stack_in(parser, VKTOR_STRUCT_OBJECT));
 	
-	// Expecting a string
-	parser->expected = VKTOR_T_STRING;
-	
+	// Expecting a string, unless resuming in the middle of an escape sequence
 	if (! parser->token_resume) {
+		parser->expected = VKTOR_T_STRING;
 		parser_set_token(parser, VKTOR_T_OBJECT_KEY, NULL);
 	}
 	
-	// Read string	
-	status = parser_read_string(parser, error);
+	// Read string, or only find its end if it is not returned
+	if (! parser->token_resume && ! (parser->token_mask & VKTOR_T_OBJECT_KEY) && 
+	    parser->capture_fn == NULL) {
+		status = parser_scan_string(parser, error);
+	} else {
+		status = parser_read_string(parser, error);
+	}
 	
 	// Set next expected token
 	if (status == VKTOR_OK) {
@@ -802,34 +1810,108 @@ parser_read_objkey_token(vktor_parser *parser, vktor_error **error)
 }
 
 /**
- * @brief Read an "expected" token
+ * @brief Start reading a streamed string
  * 
- * Read an "expected" token - used when we guess in advance what the next token
- * should be and want to try reading it. 
+ * Called after the opening quote of a string value with the 
+ * VKTOR_OPT_STREAM_STRINGS option. Sets a VKTOR_T_STRING_START token, 
+ * leaving the string itself to be read with vktor_read_string_chunk().
  * 
- * Used internally to read true, false, and null tokens.
+ * @param [in,out] parser Parser object
  * 
- * If during the parsing the input does not match the expected token, an error
- * is returned.
+ * @return Status code - always VKTOR_OK
+ */
+static vktor_status
+parser_open_string(vktor_parser *parser)
+{
+	parser_set_token(parser, VKTOR_T_STRING_START, NULL);
+	
+	parser->expected    = VKTOR_T_STRING;
+	parser->str_open    = 1;
+	parser->str_started = 0;
+	parser->token_size  = 0;
+	parser->utf8_need   = 0;
+	parser->utf8_len    = 0;
+	
+	return VKTOR_OK;
+}
+
+/**
+ * @brief Finish reading a streamed string
+ * 
+ * Called once the closing quote of a streamed string is read, setting the 
+ * next expected token map as after any other string value.
+ * 
+ * @param [in,out] parser Parser object
+ */
+static void
+parser_close_string(vktor_parser *parser)
+{
+	parser->str_open   = 0;
+	parser->token_size = 0;
+	expect_next_value_token(parser);
+}
+
+/**
+ * @brief Skip the rest of a streamed string
+ * 
+ * Read the rest of a streamed string in chunks which are thrown away, so 
+ * the string is still validated as usual.
  * 
  * @param [in,out] parser Parser object
- * @param [in]     expect Expected token as string
- * @param [in]     explen Expected token length
  * @param [out]    error  Error object pointer pointer or NULL
  * 
- * @return Status code
+ * @return Status code - VKTOR_OK at the end of the string, VKTOR_MORE_DATA 
+ *         or VKTOR_ERROR
  */
 static vktor_status
-parser_read_expectedstr(vktor_parser *parser, const char *expect, int explen, 
-	vktor_error **error)
+parser_skip_string(vktor_parser *parser, vktor_error **error)
 {
-	char  c;
+	vktor_status status;
 	
-	assert(parser != NULL);
-	assert(expect != NULL);
+	parser->str_chunk   = VKTOR_STR_SKIPCHUNK;
+	parser->str_started = 1;
 	
-	// Expected string should be "null", "true" or "false"
-	assert(explen > 3 && explen < 6);
+	while ((status = parser_read_string(parser, error)) == VKTOR_OK) {
+		parser->token_size = 0;
+	}
+	
+	if (status == VKTOR_COMPLETE) {
+		parser_close_string(parser);
+		return VKTOR_OK;
+	}
+	
+	return status;
+}
+
+/**
+ * @brief Read an "expected" token
+ * 
+ * Read an "expected" token - used when we guess in advance what the next token
+ * should be and want to try reading it. 
+ * 
+ * Used internally to read true, false, and null tokens.
+ * 
+ * If during the parsing the input does not match the expected token, an error
+ * is returned.
+ * 
+ * @param [in,out] parser Parser object
+ * @param [in]     expect Expected token as string
+ * @param [in]     explen Expected token length
+ * @param [out]    error  Error object pointer pointer or NULL
+ * 
+ * @return Status code
+ */
+static vktor_status
+parser_read_expectedstr(vktor_parser *parser, const char *expect, int explen, 
+	vktor_error **error)
+{
+	char  c;
+	
+	assert(parser != NULL);
+	assert(expect != NULL);
+	
+	// Expected string should be "null", "true" or "false"
+	assert(explen > 3 && explen < 6);
 	
 	if (! parser->token_resume) {
 		parser->token_size = 0;
@@ -842,6 +1924,9 @@ parser_read_expectedstr(vktor_parser *parser, const char *expect, int explen,
 		}
 		
 		if (eobuffer(parser->buffer)) {
+			if (parser_keep_token_raw(parser, error) == VKTOR_ERROR) {
+				return VKTOR_ERROR;
+			}
 			parser_advance_buffer(parser);
 			if (parser->buffer == NULL) {
 				parser->token_resume = 1;
@@ -963,24 +2048,20 @@ parser_read_number_token(vktor_parser *parser, vktor_error **error)
 	char *token;
 	int   ptr, maxlen;
 	int   done = 0;
+	int   skip;
 	
 	assert(parser != NULL);
 	
+	// If numbers are masked out, only the last character is kept, which is 
+	// all that is needed to validate the number
+	skip = ! (parser->token_mask & (VKTOR_T_INT | VKTOR_T_FLOAT));
+	
 	if (parser->token_resume) {
 		ptr = parser->token_size;
-		if (ptr < VKTOR_NUM_MEMCHUNK) {
-			maxlen = VKTOR_NUM_MEMCHUNK;
-			token = (void *) parser->token_value;
-			assert(token != NULL);
-		} else {
-			maxlen = ptr + VKTOR_NUM_MEMCHUNK;
-			token = vrealloc(parser->token_value, sizeof(char) * maxlen);
-		}
+		assert(parser->token_value == parser->scratch);
 		
 	} else {
-		token  = vmalloc(VKTOR_NUM_MEMCHUNK * sizeof(char));
-		maxlen = VKTOR_NUM_MEMCHUNK;
-		ptr    = 0;
+		ptr = 0;
 		
 		// Reading a new token - set possible expected characters
 		parser->expected = VKTOR_T_INT    | 
@@ -989,16 +2070,17 @@ parser_read_number_token(vktor_parser *parser, vktor_error **error)
 				   VKTOR_C_EXP    | 
 				   VKTOR_C_SIGNUM;
 						   
-		// Free previous token and set token type to INT until proven otherwise 
+		// Set token type to INT until proven otherwise 
 		parser_set_token(parser, VKTOR_T_INT, NULL);
 	}
 	
-	if (token == NULL) {
-		set_error(error, VKTOR_ERR_OUT_OF_MEMORY, 
-			"unable to allocate %d bytes for string parsing", 
-			VKTOR_NUM_MEMCHUNK);
+	if ((token = parser_scratch(parser, ptr + VKTOR_NUM_MEMCHUNK)) == NULL) {
+		set_error(parser, error, VKTOR_ERR_OUT_OF_MEMORY, 
+			"unable to allocate %d bytes for number parsing", 
+			ptr + VKTOR_NUM_MEMCHUNK);
 		return VKTOR_ERROR;
 	}
+	maxlen = parser->scratch_size;
 	
 	while (parser->buffer != NULL) {
 		while (! eobuffer(parser->buffer)) {
@@ -1079,7 +2161,9 @@ parser_read_number_token(vktor_parser *parser, vktor_error **error)
 					// This is a floating point number
 					parser->token_type = VKTOR_T_FLOAT;
 					
-					token[ptr++] = 'e';
+					// Keep the exponent marker as is, so the token text is 
+					// exactly the number as written
+					token[ptr++] = c;
 					break;
 					
 				default:
@@ -1102,10 +2186,18 @@ parser_read_number_token(vktor_parser *parser, vktor_error **error)
 			
 			if (done) break;
 			INCREMENT_BUFFER_PTR(parser);
-			check_reallocate_token_memory(VKTOR_NUM_MEMCHUNK);
+			if (skip) {
+				token[0] = token[ptr - 1];
+				ptr = 1;
+			} else {
+				check_reallocate_token_memory(VKTOR_NUM_MEMCHUNK);
+			}
 		}
 		
 		if (done) break;
+		if (parser_keep_token_raw(parser, error) == VKTOR_ERROR) {
+			return VKTOR_ERROR;
+		}
 		parser_advance_buffer(parser);
 	}
 	
@@ -1120,7 +2212,163 @@ parser_read_number_token(vktor_parser *parser, vktor_error **error)
 		token[ptr] = '\0';
 		parser->token_resume = 0;
 		expect_next_value_token(parser);
-		return VKTOR_OK;
+		return parser_check_token_size(parser, ptr, error);
+	}
+}
+
+/**
+ * @brief Write an integer into a snapshot
+ * 
+ * Write an unsigned long integer as 8 little-endian bytes, so that snapshots 
+ * do not depend on the byte order or long size of the host.
+ * 
+ * @param [out] dest  Destination, must have room for 8 bytes
+ * @param [in]  value Value to write
+ */
+static void
+snapshot_put_ulong(unsigned char *dest, unsigned long value)
+{
+	int i;
+	
+	for (i = 0; i < 8; i++) {
+		dest[i] = (unsigned char) (value & 0xff);
+		value >>= 8;
+	}
+}
+
+/**
+ * @brief Read an integer from a snapshot
+ * 
+ * Read an unsigned long integer written by snapshot_put_ulong(). 
+ * 
+ * @param [in]  src   Source, must hold at least 8 bytes
+ * @param [out] value Pointer to be populated with the value
+ * 
+ * @return 1 on success, 0 if the value does not fit in a long on this host
+ */
+static int
+snapshot_get_ulong(const unsigned char *src, unsigned long *value)
+{
+	unsigned long uval = 0;
+	int           i;
+	
+	for (i = 7; i >= 0; i--) {
+		if (uval > (((unsigned long) -1) >> 8)) {
+			return 0;
+		}
+		uval = (uval << 8) | src[i];
+	}
+	
+	*value = uval;
+	return 1;
+}
+
+/**
+ * @brief Get the literal a null, true or false token is read from
+ * 
+ * @param [in] type Token type
+ * 
+ * @return The literal, or NULL for other token types
+ */
+static const char *
+snapshot_literal(unsigned long type)
+{
+	switch (type) {
+		case VKTOR_T_NULL:  return "null";
+		case VKTOR_T_TRUE:  return "true";
+		case VKTOR_T_FALSE: return "false";
+		default:            return NULL;
+	}
+}
+
+/**
+ * @brief Check the parser state stored in a snapshot
+ * 
+ * Check that the expected token map, token type, half-read token and UTF-8 
+ * sequence state stored in a snapshot make up a state the parser can really
+ * be left in, given the struct it is in. Restoring any other state could 
+ * trip internal assertions or make the parser read or write outside of its 
+ * token memory.
+ * 
+ * @param [in] f       Snapshot integer fields
+ * @param [in] current Type of the struct the snapshot is in
+ * @param [in] token   Half-read token saved in the snapshot
+ * 
+ * @return 1 if the state is valid, 0 otherwise
+ */
+static int
+snapshot_state_valid(const unsigned long *f, vktor_struct current, 
+                     const unsigned char *token)
+{
+	unsigned long expected = f[1];
+	unsigned long type     = f[2];
+	unsigned long need     = f[8] & 0xff;
+	unsigned long len      = (f[8] >> 8) & 0xff;
+	unsigned long lo       = (f[8] >> 16) & 0xff;
+	unsigned long hi       = (f[8] >> 24) & 0xff;
+	const char   *literal;
+	
+	// A single token type or none, and a sane UTF-8 sequence state
+	if (type > VKTOR_T_ALL || (type & (type - 1)) != 0 || f[3] > 1 ||
+	    f[7] > 0xffffffffUL || f[8] > 0xffffffffUL || need > 3 || 
+	    len + need > 4 || (need > 0 && (lo < 0x80 || hi > 0xbf || lo > hi))) {
+		return 0;
+	}
+	
+	if (f[3]) {
+		switch (type) {
+			case VKTOR_T_OBJECT_KEY:
+				if (current != VKTOR_STRUCT_OBJECT) return 0;
+				// fall through
+				
+			case VKTOR_T_STRING:
+				// Any UTF-8 sequence being read is part of the saved token
+				if (need > 0 && len > f[4]) return 0;
+				
+				// Inside an escape sequence, or reading plain characters - 
+				// string values keep the map they were expected with
+				if (expected == VKTOR_C_ESCAPED || 
+				    expected == VKTOR_C_UNIC1 || 
+				    expected == VKTOR_C_UNIC2 || 
+				    expected == VKTOR_C_UNIC3 || 
+				    expected == VKTOR_C_UNIC4 || 
+				    expected == VKTOR_C_UNIC_LS) {
+					return 1;
+				}
+				if (! (expected & VKTOR_T_STRING)) return 0;
+				break;
+				
+			case VKTOR_T_INT:
+			case VKTOR_T_FLOAT:
+				return (f[4] > 0 && (expected & ~(VKTOR_T_INT | VKTOR_T_FLOAT |
+					VKTOR_C_DOT | VKTOR_C_EXP | VKTOR_C_SIGNUM)) == 0);
+				
+			default:
+				// A literal, which must have its matched part saved, and 
+				// was started where a value was expected
+				literal = snapshot_literal(type);
+				if (literal == NULL || f[4] == 0 || f[4] >= strlen(literal) ||
+				    memcmp(token, literal, f[4]) != 0) {
+					return 0;
+				}
+				break;
+		}
+	}
+	
+	// Between tokens, only structural tokens fitting the current struct 
+	// may be expected
+	switch (current) {
+		case VKTOR_STRUCT_NONE:
+			return ((expected & ~(VKTOR_VALUE_TOKEN)) == 0);
+			
+		case VKTOR_STRUCT_ARRAY:
+			return ((expected & ~(VKTOR_VALUE_TOKEN | VKTOR_C_COMMA | 
+				VKTOR_T_ARRAY_END | VKTOR_T_OBJECT_END)) == 0);
+			
+		default:
+			return ((expected & ~(VKTOR_VALUE_TOKEN | VKTOR_C_COMMA | 
+				VKTOR_C_COLON | VKTOR_T_OBJECT_KEY | VKTOR_T_ARRAY_END | 
+				VKTOR_T_OBJECT_END)) == 0);
 	}
 }
 
@@ -1157,6 +2405,59 @@ vktor_set_memory_handlers(vktor_malloc vmallocf, vktor_realloc vreallocf,
 	vfree    = (vfreef    == NULL ? free    : vfreef);
 }
 
+/**
+ * @brief Set all parser state to that of a newly initialized parser
+ * 
+ * Set all parser state to that of a newly initialized parser. Does not touch
+ * any allocated memory, and expects no buffers to be linked to the parser.
+ * 
+ * @param [in,out] parser Parser to reset
+ */
+static void
+parser_reset_state(vktor_parser *parser)
+{
+	parser->token_type   = VKTOR_T_NONE;
+	parser->token_value  = NULL;
+	parser->token_size   = 0;
+	parser->token_resume = 0;
+	parser->token_lazy   = 0;
+	parser->token_escaped = 0;
+	parser->lazy_strings = 0;
+	parser->stream_strings = 0;
+	parser->structural_index = 0;
+	parser->str_open     = 0;
+	parser->str_started  = 0;
+	parser->str_chunk    = 0;
+	parser->max_token    = 0;
+	parser->unicode_c    = 0;
+	parser->offset       = 0;
+	parser->utf8_mode    = VKTOR_UTF8_IGNORE;
+	parser->utf8_need    = 0;
+	parser->utf8_len     = 0;
+	parser->encoding     = VKTOR_ENC_AUTO;
+	parser->enc_carry_len = 0;
+	parser->enc_high     = 0;
+	parser->token_mask   = VKTOR_T_ALL;
+	parser->skip_depth   = 0;
+	parser->skip_string  = 0;
+	parser->raw_start    = 0;
+	parser->raw_end      = -1;
+	parser->raw_len      = 0;
+	parser->capture_fn   = NULL;
+	parser->capture_ctx  = NULL;
+	
+	// set expectated tokens
+	parser->expected   = VKTOR_VALUE_TOKEN;
+
+	// reset nesting stack
+	parser->nest_ptr      = 0;
+	parser->nest_current  = VKTOR_STRUCT_NONE;
+	
+#ifdef BYTECOUNTER
+	parser->bytecounter = 0;
+#endif
+}
+
 /**
  * @brief Initialize a new parser 
  * 
@@ -1169,35 +2470,308 @@ vktor_set_memory_handlers(vktor_malloc vmallocf, vktor_realloc vreallocf,
  */
 vktor_parser*
 vktor_parser_init(int max_nest)
+{
+	return vktor_parser_init_ex(max_nest, NULL);
+}
+
+/**
+ * @brief Initialize a new parser using a specific allocator
+ * 
+ * Initialize and return a new parser struct, which will manage all of its
+ * memory using the passed allocator instead of the global memory handlers. 
+ * Will return NULL if memory can't be allocated.
+ * 
+ * @param [in] max_nest  maximal nesting level
+ * @param [in] allocator allocator to use, copied into the parser, or NULL to
+ *                       use the global memory handlers
+ * 
+ * @return a newly allocated parser
+ */
+vktor_parser*
+vktor_parser_init_ex(int max_nest, const vktor_allocator *allocator)
 {
 	vktor_parser *parser;
 	
-	if ((parser = vmalloc(sizeof(vktor_parser))) == NULL) {
+	if (allocator == NULL) {
+		allocator = &default_allocator;
+	}
+	
+	if ((parser = allocator->malloc_fn(allocator->ctx, sizeof(vktor_parser))) == NULL) {
 		return NULL;
 	}
-		
+	
+	parser->allocator    = *allocator;
+	parser->scratch      = NULL;
+	parser->scratch_size = 0;
+	parser->raw          = NULL;
+	parser->raw_size     = 0;
 	parser->buffer       = NULL;
 	parser->last_buffer  = NULL;
-	parser->token_type   = VKTOR_T_NONE;
-	parser->token_value  = NULL;
-	parser->token_resume = 0;
-	parser->unicode_c    = 0;
-	
-	// set expectated tokens
-	parser->expected   = VKTOR_VALUE_TOKEN;
 
-	// set up nesting stack
-	parser->nest_stack   = vmalloc(sizeof(vktor_struct) * max_nest);
-	parser->nest_ptr     = 0;
+	// set up nesting stack, which will grow as needed up to max_nest
+	parser->nest_size    = nest_stack_bytes(max_nest);
+	if (parser->nest_size > VKTOR_NEST_MEMCHUNK) {
+		parser->nest_size = VKTOR_NEST_MEMCHUNK;
+	}
+	parser->nest_stack   = pmalloc(parser, parser->nest_size);
 	parser->max_nest     = max_nest;
 	
-#ifdef BYTECOUNTER
-	parser->bytecounter = 0;
-#endif
+	if (parser->nest_stack == NULL) {
+		pfree(parser, parser);
+		return NULL;
+	}
+	
+	parser_reset_state(parser);
 
 	return parser;
 }
 
+/**
+ * @brief Reset a parser for parsing a new document
+ * 
+ * Free any buffers still linked to the parser and bring it back to the state 
+ * of a newly initialized parser, so it can be used to parse another JSON 
+ * document. Allocated memory such as the nesting stack and the token scratch
+ * memory is kept and reused, making this cheaper than freeing the parser and
+ * initializing a new one. 
+ * 
+ * Parser options are reset to their defaults, and should be set again if
+ * needed.
+ * 
+ * @param [in,out] parser   Parser to reset
+ * @param [in]     max_nest Maximal nesting level for the new document
+ */
+void
+vktor_parser_reset(vktor_parser *parser, int max_nest)
+{
+	assert(parser != NULL);
+	
+	if (parser->buffer != NULL) {
+		buffer_free_all(parser, parser->buffer);
+		parser->buffer      = NULL;
+		parser->last_buffer = NULL;
+	}
+	
+	// The nesting stack grows on demand, so a new limit needs no allocation
+	parser->max_nest = max_nest;
+	
+	parser_reset_state(parser);
+}
+
+/**
+ * @brief Detect the input encoding from the first bytes of input
+ * 
+ * Detect the encoding from a byte order mark, or from the pattern of zero 
+ * bytes in the first 4 bytes - since the first two characters of JSON text 
+ * are always ASCII characters, only UTF-16 and UTF-32 have zero bytes there.
+ * 
+ * @param [in]  bytes   First bytes of input
+ * @param [in]  n       Number of bytes available, up to 4
+ * @param [out] bom_len Length of the byte order mark, if any
+ * 
+ * @return The detected encoding, or VKTOR_ENC_AUTO if more bytes are needed
+ */
+static vktor_encoding
+encoding_detect(const unsigned char *bytes, int n, int *bom_len)
+{
+	*bom_len = 0;
+	
+	if (n < 2) {
+		return VKTOR_ENC_AUTO;
+	}
+	
+	switch (bytes[0]) {
+		case 0xef:
+			if (bytes[1] != 0xbb) return VKTOR_ENC_UTF8;
+			if (n < 3) return VKTOR_ENC_AUTO;
+			if (bytes[2] == 0xbf) *bom_len = 3;
+			return VKTOR_ENC_UTF8;
+			break;
+			
+		case 0xfe:
+			if (bytes[1] != 0xff) return VKTOR_ENC_UTF8;
+			*bom_len = 2;
+			return VKTOR_ENC_UTF16BE;
+			break;
+			
+		case 0xff:
+			if (bytes[1] != 0xfe) return VKTOR_ENC_UTF8;
+			if (n < 4) return VKTOR_ENC_AUTO;
+			if (bytes[2] == 0 && bytes[3] == 0) {
+				*bom_len = 4;
+				return VKTOR_ENC_UTF32LE;
+			}
+			*bom_len = 2;
+			return VKTOR_ENC_UTF16LE;
+			break;
+			
+		case 0:
+			if (bytes[1] != 0) return VKTOR_ENC_UTF16BE;
+			if (n < 4) return VKTOR_ENC_AUTO;
+			if (bytes[2] == 0xfe && bytes[3] == 0xff) *bom_len = 4;
+			return VKTOR_ENC_UTF32BE;
+			break;
+			
+		default:
+			if (bytes[1] != 0) return VKTOR_ENC_UTF8;
+			if (n < 4) return VKTOR_ENC_AUTO;
+			if (bytes[2] == 0 && bytes[3] == 0) return VKTOR_ENC_UTF32LE;
+			return VKTOR_ENC_UTF16LE;
+			break;
+	}
+}
+
+/**
+ * @brief Transcode UTF-16 or UTF-32 input text to UTF-8
+ * 
+ * Convert input text in the parser's input encoding to UTF-8. A code unit or
+ * surrogate pair split between buffers is kept in the parser and completed 
+ * by the next call.
+ * 
+ * @param [in,out] parser   Parser object
+ * @param [in]     text     Input text
+ * @param [in]     text_len Input text length
+ * @param [out]    utf8_len Length of the returned text
+ * @param [out]    error    Error object pointer pointer or NULL
+ * 
+ * @return Newly allocated UTF-8 text, or NULL in case of error
+ */
+static char *
+parser_transcode(vktor_parser *parser, const char *text, long text_len, 
+	long *utf8_len, vktor_error **error)
+{
+	char *utf8;
+	long  i = 0, o = 0, whole, size;
+	int   unit, big_endian;
+	
+	assert(parser->encoding > VKTOR_ENC_UTF8);
+	
+	unit = (parser->encoding == VKTOR_ENC_UTF16LE || 
+	        parser->encoding == VKTOR_ENC_UTF16BE) ? 2 : 4;
+	big_endian = (parser->encoding == VKTOR_ENC_UTF16BE || 
+	              parser->encoding == VKTOR_ENC_UTF32BE);
+	
+	size = (text_len + parser->enc_carry_len) * 2 + 4;
+	if ((utf8 = pmalloc(parser, sizeof(char) * size)) == NULL) {
+		set_error(parser, error, VKTOR_ERR_OUT_OF_MEMORY, 
+			"unable to allocate %ld bytes for transcoding input", size);
+		return NULL;
+	}
+	
+	// Complete a code unit left over from the previous buffer
+	if (parser->enc_carry_len > 0) {
+		while (parser->enc_carry_len < unit && i < text_len) {
+			parser->enc_carry[parser->enc_carry_len++] = text[i++];
+		}
+		if (parser->enc_carry_len < unit) {
+			*utf8_len = 0;
+			return utf8;
+		}
+		
+		o = vktor_unicode_transcode((char *) parser->enc_carry, unit, unit, 
+			big_endian, utf8, &parser->enc_high);
+		parser->enc_carry_len = 0;
+	}
+	
+	whole = (text_len - i) - (text_len - i) % unit;
+	o += vktor_unicode_transcode(text + i, whole, unit, big_endian, utf8 + o, 
+		&parser->enc_high);
+	i += whole;
+	
+	// Keep any partial code unit for the next buffer
+	while (i < text_len) {
+		parser->enc_carry[parser->enc_carry_len++] = text[i++];
+	}
+	
+	*utf8_len = o;
+	return utf8;
+}
+
+/**
+ * @brief Detect the input encoding once enough input is available
+ * 
+ * Called when input is fed and the encoding is not known yet. Skips any byte 
+ * order mark, and if the input is UTF-16 or UTF-32, transcodes any buffered 
+ * input to UTF-8.
+ * 
+ * @param [in,out] parser Parser object
+ * @param [out]    error  Error object pointer pointer or NULL
+ * 
+ * @return Status code - VKTOR_OK or VKTOR_ERROR
+ */
+static vktor_status
+parser_detect_encoding(vktor_parser *parser, vktor_error **error)
+{
+	vktor_buffer   *buffer;
+	vktor_encoding  encoding;
+	unsigned char   bytes[4];
+	char           *utf8;
+	long            utf8_len, i;
+	int             n = 0, bom_len;
+	
+	for (buffer = parser->buffer; buffer != NULL && n < 4; buffer = buffer->next_buff) {
+		for (i = buffer->ptr; i < buffer->size && n < 4; i++) {
+			bytes[n++] = (unsigned char) buffer->text[i];
+		}
+	}
+	
+	if ((encoding = encoding_detect(bytes, n, &bom_len)) == VKTOR_ENC_AUTO) {
+		// Not enough input yet - the parser will ask for more data before 
+		// reading these buffers, so keep a copy of any text it does not own,
+		// as the caller may reuse that memory for the next buffer
+		for (buffer = parser->buffer; buffer != NULL; buffer = buffer->next_buff) {
+			if (buffer->free) continue;
+			
+			if ((utf8 = pmalloc(parser, buffer->size - buffer->ptr + 1)) == NULL) {
+				set_error(parser, error, VKTOR_ERR_OUT_OF_MEMORY, 
+					"unable to allocate %ld bytes for input buffer", 
+					buffer->size - buffer->ptr + 1);
+				return VKTOR_ERROR;
+			}
+			memcpy(utf8, buffer->text + buffer->ptr, buffer->size - buffer->ptr);
+			buffer->text = utf8;
+			buffer->size = buffer->size - buffer->ptr;
+			buffer->ptr  = 0;
+			buffer->free = 1;
+		}
+		return VKTOR_OK;
+	}
+	
+	// Skip the byte order mark
+	while (bom_len > 0) {
+		if (eobuffer(parser->buffer)) {
+			parser_advance_buffer(parser);
+		} else {
+			parser->buffer->ptr++;
+			bom_len--;
+		}
+	}
+	
+	parser->encoding = encoding;
+	if (encoding == VKTOR_ENC_UTF8) {
+		return VKTOR_OK;
+	}
+	
+	// Transcode the input buffered so far
+	for (buffer = parser->buffer; buffer != NULL; buffer = buffer->next_buff) {
+		utf8 = parser_transcode(parser, buffer->text + buffer->ptr, 
+			buffer->size - buffer->ptr, &utf8_len, error);
+		if (utf8 == NULL) {
+			return VKTOR_ERROR;
+		}
+		
+		if (buffer->free) {
+			pfree(parser, buffer->text);
+		}
+		buffer->text = utf8;
+		buffer->size = utf8_len;
+		buffer->ptr  = 0;
+		buffer->free = 1;
+	}
+	
+	return VKTOR_OK;
+}
+
 /**
  * @brief Feed the parser's internal buffer with more JSON data
  * 
@@ -1222,10 +2796,27 @@ vktor_feed(vktor_parser *parser, char *text, long text_len,
            char free, vktor_error **err) 
 {
 	vktor_buffer *buffer;
+	char         *utf8;
+	long          utf8_len;
+	
+	// Convert non-UTF-8 input, taking ownership of the converted text
+	if (parser->encoding > VKTOR_ENC_UTF8) {
+		utf8 = parser_transcode(parser, text, text_len, &utf8_len, err);
+		if (free) {
+			pfree(parser, text);
+		}
+		if (utf8 == NULL) {
+			return VKTOR_ERROR;
+		}
+		
+		text     = utf8;
+		text_len = utf8_len;
+		free     = 1;
+	}
 	
 	// Create buffer
-	if ((buffer = buffer_init(text, text_len, free)) == NULL) {
-		set_error(err, VKTOR_ERR_OUT_OF_MEMORY, 
+	if ((buffer = buffer_init(parser, text, text_len, free)) == NULL) {
+		set_error(parser, err, VKTOR_ERR_OUT_OF_MEMORY, 
 			"Unable to allocate memory buffer for %ld bytes", text_len);
 		return VKTOR_ERROR;
 	}
@@ -1240,88 +2831,774 @@ vktor_feed(vktor_parser *parser, char *text, long text_len,
 		parser->last_buffer = buffer;
 	}
 	
+	if (parser->encoding == VKTOR_ENC_AUTO) {
+		return parser_detect_encoding(parser, err);
+	}
+	
 	return VKTOR_OK;
 }
 
+typedef struct _vktor_array_struct vktor_array;
+
 /**
- * @brief Parse some JSON text and return on the next token
- * 
- * Parse the text buffer until the next JSON token is encountered
+ * Piece of an array body parsed by vktor_parse_array(). The body is cut into
+ * pieces of equal size, which are scanned and then parsed by one worker each.
+ */
+typedef struct _vktor_piece_struct {
+	vktor_array  *array;     /**< array this piece is a part of */
+	int           index;     /**< index of the piece in the array */
+	long          start;     /**< offset of the first byte of the piece */
+	long          end;       /**< offset right after the last byte */
+	long          delta[2];  /**< nesting depth change if the piece starts 
+	                              outside [0] or inside [1] a string */
+	char          quote;     /**< whether the piece has an odd number of 
+	                              unescaped quotes */
+	char          in_string; /**< whether the piece starts inside a string */
+	long          depth;     /**< nesting depth at the start of the piece */
+	void         *result;    /**< result of the chunk handler */
+	vktor_status  status;    /**< status of parsing the chunk */
+	vktor_error  *error;     /**< error of parsing the chunk, if any */
+#ifndef VKTOR_NO_THREADS
+	pthread_t     thread;    /**< worker thread handling the piece */
+	char          threaded;  /**< whether the worker thread was started */
+#endif
+} vktor_piece;
+
+/**
+ * Array parsed by vktor_parse_array()
+ */
+struct _vktor_array_struct {
+	const char            *text;      /**< JSON text */
+	long                   first;     /**< offset of the first body byte */
+	long                   last;      /**< offset of the closing bracket */
+	int                    max_nest;  /**< maximal nesting level */
+	const vktor_allocator *allocator; /**< allocator of the chunk parsers */
+	vktor_chunk_handler    handler;   /**< chunk handler */
+	void                  *ctx;       /**< chunk handler context */
+	vktor_piece           *pieces;    /**< pieces of the body */
+	int                    count;     /**< number of pieces */
+};
+
+/**
+ * @brief malloc of the allocator used by vktor_parse_array() when none is 
+ * passed, which calls the thread safe standard malloc directly
+ */
+static void *
+std_malloc(void *ctx, size_t size)
+{
+	return malloc(size);
+}
+
+/**
+ * @brief realloc of the standard allocator
+ */
+static void *
+std_realloc(void *ctx, void *pointer, size_t size)
+{
+	return realloc(pointer, size);
+}
+
+/**
+ * @brief free of the standard allocator
+ */
+static void
+std_free(void *ctx, void *pointer)
+{
+	free(pointer);
+}
+
+/**
+ * Standard allocator, used by the parsers of vktor_parse_array() when no 
+ * allocator is passed, as the global memory handlers may not be thread safe
+ */
+static const vktor_allocator std_allocator = {
+	std_malloc, 
+	std_realloc, 
+	std_free, 
+	NULL
+};
+
+/**
+ * @brief Check whether a byte is JSON whitespace
+ */
+#define is_json_space(c) ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+
+/**
+ * @brief Check whether the byte at an offset is escaped
  * 
- * In case of error, if error is not NULL, it will be populated with error 
- * information, and VKTOR_ERROR will be returned
+ * Count the backslashes right before an offset, going back no further than 
+ * the start of the array body. An odd count means the byte is escaped.
+ * Backslashes are only valid inside strings, so the result is right for any
+ * valid JSON text no matter whether the offset is inside a string or not.
  * 
- * @param [in,out] parser The parser object to work with
- * @param [out]    error  A vktor_error pointer pointer, or NULL
+ * @param [in] text  JSON text
+ * @param [in] ptr   offset to check
+ * @param [in] first offset of the first byte of the array body
  * 
- * @return status code:
- *  - VKTOR_OK        if a token was encountered
- *  - VKTOR_ERROR     if an error has occured
- *  - VKTOR_MORE_DATA if we need more data in order to continue parsing
- *  - VKTOR_COMPLETE  if parsing is complete and no further data is expected
+ * @return 1 if the byte is escaped, 0 otherwise
  */
-vktor_status 
-vktor_parse(vktor_parser *parser, vktor_error **error)
+static char
+parallel_escaped(const char *text, long ptr, long first)
 {
-	char c;
-	int  done;
+	char escaped = 0;
 	
-	assert(parser != NULL);
+	while (ptr > first && text[ptr - 1] == '\\') {
+		escaped = ! escaped;
+		ptr--;
+	}
 	
-	// Do we have a buffer to work with?
-	while (parser->buffer != NULL) {
-		done = 0;
+	return escaped;
+}
+
+/**
+ * @brief Scan one piece of an array body
+ * 
+ * First pass of vktor_parse_array(), run on a worker for each piece. Count 
+ * the unescaped quotes in the piece, and the nesting depth change for both 
+ * possible string states at its start: brackets seen while the quote count 
+ * is even are outside strings if the piece starts outside a string, and 
+ * those seen while it is odd are outside strings if it starts inside one. 
+ * Once the state at the start of each piece is known, the depth change of 
+ * the matching assumption is used.
+ * 
+ * @param [in,out] arg The vktor_piece to scan
+ * 
+ * @return NULL
+ */
+static void *
+parallel_scan_piece(void *arg)
+{
+	vktor_piece *piece = arg;
+	const char  *text  = piece->array->text;
+	long         ptr;
+	char         quote   = 0;
+	char         escaped = parallel_escaped(text, piece->start, piece->array->first);
+	
+	piece->delta[0] = 0;
+	piece->delta[1] = 0;
+	
+	for (ptr = piece->start; ptr < piece->end; ptr++) {
+		if (escaped) {
+			escaped = 0;
+			continue;
+		}
 		
-		// Do we need to continue reading the previous token?
-		if (parser->token_resume) {
-						
-		    switch (parser->token_type) {
-		    	case VKTOR_T_OBJECT_KEY:
-		    		return parser_read_objkey_token(parser, error);
-		    		break;
-		    		
-		    	case VKTOR_T_STRING:
-		    		return parser_read_string_token(parser, error);
-		    		break;
-		    	
-				case VKTOR_T_NULL:
-					return parser_read_null(parser, error);
-					break;
-					
-				case VKTOR_T_TRUE:
-					return parser_read_true(parser, error);
-					break;
+		switch (text[ptr]) {
+			case '\\':
+				escaped = 1;
+				break;
 				
-				case VKTOR_T_FALSE:
-					return parser_read_false(parser, error);
-					break;
+			case '"':
+				quote = ! quote;
+				break;
 				
-				case VKTOR_T_INT:
-				case VKTOR_T_FLOAT:
-					return parser_read_number_token(parser, error);
-					break;
-					
-		    	default:
-		    		set_error(error, VKTOR_ERR_INTERNAL_ERR, 
-		    			"token resume flag is set but token type %d is unexpected",
-		    			parser->token_type);
-		    		return VKTOR_ERROR;
-		    		break;
-		    }
+			case '[':
+			case '{':
+				piece->delta[(int) quote]++;
+				break;
+				
+			case ']':
+			case '}':
+				piece->delta[(int) quote]--;
+				break;
+		}
+	}
+	
+	piece->quote = quote;
+	
+	return NULL;
+}
+
+/**
+ * @brief Find the first element boundary at or after the start of a piece
+ * 
+ * Scan from the start of a piece, whose string state and nesting depth are
+ * known, to the first comma separating two elements of the array. Quotes 
+ * and backslashes are handled exactly like parallel_scan_piece() does, so 
+ * boundaries never go backwards from one piece to the next, even if the text
+ * is not valid JSON. 
+ * 
+ * @param [in] piece The piece to start from
+ * 
+ * @return The offset of the comma, or the offset of the closing bracket of 
+ *         the array if there are no more elements
+ */
+static long
+parallel_find_boundary(vktor_piece *piece)
+{
+	const char *text      = piece->array->text;
+	long        ptr       = piece->start;
+	long        depth     = piece->depth;
+	char        in_string = piece->in_string;
+	char        escaped   = parallel_escaped(text, ptr, piece->array->first);
+	
+	for (; ptr < piece->array->last; ptr++) {
+		if (escaped) {
+			escaped = 0;
+			continue;
 		}
 		
-		while (! eobuffer(parser->buffer)) {
-			c = parser->buffer->text[parser->buffer->ptr];
+		switch (text[ptr]) {
+			case '\\':
+				escaped = 1;
+				break;
+				
+			case '"':
+				in_string = ! in_string;
+				break;
+				
+			case '[':
+			case '{':
+				if (! in_string) depth++;
+				break;
+				
+			case ']':
+			case '}':
+				if (! in_string) depth--;
+				break;
+				
+			case ',':
+				if (! in_string && depth == 0) return ptr;
+				break;
+		}
+	}
+	
+	return ptr;
+}
+
+/**
+ * @brief Parse the chunk of array elements starting in a piece
+ * 
+ * Second pass of vktor_parse_array(), run on a worker for each piece. Find 
+ * the element boundaries at the start of this piece and of the next one, and
+ * parse the elements between them, wrapped in an array of their own, using a
+ * new parser. The chunk handler is called to read the tokens, and any tokens
+ * it leaves unread are validated afterwards. A piece holding no boundary of 
+ * its own has no chunk, as its elements belong to the chunk of a previous 
+ * piece.
+ * 
+ * @param [in,out] arg The vktor_piece to parse
+ * 
+ * @return NULL
+ */
+static void *
+parallel_parse_piece(void *arg)
+{
+	static char   open_bracket[]  = "[";
+	static char   close_bracket[] = "]";
+	vktor_piece  *piece = arg;
+	vktor_array  *array = piece->array;
+	vktor_parser *parser;
+	long          start, end, ptr;
+	
+	piece->status = VKTOR_OK;
+	
+	start = (piece->index == 0 ? array->first - 1 : parallel_find_boundary(piece));
+	end   = (piece->index == array->count - 1 ? array->last : 
+	         parallel_find_boundary(piece + 1));
+	
+	if (start >= end) {
+		return NULL;
+	}
+	
+	start++;
+	
+	if ((parser = vktor_parser_init_ex(array->max_nest, array->allocator)) == NULL) {
+		piece->status = VKTOR_ERROR;
+		return NULL;
+	}
+	
+	// An empty chunk is only valid as the body of an empty array
+	for (ptr = start; ptr < end && is_json_space(array->text[ptr]); ptr++);
+	if (ptr == end && ! (start == array->first && end == array->last)) {
+		set_error(parser, &piece->error, VKTOR_ERR_UNEXPECTED_INPUT, 
+			"expecting a value between bytes %ld and %ld", start - 1, end);
+		piece->status = VKTOR_ERROR;
+		vktor_parser_free(parser);
+		return NULL;
+	}
+	
+	if (vktor_feed(parser, open_bracket, 1, 0, &piece->error) == VKTOR_ERROR ||
+	    vktor_feed(parser, (char *) array->text + start, end - start, 0, 
+	               &piece->error) == VKTOR_ERROR ||
+	    vktor_feed(parser, close_bracket, 1, 0, &piece->error) == VKTOR_ERROR) {
+		piece->status = VKTOR_ERROR;
+		vktor_parser_free(parser);
+		return NULL;
+	}
+	
+	if (array->handler(array->ctx, parser, &piece->result, &piece->error) == VKTOR_ERROR) {
+		if (piece->error == NULL) {
+			set_error(parser, &piece->error, VKTOR_ERR_UNEXPECTED_INPUT, 
+				"array chunk handler failed for bytes %ld to %ld", start, end);
+		}
+		piece->status = VKTOR_ERROR;
+		vktor_parser_free(parser);
+		return NULL;
+	}
+	
+	// Validate whatever the handler left unread
+	do {
+		piece->status = vktor_parse(parser, &piece->error);
+	} while (piece->status == VKTOR_OK);
+	
+	if (piece->status == VKTOR_MORE_DATA) {
+		set_error(parser, &piece->error, VKTOR_ERR_INCOMPLETE_DATA, 
+			"array element starting before byte %ld is not complete", end);
+		piece->status = VKTOR_ERROR;
+	}
+	
+	vktor_parser_free(parser);
+	
+	return NULL;
+}
+
+/**
+ * @brief Run a function for each piece of an array
+ * 
+ * Run a function on a worker thread for each piece but the first, which is 
+ * handled by the calling thread, and wait for all of them to finish. Pieces 
+ * for which a thread cannot be created are handled by the calling thread too.
+ * 
+ * @param [in,out] array The array whose pieces to handle
+ * @param [in]     fn    Function to run, passed a vktor_piece
+ */
+static void
+parallel_run(vktor_array *array, void *(*fn) (void *))
+{
+	int i;
+	
+#ifndef VKTOR_NO_THREADS
+	for (i = 1; i < array->count; i++) {
+		array->pieces[i].threaded = (pthread_create(&array->pieces[i].thread, 
+			NULL, fn, &array->pieces[i]) == 0);
+	}
+	
+	fn(&array->pieces[0]);
+	
+	for (i = 1; i < array->count; i++) {
+		if (array->pieces[i].threaded) {
+			pthread_join(array->pieces[i].thread, NULL);
+		} else {
+			fn(&array->pieces[i]);
+		}
+	}
+#else
+	for (i = 0; i < array->count; i++) {
+		fn(&array->pieces[i]);
+	}
+#endif
+}
+
+/**
+ * @brief Parse the elements of a JSON array in parallel
+ * 
+ * Parse a buffer holding an entire UTF-8 JSON document whose top level value 
+ * is an array, splitting its elements into up to max_chunks chunks which are 
+ * parsed on worker threads. 
+ * 
+ * The array body is cut into pieces of equal size, and each worker counts 
+ * the unescaped quotes and nesting depth changes in its piece. The string 
+ * state and depth at the start of each piece follow from the counts of the 
+ * pieces before it, and each worker then scans from the start of its piece 
+ * to the first element boundary, and parses the elements up to the boundary
+ * found for the next piece. Each chunk is parsed by a new parser, created by
+ * vktor_parser_init_ex() with the passed allocator, and fed with the chunk 
+ * wrapped in an array of its own. 
+ * 
+ * The handler is called on the worker thread with the parser of each chunk.
+ * It may set parser options, and reads the tokens using vktor_parse(): an 
+ * array start token, the elements in the chunk and an array end token. Any 
+ * tokens it leaves unread are parsed and validated after it returns. Whatever
+ * the handler stores in its result pointer is returned in results, in chunk 
+ * order, which allows concatenating the elements of all chunks. As the 
+ * handler runs on several threads at once, it must be thread safe, and so 
+ * must the allocator. 
+ * 
+ * Input before the opening bracket and after the closing bracket of the array
+ * may only be whitespace. The text is not copied, and the whole document is
+ * validated. In case of error, -1 is returned but any results stored by the 
+ * handler are still returned in results, and all other entries are set to 
+ * NULL, so they can be freed.
+ * 
+ * @param [in]  text       JSON text
+ * @param [in]  text_len   JSON text length
+ * @param [in]  max_chunks Maximal number of chunks and threads
+ * @param [in]  max_nest   Maximal nesting level of each chunk parser, 
+ *                         including the array wrapping the chunk
+ * @param [in]  allocator  Thread safe allocator for the chunk parsers, or 
+ *                         NULL to use the standard malloc and free
+ * @param [in]  handler    Chunk handler
+ * @param [in]  ctx        Context pointer passed to the chunk handler
+ * @param [out] results    Array of at least max_chunks result pointers
+ * @param [out] error      Error object pointer pointer or NULL
+ * 
+ * @return The number of chunks parsed - an empty array is a single chunk 
+ *         with no elements
+ * @retval -1 in case of error
+ */
+int
+vktor_parse_array(const char *text, long text_len, int max_chunks, int max_nest,
+                  const vktor_allocator *allocator, vktor_chunk_handler handler,
+                  void *ctx, void **results, vktor_error **error)
+{
+	vktor_array  array;
+	vktor_piece *piece;
+	vktor_error *chunk_error = NULL;
+	long         first, last, size, depth = 0;
+	char         in_string = 0;
+	int          i, count = 0, failed = -1;
+	
+	assert(text != NULL);
+	assert(handler != NULL);
+	assert(results != NULL);
+	assert(max_chunks > 0);
+	
+	for (i = 0; i < max_chunks; i++) {
+		results[i] = NULL;
+	}
+	
+	// Find the brackets of the array, with nothing but whitespace around them
+	for (first = 0; first < text_len && is_json_space(text[first]); first++);
+	for (last = text_len - 1; last > first && is_json_space(text[last]); last--);
+	
+	if (first >= text_len || text[first] != '[') {
+		set_error(NULL, error, VKTOR_ERR_UNEXPECTED_INPUT, 
+			"expecting a JSON array to parse");
+		return -1;
+	}
+	
+	if (last == first || text[last] != ']') {
+		set_error(NULL, error, VKTOR_ERR_UNEXPECTED_INPUT, 
+			"expecting the JSON array to end at byte %ld", last);
+		return -1;
+	}
+	
+	array.text      = text;
+	array.first     = first + 1;
+	array.last      = last;
+	array.max_nest  = max_nest;
+	array.allocator = (allocator == NULL ? &std_allocator : allocator);
+	array.handler   = handler;
+	array.ctx       = ctx;
+	
+	// Pieces too small are not worth a thread
+	size = last - first - 1;
+	array.count = max_chunks;
+	if (size / VKTOR_PARALLEL_MINCHUNK < array.count) {
+		array.count = (int) (size / VKTOR_PARALLEL_MINCHUNK);
+		if (array.count < 1) array.count = 1;
+	}
+	
+	array.pieces = array.allocator->malloc_fn(array.allocator->ctx, 
+		array.count * sizeof(vktor_piece));
+	if (array.pieces == NULL) {
+		set_error(NULL, error, VKTOR_ERR_OUT_OF_MEMORY, 
+			"unable to allocate %ld bytes for array pieces", 
+			(long) (array.count * sizeof(vktor_piece)));
+		return -1;
+	}
+	
+	for (i = 0; i < array.count; i++) {
+		piece = &array.pieces[i];
+		piece->array  = &array;
+		piece->index  = i;
+		piece->start  = array.first + (size / array.count) * i;
+		piece->end    = (i == array.count - 1 ? array.last : 
+		                 array.first + (size / array.count) * (i + 1));
+		piece->result = NULL;
+		piece->error  = NULL;
+	}
+	
+	// Scan all pieces, and carry the string state and depth from each piece 
+	// to the next one
+	if (array.count > 1) {
+		parallel_run(&array, parallel_scan_piece);
+		
+		for (i = 0; i < array.count; i++) {
+			piece = &array.pieces[i];
+			piece->in_string = in_string;
+			piece->depth     = depth;
+			
+			depth     += piece->delta[(int) in_string];
+			in_string ^= piece->quote;
+		}
+	}
+	
+	parallel_run(&array, parallel_parse_piece);
+	
+	// Collect the results in order, keeping the error of the first chunk 
+	// that failed
+	for (i = 0; i < array.count; i++) {
+		piece = &array.pieces[i];
+		
+		if (piece->result != NULL) {
+			results[count++] = piece->result;
+		}
+		
+		if (piece->status != VKTOR_ERROR) continue;
+		
+		if (failed < 0) {
+			failed      = i;
+			chunk_error = piece->error;
+		} else if (piece->error != NULL) {
+			vktor_error_free(piece->error);
+		}
+	}
+	
+	array.allocator->free_fn(array.allocator->ctx, array.pieces);
+	
+	if (failed >= 0) {
+		if (chunk_error == NULL) {
+			set_error(NULL, error, VKTOR_ERR_OUT_OF_MEMORY, 
+				"unable to allocate a parser for array piece %d", failed);
+		} else if (error != NULL) {
+			*error = chunk_error;
+		} else {
+			vktor_error_free(chunk_error);
+		}
+		return -1;
+	}
+	
+	return count;
+}
+
+/**
+ * @brief Skip the rest of the struct being skipped 
+ * 
+ * Skip raw input until the end of the struct being skipped, only keeping 
+ * track of strings and of the nesting depth (parser->skip_depth) inside the
+ * struct. Skipped input is not validated, except for the bracket closing the
+ * struct itself. When the end of the struct is reached, it is set as the 
+ * current token.
+ * 
+ * @param [in,out] parser Parser object
+ * @param [out]    error  Error object pointer pointer or NULL
+ * 
+ * @return Status code - VKTOR_OK when the struct end is reached, 
+ *         VKTOR_MORE_DATA if more data is needed, or VKTOR_ERROR
+ */
+static vktor_status
+parser_skip_struct(vktor_parser *parser, vktor_error **error)
+{
+	vktor_buffer *buffer;
+	char          c;
+	long          run;
+	
+	assert(parser->skip_depth > 0);
+	
+	while (parser->buffer != NULL) {
+		buffer = parser->buffer;
+		if (parser->skip_string == 0) {
+			parser_index_buffer(parser);
+		}
+		
+		while (! eobuffer(buffer)) {
+			// Walk the structural index right to the bracket closing the 
+			// struct if there is one, or jump over any run of plain string 
+			// characters at once
+			if (parser->skip_string == 0 && buffer_has_index(buffer)) {
+				int string;
+				
+				run = vktor_index_skip(buffer->text + buffer->index_start, 
+					buffer->index, buffer->ptr - buffer->index_start, 
+					buffer->size - buffer->index_start, &parser->skip_depth, 
+					&string) + buffer->index_start - buffer->ptr;
+				buffer->ptr += run;
+#ifdef BYTECOUNTER
+				parser->bytecounter += run;
+#endif
+				if (eobuffer(buffer)) {
+					parser->skip_string = (unsigned char) string;
+					break;
+				}
+			} else if (parser->skip_string == 1) {
+				run = vktor_scan_string(buffer->text + buffer->ptr, 
+					buffer->size - buffer->ptr, 0);
+				buffer->ptr += run;
+#ifdef BYTECOUNTER
+				parser->bytecounter += run;
+#endif
+				if (eobuffer(buffer)) break;
+			}
+			
+			c = buffer->text[buffer->ptr];
+			INCREMENT_BUFFER_PTR(parser);
+			
+			if (parser->skip_string) {
+				if (parser->skip_string == 2) {
+					parser->skip_string = 1;
+				} else if (c == '\\') {
+					parser->skip_string = 2;
+				} else if (c == '"') {
+					parser->skip_string = 0;
+				}
+				continue;
+			}
 			
 			switch (c) {
+				case '"':
+					parser->skip_string = 1;
+					break;
+					
+				case '[':
 				case '{':
-					if (! parser->expected & VKTOR_T_OBJECT_START) {
+					parser->skip_depth++;
+					break;
+					
+				case ']':
+				case '}':
+					if (--parser->skip_depth > 0) break;
+					
+					// End of the skipped struct
+					if ((c == ']') != nest_stack_in(parser, VKTOR_STRUCT_ARRAY)) {
 						set_error_unexpected_c(error, c);
 						return VKTOR_ERROR;
 					}
 					
-					if (nest_stack_add(parser, VKTOR_STRUCT_OBJECT, error) == VKTOR_ERROR) {
-						return VKTOR_ERROR;
+					if (parser->capture_fn == NULL) {
+						parser->raw_start = buffer->ptr - 1;
+						parser->raw_end   = -1;
+						parser->raw_len   = 0;
+					}
+					
+					if (nest_stack_pop(parser, error) == VKTOR_ERROR) {
+						return VKTOR_ERROR;
+					}
+					
+					parser_set_token(parser, (c == ']' ? VKTOR_T_ARRAY_END : 
+						VKTOR_T_OBJECT_END), NULL);
+					parser->expected = end_next_expected[parser->nest_ptr > 0];
+					return VKTOR_OK;
+			}
+		}
+		
+		parser_advance_buffer(parser);
+	}
+	
+	return VKTOR_MORE_DATA;
+}
+
+/**
+ * @brief Parse some JSON text and return on the next token
+ * 
+ * Parse the text buffer until the next JSON token of any type is encountered.
+ * Used by vktor_parse(), which applies the token mask.
+ * 
+ * @param [in,out] parser The parser object to work with
+ * @param [out]    error  A vktor_error pointer pointer, or NULL
+ * 
+ * @return status code, as returned by vktor_parse()
+ */
+static vktor_status 
+parser_parse_token(vktor_parser *parser, vktor_error **error)
+{
+	char            c;
+	vktor_charclass cc;
+	int             done;
+	vktor_status    status;
+#ifdef VKTOR_COMPUTED_GOTO
+	static const void *class_labels[VKTOR_CC_COUNT] = {
+		&&label_VKTOR_CC_INVALID,
+		&&label_VKTOR_CC_WS,
+		&&label_VKTOR_CC_OBJECT_START,
+		&&label_VKTOR_CC_OBJECT_END,
+		&&label_VKTOR_CC_ARRAY_START,
+		&&label_VKTOR_CC_ARRAY_END,
+		&&label_VKTOR_CC_QUOTE,
+		&&label_VKTOR_CC_COMMA,
+		&&label_VKTOR_CC_COLON,
+		&&label_VKTOR_CC_TRUE,
+		&&label_VKTOR_CC_FALSE,
+		&&label_VKTOR_CC_NULL,
+		&&label_VKTOR_CC_NUMBER
+	};
+#endif
+	
+	assert(parser != NULL);
+	
+	// Wait until the input encoding is known
+	if (parser->encoding == VKTOR_ENC_AUTO) {
+		return VKTOR_MORE_DATA;
+	}
+	
+	// Continue skipping a struct, if one is half skipped
+	if (parser->skip_depth > 0) {
+		return parser_skip_struct(parser, error);
+	}
+	
+	// Skip whatever was not read of a streamed string
+	if (parser->str_open) {
+		status = parser_skip_string(parser, error);
+		if (status != VKTOR_OK) {
+			return status;
+		}
+	}
+	
+	// Remember where the last token ended, so that its raw text can be kept 
+	// if its buffer is done with before another token starts
+	if (parser->buffer != NULL && parser->capture_fn == NULL && 
+	    parser->token_type != VKTOR_T_NONE && ! parser->token_resume) {
+		parser->raw_end = parser->buffer->ptr;
+	}
+	
+	// Do we have a buffer to work with?
+	while (parser->buffer != NULL) {
+		done = 0;
+		
+		// Do we need to continue reading the previous token?
+		if (parser->token_resume) {
+						
+		    switch (parser->token_type) {
+		    	case VKTOR_T_OBJECT_KEY:
+		    		return parser_read_objkey_token(parser, error);
+		    		break;
+		    		
+		    	case VKTOR_T_STRING:
+		    		return parser_read_string_token(parser, error);
+		    		break;
+		    	
+				case VKTOR_T_NULL:
+					return parser_read_null(parser, error);
+					break;
+					
+				case VKTOR_T_TRUE:
+					return parser_read_true(parser, error);
+					break;
+				
+				case VKTOR_T_FALSE:
+					return parser_read_false(parser, error);
+					break;
+				
+				case VKTOR_T_INT:
+				case VKTOR_T_FLOAT:
+					return parser_read_number_token(parser, error);
+					break;
+					
+		    	default:
+		    		set_error(parser, error, VKTOR_ERR_INTERNAL_ERR, 
+		    			"token resume flag is set but token type %d is unexpected",
+		    			parser->token_type);
+		    		return VKTOR_ERROR;
+		    		break;
+		    }
+		}
+		
+		while (! eobuffer(parser->buffer)) {
+			c  = parser->buffer->text[parser->buffer->ptr];
+			cc = char_classes[(unsigned char) c];
+			
+			// Is this character acceptable right now?
+			if (! ((parser->expected | VKTOR_C_WS) & class_expected[cc])) {
+				set_error_unexpected_c(error, c);
+				return VKTOR_ERROR;
+			}
+			
+			dispatch_char_class(cc) {
+				char_class_handler(VKTOR_CC_OBJECT_START):
+					mark_token_start(parser);
+					if (nest_stack_add(parser, VKTOR_STRUCT_OBJECT, error) == VKTOR_ERROR) {
+						return VKTOR_ERROR;
 					}
 					
 					parser_set_token(parser, VKTOR_T_OBJECT_START, NULL);
@@ -1331,14 +3608,10 @@ vktor_parse(vktor_parser *parser, vktor_error **error)
 					                   VKTOR_T_OBJECT_END;
 					
 					done = 1;
-					break;
-					
-				case '[':
-					if (! parser->expected & VKTOR_T_ARRAY_START) {
-						set_error_unexpected_c(error, c);
-						return VKTOR_ERROR;
-					}
+					goto next_char;
 					
+				char_class_handler(VKTOR_CC_ARRAY_START):
+					mark_token_start(parser);
 					if (nest_stack_add(parser, VKTOR_STRUCT_ARRAY, error) == VKTOR_ERROR) {
 						return VKTOR_ERROR;
 					}
@@ -1350,65 +3623,40 @@ vktor_parse(vktor_parser *parser, vktor_error **error)
 					                   VKTOR_T_ARRAY_END;
 					
 					done = 1;
-					break;
+					goto next_char;
 					
-				case '"':
-					if (! (parser->expected & (VKTOR_T_STRING | 
-					                           VKTOR_T_OBJECT_KEY))) {
-						set_error_unexpected_c(error, c);
-						return VKTOR_ERROR;
-					}
-				
+				char_class_handler(VKTOR_CC_QUOTE):
+					mark_token_start(parser);
 					INCREMENT_BUFFER_PTR(parser);
 					
 					if (parser->expected & VKTOR_T_OBJECT_KEY) {
 						return parser_read_objkey_token(parser, error);
+					} else if (parser->stream_strings) {
+						return parser_open_string(parser);
 					} else {
 						return parser_read_string_token(parser, error);
 					}
-					
-					break;
 				
-				case ',':
-					if (! (parser->expected & VKTOR_C_COMMA)) {
-						set_error_unexpected_c(error, c);
+				char_class_handler(VKTOR_CC_COMMA):
+					parser->expected = comma_next_expected[parser->nest_current];
+					if (parser->expected == 0) {
+						set_error(parser, error, VKTOR_ERR_INTERNAL_ERR, 
+							"internal parser error: unexpected nesting stack member");
 						return VKTOR_ERROR;
 					}
-					
-					switch(parser->nest_stack[parser->nest_ptr]) {
-						case VKTOR_STRUCT_OBJECT:
-							parser->expected = VKTOR_T_OBJECT_KEY;
-							break;
-							
-						case VKTOR_STRUCT_ARRAY:
-							parser->expected = VKTOR_VALUE_TOKEN;
-							break;
-							
-						default:
-							set_error(error, VKTOR_ERR_INTERNAL_ERR, 
-								"internal parser error: unexpected nesting stack member");
-							return VKTOR_ERROR;
-							break;
-					}
-					break;
+					goto next_char;
 				
-				case ':':
-					if (! (parser->expected & VKTOR_C_COLON)) {
-						set_error_unexpected_c(error, c);
-						return VKTOR_ERROR;
-					}
-					
+				char_class_handler(VKTOR_CC_COLON):
 					// Colon is only expected inside objects
 					assert(nest_stack_in(parser, VKTOR_STRUCT_OBJECT));
 					
 					// Next we expected a value
 					parser->expected = VKTOR_VALUE_TOKEN;
-					break;
-					
-				case '}':
-					if (! (parser->expected & VKTOR_T_OBJECT_END &&
-					       nest_stack_in(parser, VKTOR_STRUCT_OBJECT))) {
+					goto next_char;
 					
+				char_class_handler(VKTOR_CC_OBJECT_END):
+					mark_token_start(parser);
+					if (! nest_stack_in(parser, VKTOR_STRUCT_OBJECT)) {
 						set_error_unexpected_c(error, c);
 						return VKTOR_ERROR;
 					}
@@ -1419,185 +3667,689 @@ vktor_parse(vktor_parser *parser, vktor_error **error)
 						return VKTOR_ERROR;
 					} 
 					
-					if (parser->nest_ptr > 0) {
-						// Next can be either a comma, or end of array / object
-						parser->expected = VKTOR_C_COMMA | 
-											 VKTOR_T_OBJECT_END | 
-											 VKTOR_T_ARRAY_END;
-					} else {
-						// Next can be nothing
-						parser->expected = VKTOR_T_NONE;
-					}
-					                     
-					done = 1;
-					break;
+					// Next can be either a comma, or end of array / object, 
+					// or nothing at the top level
+					parser->expected = end_next_expected[parser->nest_ptr > 0];
 					
-				case ']':
-					if (! (parser->expected & VKTOR_T_ARRAY_END &&
-					       nest_stack_in(parser, VKTOR_STRUCT_ARRAY))) { 
+					done = 1;
+					goto next_char;
 					
+				char_class_handler(VKTOR_CC_ARRAY_END):
+					mark_token_start(parser);
+					if (! nest_stack_in(parser, VKTOR_STRUCT_ARRAY)) { 
 						set_error_unexpected_c(error, c);
 						return VKTOR_ERROR;
 					}
+					
 					parser_set_token(parser, VKTOR_T_ARRAY_END, NULL);
 					
 					if (nest_stack_pop(parser, error) == VKTOR_ERROR) {
 						return VKTOR_ERROR;
 					} 
 					
-					if (parser->nest_ptr > 0) {
-						// Next can be either a comma, or end of array / object
-						parser->expected = VKTOR_C_COMMA      | 
-						                   VKTOR_T_OBJECT_END | 
-										   VKTOR_T_ARRAY_END;
-					} else {
-						// Next can be nothing
-						parser->expected = VKTOR_T_NONE;
-					}
-					                     
-					done = 1;
-					break;
+					parser->expected = end_next_expected[parser->nest_ptr > 0];
 					
-				case ' ':
-				case '\n':
-				case '\r':
-				case '\t':
-				case '\f':
-				case '\v':
-					// Whitespace - do nothing!
-					/** 
-					 * @todo consinder: read all whitespace without looping? 
-					 */
-					break;
+					done = 1;
+					goto next_char;
 					
-				case 't':
-					// true?
-					if (! (parser->expected & VKTOR_T_TRUE)) {
-						set_error_unexpected_c(error, c);
-						return VKTOR_ERROR;
+				char_class_handler(VKTOR_CC_WS):
+					// Whitespace - skip the entire run, leaving the pointer 
+					// on the last whitespace character
+					{
+						long run;
+						
+						if (buffer_has_index(parser->buffer)) {
+							run = buffer_next_mark(parser->buffer, 
+								parser->buffer->size - parser->buffer->ptr);
+						} else {
+							run = vktor_scan_whitespace(
+								parser->buffer->text + parser->buffer->ptr, 
+								parser->buffer->size - parser->buffer->ptr);
+						}
+						
+						parser->buffer->ptr += run - 1;
+#ifdef BYTECOUNTER
+						parser->bytecounter += run - 1;
+#endif
 					}
+					goto next_char;
 					
+				char_class_handler(VKTOR_CC_TRUE):
+					mark_token_start(parser);
 					return parser_read_true(parser, error);
-					break;
-					
-				case 'f':
-					// false?
-					if (! (parser->expected & VKTOR_T_FALSE)) {
-						set_error_unexpected_c(error, c);
-						return VKTOR_ERROR;
-					}
 					
+				char_class_handler(VKTOR_CC_FALSE):
+					mark_token_start(parser);
 					return parser_read_false(parser, error);
-					break;
-
-				case 'n':
-					// null?
-					if (! (parser->expected & VKTOR_T_NULL)) {
-						set_error_unexpected_c(error, c);
-						return VKTOR_ERROR;
-					}
 					
+				char_class_handler(VKTOR_CC_NULL):
+					mark_token_start(parser);
 					return parser_read_null(parser, error);
-					break;
-									
-				case '0':
-				case '1':
-				case '2':
-				case '3':
-				case '4':
-				case '5':
-				case '6':
-				case '7':
-				case '8':
-				case '9':
-				case '-':
-				case '+':
-					// Read a number
-					if (! (parser->expected & (VKTOR_T_INT | 
-					                           VKTOR_T_FLOAT))) {
-						set_error_unexpected_c(error, c);
-						return VKTOR_ERROR;
-					}
 					
+				char_class_handler(VKTOR_CC_NUMBER):
+					mark_token_start(parser);
 					return parser_read_number_token(parser, error);
-					break;
 					
+				char_class_handler(VKTOR_CC_INVALID):
+#ifndef VKTOR_COMPUTED_GOTO
 				default:
-					// Unexpected character
+#endif
+					// Unexpected character - should have been caught above
 					set_error_unexpected_c(error, c);
 					return VKTOR_ERROR;
-					break;
 			}
 			
+next_char:
 			INCREMENT_BUFFER_PTR(parser);
 			if (done) break;
 		}
 		
 		if (done) break;
+		
+		if (parser->raw_end >= 0 && parser_keep_token_raw(parser, error) == VKTOR_ERROR) {
+			return VKTOR_ERROR;
+		}
 		parser_advance_buffer(parser);	
 	}
 	
-	assert(parser->nest_ptr >= 0);
+	assert(parser->nest_ptr >= 0);
+	
+	if (parser->buffer != NULL) {
+		return VKTOR_OK;
+	} else {
+		if (parser->nest_ptr == 0 && parser->token_type != VKTOR_T_NONE && 
+		    ! parser->token_resume) {
+			return VKTOR_COMPLETE;
+		} else {
+			return VKTOR_MORE_DATA;
+		}
+	}
+}
+
+/**
+ * @brief Parse some JSON text and return on the next token
+ * 
+ * Parse the text buffer until the next JSON token is encountered. If the
+ * VKTOR_OPT_TOKEN_MASK option is set, tokens of types not in the mask are
+ * parsed and validated but skipped, and parsing goes on to the next token. 
+ * Skipped strings and object keys are not decoded - only their end is found,
+ * so their escape sequences and UTF-8 are not checked.
+ * 
+ * In case of error, if error is not NULL, it will be populated with error 
+ * information, and VKTOR_ERROR will be returned
+ * 
+ * @param [in,out] parser The parser object to work with
+ * @param [out]    error  A vktor_error pointer pointer, or NULL
+ * 
+ * @return status code:
+ *  - VKTOR_OK        if a token was encountered
+ *  - VKTOR_ERROR     if an error has occured
+ *  - VKTOR_MORE_DATA if we need more data in order to continue parsing
+ *  - VKTOR_COMPLETE  if parsing is complete and no further data is expected
+ */
+vktor_status 
+vktor_parse(vktor_parser *parser, vktor_error **error)
+{
+	vktor_status status;
+	
+	do {
+		status = parser_parse_token(parser, error);
+	} while (status == VKTOR_OK && ! (parser->token_type & parser->token_mask));
+	
+	return status;
+}
+
+/**
+ * @brief Skip the next JSON value
+ * 
+ * Read the next token, and if it is the start of an array or an object, skip
+ * the entire struct, leaving the parser on its end token. Structs are skipped
+ * by scanning the raw input for the matching closing bracket, which is much 
+ * faster than parsing each token but does not validate the skipped input. 
+ * 
+ * If the next token is not a struct start, it is read just like vktor_parse() 
+ * would read it - so this can also be used to skip object keys, or to detect
+ * the end of the struct being read. The token mask is ignored. 
+ * 
+ * If VKTOR_MORE_DATA is returned, more data should be fed to the parser and
+ * vktor_skip_value() or vktor_parse() called again to complete skipping.
+ * 
+ * @param [in,out] parser The parser object to work with
+ * @param [out]    error  A vktor_error pointer pointer, or NULL
+ * 
+ * @return status code, as returned by vktor_parse()
+ */
+vktor_status
+vktor_skip_value(vktor_parser *parser, vktor_error **error)
+{
+	vktor_status status;
+	
+	assert(parser != NULL);
+	
+	if (parser->skip_depth > 0) {
+		return parser_parse_token(parser, error);
+	}
+	
+	status = parser_parse_token(parser, error);
+	if (status == VKTOR_OK && (parser->token_type == VKTOR_T_ARRAY_START || 
+	                           parser->token_type == VKTOR_T_OBJECT_START)) {
+		parser->skip_depth  = 1;
+		parser->skip_string = 0;
+		status = parser_skip_struct(parser, error);
+	}
+	
+	return status;
+}
+
+/**
+ * @brief Skip the rest of the current JSON struct
+ * 
+ * Skip the rest of the array or object the parser is in, as reported by 
+ * vktor_get_current_struct(), leaving the parser on its end token. Like 
+ * vktor_skip_value(), the skipped input is scanned for the closing bracket 
+ * without being validated. 
+ * 
+ * If VKTOR_MORE_DATA is returned, more data should be fed to the parser and
+ * vktor_skip_struct() or vktor_parse() called again to complete skipping.
+ * 
+ * @param [in,out] parser The parser object to work with
+ * @param [out]    error  A vktor_error pointer pointer, or NULL
+ * 
+ * @return status code, as returned by vktor_parse()
+ */
+vktor_status
+vktor_skip_struct(vktor_parser *parser, vktor_error **error)
+{
+	vktor_status status;
+	
+	assert(parser != NULL);
+	
+	if (parser->skip_depth > 0) {
+		return parser_parse_token(parser, error);
+	}
+	
+	if (parser->nest_ptr == 0) {
+		set_error(parser, error, VKTOR_ERR_UNSUPPORTED, 
+			"not in an array or object, nothing to skip");
+		return VKTOR_ERROR;
+	}
+	
+	// Finish reading a half read token or streamed string, so skipping 
+	// starts between tokens
+	if (parser->str_open) {
+		status = parser_skip_string(parser, error);
+		if (status != VKTOR_OK) {
+			return status;
+		}
+	}
+	
+	if (parser->token_resume) {
+		status = parser_parse_token(parser, error);
+		if (status != VKTOR_OK) {
+			return status;
+		}
+		if (parser->token_type == VKTOR_T_ARRAY_END || 
+		    parser->token_type == VKTOR_T_OBJECT_END) {
+			return VKTOR_OK;
+		}
+	}
+	
+	parser->skip_depth  = 1;
+	parser->skip_string = 0;
+	
+	return parser_skip_struct(parser, error);
+}
+
+/**
+ * @brief Get the current nesting depth
+ * 
+ * Get the current array/object nesting depth of the current token the parser
+ * is pointing to
+ * 
+ * @param [in] parser Parser object
+ * 
+ * @return nesting level - 0 means top level
+ */
+int
+vktor_get_depth(vktor_parser *parser) 
+{
+	return parser->nest_ptr;	
+}
+
+/**
+ * @brief Get the current struct type
+ * 
+ * Get the struct type (object, array or none) containing the current token
+ * pointed to by the parser
+ * 
+ * @param [in] parser Parser object
+ * 
+ * @return A vktor_struct value or VKTOR_STRUCT_NONE if we are in the top 
+ *   level
+ */
+vktor_struct
+vktor_get_current_struct(vktor_parser *parser)
+{
+	assert(parser != NULL);
+	return parser->nest_current;
+}
+
+/**
+ * @brief Get the current token type
+ * 
+ * Get the type of the current token pointed to by the parser
+ * 
+ * @param [in] parser Parser object
+ * 
+ * @return Token type (one of the VKTOR_T_* tokens)
+ */
+vktor_token
+vktor_get_token_type(vktor_parser *parser)
+{
+	assert(parser != NULL);
+	return parser->token_type;	
+}
+
+/**
+ * @brief Get the absolute input offset of the parser
+ * 
+ * Get the number of input bytes consumed by the parser since it was 
+ * initialized (or since the offset recorded in a restored snapshot). This is 
+ * the position right after the current token.
+ * 
+ * @param [in] parser Parser object
+ * 
+ * @return offset in bytes
+ */
+long
+vktor_get_offset(vktor_parser *parser)
+{
+	assert(parser != NULL);
+	
+	if (parser->buffer == NULL) {
+		return parser->offset;
+	}
+	
+	return parser->offset + parser->buffer->ptr;
+}
+
+/**
+ * @brief Get the raw input text of the current token
+ * 
+ * Get the current token exactly as it appears in the input. The part of the 
+ * token in the current buffer is returned in place when possible - only the
+ * parts of tokens spanning buffers are copied, by parser_keep_token_raw().
+ * 
+ * @param [in]  parser Parser object
+ * @param [out] raw    Pointer-pointer to be populated with the raw text
+ * @param [out] error  Error object pointer pointer or NULL
+ * 
+ * @return The length of the raw text
+ * @retval -1 in case of error
+ */
+long
+vktor_get_token_raw(vktor_parser *parser, char **raw, vktor_error **error)
+{
+	long len;
+	
+	assert(parser != NULL);
+	
+	if (parser->token_type == VKTOR_T_NONE || parser->token_resume || 
+	    parser->skip_depth > 0) {
+		set_error(parser, error, VKTOR_ERR_NO_VALUE, 
+			"no complete token to get the raw text of");
+		return -1;
+	}
+	
+	if (parser->token_type == VKTOR_T_STRING_START) {
+		set_error(parser, error, VKTOR_ERR_UNSUPPORTED, 
+			"raw text of streamed strings is not available");
+		return -1;
+	}
+	
+	if (parser->capture_fn != NULL) {
+		set_error(parser, error, VKTOR_ERR_UNSUPPORTED, 
+			"raw token text is not available while capturing");
+		return -1;
+	}
+	
+	if (parser->raw_len == 0 && parser->buffer != NULL) {
+		*raw = parser->buffer->text + parser->raw_start;
+		len  = (parser->raw_end >= 0 ? parser->raw_end : parser->buffer->ptr) - 
+			parser->raw_start;
+	} else {
+		if (parser_keep_token_raw(parser, error) == VKTOR_ERROR) {
+			return -1;
+		}
+		*raw = parser->raw;
+		len  = parser->raw_len;
+	}
+	
+	// No token is empty - its text was not kept, as after a restore
+	if (len == 0) {
+		set_error(parser, error, VKTOR_ERR_NO_VALUE, 
+			"raw text of the current token is no longer available");
+		return -1;
+	}
+	
+	return len;
+}
+
+/**
+ * @brief Decode a string read with the VKTOR_OPT_LAZY_STRINGS option
+ * 
+ * Decode the raw text of the current string token found by 
+ * parser_scan_string() into the token value. The raw text is copied as is if
+ * it has no escape sequences and UTF-8 needs no checking, or otherwise read 
+ * by parser_read_string() as if it was the input. 
+ * 
+ * @param [in,out] parser Parser object
+ * @param [out]    error  Error object pointer pointer or NULL
+ * 
+ * @return Status code - VKTOR_OK or VKTOR_ERROR
+ */
+static vktor_status
+parser_decode_string(vktor_parser *parser, vktor_error **error)
+{
+	vktor_buffer  raw_buffer, *buffer;
+	vktor_status  status;
+	long          expected, raw_len;
+	char         *raw, *token, lazy_strings;
+#ifdef BYTECOUNTER
+	unsigned long bytecounter = parser->bytecounter;
+#endif
+	
+	assert(parser->token_lazy && ! parser->token_resume);
+	
+	if ((raw_len = vktor_get_token_raw(parser, &raw, error)) < 0) {
+		return VKTOR_ERROR;
+	}
+	assert(raw_len >= 2);
+	
+	if (! parser->token_escaped && parser->utf8_mode == VKTOR_UTF8_IGNORE) {
+		if ((token = parser_scratch(parser, (int) raw_len)) == NULL) {
+			set_error(parser, error, VKTOR_ERR_OUT_OF_MEMORY, 
+				"unable to allocate %ld bytes for string decoding", raw_len);
+			return VKTOR_ERROR;
+		}
+		memcpy(token, raw + 1, raw_len - 2);
+		token[raw_len - 2] = '\0';
+		
+		parser->token_value = (void *) token;
+		parser->token_size  = (int) raw_len - 2;
+		parser->token_lazy  = 0;
+		return VKTOR_OK;
+	}
+	
+	// Read the raw text after the opening quote, as the only input buffer
+	raw_buffer.text      = raw + 1;
+	raw_buffer.size      = raw_len - 1;
+	raw_buffer.ptr       = 0;
+	raw_buffer.free      = 0;
+	raw_buffer.indexed   = 1;
+	raw_buffer.index     = NULL;
+	raw_buffer.next_buff = NULL;
+	
+	buffer       = parser->buffer;
+	expected     = parser->expected;
+	lazy_strings = parser->lazy_strings;
+	
+	parser->buffer       = &raw_buffer;
+	parser->expected     = VKTOR_T_STRING;
+	parser->token_lazy   = 0;
+	parser->lazy_strings = 0;
+	
+	status = parser_read_string(parser, error);
+	
+	parser->buffer       = buffer;
+	parser->expected     = expected;
+	parser->lazy_strings = lazy_strings;
+#ifdef BYTECOUNTER
+	parser->bytecounter  = bytecounter;
+#endif
+	
+	if (status != VKTOR_OK) {
+		// Decoding fails the same way if tried again
+		parser->token_value  = NULL;
+		parser->token_resume = 0;
+		parser->token_lazy   = 1;
+		if (status != VKTOR_ERROR) {
+			set_error(parser, error, VKTOR_ERR_INTERNAL_ERR, 
+				"internal parser error: incomplete lazy string");
+		}
+		return VKTOR_ERROR;
+	}
+	
+	return VKTOR_OK;
+}
+
+/**
+ * @brief Start capturing raw input
+ * 
+ * Start passing the raw input consumed by the parser to a handler, beginning
+ * with the current token. The handler is called by parser_advance_buffer() 
+ * with the rest of each buffer, and by vktor_capture_end().
+ * 
+ * @param [in,out] parser  Parser object
+ * @param [in]     handler Handler to pass the captured input to
+ * @param [in]     ctx     Pointer passed to the handler
+ * @param [out]    error   Error object pointer pointer or NULL
+ * 
+ * @return Status code - VKTOR_OK or VKTOR_ERROR
+ */
+vktor_status
+vktor_capture_start(vktor_parser *parser, vktor_raw_handler handler, void *ctx,
+                    vktor_error **error)
+{
+	assert(parser != NULL);
+	assert(handler != NULL);
+	
+	if (parser->capture_fn != NULL) {
+		set_error(parser, error, VKTOR_ERR_UNSUPPORTED, 
+			"already capturing raw input");
+		return VKTOR_ERROR;
+	}
+	
+	if (parser->token_type == VKTOR_T_NONE || parser->token_resume || 
+	    parser->skip_depth > 0) {
+		set_error(parser, error, VKTOR_ERR_NO_VALUE, 
+			"no complete token to start capturing from");
+		return VKTOR_ERROR;
+	}
 	
-	if (parser->buffer != NULL) {
-		return VKTOR_OK;
-	} else {
-		if (parser->nest_ptr == 0 && parser->token_type != VKTOR_T_NONE) {
-			return VKTOR_COMPLETE;
-		} else {
-			return VKTOR_MORE_DATA;
-		}
+	// A streamed string is captured from its opening quote, so none of it 
+	// may have been read yet
+	if (parser->token_type == VKTOR_T_STRING_START && 
+	    (! parser->str_open || parser->str_started)) {
+		set_error(parser, error, VKTOR_ERR_UNSUPPORTED, 
+			"can not capture a streamed string which was already read from");
+		return VKTOR_ERROR;
+	}
+	
+	// Raw text is not tracked while capturing, so decode a lazy string now
+	if (parser->token_lazy && parser_decode_string(parser, error) == VKTOR_ERROR) {
+		return VKTOR_ERROR;
+	}
+	
+	// The part of the current token from previous buffers goes first
+	if (parser->raw_len > 0) {
+		handler(ctx, parser->raw, parser->raw_len);
+		parser->raw_len = 0;
 	}
+	
+	parser->capture_fn  = handler;
+	parser->capture_ctx = ctx;
+	
+	return VKTOR_OK;
 }
 
 /**
- * @brief Get the current nesting depth
+ * @brief Stop capturing raw input
  * 
- * Get the current array/object nesting depth of the current token the parser
- * is pointing to
+ * Pass any captured input up to the current buffer position to the handler,
+ * and stop capturing. 
  * 
- * @param [in] parser Parser object
+ * @param [in,out] parser Parser object
+ * @param [out]    error  Error object pointer pointer or NULL
  * 
- * @return nesting level - 0 means top level
+ * @return Status code - VKTOR_OK or VKTOR_ERROR
  */
-int
-vktor_get_depth(vktor_parser *parser) 
+vktor_status
+vktor_capture_end(vktor_parser *parser, vktor_error **error)
 {
-	return parser->nest_ptr;	
+	assert(parser != NULL);
+	
+	if (parser->capture_fn == NULL) {
+		set_error(parser, error, VKTOR_ERR_UNSUPPORTED, 
+			"not capturing raw input");
+		return VKTOR_ERROR;
+	}
+	
+	if (parser->buffer != NULL && parser->raw_start < parser->buffer->ptr) {
+		parser->capture_fn(parser->capture_ctx, 
+			parser->buffer->text + parser->raw_start, 
+			parser->buffer->ptr - parser->raw_start);
+	}
+	
+	// Nothing is left of the current token to return as raw text
+	if (parser->buffer != NULL) {
+		parser->raw_start = parser->buffer->ptr;
+	}
+	parser->raw_end     = -1;
+	parser->raw_len     = 0;
+	parser->capture_fn  = NULL;
+	parser->capture_ctx = NULL;
+	
+	return VKTOR_OK;
 }
 
 /**
- * @brief Get the current struct type
+ * @brief Get the input encoding of the parser
  * 
- * Get the struct type (object, array or none) containing the current token
- * pointed to by the parser
+ * Get the input encoding, as set using the VKTOR_OPT_ENCODING option or as 
+ * detected from the input. VKTOR_ENC_AUTO is returned if the encoding was not
+ * detected yet.
  * 
  * @param [in] parser Parser object
  * 
- * @return A vktor_struct value or VKTOR_STRUCT_NONE if we are in the top 
- *   level
+ * @return Input encoding
  */
-vktor_struct
-vktor_get_current_struct(vktor_parser *parser)
+vktor_encoding
+vktor_get_encoding(vktor_parser *parser)
 {
 	assert(parser != NULL);
-	return parser->nest_stack[parser->nest_ptr];
+	
+	return parser->encoding;
 }
 
 /**
- * @brief Get the current token type
+ * Powers of ten which are exactly representable as a double
+ */
+static const double pow10_exact[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * @brief Convert the text of a number token to a long
  * 
- * Get the type of the current token pointed to by the parser
+ * Convert an integer number token directly, without going through strtol(). 
+ * The token is known to be a valid JSON integer, optionally signed.
  * 
- * @param [in] parser Parser object
+ * @param [in]  text Token text
+ * @param [out] val  Converted value
  * 
- * @return Token type (one of the VKTOR_T_* tokens)
+ * @return Status code - VKTOR_OK, or VKTOR_ERROR if the value overflows
  */
-vktor_token
-vktor_get_token_type(vktor_parser *parser)
+static vktor_status
+number_to_long(const char *text, long *val)
 {
-	assert(parser != NULL);
-	return parser->token_type;	
+	long n = 0;
+	int  d, neg = 0;
+	
+	if (*text == '-' || *text == '+') {
+		neg = (*text == '-');
+		text++;
+	}
+	
+	for (; *text >= '0' && *text <= '9'; text++) {
+		d = *text - '0';
+		if (neg) {
+			if (n < (LONG_MIN + d) / 10) return VKTOR_ERROR;
+			n = n * 10 - d;
+		} else {
+			if (n > (LONG_MAX - d) / 10) return VKTOR_ERROR;
+			n = n * 10 + d;
+		}
+	}
+	
+	*val = n;
+	return VKTOR_OK;
+}
+
+/**
+ * @brief Convert the text of a number token to a double
+ * 
+ * Convert a number token without going through strtod(), if this can be 
+ * done exactly: when the significand has no more than 15 digits and the 
+ * decimal exponent is within the range of exactly representable powers of 
+ * ten, a single multiplication or division gives the correctly rounded 
+ * result. Other numbers are left to strtod().
+ * 
+ * @param [in]  text Token text
+ * @param [out] val  Converted value
+ * 
+ * @return Status code - VKTOR_OK, or VKTOR_ERROR if the fast conversion 
+ *         cannot be used
+ */
+static vktor_status
+number_to_double(const char *text, double *val)
+{
+	double m = 0;
+	int    digits = 0, exp = 0, e = 0, eneg = 0, neg = 0;
+	
+	if (*text == '-' || *text == '+') {
+		neg = (*text == '-');
+		text++;
+	}
+	
+	for (; *text >= '0' && *text <= '9'; text++) {
+		if (m > 0 || *text != '0') digits++;
+		m = m * 10 + (*text - '0');
+	}
+	
+	if (*text == '.') {
+		for (text++; *text >= '0' && *text <= '9'; text++) {
+			if (m > 0 || *text != '0') digits++;
+			m = m * 10 + (*text - '0');
+			exp--;
+		}
+	}
+	
+	if (digits > 15) return VKTOR_ERROR;
+	
+	if (*text == 'e' || *text == 'E') {
+		text++;
+		if (*text == '-' || *text == '+') {
+			eneg = (*text == '-');
+			text++;
+		}
+		for (; *text >= '0' && *text <= '9'; text++) {
+			if (e > 1000) return VKTOR_ERROR;
+			e = e * 10 + (*text - '0');
+		}
+		exp += (eneg ? -e : e);
+	}
+	
+	if (*text != '\0') return VKTOR_ERROR;
+	
+	if (m != 0) {
+		if (exp < -22 || exp > 22) return VKTOR_ERROR;
+		m = (exp < 0 ? m / pow10_exact[-exp] : m * pow10_exact[exp]);
+	}
+	
+	*val = (neg ? -m : m);
+	return VKTOR_OK;
 }
 
 /**
@@ -1627,14 +4379,23 @@ vktor_get_value_long(vktor_parser *parser, vktor_error **error)
 	assert(parser != NULL);
 	
 	if (parser->token_value == NULL) {
-		set_error(error, VKTOR_ERR_NO_VALUE, "token value is unknown");
+		set_error(parser, error, VKTOR_ERR_NO_VALUE, "token value is unknown");
 		return 0;
 	}
 	
+	if (parser->token_type == VKTOR_T_INT) {
+		if (number_to_long((char *) parser->token_value, &val) != VKTOR_OK) {
+			set_error(parser, error, VKTOR_ERR_OUT_OF_RANGE,
+				"integer value overflows maximal long value");
+			return 0;
+		}
+		return val;
+	}
+	
 	errno = 0;
 	val = strtol((char *) parser->token_value, NULL, 10);
 	if (errno == ERANGE) {
-		set_error(error, VKTOR_ERR_OUT_OF_RANGE,
+		set_error(parser, error, VKTOR_ERR_OUT_OF_RANGE,
 			"integer value overflows maximal long value");
 		return 0;
 	}
@@ -1667,14 +4428,19 @@ vktor_get_value_double(vktor_parser *parser, vktor_error **error)
 	assert(parser != NULL);
 	
 	if (parser->token_value == NULL) {
-		set_error(error, VKTOR_ERR_NO_VALUE, "token value is unknown");
+		set_error(parser, error, VKTOR_ERR_NO_VALUE, "token value is unknown");
 		return 0;
 	}
 	
+	if ((parser->token_type == VKTOR_T_INT || parser->token_type == VKTOR_T_FLOAT) &&
+	    number_to_double((char *) parser->token_value, &val) == VKTOR_OK) {
+		return val;
+	}
+	
 	errno = 0;
 	val = strtod((char *) parser->token_value, NULL);
 	if (errno == ERANGE) {
-		set_error(error, VKTOR_ERR_OUT_OF_RANGE,
+		set_error(parser, error, VKTOR_ERR_OUT_OF_RANGE,
 			"number value overflows maximal double value");
 		return 0;
 	}
@@ -1682,6 +4448,62 @@ vktor_get_value_double(vktor_parser *parser, vktor_error **error)
 	return val;
 }
 
+/**
+ * @brief Read the next chunk of a streamed string
+ * 
+ * Read the decoded content of the string value at the current 
+ * VKTOR_T_STRING_START token, one chunk of up to max bytes at a time. The 
+ * chunk is read into the token scratch memory, so memory use is bounded by 
+ * the chunk size no matter how long the string is. If the input runs out in 
+ * the middle of a chunk, what was read of it is kept until more data is fed.
+ * 
+ * @param [in]  parser    Parser object
+ * @param [in]  max       Maximal chunk length
+ * @param [out] chunk     Pointer-pointer to be populated with the chunk
+ * @param [out] chunk_len Populated with the chunk length
+ * @param [out] error     Error object pointer pointer or NULL
+ * 
+ * @return Status code - VKTOR_OK if the string goes on, VKTOR_COMPLETE if 
+ *         it has ended, VKTOR_MORE_DATA or VKTOR_ERROR
+ */
+vktor_status
+vktor_read_string_chunk(vktor_parser *parser, long max, char **chunk, 
+                        long *chunk_len, vktor_error **error)
+{
+	vktor_status status;
+	
+	assert(parser != NULL);
+	
+	if (parser->token_type != VKTOR_T_STRING_START) {
+		set_error(parser, error, VKTOR_ERR_UNSUPPORTED, 
+			"not reading a streamed string");
+		return VKTOR_ERROR;
+	}
+	
+	*chunk     = "";
+	*chunk_len = 0;
+	
+	if (! parser->str_open) {
+		return VKTOR_COMPLETE;
+	}
+	
+	parser->str_chunk   = max;
+	parser->str_started = 1;
+	
+	status = parser_read_string(parser, error);
+	if (status == VKTOR_OK || status == VKTOR_COMPLETE) {
+		*chunk     = parser->scratch;
+		*chunk_len = parser->token_size;
+		parser->token_size = 0;
+	}
+	
+	if (status == VKTOR_COMPLETE) {
+		parser_close_string(parser);
+	}
+	
+	return status;
+}
+
 /**
  * @brief Get the value of the token as a string
  * 
@@ -1697,16 +4519,19 @@ vktor_get_value_double(vktor_parser *parser, vktor_error **error)
  * @param [out] error  Error object pointer pointer or NULL
  * 
  * @return The length of the string
- * @retval 0 in case of error (although 0 might also be normal, so check the 
- *         value of error)
+ * @retval -1 in case of error
  */
 int
 vktor_get_value_str(vktor_parser *parser, char **val, vktor_error **error)
 {
 	assert(parser != NULL);
 	
+	if (parser->token_lazy && parser_decode_string(parser, error) == VKTOR_ERROR) {
+		return -1;
+	}
+	
 	if (parser->token_value == NULL) {
-		set_error(error, VKTOR_ERR_NO_VALUE, "token value is unknown");
+		set_error(parser, error, VKTOR_ERR_NO_VALUE, "token value is unknown");
 		return -1;
 	}
 	
@@ -1736,12 +4561,21 @@ vktor_get_value_str_copy(vktor_parser *parser, char **val, vktor_error **error)
 	
 	assert(parser != NULL);
 	
+	if (parser->token_lazy && parser_decode_string(parser, error) == VKTOR_ERROR) {
+		return 0;
+	}
+	
 	if (parser->token_value == NULL) {
-		set_error(error, VKTOR_ERR_NO_VALUE, "token value is unknown");
+		set_error(parser, error, VKTOR_ERR_NO_VALUE, "token value is unknown");
+		return 0;
+	}
+	
+	if ((str = pmalloc(parser, sizeof(char) * (parser->token_size + 1))) == NULL) {
+		set_error(parser, error, VKTOR_ERR_OUT_OF_MEMORY, 
+			"unable to allocate %d bytes for string copy", parser->token_size + 1);
 		return 0;
 	}
 	
-	str = vmalloc(sizeof(char) * (parser->token_size + 1));
 	str = memcpy(str, parser->token_value, parser->token_size);
 	str[parser->token_size] = '\0';
 	
@@ -1749,6 +4583,342 @@ vktor_get_value_str_copy(vktor_parser *parser, char **val, vktor_error **error)
 	return parser->token_size;
 }
 
+/**
+ * @brief Take a snapshot of the parser state
+ * 
+ * Serialize the parser state - nesting stack, expected token map, any 
+ * half-read token and the absolute input offset - into a small binary blob. 
+ * The blob can later be passed to vktor_parser_restore(), possibly by another 
+ * process, to continue parsing from the same point once the input is fed 
+ * again starting at the saved offset. 
+ * 
+ * Buffered input which was not yet parsed is not saved, nor is the value of 
+ * a completely read token. The blob is allocated using the vktor memory 
+ * handlers and must be freed by the user. 
+ * 
+ * @param [in]  parser   Parser object
+ * @param [out] snapshot Pointer-pointer to be populated with the snapshot
+ * @param [out] error    Error object pointer pointer or NULL
+ * 
+ * @return The length of the snapshot
+ * @retval 0 in case of error
+ */
+long
+vktor_parser_snapshot(vktor_parser *parser, char **snapshot, 
+                      vktor_error **error)
+{
+	unsigned char *snap, *p;
+	long           token_len = 0;
+	long           snap_len;
+	int            nest_len;
+	
+	assert(parser != NULL);
+	assert(snapshot != NULL);
+	
+	if (parser->encoding > VKTOR_ENC_UTF8) {
+		set_error(parser, error, VKTOR_ERR_UNSUPPORTED, 
+			"snapshots of UTF-16 or UTF-32 input are not supported");
+		return 0;
+	}
+	
+	if (parser->skip_depth > 0) {
+		set_error(parser, error, VKTOR_ERR_UNSUPPORTED, 
+			"snapshots can not be created while skipping a struct");
+		return 0;
+	}
+	
+	if (parser->token_resume && parser->token_lazy) {
+		set_error(parser, error, VKTOR_ERR_UNSUPPORTED, 
+			"snapshots can not be created in the middle of a lazily read string");
+		return 0;
+	}
+	
+	if (parser->str_open) {
+		set_error(parser, error, VKTOR_ERR_UNSUPPORTED, 
+			"snapshots can not be created in the middle of a streamed string");
+		return 0;
+	}
+	
+	// A half-read token is saved with all of it read so far, which for a 
+	// literal is the matched part of the literal
+	if (parser->token_resume) {
+		token_len = parser->token_size;
+	}
+	
+	snap_len = VKTOR_SNAPSHOT_HDR_LEN + nest_stack_bytes(parser->nest_ptr) + 
+		token_len;
+	if ((snap = pmalloc(parser, sizeof(char) * snap_len)) == NULL) {
+		set_error(parser, error, VKTOR_ERR_OUT_OF_MEMORY, 
+			"unable to allocate %ld bytes for parser snapshot", snap_len);
+		return 0;
+	}
+	
+	memcpy(snap, VKTOR_SNAPSHOT_MAGIC, 3);
+	snap[3] = VKTOR_SNAPSHOT_VERSION;
+	p = snap + 4;
+	
+	snapshot_put_ulong(p, vktor_get_offset(parser));    p += 8;
+	snapshot_put_ulong(p, parser->expected);            p += 8;
+	snapshot_put_ulong(p, parser->token_type);          p += 8;
+	snapshot_put_ulong(p, parser->token_resume);        p += 8;
+	snapshot_put_ulong(p, parser->token_size);          p += 8;
+	snapshot_put_ulong(p, token_len);                   p += 8;
+	snapshot_put_ulong(p, parser->nest_ptr);            p += 8;
+	snapshot_put_ulong(p, parser->unicode_c);           p += 8;
+	snapshot_put_ulong(p, parser->utf8_need | (parser->utf8_len << 8) | 
+		(parser->utf8_lo << 16) | ((unsigned long) parser->utf8_hi << 24)); 
+	p += 8;
+	snapshot_put_ulong(p, parser->encoding);            p += 8;
+	
+	// Copy the nesting stack bits, clearing the unused bits of level 0 and 
+	// of levels above the current one
+	nest_len = nest_stack_bytes(parser->nest_ptr);
+	memcpy(p, parser->nest_stack, nest_len);
+	p[0] &= ~1;
+	p[nest_len - 1] &= (unsigned char) ((2 << (parser->nest_ptr & 7)) - 1);
+	p += nest_len;
+	
+	if (token_len > 0) {
+		memcpy(p, (parser->token_value != NULL ? parser->token_value : 
+			snapshot_literal(parser->token_type)), token_len);
+	}
+	
+	*snapshot = (char *) snap;
+	return snap_len;
+}
+
+/**
+ * @brief Restore the parser state from a snapshot
+ * 
+ * Restore the state saved by vktor_parser_snapshot() into a parser. Any 
+ * buffers and token held by the parser are discarded. After restoring, the 
+ * user should feed the parser with input starting at the offset returned by
+ * vktor_get_offset().
+ * 
+ * @param [in,out] parser       Parser object
+ * @param [in]     snapshot     Snapshot data
+ * @param [in]     snapshot_len Snapshot data length
+ * @param [out]    error        Error object pointer pointer or NULL
+ * 
+ * @return Status code - VKTOR_OK or VKTOR_ERROR
+ */
+vktor_status
+vktor_parser_restore(vktor_parser *parser, const char *snapshot, 
+                     long snapshot_len, vktor_error **error)
+{
+	const unsigned char *p = (const unsigned char *) snapshot;
+	unsigned long        f[VKTOR_SNAPSHOT_FIELDS];
+	char                *token = NULL;
+	vktor_struct         current;
+	int                  nest_len;
+	int                  i;
+	
+	assert(parser != NULL);
+	assert(snapshot != NULL);
+	
+	if (snapshot_len < VKTOR_SNAPSHOT_HDR_LEN || 
+	    memcmp(p, VKTOR_SNAPSHOT_MAGIC, 3) != 0) {
+		set_error(parser, error, VKTOR_ERR_INVALID_SNAPSHOT, 
+			"snapshot data is not a valid parser snapshot");
+		return VKTOR_ERROR;
+	}
+	
+	if (p[3] != VKTOR_SNAPSHOT_VERSION) {
+		set_error(parser, error, VKTOR_ERR_INVALID_SNAPSHOT, 
+			"unsupported snapshot version %d", (int) p[3]);
+		return VKTOR_ERROR;
+	}
+	
+	p += 4;
+	for (i = 0; i < VKTOR_SNAPSHOT_FIELDS; i++, p += 8) {
+		if (! snapshot_get_ulong(p, &f[i])) {
+			set_error(parser, error, VKTOR_ERR_INVALID_SNAPSHOT, 
+				"snapshot value is out of range for this platform");
+			return VKTOR_ERROR;
+		}
+	}
+	
+	// f[] holds offset, expected, token type, token resume flag, token size, 
+	// saved token length, nesting pointer, unicode character, UTF-8 
+	// sequence state and input encoding in this order
+	if (f[6] >= (unsigned long) parser->max_nest) {
+		set_error(parser, error, VKTOR_ERR_MAX_NEST, 
+			"snapshot nesting level exceeds maximal nesting level of %d", 
+			parser->max_nest);
+		return VKTOR_ERROR;
+	}
+	
+	// A half-read token is saved whole, anything else has no saved token
+	if (f[0] > (unsigned long) ((unsigned long) -1 >> 1) || 
+	    f[4] > VKTOR_SNAPSHOT_MAX_TOKEN || f[5] != (f[3] ? f[4] : 0) || 
+	    f[9] > VKTOR_ENC_UTF8 ||
+	    snapshot_len != (long) (VKTOR_SNAPSHOT_HDR_LEN + 
+	                            nest_stack_bytes(f[6]) + f[5])) {
+		set_error(parser, error, VKTOR_ERR_INVALID_SNAPSHOT, 
+			"snapshot data is corrupt");
+		return VKTOR_ERROR;
+	}
+	
+	nest_len = nest_stack_bytes((int) f[6]);
+	if ((p[0] & 1) || 
+	    (p[nest_len - 1] & ~((2 << (f[6] & 7)) - 1))) {
+		set_error(parser, error, VKTOR_ERR_INVALID_SNAPSHOT, 
+			"snapshot nesting stack is corrupt");
+		return VKTOR_ERROR;
+	}
+	
+	if (f[6] == 0) {
+		current = VKTOR_STRUCT_NONE;
+	} else {
+		current = ((p[f[6] >> 3] & (1 << (f[6] & 7))) ? 
+			VKTOR_STRUCT_OBJECT : VKTOR_STRUCT_ARRAY);
+	}
+	
+	if (! snapshot_state_valid(f, current, p + nest_len)) {
+		set_error(parser, error, VKTOR_ERR_INVALID_SNAPSHOT, 
+			"snapshot parser state is corrupt");
+		return VKTOR_ERROR;
+	}
+	
+	if (nest_len > parser->nest_size && 
+	    nest_stack_grow(parser, (int) f[6], error) == VKTOR_ERROR) {
+		return VKTOR_ERROR;
+	}
+	
+	// Copy back any half-read string or number, leaving room for reading 
+	// more of it. It is always read into the scratch memory, even if nothing
+	// of it was read yet, as when the buffer ended right after a quote. 
+	// Literals are matched against their text and have no token value.
+	if (f[3] && snapshot_literal(f[2]) == NULL) {
+		if ((token = parser_scratch(parser, (int) f[5] + VKTOR_STR_MEMCHUNK)) == NULL) {
+			set_error(parser, error, VKTOR_ERR_OUT_OF_MEMORY, 
+				"unable to allocate %lu bytes for snapshot token", f[5]);
+			return VKTOR_ERROR;
+		}
+		memcpy(token, p + nest_len, f[5]);
+	}
+	
+	// Discard current state 
+	if (parser->buffer != NULL) {
+		buffer_free_all(parser, parser->buffer);
+	}
+	parser->buffer      = NULL;
+	parser->last_buffer = NULL;
+	
+	parser->offset       = (long) f[0];
+	parser->expected     = (long) f[1];
+	parser->token_type   = (vktor_token) f[2];
+	parser->token_resume = (char) f[3];
+	parser->token_lazy   = 0;
+	parser->str_open     = 0;
+	parser->token_size   = (int) f[4];
+	parser->token_value  = token;
+	parser->nest_ptr     = (int) f[6];
+	parser->unicode_c    = f[7];
+	parser->utf8_need    = (unsigned char) (f[8] & 0xff);
+	parser->utf8_len     = (unsigned char) ((f[8] >> 8) & 0xff);
+	parser->utf8_lo      = (unsigned char) ((f[8] >> 16) & 0xff);
+	parser->utf8_hi      = (unsigned char) ((f[8] >> 24) & 0xff);
+	parser->encoding     = (vktor_encoding) f[9];
+	parser->enc_carry_len = 0;
+	parser->enc_high     = 0;
+	parser->skip_depth   = 0;
+	parser->skip_string  = 0;
+	parser->raw_start    = 0;
+	parser->raw_end      = -1;
+	parser->raw_len      = 0;
+	parser->capture_fn   = NULL;
+	parser->capture_ctx  = NULL;
+	
+	memcpy(parser->nest_stack, p, nest_len);
+	if (parser->nest_ptr == 0) {
+		parser->nest_current = VKTOR_STRUCT_NONE;
+	} else {
+		parser->nest_current = nest_stack_get(parser, parser->nest_ptr);
+	}
+	
+	return VKTOR_OK;
+}
+
+/**
+ * @brief Set a parser option
+ * 
+ * Set one of the vktor_option options of a parser. Options should be set 
+ * before starting to parse.
+ * 
+ * @param [in,out] parser Parser object
+ * @param [in]     option Option to set
+ * @param [in]     value  Option value
+ * @param [out]    error  Error object pointer pointer or NULL
+ * 
+ * @return Status code - VKTOR_OK or VKTOR_ERROR
+ */
+vktor_status
+vktor_set_option(vktor_parser *parser, vktor_option option, long value, 
+                 vktor_error **error)
+{
+	assert(parser != NULL);
+	
+	switch (option) {
+		case VKTOR_OPT_VALIDATE_UTF8:
+			if (value != VKTOR_UTF8_IGNORE && value != VKTOR_UTF8_REJECT &&
+			    value != VKTOR_UTF8_REPLACE) {
+				set_error(parser, error, VKTOR_ERR_INVALID_OPTION, 
+					"invalid UTF-8 validation mode: %ld", value);
+				return VKTOR_ERROR;
+			}
+			parser->utf8_mode = (vktor_utf8_mode) value;
+			break;
+			
+		case VKTOR_OPT_ENCODING:
+			if (value < VKTOR_ENC_AUTO || value > VKTOR_ENC_UTF32BE) {
+				set_error(parser, error, VKTOR_ERR_INVALID_OPTION, 
+					"invalid input encoding: %ld", value);
+				return VKTOR_ERROR;
+			}
+			parser->encoding = (vktor_encoding) value;
+			break;
+			
+		case VKTOR_OPT_TOKEN_MASK:
+			if (value & ~VKTOR_T_ALL) {
+				set_error(parser, error, VKTOR_ERR_INVALID_OPTION, 
+					"invalid token mask: %ld", value);
+				return VKTOR_ERROR;
+			}
+			parser->token_mask = value;
+			break;
+			
+		case VKTOR_OPT_LAZY_STRINGS:
+			parser->lazy_strings = (value ? 1 : 0);
+			break;
+			
+		case VKTOR_OPT_STREAM_STRINGS:
+			parser->stream_strings = (value ? 1 : 0);
+			break;
+			
+		case VKTOR_OPT_STRUCTURAL_INDEX:
+			parser->structural_index = (value ? 1 : 0);
+			break;
+			
+		case VKTOR_OPT_MAX_TOKEN_SIZE:
+			if (value < 0) {
+				set_error(parser, error, VKTOR_ERR_INVALID_OPTION, 
+					"invalid maximal token size: %ld", value);
+				return VKTOR_ERROR;
+			}
+			parser->max_token = value;
+			break;
+			
+		default:
+			set_error(parser, error, VKTOR_ERR_INVALID_OPTION, 
+				"unknown parser option: %d", (int) option);
+			return VKTOR_ERROR;
+			break;
+	}
+	
+	return VKTOR_OK;
+}
+
 /**
  * @brief Free a parser and any associated memory
  * 
@@ -1763,16 +4933,20 @@ vktor_parser_free(vktor_parser *parser)
 	assert(parser != NULL);
 	
 	if (parser->buffer != NULL) {
-		buffer_free_all(parser->buffer);
+		buffer_free_all(parser, parser->buffer);
+	}
+	
+	if (parser->scratch != NULL) {
+		pfree(parser, parser->scratch);
 	}
 	
-	if (parser->token_value != NULL) {
-		vfree(parser->token_value);
+	if (parser->raw != NULL) {
+		pfree(parser, parser->raw);
 	}
 	
-	vfree(parser->nest_stack);
+	pfree(parser, parser->nest_stack);
 	
-	vfree(parser);
+	pfree(parser, parser);
 }
 
 /**
@@ -1786,10 +4960,10 @@ void
 vktor_error_free(vktor_error *err)
 {
 	if (err->message != NULL) {
-		vfree(err->message);
+		err->allocator.free_fn(err->allocator.ctx, err->message);
 	}
 	
-	vfree(err);
+	err->allocator.free_fn(err->allocator.ctx, err);
 }
 
 /** @} */ // end of external API
@@ -69,8 +69,16 @@ typedef enum {
 	VKTOR_T_OBJECT_START =  1 << 8,  /**< object beginning */
 	VKTOR_T_OBJECT_KEY   =  1 << 9,  /**< an object pair key */
 	VKTOR_T_OBJECT_END   =  1 << 10, /**< object end */
+	VKTOR_T_STRING_START =  1 << 11  /**< start of a string value to be read
+	                                      with vktor_read_string_chunk() */
 } vktor_token;
 
+/**
+ * Mask of all token types, the default value of the VKTOR_OPT_TOKEN_MASK 
+ * option
+ */
+#define VKTOR_T_ALL ((1 << 12) - 1)
+
 /**
  * @enum vktor_struct
  * 
@@ -107,9 +115,61 @@ typedef enum {
 	VKTOR_ERR_NO_VALUE,         /**< trying to read non-existing value */
 	VKTOR_ERR_OUT_OF_RANGE,     /**< long or double value is out of range */
 	VKTOR_ERR_MAX_NEST,         /**< maximal nesting level reached */
-	VKTOR_ERR_INTERNAL_ERR      /**< internal parser error */
+	VKTOR_ERR_INTERNAL_ERR,     /**< internal parser error */
+	VKTOR_ERR_INVALID_SNAPSHOT, /**< snapshot data is corrupt or incompatible */
+	VKTOR_ERR_INVALID_UTF8,     /**< string contains invalid UTF-8 sequence */
+	VKTOR_ERR_INVALID_OPTION,   /**< unknown option or invalid option value */
+	VKTOR_ERR_UNSUPPORTED,      /**< operation not supported in this state */
+	VKTOR_ERR_TOKEN_TOO_LARGE   /**< token is larger than the maximal size */
 } vktor_errcode;
 
+/**
+ * @enum vktor_option
+ * 
+ * Parser options, which can be set using vktor_set_option()
+ */
+typedef enum {
+	VKTOR_OPT_VALIDATE_UTF8, /**< UTF-8 validation mode (vktor_utf8_mode) */
+	VKTOR_OPT_ENCODING,      /**< input encoding (vktor_encoding) */
+	VKTOR_OPT_TOKEN_MASK,    /**< bitmask of token types to stop on */
+	VKTOR_OPT_LAZY_STRINGS,  /**< only decode strings when their value is 
+	                              asked for (boolean) */
+	VKTOR_OPT_STREAM_STRINGS,/**< return string values as 
+	                              VKTOR_T_STRING_START tokens (boolean) */
+	VKTOR_OPT_MAX_TOKEN_SIZE,/**< maximal token size in bytes, or 0 for no
+	                              limit */
+	VKTOR_OPT_STRUCTURAL_INDEX /**< index the rest of a buffer when a struct
+	                                is first skipped in it, for input pushed
+	                                in large buffers (boolean) */
+} vktor_option;
+
+/**
+ * @enum vktor_utf8_mode
+ * 
+ * Possible values of the VKTOR_OPT_VALIDATE_UTF8 option, controlling what is
+ * done with strings and object keys containing invalid UTF-8 sequences
+ */
+typedef enum {
+	VKTOR_UTF8_IGNORE,  /**< do not validate UTF-8 (default) */
+	VKTOR_UTF8_REJECT,  /**< invalid sequences are a parser error */
+	VKTOR_UTF8_REPLACE  /**< replace invalid sequences with U+FFFD */
+} vktor_utf8_mode;
+
+/**
+ * @enum vktor_encoding
+ * 
+ * Input encodings, as set using the VKTOR_OPT_ENCODING option. Input which is
+ * not UTF-8 is transcoded to UTF-8 as it is fed to the parser.
+ */
+typedef enum {
+	VKTOR_ENC_AUTO,    /**< detect from a BOM or the first bytes (default) */
+	VKTOR_ENC_UTF8,    /**< UTF-8 */
+	VKTOR_ENC_UTF16LE, /**< UTF-16, little endian */
+	VKTOR_ENC_UTF16BE, /**< UTF-16, big endian */
+	VKTOR_ENC_UTF32LE, /**< UTF-32, little endian */
+	VKTOR_ENC_UTF32BE  /**< UTF-32, big endian */
+} vktor_encoding;
+
 /** 
  * Memory allocation and management function pointers 
  */
@@ -129,16 +189,46 @@ typedef void *(*vktor_realloc) (void *pointer, size_t size);
  */
 typedef void  (*vktor_free)    (void *pointer);
 
+/**
+ * Allocator, used to manage the memory of a single parser. Each function is 
+ * passed the ctx pointer as its first argument, which allows for example 
+ * using a per-thread memory arena.
+ */
+typedef struct _vktor_allocator_struct {
+	void *(*malloc_fn)  (void *ctx, size_t size);                /**< malloc */
+	void *(*realloc_fn) (void *ctx, void *pointer, size_t size); /**< realloc */
+	void  (*free_fn)    (void *ctx, void *pointer);              /**< free */
+	void   *ctx;                                 /**< allocator context */
+} vktor_allocator;
+
 /**
  * Error structure, signifying the error code and error message
  * 
  * Error structs must be freed using vktor_error_free()
  */
 typedef struct _vktor_error_struct {
-	vktor_errcode  code;    /**< error code */
-	char          *message; /**< error message */
+	vktor_errcode    code;      /**< error code */
+	char            *message;   /**< error message */
+	vktor_allocator  allocator; /**< allocator the error was allocated by */
 } vktor_error;
 
+/**
+ * Chunk handler, called by vktor_parse_array() on a worker thread with a new
+ * parser fed with one chunk of the array, wrapped in an array of its own. 
+ * ctx is the pointer passed to vktor_parse_array(), and whatever is stored in
+ * result is returned to its caller. Returns VKTOR_OK, or VKTOR_ERROR to stop
+ * parsing, populating error if it is set by the parser.
+ */
+typedef vktor_status (*vktor_chunk_handler) (void *ctx, vktor_parser *parser,
+                                             void **result, vktor_error **error);
+
+/**
+ * Raw input handler, called by a capturing parser with each piece of the 
+ * captured input text, in order. ctx is the pointer passed to 
+ * vktor_capture_start().
+ */
+typedef void (*vktor_raw_handler) (void *ctx, const char *text, long text_len);
+
 /* function prototypes */
 
 /**
@@ -153,6 +243,52 @@ typedef struct _vktor_error_struct {
  */
 vktor_parser* vktor_parser_init(int max_nest);
 
+/**
+ * @brief Initialize a new parser using a specific allocator
+ * 
+ * Initialize and return a new parser struct, which will manage all of its
+ * memory using the passed allocator instead of the global memory handlers. 
+ * This includes any text fed with the free flag set, values returned by 
+ * vktor_get_value_str_copy(), snapshots and errors. Will return NULL if 
+ * memory can't be allocated.
+ * 
+ * @param [in] max_nest  maximal nesting level
+ * @param [in] allocator allocator to use, copied into the parser, or NULL to
+ *                       use the global memory handlers
+ * 
+ * @return a newly allocated parser
+ */
+vktor_parser* vktor_parser_init_ex(int max_nest, const vktor_allocator *allocator);
+
+/**
+ * @brief Reset a parser for parsing a new document
+ * 
+ * Free any buffers still linked to the parser and bring it back to the state 
+ * of a newly initialized parser, keeping allocated memory such as the nesting
+ * stack and the token scratch memory for reuse. Parser options are reset to 
+ * their defaults.
+ * 
+ * @param [in,out] parser   Parser to reset
+ * @param [in]     max_nest Maximal nesting level for the new document
+ */
+void vktor_parser_reset(vktor_parser *parser, int max_nest);
+
+/**
+ * @brief Set a parser option
+ * 
+ * Set one of the vktor_option options of a parser. Options should be set 
+ * before starting to parse.
+ * 
+ * @param [in,out] parser Parser object
+ * @param [in]     option Option to set
+ * @param [in]     value  Option value
+ * @param [out]    error  Error object pointer pointer or NULL
+ * 
+ * @return Status code - VKTOR_OK or VKTOR_ERROR
+ */
+vktor_status vktor_set_option(vktor_parser *parser, vktor_option option, 
+                              long value, vktor_error **error);
+
 /**
  * @brief Free a parser and any associated memory
  * 
@@ -212,6 +348,35 @@ vktor_status vktor_feed(vktor_parser *parser, char *text, long text_len,
  *  - VKTOR_COMPLETE  if parsing is complete and no further data is expected
  */
 vktor_status vktor_parse(vktor_parser *parser, vktor_error **error);
+
+/**
+ * @brief Skip the next JSON value
+ * 
+ * Read the next token, and if it is the start of an array or an object, skip
+ * the entire struct, leaving the parser on its end token. Structs are skipped
+ * by scanning the raw input for the matching closing bracket, without 
+ * validating it. Other tokens are read just like vktor_parse() reads them, 
+ * ignoring the token mask. 
+ * 
+ * @param [in,out] parser The parser object to work with
+ * @param [out]    error  A vktor_error pointer pointer, or NULL
+ * 
+ * @return Status code, as returned by vktor_parse()
+ */
+vktor_status vktor_skip_value(vktor_parser *parser, vktor_error **error);
+
+/**
+ * @brief Skip the rest of the current JSON struct
+ * 
+ * Skip the rest of the array or object the parser is in, leaving the parser 
+ * on its end token. The skipped input is not validated. 
+ * 
+ * @param [in,out] parser The parser object to work with
+ * @param [out]    error  A vktor_error pointer pointer, or NULL
+ * 
+ * @return Status code, as returned by vktor_parse()
+ */
+vktor_status vktor_skip_struct(vktor_parser *parser, vktor_error **error);
 		  
 /**
  * @brief Get the current token type
@@ -299,16 +464,51 @@ double vktor_get_value_double(vktor_parser *parser, vktor_error **error);
  * Note that the string pointer populated into val is owned by the parser and 
  * should not be freed by the user.
  * 
+ * With the VKTOR_OPT_LAZY_STRINGS option, strings and object keys are only 
+ * decoded when this is called, so errors in their escape sequences or UTF-8 
+ * are reported here. 
+ * 
  * @param [in]  parser Parser object
  * @param [out] val    Pointer-pointer to be populated with the value
  * @param [out] error  Error object pointer pointer or NULL
  * 
  * @return The length of the string
- * @retval 0 in case of error (although 0 might also be normal, so check the 
- *         value of error)
+ * @retval -1 in case of error
  */
 int vktor_get_value_str(vktor_parser *parser, char **val, vktor_error **error);
 
+/**
+ * @brief Read the next chunk of a streamed string
+ * 
+ * With the VKTOR_OPT_STREAM_STRINGS option, string values are returned as 
+ * VKTOR_T_STRING_START tokens as soon as their opening quote is read, and 
+ * their decoded content is read with this function, one chunk of up to max 
+ * bytes at a time, so that strings of any size can be read in bounded 
+ * memory. Chunks never end in the middle of a character, so a chunk may be a
+ * few bytes shorter than max, and holds at least one character even if max 
+ * is smaller. Calling vktor_parse() skips the rest of the string.
+ * 
+ * The chunk is owned by the parser, and is valid until the next call to any 
+ * parser function.
+ * 
+ * @param [in]  parser    Parser object
+ * @param [in]  max       Maximal chunk length
+ * @param [out] chunk     Pointer-pointer to be populated with the chunk
+ * @param [out] chunk_len Populated with the chunk length
+ * @param [out] error     Error object pointer pointer or NULL
+ * 
+ * @return Status code:
+ *  - VKTOR_OK        if a chunk was read and the string goes on
+ *  - VKTOR_COMPLETE  if the string has ended - the chunk holds its last part, 
+ *                    which is empty if the string was already read
+ *  - VKTOR_MORE_DATA if more data is required before the next chunk, which 
+ *                    should be fed to the parser before calling again
+ *  - VKTOR_ERROR     if an error has occured
+ */
+vktor_status vktor_read_string_chunk(vktor_parser *parser, long max, 
+                                     char **chunk, long *chunk_len, 
+                                     vktor_error **error);
+
 /**
  * @brief Get the value of the token as a string
  * 
@@ -326,13 +526,181 @@ int vktor_get_value_str(vktor_parser *parser, char **val, vktor_error **error);
  */
 int vktor_get_value_str_copy(vktor_parser *parser, char **val, vktor_error **error);
 
+/**
+ * @brief Get the absolute input offset of the parser
+ * 
+ * Get the number of input bytes consumed by the parser since it was 
+ * initialized (or since the offset recorded in a restored snapshot). This is 
+ * the position right after the current token.
+ * 
+ * @param [in] parser Parser object
+ * 
+ * @return offset in bytes
+ */
+long vktor_get_offset(vktor_parser *parser);
+
+/**
+ * @brief Get the raw input text of the current token
+ * 
+ * Get the current token exactly as it appears in the input, for example with
+ * the quotes and escape sequences of a string, or "[" for an array start. 
+ * Input which is not UTF-8 is returned transcoded to UTF-8. 
+ * 
+ * Note that the string pointer populated into raw is owned by the parser, is
+ * not NUL terminated, and is only valid until the parser is used again.
+ * 
+ * @param [in]  parser Parser object
+ * @param [out] raw    Pointer-pointer to be populated with the raw text
+ * @param [out] error  Error object pointer pointer or NULL
+ * 
+ * @return The length of the raw text
+ * @retval -1 in case of error
+ */
+long vktor_get_token_raw(vktor_parser *parser, char **raw, vktor_error **error);
+
+/**
+ * @brief Start capturing raw input
+ * 
+ * Start passing the raw input consumed by the parser to a handler, beginning
+ * with the current token. Input is passed in the largest possible pieces, 
+ * without being copied, whenever the parser is done with an input buffer, 
+ * and when vktor_capture_end() is called. 
+ * 
+ * This is typically used to copy an entire array or object: when the parser 
+ * is on its start token, start capturing, skip the struct using 
+ * vktor_skip_struct() and end capturing. 
+ * 
+ * @param [in,out] parser  Parser object
+ * @param [in]     handler Handler to pass the captured input to
+ * @param [in]     ctx     Pointer passed to the handler
+ * @param [out]    error   Error object pointer pointer or NULL
+ * 
+ * @return Status code - VKTOR_OK or VKTOR_ERROR
+ */
+vktor_status vktor_capture_start(vktor_parser *parser, vktor_raw_handler handler,
+                                 void *ctx, vktor_error **error);
+
+/**
+ * @brief Stop capturing raw input
+ * 
+ * Pass any captured input up to the end of the current token to the handler, 
+ * and stop capturing. 
+ * 
+ * @param [in,out] parser Parser object
+ * @param [out]    error  Error object pointer pointer or NULL
+ * 
+ * @return Status code - VKTOR_OK or VKTOR_ERROR
+ */
+vktor_status vktor_capture_end(vktor_parser *parser, vktor_error **error);
+
+/**
+ * @brief Get the input encoding of the parser
+ * 
+ * Get the input encoding, as set using the VKTOR_OPT_ENCODING option or as 
+ * detected from the input. VKTOR_ENC_AUTO is returned if the encoding was not
+ * detected yet.
+ * 
+ * @param [in] parser Parser object
+ * 
+ * @return Input encoding
+ */
+vktor_encoding vktor_get_encoding(vktor_parser *parser);
+
+/**
+ * @brief Take a snapshot of the parser state
+ * 
+ * Serialize the parser state - nesting stack, expected token map, any 
+ * half-read token and the absolute input offset - into a small binary blob. 
+ * The blob can later be passed to vktor_parser_restore(), possibly by another 
+ * process, to continue parsing from the same point once the input is fed 
+ * again starting at the saved offset. 
+ * 
+ * Buffered input which was not yet parsed is not saved, nor is the value of 
+ * a completely read token. The blob is allocated using the vktor memory 
+ * handlers and must be freed by the user. Snapshots of UTF-16 or UTF-32 
+ * input are not supported, as offsets do not map back to the input.
+ * 
+ * @param [in]  parser   Parser object
+ * @param [out] snapshot Pointer-pointer to be populated with the snapshot
+ * @param [out] error    Error object pointer pointer or NULL
+ * 
+ * @return The length of the snapshot
+ * @retval 0 in case of error
+ */
+long vktor_parser_snapshot(vktor_parser *parser, char **snapshot, 
+                           vktor_error **error);
+
+/**
+ * @brief Restore the parser state from a snapshot
+ * 
+ * Restore the state saved by vktor_parser_snapshot() into a parser. Any 
+ * buffers and token held by the parser are discarded. After restoring, the 
+ * user should feed the parser with input starting at the offset returned by
+ * vktor_get_offset().
+ * 
+ * @param [in,out] parser       Parser object
+ * @param [in]     snapshot     Snapshot data
+ * @param [in]     snapshot_len Snapshot data length
+ * @param [out]    error        Error object pointer pointer or NULL
+ * 
+ * @return Status code - VKTOR_OK or VKTOR_ERROR
+ */
+vktor_status vktor_parser_restore(vktor_parser *parser, const char *snapshot, 
+                                  long snapshot_len, vktor_error **error);
+
+/**
+ * @brief Parse the elements of a JSON array in parallel
+ * 
+ * Parse a buffer holding an entire UTF-8 JSON document whose top level value 
+ * is an array, splitting its elements into up to max_chunks chunks which are 
+ * parsed on worker threads. Each chunk is parsed by a new parser, created by
+ * vktor_parser_init_ex() with the passed allocator, and fed with the chunk 
+ * wrapped in an array of its own.
+ * 
+ * The handler is called on the worker thread with the parser of each chunk.
+ * It may set parser options, and reads the tokens using vktor_parse(): an 
+ * array start token, the elements in the chunk and an array end token. Any 
+ * tokens it leaves unread are parsed and validated after it returns. Whatever
+ * the handler stores in its result pointer is returned in results, in chunk 
+ * order, which allows concatenating the elements of all chunks. As the 
+ * handler runs on several threads at once, it must be thread safe, and so 
+ * must the allocator. 
+ * 
+ * Input before the opening bracket and after the closing bracket of the array
+ * may only be whitespace. The text is not copied, and the whole document is
+ * validated. In case of error, -1 is returned but any results stored by the 
+ * handler are still returned in results, and all other entries are set to 
+ * NULL, so they can be freed.
+ * 
+ * @param [in]  text       JSON text
+ * @param [in]  text_len   JSON text length
+ * @param [in]  max_chunks Maximal number of chunks and threads
+ * @param [in]  max_nest   Maximal nesting level of each chunk parser, 
+ *                         including the array wrapping the chunk
+ * @param [in]  allocator  Thread safe allocator for the chunk parsers, or 
+ *                         NULL to use the standard malloc and free
+ * @param [in]  handler    Chunk handler
+ * @param [in]  ctx        Context pointer passed to the chunk handler
+ * @param [out] results    Array of at least max_chunks result pointers
+ * @param [out] error      Error object pointer pointer or NULL
+ * 
+ * @return The number of chunks parsed - an empty array is a single chunk 
+ *         with no elements
+ * @retval -1 in case of error
+ */
+int vktor_parse_array(const char *text, long text_len, int max_chunks, 
+                      int max_nest, const vktor_allocator *allocator, 
+                      vktor_chunk_handler handler, void *ctx, void **results,
+                      vktor_error **error);
+
 /**
  * @brief Set memory handling function implementation
  *
  * Allows one to set alternative implementations of malloc, realloc and free. If 
  * set, the alternative implementations will be used by vktor globally to manage
  * memory. Since this has global effect it is recommended to set this once before
- * doing anything with vktor, and not to change this.
+ * doing anything with vktor, and not to change this. Parsers created using 
+ * vktor_parser_init_ex() with an allocator are not affected.
  *
  * You can pass NULL as any of the functions, in which case the standard malloc, 
  * realloc or free will be used.
@@ -0,0 +1,696 @@
+/* 
+ * vktor JSON pull-parser library
+ * 
+ * Copyright (c) 2009 Shahar Evron
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/**
+ * @file vktor_scan.c
+ * 
+ * Fast input scanning functions, used to skip over long runs of bytes which 
+ * need no special handling by the parser
+ * 
+ * @internal
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <assert.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "vktor_scan.h"
+
+/**
+ * A word with all bytes set to 0x01, and a word with all bytes set to 0x80, 
+ * used for checking all bytes of a word at once when SSE2 is not available
+ */
+#define ONES_WORD  ((unsigned long) -1 / 0xff)
+#define HIGHS_WORD (ONES_WORD * 0x80)
+
+/**
+ * Non-zero if any byte in word w is less than n (n must be at most 0x80)
+ */
+#define word_has_less(w, n) (((w) - ONES_WORD * (n)) & ~(w) & HIGHS_WORD)
+
+/**
+ * Non-zero if any byte in word w equals n
+ */
+#define word_has_byte(w, n) word_has_less((w) ^ (ONES_WORD * (n)), 1)
+
+/**
+ * Convenience macro to check if a byte is JSON (or vktor-accepted) whitespace
+ */
+#define is_whitespace(c) ((c) == ' '  || (c) == '\n' || (c) == '\r' || \
+                          (c) == '\t' || (c) == '\f' || (c) == '\v')
+
+#ifdef __SSE2__
+
+/**
+ * @brief Get the position of the lowest bit set in a non-zero mask
+ * 
+ * @param [in] mask Bit mask, must not be 0
+ * 
+ * @return Position of the lowest set bit
+ */
+static int
+lowest_bit(int mask)
+{
+#ifdef __GNUC__
+	return __builtin_ctz(mask);
+#else
+	int i = 0;
+	
+	while (! (mask & 1)) {
+		mask >>= 1;
+		i++;
+	}
+	
+	return i;
+#endif
+}
+
+#endif
+
+/**
+ * @brief Find the end of a run of plain string characters
+ * 
+ * Scan a buffer for the first byte which can not be copied as-is into a 
+ * string token - a double quote, a backslash or a control character, and if
+ * ascii_only is set, any non-ASCII byte. Bytes are classified in blocks using
+ * SSE2 when available, or one machine word at a time otherwise.
+ * 
+ * @param [in] text       Text to scan
+ * @param [in] len        Length of text
+ * @param [in] ascii_only Whether to also stop on non-ASCII bytes
+ * 
+ * @return The offset of the first special byte, or len if there is none
+ */
+long
+vktor_scan_string(const char *text, long len, int ascii_only)
+{
+	long          i = 0;
+	unsigned char c;
+	
+	assert(text != NULL);
+	
+#ifdef __SSE2__
+	{
+		const __m128i quote  = _mm_set1_epi8('"');
+		const __m128i bslash = _mm_set1_epi8('\\');
+		const __m128i ctrl   = _mm_set1_epi8(0x1f);
+		__m128i       block, special;
+		int           mask;
+		
+		for (; i + 16 <= len; i += 16) {
+			block   = _mm_loadu_si128((const __m128i *) (text + i));
+			special = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(block, quote), 
+				             _mm_cmpeq_epi8(block, bslash)),
+				// unsigned byte <= 0x1f iff max(byte, 0x1f) == 0x1f
+				_mm_cmpeq_epi8(_mm_max_epu8(block, ctrl), ctrl));
+			
+			mask = _mm_movemask_epi8(special);
+			if (ascii_only) {
+				// the high bit of each byte is set for non-ASCII bytes
+				mask |= _mm_movemask_epi8(block);
+			}
+			
+			if (mask) {
+				return i + lowest_bit(mask);
+			}
+		}
+	}
+#else
+	{
+		unsigned long w;
+		
+		for (; i + (long) sizeof(w) <= len; i += sizeof(w)) {
+			memcpy(&w, text + i, sizeof(w));
+			if (word_has_byte(w, '"') || word_has_byte(w, '\\') || 
+			    word_has_less(w, 0x20) || (ascii_only && (w & HIGHS_WORD))) {
+				break;
+			}
+		}
+	}
+#endif
+	
+	for (; i < len; i++) {
+		c = (unsigned char) text[i];
+		if (c == '"' || c == '\\' || c < 0x20 || (ascii_only && c >= 0x80)) {
+			break;
+		}
+	}
+	
+	return i;
+}
+
+/**
+ * @brief Find the end of a run of whitespace
+ * 
+ * Scan a buffer for the first byte which is not whitespace. 
+ * 
+ * @param [in] text Text to scan
+ * @param [in] len  Length of text
+ * 
+ * @return The offset of the first non-whitespace byte, or len if there is 
+ *         none
+ */
+long
+vktor_scan_whitespace(const char *text, long len)
+{
+	long i = 0;
+	
+	assert(text != NULL);
+	
+#ifdef __SSE2__
+	{
+		const __m128i space = _mm_set1_epi8(' ');
+		const __m128i nl    = _mm_set1_epi8('\n');
+		const __m128i cr    = _mm_set1_epi8('\r');
+		const __m128i tab   = _mm_set1_epi8('\t');
+		__m128i       block, ws;
+		int           mask;
+		
+		// Only worth it for long runs such as indentation; short runs are 
+		// handled by the loop below 
+		while (i + 16 <= len && is_whitespace(text[i]) && is_whitespace(text[i + 1])) {
+			block = _mm_loadu_si128((const __m128i *) (text + i));
+			ws    = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(block, space), 
+				             _mm_cmpeq_epi8(block, nl)),
+				_mm_or_si128(_mm_cmpeq_epi8(block, cr), 
+				             _mm_cmpeq_epi8(block, tab)));
+			
+			mask = ~_mm_movemask_epi8(ws) & 0xffff;
+			if (mask) {
+				i += lowest_bit(mask);
+				break;
+			}
+			i += 16;
+		}
+	}
+#endif
+	
+	for (; i < len; i++) {
+		if (! is_whitespace(text[i])) {
+			break;
+		}
+	}
+	
+	return i;
+}
+
+/**
+ * @brief Convert a run of ASCII characters from UTF-16 to UTF-8
+ * 
+ * Copy UTF-16 code units to out as single bytes, as long as they are in the
+ * ASCII range, stopping at the first unit which is not. Units are converted
+ * 8 at a time using SSE2 when available.
+ * 
+ * @param [in]  text       UTF-16 text
+ * @param [in]  units      Number of complete code units in text
+ * @param [in]  big_endian Whether text is big-endian
+ * @param [out] out        Output buffer, at least units bytes long
+ * 
+ * @return The number of code units converted
+ */
+long
+vktor_scan_utf16_ascii(const char *text, long units, int big_endian, char *out)
+{
+	long          i = 0;
+	unsigned char lo, hi;
+	
+	assert(text != NULL);
+	assert(out != NULL);
+	
+#ifdef __SSE2__
+	{
+		const __m128i high = _mm_set1_epi16((short) 0xff80);
+		const __m128i zero = _mm_setzero_si128();
+		__m128i       block;
+		
+		for (; i + 8 <= units; i += 8) {
+			block = _mm_loadu_si128((const __m128i *) (text + i * 2));
+			if (big_endian) {
+				block = _mm_or_si128(_mm_slli_epi16(block, 8), 
+				                     _mm_srli_epi16(block, 8));
+			}
+			
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(block, high), zero)) != 0xffff) {
+				break;
+			}
+			
+			_mm_storel_epi64((__m128i *) (out + i), _mm_packus_epi16(block, block));
+		}
+	}
+#endif
+	
+	for (; i < units; i++) {
+		lo = (unsigned char) text[i * 2 + (big_endian ? 1 : 0)];
+		hi = (unsigned char) text[i * 2 + (big_endian ? 0 : 1)];
+		if (hi || lo >= 0x80) {
+			break;
+		}
+		out[i] = (char) lo;
+	}
+	
+	return i;
+}
+
+/**
+ * @brief Convert a run of ASCII characters from UTF-32 to UTF-8
+ * 
+ * Copy UTF-32 code units to out as single bytes, as long as they are in the
+ * ASCII range, stopping at the first unit which is not. Units are converted
+ * 4 at a time using SSE2 when available.
+ * 
+ * @param [in]  text       UTF-32 text
+ * @param [in]  units      Number of complete code units in text
+ * @param [in]  big_endian Whether text is big-endian
+ * @param [out] out        Output buffer, at least units bytes long
+ * 
+ * @return The number of code units converted
+ */
+long
+vktor_scan_utf32_ascii(const char *text, long units, int big_endian, char *out)
+{
+	long                 i = 0;
+	const unsigned char *u;
+	
+	assert(text != NULL);
+	assert(out != NULL);
+	
+#ifdef __SSE2__
+	{
+		// all bits except the low 7 bits of the value byte
+		const __m128i high = big_endian ? 
+			_mm_set1_epi32((int) 0x80ffffff) : _mm_set1_epi32((int) 0xffffff80);
+		const __m128i zero = _mm_setzero_si128();
+		__m128i       block;
+		int           packed;
+		
+		for (; i + 4 <= units; i += 4) {
+			block = _mm_loadu_si128((const __m128i *) (text + i * 4));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(block, high), zero)) != 0xffff) {
+				break;
+			}
+			
+			if (big_endian) {
+				block = _mm_srli_epi32(block, 24);
+			}
+			block  = _mm_packs_epi32(block, block);
+			packed = _mm_cvtsi128_si32(_mm_packus_epi16(block, block));
+			memcpy(out + i, &packed, 4);
+		}
+	}
+#endif
+	
+	for (; i < units; i++) {
+		u = (const unsigned char *) text + i * 4;
+		if (big_endian) {
+			if (u[0] || u[1] || u[2] || u[3] >= 0x80) break;
+			out[i] = (char) u[3];
+		} else {
+			if (u[3] || u[2] || u[1] || u[0] >= 0x80) break;
+			out[i] = (char) u[0];
+		}
+	}
+	
+	return i;
+}
+
+/**
+ * Every other bit of an index word, starting with the lowest one
+ */
+#define EVEN_BITS UINT64_C(0x5555555555555555)
+
+/**
+ * @brief Get the position of the lowest bit set in a non-zero index word
+ * 
+ * @param [in] word Index word, must not be 0
+ * 
+ * @return Position of the lowest set bit
+ */
+static int
+lowest_bit64(uint64_t word)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(word);
+#else
+	int i = 0;
+	
+	while (! (word & 1)) {
+		word >>= 1;
+		i++;
+	}
+	
+	return i;
+#endif
+}
+
+/**
+ * @brief Compute the running XOR of all lower bits for each bit of a word
+ * 
+ * Each bit of the result is set if an odd number of bits are set at or 
+ * below the same position in word. 
+ * 
+ * @param [in] word Word to compute
+ * 
+ * @return Prefix XOR of word
+ */
+static uint64_t
+prefix_xor(uint64_t word)
+{
+	word ^= word << 1;
+	word ^= word << 2;
+	word ^= word << 4;
+	word ^= word << 8;
+	word ^= word << 16;
+	word ^= word << 32;
+	
+	return word;
+}
+
+/**
+ * @brief Classify the bytes of a 64 byte block
+ * 
+ * Set one bit per byte of a block in each of the classification masks.
+ * Bytes are compared 16 at a time using SSE2 when available.
+ * 
+ * @param [in]  block  64 bytes of text
+ * @param [out] quote  Double quotes
+ * @param [out] bslash Backslashes
+ * @param [out] op     Structural characters - brackets, colons and commas
+ * @param [out] ws     Whitespace
+ * @param [out] ctrl   Control characters
+ */
+static void
+classify_block(const char *block, uint64_t *quote, uint64_t *bslash, 
+               uint64_t *op, uint64_t *ws, uint64_t *ctrl)
+{
+	int i;
+	
+	*quote = *bslash = *op = *ws = *ctrl = 0;
+	
+#ifdef __SSE2__
+	{
+		const __m128i v_quote  = _mm_set1_epi8('"');
+		const __m128i v_bslash = _mm_set1_epi8('\\');
+		const __m128i v_ctrl   = _mm_set1_epi8(0x1f);
+		const __m128i v_wsbase = _mm_set1_epi8(0x09);
+		const __m128i v_wsmax  = _mm_set1_epi8(0x04);
+		const __m128i v_space  = _mm_set1_epi8(' ');
+		const __m128i v_case   = _mm_set1_epi8(0x20);
+		const __m128i v_open   = _mm_set1_epi8('{');
+		const __m128i v_close  = _mm_set1_epi8('}');
+		const __m128i v_colon  = _mm_set1_epi8(':');
+		const __m128i v_comma  = _mm_set1_epi8(',');
+		__m128i       v, v_op, v_ws;
+		
+		for (i = 0; i < 64; i += 16) {
+			v    = _mm_loadu_si128((const __m128i *) (block + i));
+			// '[' and ']' only differ from '{' and '}' in bit 0x20
+			v_op = _mm_or_si128(v, v_case);
+			v_op = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v_op, v_open), 
+				             _mm_cmpeq_epi8(v_op, v_close)),
+				_mm_or_si128(_mm_cmpeq_epi8(v, v_colon), 
+				             _mm_cmpeq_epi8(v, v_comma)));
+			
+			// 0x09 - 0x0d are whitespace, wrapping around for lower bytes
+			v_ws = _mm_sub_epi8(v, v_wsbase);
+			v_ws = _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(v_ws, v_wsmax), v_wsmax),
+			                    _mm_cmpeq_epi8(v, v_space));
+			
+			*quote  |= (uint64_t) (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, v_quote)) << i;
+			*bslash |= (uint64_t) (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, v_bslash)) << i;
+			*op     |= (uint64_t) (unsigned) _mm_movemask_epi8(v_op) << i;
+			*ws     |= (uint64_t) (unsigned) _mm_movemask_epi8(v_ws) << i;
+			*ctrl   |= (uint64_t) (unsigned) _mm_movemask_epi8(
+				_mm_cmpeq_epi8(_mm_max_epu8(v, v_ctrl), v_ctrl)) << i;
+		}
+	}
+#else
+	for (i = 0; i < 64; i++) {
+		uint64_t      bit = (uint64_t) 1 << i;
+		unsigned char c   = (unsigned char) block[i];
+		
+		switch (c) {
+			case '"':
+				*quote |= bit;
+				break;
+				
+			case '\\':
+				*bslash |= bit;
+				break;
+				
+			case '[':
+			case ']':
+			case '{':
+			case '}':
+			case ':':
+			case ',':
+				*op |= bit;
+				break;
+				
+			default:
+				if (is_whitespace(c)) {
+					*ws |= bit;
+				}
+				if (c < 0x20) {
+					*ctrl |= bit;
+				}
+				break;
+		}
+	}
+#endif
+}
+
+/**
+ * @brief Build the structural index of a buffer
+ * 
+ * Stage 1 of structural indexing: classify text in blocks of 64 bytes, and
+ * set one bit in index per byte the parser has to look at - structural 
+ * characters, quotes and the first byte of any other value outside of 
+ * strings, and the closing quote, backslashes and control characters inside 
+ * strings. Escaped characters are not marked. Text is expected to start 
+ * outside of a string.
+ * 
+ * Escaped characters are found by the parity of backslash runs, and string 
+ * contents by a prefix XOR of the unescaped quotes, carrying both from each 
+ * block to the next one. Backslashes outside of strings would throw the 
+ * escape bits off, so text with any is left for the parser to reject.
+ * 
+ * @param [in]  text  Text to index
+ * @param [in]  len   Length of text
+ * @param [out] index Index, at least (len + 63) / 64 words long
+ * 
+ * @return 0, or -1 if text has a backslash outside of a string and so can 
+ *         not be indexed
+ */
+int
+vktor_scan_index(const char *text, long len, uint64_t *index)
+{
+	uint64_t    quote, bslash, op, ws, ctrl, scalar, escaped, follows, 
+	            starts, carry, bounds, in_string, inner;
+	uint64_t    prev_escaped = 0, prev_string = 0, prev_scalar = 0;
+	char        last[64];
+	const char *block;
+	long        i;
+	
+	assert(text != NULL);
+	assert(index != NULL);
+	
+	for (i = 0; i < len; i += 64) {
+		block = text + i;
+		
+		// Pad the last block with whitespace
+		if (len - i < 64) {
+			memset(last, ' ', sizeof(last));
+			memcpy(last, block, len - i);
+			block = last;
+		}
+		
+		classify_block(block, &quote, &bslash, &op, &ws, &ctrl);
+		
+		// A character is escaped if it follows an odd-length run of 
+		// backslashes: adding the odd-starting runs to the backslashes 
+		// carries out of the runs on the flipped parity
+		escaped  = bslash & ~prev_escaped;
+		follows  = (escaped << 1) | prev_escaped;
+		starts   = escaped & ~EVEN_BITS & ~follows;
+		carry    = starts + escaped;
+		prev_escaped = (carry < escaped);
+		escaped  = (EVEN_BITS ^ (carry << 1)) & follows;
+		
+		// Strings run from each opening quote up to the closing one
+		bounds    = quote & ~escaped;
+		in_string = prefix_xor(bounds) ^ prev_string;
+		prev_string = (uint64_t) 0 - (in_string >> 63);
+		inner     = in_string & ~bounds;
+		
+		if (bslash & ~in_string) {
+			return -1;
+		}
+		
+		// Values other than strings start at any byte which is not 
+		// whitespace, structural or a quote, and does not follow another one
+		scalar      = ~(op | ws | quote);
+		starts      = scalar & ~((scalar << 1) | prev_scalar);
+		prev_scalar = scalar >> 63;
+		
+		index[i / 64] = ((op | starts) & ~in_string) | bounds | 
+		                ((bslash | ctrl) & inner & ~escaped);
+	}
+	
+	return 0;
+}
+
+/**
+ * @brief Find the next byte marked in a structural index
+ * 
+ * Stage 2 of structural indexing: walk the index bits set by 
+ * vktor_scan_index() instead of the text itself.
+ * 
+ * @param [in] index Structural index
+ * @param [in] from  Offset to start at
+ * @param [in] end   Offset to stop at, not beyond the indexed text
+ * 
+ * @return The offset of the first marked byte in [from, end), or end if 
+ *         there is none
+ */
+long
+vktor_index_next(const uint64_t *index, long from, long end)
+{
+	long     block, next;
+	uint64_t word;
+	
+	assert(index != NULL);
+	
+	if (from >= end) {
+		return end;
+	}
+	
+	block = from / 64;
+	word  = index[block] & (~(uint64_t) 0 << (from % 64));
+	
+	while (word == 0) {
+		if (++block * 64 >= end) {
+			return end;
+		}
+		word = index[block];
+	}
+	
+	next = block * 64 + lowest_bit64(word);
+	return (next < end ? next : end);
+}
+
+/**
+ * @brief Skip to the end of a struct using a structural index
+ * 
+ * Walk the index bits set by vktor_scan_index() from an offset outside of a
+ * string, counting opening and closing brackets until the nesting depth 
+ * would drop to 0. Brackets inside strings are never marked, and quotes are 
+ * only counted to tell if the end of the text is inside a string.
+ * 
+ * @param [in]     text   Indexed text
+ * @param [in]     index  Structural index
+ * @param [in]     from   Offset to start at
+ * @param [in]     end    Offset to stop at, not beyond the indexed text
+ * @param [in,out] depth  Nesting depth, must be positive
+ * @param [out]    string 0 if end is outside of a string, 1 if it is inside 
+ *                        one, or 2 if it also follows a backslash
+ * 
+ * @return The offset of the bracket closing the struct, which is left for 
+ *         the caller to count, or end if it is not found
+ */
+long
+vktor_index_skip(const char *text, const uint64_t *index, long from, long end,
+                 long *depth, int *string)
+{
+	long     block, pos;
+	uint64_t word;
+	int      quotes = 0;
+	
+	assert(text != NULL);
+	assert(index != NULL);
+	assert(*depth > 0);
+	
+	*string = 0;
+	if (from >= end) {
+		return end;
+	}
+	
+	block = from / 64;
+	word  = index[block] & (~(uint64_t) 0 << (from % 64));
+	
+	for (;;) {
+		while (word != 0) {
+			pos = block * 64 + lowest_bit64(word);
+			if (pos >= end) {
+				goto done;
+			}
+			word &= word - 1;
+			
+			switch (text[pos]) {
+				case '"':
+					quotes ^= 1;
+					break;
+					
+				case '[':
+				case '{':
+					(*depth)++;
+					break;
+					
+				case ']':
+				case '}':
+					if (*depth == 1) {
+						return pos;
+					}
+					(*depth)--;
+					break;
+			}
+		}
+		
+		if (++block * 64 >= end) {
+			break;
+		}
+		word = index[block];
+	}
+	
+done:
+	// A backslash at the very end escapes the first byte of the next text
+	if (quotes) {
+		*string = (text[end - 1] == '\\' && 
+			(index[(end - 1) / 64] >> ((end - 1) % 64) & 1) ? 2 : 1);
+	}
+	
+	return end;
+}
@@ -0,0 +1,163 @@
+/* 
+ * vktor JSON pull-parser library
+ * 
+ * Copyright (c) 2009 Shahar Evron
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/**
+ * @file vktor_scan.h
+ * 
+ * vktor scanning header file - functions for quickly scanning runs of input 
+ * bytes which do not require any special handling
+ * 
+ * @internal
+ */
+
+#ifndef _VKTOR_SCAN_H
+
+#include <stdint.h>
+
+/**
+ * @ingroup internal
+ * @{
+ */
+
+/**
+ * @brief Find the end of a run of plain string characters
+ * 
+ * Scan a buffer for the first byte which can not be copied as-is into a 
+ * string token - a double quote, a backslash or a control character, and if
+ * ascii_only is set, any non-ASCII byte. Bytes are classified in blocks using
+ * SSE2 when available, or one machine word at a time otherwise.
+ * 
+ * @param [in] text       Text to scan
+ * @param [in] len        Length of text
+ * @param [in] ascii_only Whether to also stop on non-ASCII bytes
+ * 
+ * @return The offset of the first special byte, or len if there is none
+ */
+long vktor_scan_string(const char *text, long len, int ascii_only);
+
+/**
+ * @brief Find the end of a run of whitespace
+ * 
+ * Scan a buffer for the first byte which is not whitespace. 
+ * 
+ * @param [in] text Text to scan
+ * @param [in] len  Length of text
+ * 
+ * @return The offset of the first non-whitespace byte, or len if there is 
+ *         none
+ */
+long vktor_scan_whitespace(const char *text, long len);
+
+/**
+ * @brief Convert a run of ASCII characters from UTF-16 to UTF-8
+ * 
+ * Copy UTF-16 code units to out as single bytes, as long as they are in the
+ * ASCII range, stopping at the first unit which is not.
+ * 
+ * @param [in]  text       UTF-16 text
+ * @param [in]  units      Number of complete code units in text
+ * @param [in]  big_endian Whether text is big-endian
+ * @param [out] out        Output buffer, at least units bytes long
+ * 
+ * @return The number of code units converted
+ */
+long vktor_scan_utf16_ascii(const char *text, long units, int big_endian, char *out);
+
+/**
+ * @brief Convert a run of ASCII characters from UTF-32 to UTF-8
+ * 
+ * Copy UTF-32 code units to out as single bytes, as long as they are in the
+ * ASCII range, stopping at the first unit which is not.
+ * 
+ * @param [in]  text       UTF-32 text
+ * @param [in]  units      Number of complete code units in text
+ * @param [in]  big_endian Whether text is big-endian
+ * @param [out] out        Output buffer, at least units bytes long
+ * 
+ * @return The number of code units converted
+ */
+long vktor_scan_utf32_ascii(const char *text, long units, int big_endian, char *out);
+
+/**
+ * @brief Build the structural index of a buffer
+ * 
+ * Stage 1 of structural indexing: classify text in blocks of 64 bytes, and
+ * set one bit in index per byte the parser has to look at - structural 
+ * characters, quotes and the first byte of any other value outside of 
+ * strings, and the closing quote, backslashes and control characters inside 
+ * strings. Escaped characters are not marked. Text is expected to start 
+ * outside of a string.
+ * 
+ * @param [in]  text  Text to index
+ * @param [in]  len   Length of text
+ * @param [out] index Index, at least (len + 63) / 64 words long
+ * 
+ * @return 0, or -1 if text has a backslash outside of a string and so can 
+ *         not be indexed
+ */
+int vktor_scan_index(const char *text, long len, uint64_t *index);
+
+/**
+ * @brief Find the next byte marked in a structural index
+ * 
+ * Stage 2 of structural indexing: walk the index bits set by 
+ * vktor_scan_index() instead of the text itself.
+ * 
+ * @param [in] index Structural index
+ * @param [in] from  Offset to start at
+ * @param [in] end   Offset to stop at, not beyond the indexed text
+ * 
+ * @return The offset of the first marked byte in [from, end), or end if 
+ *         there is none
+ */
+long vktor_index_next(const uint64_t *index, long from, long end);
+
+/**
+ * @brief Skip to the end of a struct using a structural index
+ * 
+ * Walk the index bits set by vktor_scan_index() from an offset outside of a
+ * string, counting opening and closing brackets until the nesting depth 
+ * would drop to 0.
+ * 
+ * @param [in]     text   Indexed text
+ * @param [in]     index  Structural index
+ * @param [in]     from   Offset to start at
+ * @param [in]     end    Offset to stop at, not beyond the indexed text
+ * @param [in,out] depth  Nesting depth, must be positive
+ * @param [out]    string 0 if end is outside of a string, 1 if it is inside 
+ *                        one, or 2 if it also follows a backslash
+ * 
+ * @return The offset of the bracket closing the struct, which is left for 
+ *         the caller to count, or end if it is not found
+ */
+long vktor_index_skip(const char *text, const uint64_t *index, long from, long end,
+                      long *depth, int *string);
+
+/** @} */ // end of internal API
+
+#define _VKTOR_SCAN_H
+#endif /* VKTOR_SCAN_H */
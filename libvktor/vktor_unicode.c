@@ -33,41 +33,78 @@
 #include <stdio.h>
 
 #include "vktor_unicode.h"
+#include "vktor_scan.h"
 
 #define SURROGATE_OFFSET (0x10000 - (0xd800 << 10) - 0xdc00)
 
+/**
+ * Hexadecimal digit values, indexed by character. -1 for characters which 
+ * are not hexadecimal digits.
+ */
+static const signed char hex_values[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1, 
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, 
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, 
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
 /**
  * @brief Convert a hexadecimal digit to it's integer value
  * 
  * Convert a single char containing a hexadecimal digit to it's integer value
  * (0 - 15). Used when converting escaped Unicode sequences to UTF-* characters.
  * 
- * Note that this function does not do any error checking because it is for 
- * internal use only. If the character is not a valid hex digit, 0 is returned. 
- * Obviously since 0 is a valid value it should not be used for error checking.
- * 
  * @param [in] hex Hexadecimal character
  * 
- * @return Integer value (0 - 15). 
+ * @return Integer value (0 - 15), or -1 if hex is not a hexadecimal digit
  */
-unsigned char
+int
 vktor_unicode_hex_to_int(unsigned char hex)
 {
-	unsigned char i = 0;
+	return hex_values[hex];
+}
+
+/**
+ * @brief Convert 4 hexadecimal digits to their integer value
+ * 
+ * Convert the 4 hexadecimal digits of an escaped Unicode sequence to a 16 bit
+ * code unit at once. All 4 digits are looked up before checking for invalid
+ * digits, so there is only a single branch.
+ * 
+ * @param [in] hex Pointer to 4 hexadecimal characters
+ * 
+ * @return Integer value (0 - 0xffff), or -1 if any character is not a 
+ *         hexadecimal digit
+ */
+long
+vktor_unicode_hex4_to_int(const char *hex)
+{
+	long d0, d1, d2, d3;
+	
+	assert(hex != NULL);
 	
-	assert((hex >= '0' && hex <= '9') || 
-	       (hex >= 'a' && hex <= 'f') ||
-		   (hex >= 'A' && hex <= 'F'));
-		   
-	if (hex >= '0' && hex <= '9') {
-		i = hex - 48;
-	} else if (hex >= 'A' && hex <= 'F') {
-		i = hex - 55;
-	} else if (hex >= 'a' && hex <= 'f') {
-		i = hex - 87;
+	d0 = hex_values[(unsigned char) hex[0]];
+	d1 = hex_values[(unsigned char) hex[1]];
+	d2 = hex_values[(unsigned char) hex[2]];
+	d3 = hex_values[(unsigned char) hex[3]];
+	
+	if ((d0 | d1 | d2 | d3) < 0) {
+		return -1;
 	}
 	
-	return i;
+	return (d0 << 12) | (d1 << 8) | (d2 << 4) | d3;
 }
 
 /**
@@ -153,3 +190,124 @@ vktor_unicode_sp_to_utf8(unsigned short high, unsigned short low, unsigned char
 	
 	return 4;
 }
+
+/**
+ * @brief Encode any Unicode code point to a UTF-8 string
+ * 
+ * Encode a code point in the range 0 - 0x10ffff to UTF-8. Unlike 
+ * vktor_unicode_cp_to_utf8(), the result is not null-terminated, and the 
+ * code point is assumed to be valid.
+ * 
+ * @param [in]  cp   the unicode codepoint
+ * @param [out] utf8 a pointer to at least 4 bytes of memory
+ * 
+ * @return the length of the UTF-8 string (1 - 4 bytes)
+ */
+static short
+unicode_cp32_to_utf8(unsigned long cp, unsigned char *utf8)
+{
+	if (cp <= 0x7f) {
+		utf8[0] = (unsigned char) cp;
+		return 1;
+		
+	} else if (cp <= 0x7ff) {
+		utf8[0] = (unsigned char) 0xc0 | (cp >> 6);
+		utf8[1] = (unsigned char) 0x80 | (cp & 0x3f);
+		return 2;
+		
+	} else if (cp <= 0xffff) {
+		utf8[0] = (unsigned char) 0xe0 | (cp >> 12);
+		utf8[1] = (unsigned char) 0x80 | ((cp >> 6) & 0x3f);
+		utf8[2] = (unsigned char) 0x80 | (cp & 0x3f);
+		return 3;
+		
+	} else {
+		utf8[0] = (unsigned char) 0xf0 | (cp >> 18); 
+		utf8[1] = (unsigned char) 0x80 | ((cp >> 12) & 0x3f);
+		utf8[2] = (unsigned char) 0x80 | ((cp >> 6) & 0x3f);
+		utf8[3] = (unsigned char) 0x80 | (cp & 0x3f);
+		return 4;
+	}
+}
+
+/**
+ * @brief Transcode UTF-16 or UTF-32 text to UTF-8
+ * 
+ * Convert complete UTF-16 or UTF-32 code units to UTF-8. Runs of ASCII 
+ * characters are converted using the vectorized vktor_scan_utf16_ascii() and
+ * vktor_scan_utf32_ascii() functions. Unpaired surrogates and code points 
+ * above U+10FFFF are replaced with U+FFFD.
+ * 
+ * A high surrogate at the end of the text is kept in high, so that surrogate
+ * pairs can span calls. high should point to 0 for the first call.
+ * 
+ * @param [in]     text       UTF-16 or UTF-32 text
+ * @param [in]     len        Length of text in bytes, a multiple of unit
+ * @param [in]     unit       Code unit size - 2 for UTF-16 or 4 for UTF-32
+ * @param [in]     big_endian Whether text is big-endian
+ * @param [out]    out        Output buffer, at least len * 2 + 3 bytes long
+ * @param [in,out] high       Pending high surrogate, or 0 if there is none
+ * 
+ * @return Length of the UTF-8 text written to out
+ */
+long
+vktor_unicode_transcode(const char *text, long len, int unit, int big_endian,
+                        char *out, unsigned long *high)
+{
+	const unsigned char *u;
+	unsigned long        cp;
+	long                 i = 0, o = 0, n;
+	
+	assert(unit == 2 || unit == 4);
+	assert(len % unit == 0);
+	
+	while (i < len) {
+		if (! *high) {
+			// Copy any run of ASCII characters at once
+			if (unit == 2) {
+				n = vktor_scan_utf16_ascii(text + i, (len - i) / 2, big_endian, out + o);
+			} else {
+				n = vktor_scan_utf32_ascii(text + i, (len - i) / 4, big_endian, out + o);
+			}
+			i += n * unit;
+			o += n;
+			if (i >= len) break;
+		}
+		
+		u = (const unsigned char *) text + i;
+		if (unit == 2) {
+			cp = big_endian ? (u[0] << 8) | u[1] : (u[1] << 8) | u[0];
+		} else if (big_endian) {
+			cp = ((unsigned long) u[0] << 24) | (u[1] << 16) | (u[2] << 8) | u[3];
+		} else {
+			cp = ((unsigned long) u[3] << 24) | (u[2] << 16) | (u[1] << 8) | u[0];
+		}
+		i += unit;
+		
+		if (*high) {
+			if (cp >= 0xdc00 && cp <= 0xdfff) {
+				cp = (*high << 10) + cp + SURROGATE_OFFSET;
+				*high = 0;
+				o += unicode_cp32_to_utf8(cp, (unsigned char *) out + o);
+				continue;
+			}
+			
+			// Unpaired high surrogate
+			o += unicode_cp32_to_utf8(0xfffd, (unsigned char *) out + o);
+			*high = 0;
+		}
+		
+		if (unit == 2 && cp >= 0xd800 && cp <= 0xdbff) {
+			*high = cp;
+			continue;
+		}
+		
+		if ((cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff) {
+			cp = 0xfffd;
+		}
+		
+		o += unicode_cp32_to_utf8(cp, (unsigned char *) out + o);
+	}
+	
+	return o;
+}
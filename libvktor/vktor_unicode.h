@@ -43,12 +43,12 @@
 /**
  * Convenience macro to check if a codepoint is a high surrogate
  */
-#define VKTOR_UNICODE_HIGH_SURROGATE(cp) (cp >= 0xd800 && cp <= 0xdbff)
+#define VKTOR_UNICODE_HIGH_SURROGATE(cp) ((cp) >= 0xd800 && (cp) <= 0xdbff)
 
 /**
  * Convenience macro to check if a codepoint is a low surrogate
  */
-#define VKTOR_UNICODE_LOW_SURROGATE(cp) (cp >= 0xdc99 && cp <= 0xdfff)
+#define VKTOR_UNICODE_LOW_SURROGATE(cp) ((cp) >= 0xdc00 && (cp) <= 0xdfff)
 
 /**
  * @brief Convert a hexadecimal digit to it's integer value
@@ -56,15 +56,24 @@
  * Convert a single char containing a hexadecimal digit to it's integer value
  * (0 - 15). Used when converting escaped Unicode sequences to UTF-* characters.
  * 
- * Note that this function does not do any error checking because it is for 
- * internal use only. If the character is not a valid hex digit, 0 is returned. 
- * Obviously since 0 is a valid value it should not be used for error checking.
- * 
  * @param [in] hex Hexadecimal character
  * 
- * @return Integer value (0 - 15). 
+ * @return Integer value (0 - 15), or -1 if hex is not a hexadecimal digit
+ */
+int vktor_unicode_hex_to_int(unsigned char hex);
+
+/**
+ * @brief Convert 4 hexadecimal digits to their integer value
+ * 
+ * Convert the 4 hexadecimal digits of an escaped Unicode sequence to a 16 bit
+ * code unit at once.
+ * 
+ * @param [in] hex Pointer to 4 hexadecimal characters
+ * 
+ * @return Integer value (0 - 0xffff), or -1 if any character is not a 
+ *         hexadecimal digit
  */
-unsigned char vktor_unicode_hex_to_int(unsigned char hex);
+long vktor_unicode_hex4_to_int(const char *hex);
 
 /**
  * @brief Encode a Unicode code point to a UTF-8 string
@@ -97,6 +106,26 @@ short vktor_unicode_cp_to_utf8(unsigned short cp, unsigned char *utf8);
  */
 short vktor_unicode_sp_to_utf8(unsigned short high, unsigned short low, unsigned char *utf8);
 
+/**
+ * @brief Transcode UTF-16 or UTF-32 text to UTF-8
+ * 
+ * Convert complete UTF-16 or UTF-32 code units to UTF-8. Unpaired surrogates
+ * and code points above U+10FFFF are replaced with U+FFFD. A high surrogate
+ * at the end of the text is kept in high, so that surrogate pairs can span
+ * calls.
+ * 
+ * @param [in]     text       UTF-16 or UTF-32 text
+ * @param [in]     len        Length of text in bytes, a multiple of unit
+ * @param [in]     unit       Code unit size - 2 for UTF-16 or 4 for UTF-32
+ * @param [in]     big_endian Whether text is big-endian
+ * @param [out]    out        Output buffer, at least len * 2 + 3 bytes long
+ * @param [in,out] high       Pending high surrogate, or 0 if there is none
+ * 
+ * @return Length of the UTF-8 text written to out
+ */
+long vktor_unicode_transcode(const char *text, long len, int unit, 
+                             int big_endian, char *out, unsigned long *high);
+
 /** @} */ // end of internal API
 
 #define _VKTOR_UNICODE_H
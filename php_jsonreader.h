@@ -40,6 +40,25 @@ PHP_MINIT_FUNCTION(jsonreader);
 PHP_MSHUTDOWN_FUNCTION(jsonreader);
 PHP_MINFO_FUNCTION(jsonreader);
 
+/* Declares the JSONWriter class, defined in jsonwriter.c */
+PHP_MINIT_FUNCTION(jsonwriter);
+
+/* JSONWriter internals, used by JSONReader::transformTo() to write through a
+   JSONWriter object. Return SUCCESS or FAILURE, emitting a warning on failure */
+typedef struct _jsonwriter_object jsonwriter_object;
+
+jsonwriter_object *jsonwriter_from_zval(zval *object TSRMLS_DC);
+int  jsonwriter_start(jsonwriter_object *obj, int is_object TSRMLS_DC);
+int  jsonwriter_key(jsonwriter_object *obj, const char *key, long key_len TSRMLS_DC);
+int  jsonwriter_value(jsonwriter_object *obj, zval *value TSRMLS_DC);
+int  jsonwriter_end(jsonwriter_object *obj TSRMLS_DC);
+
+/* Raw JSON text is written by jsonwriter_append() calls, enclosed by calls to 
+   jsonwriter_before_value() and jsonwriter_after_value() */
+int  jsonwriter_before_value(jsonwriter_object *obj TSRMLS_DC);
+int  jsonwriter_append(jsonwriter_object *obj, const char *data, long len TSRMLS_DC);
+void jsonwriter_after_value(jsonwriter_object *obj);
+
 ZEND_BEGIN_MODULE_GLOBALS(jsonreader)
 	long  max_depth;
 	long  read_buffer;
@@ -0,0 +1,40 @@
+--TEST--
+Test that a checkpoint can be used to resume reading in a new reader
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$file = tempnam(sys_get_temp_dir(), 'jsr');
+file_put_contents($file, '{"a": [1, 2, 3], "b": "some string value", "c": {"d": true}}');
+
+$rdr = new JSONReader(array(JSONReader::ATTR_READ_BUFF => 8));
+$rdr->open($file);
+for ($i = 0; $i < 5; $i++) {
+  $rdr->read();
+}
+echo $rdr->value, "\n";
+$checkpoint = $rdr->checkpoint();
+$rdr->close();
+
+$rdr = new JSONReader(array(JSONReader::ATTR_READ_BUFF => 8));
+$rdr->open($file);
+var_dump($rdr->resume($checkpoint));
+while ($rdr->read()) {
+  echo $rdr->tokenType, " ", var_export($rdr->value, true), "\n";
+}
+$rdr->close();
+unlink($file);
+?>
+--EXPECT--
+2
+bool(true)
+8 3
+128 NULL
+512 'b'
+32 'some string value'
+512 'c'
+256 NULL
+512 'd'
+4 true
+1024 NULL
+1024 NULL
@@ -0,0 +1,35 @@
+--TEST--
+Test that read() returns NEED_DATA on a non-blocking stream with no data
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+<?php if (!function_exists("stream_socket_pair")) print "skip no stream_socket_pair()"; ?>
+--FILE--
+<?php
+list($in, $out) = stream_socket_pair(STREAM_PF_UNIX, STREAM_SOCK_STREAM, STREAM_IPPROTO_IP);
+stream_set_blocking($in, 0);
+
+$rdr = new JSONReader(array(JSONReader::ATTR_NONBLOCK => true));
+$rdr->open($in);
+
+fwrite($out, '[1, "ab');
+while (($ret = $rdr->read()) === true) {
+  echo $rdr->tokenType, " ", var_export($rdr->value, true), "\n";
+}
+var_dump($ret === JSONReader::NEED_DATA);
+
+fwrite($out, 'c", true]');
+while (($ret = $rdr->read()) === true) {
+  echo $rdr->tokenType, " ", var_export($rdr->value, true), "\n";
+}
+var_dump($ret);
+$rdr->close();
+fclose($out);
+?>
+--EXPECT--
+64 NULL
+8 1
+bool(true)
+32 'abc'
+4 true
+128 NULL
+bool(false)
@@ -0,0 +1,48 @@
+--TEST--
+Test pushing data to the reader using feed() and end()
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$rdr = new JSONReader();
+foreach (array('{"a": [1, 2', '.5, "x', 'yz"], "b": nu', 'll}') as $chunk) {
+  $rdr->feed($chunk);
+  while (($ret = $rdr->read()) === true) {
+    echo $rdr->tokenType, " ", var_export($rdr->value, true), "\n";
+  }
+  var_dump($ret === JSONReader::NEED_DATA);
+}
+$rdr->end();
+var_dump($rdr->read());
+
+echo "--\n";
+
+$rdr = new JSONReader();
+$rdr->feed('42');
+var_dump($rdr->read() === JSONReader::NEED_DATA);
+$rdr->end();
+while (($ret = $rdr->read()) === true) {
+  echo $rdr->tokenType, " ", var_export($rdr->value, true), "\n";
+}
+var_dump($ret);
+?>
+--EXPECT--
+256 NULL
+512 'a'
+64 NULL
+8 1
+bool(true)
+16 2.5
+bool(true)
+32 'xyz'
+128 NULL
+512 'b'
+bool(true)
+1 NULL
+1024 NULL
+bool(false)
+bool(false)
+--
+bool(true)
+8 42
+bool(false)
@@ -0,0 +1,32 @@
+--TEST--
+Test adaptive read buffer size and the readBufferSize property
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$file = tempnam(sys_get_temp_dir(), 'jsr');
+file_put_contents($file, '["' . str_repeat('x', 90) . '", 1]');
+
+$rdr = new JSONReader(array(JSONReader::ATTR_READ_BUFF => 16));
+$rdr->open($file);
+var_dump($rdr->readBufferSize);
+$rdr->close();
+
+$rdr = new JSONReader(array(JSONReader::ATTR_READ_BUFF => JSONReader::READ_BUFF_ADAPTIVE));
+$rdr->open($file);
+var_dump($rdr->readBufferSize);
+while ($rdr->read()) {
+  echo $rdr->tokenType, " ", strlen($rdr->value), "\n";
+}
+var_dump($rdr->readBufferSize >= 1024);
+$rdr->close();
+unlink($file);
+?>
+--EXPECT--
+int(16)
+int(1024)
+64 0
+32 90
+8 1
+128 0
+bool(true)
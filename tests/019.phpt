@@ -0,0 +1,41 @@
+--TEST--
+Test UTF-8 validation using ATTR_VALIDATE_UTF8
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$file = tempnam(sys_get_temp_dir(), 'jsr');
+file_put_contents($file, "[\"caf\xc3\xa9\", \"bad\xc3\", \"\xed\xa0\x80\"]");
+
+foreach (array(JSONReader::UTF8_IGNORE, JSONReader::UTF8_REPLACE, JSONReader::UTF8_REJECT) as $mode) {
+  $rdr = new JSONReader(array(
+    JSONReader::ATTR_VALIDATE_UTF8 => $mode,
+    JSONReader::ATTR_ERRMODE       => JSONReader::ERRMODE_EXCEPT
+  ));
+  $rdr->open($file);
+  try {
+    while ($rdr->read()) {
+      if ($rdr->tokenType == JSONReader::STRING) {
+        echo bin2hex($rdr->value), "\n";
+      }
+    }
+  } catch (JSONReaderException $e) {
+    echo "EX: {$e->getMessage()}\n";
+  }
+  $rdr->close();
+  echo "--\n";
+}
+unlink($file);
+?>
+--EXPECTF--
+636166c3a9
+626164c3
+eda080
+--
+636166c3a9
+626164efbfbd
+efbfbdefbfbdefbfbd
+--
+636166c3a9
+EX: Invalid UTF-8 sequence in string%s
+--
@@ -0,0 +1,62 @@
+--TEST--
+Test reading UTF-16 and UTF-32 encoded input
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+/* {"k": ["café", "<U+1F600>", 1]} as code points */
+$cps = array_merge(array_map('ord', str_split('{"k": ["caf')), array(0xe9), 
+  array_map('ord', str_split('", "')), array(0x1f600), 
+  array_map('ord', str_split('", 1]}')));
+
+function encode($cps, $unit, $be) {
+  $out = '';
+  foreach ($cps as $cp) {
+    if ($unit == 2 && $cp > 0xffff) {
+      $cp -= 0x10000;
+      $units = array(0xd800 | ($cp >> 10), 0xdc00 | ($cp & 0x3ff));
+    } else {
+      $units = array($cp);
+    }
+    foreach ($units as $u) {
+      $out .= pack($unit == 2 ? ($be ? 'n' : 'v') : ($be ? 'N' : 'V'), $u);
+    }
+  }
+  return $out;
+}
+
+$inputs = array(
+  array("\xff\xfe" . encode($cps, 2, false), JSONReader::ENCODING_AUTO),
+  array(encode($cps, 2, true), JSONReader::ENCODING_AUTO),
+  array(encode($cps, 4, false), JSONReader::ENCODING_AUTO),
+  array("\x00\x00\xfe\xff" . encode($cps, 4, true), JSONReader::ENCODING_AUTO),
+  array("\xef\xbb\xbf{\"k\": [\"caf\xc3\xa9\", \"\xf0\x9f\x98\x80\", 1]}", JSONReader::ENCODING_AUTO),
+  array(encode($cps, 2, true), JSONReader::ENCODING_UTF16BE),
+);
+
+$file = tempnam(sys_get_temp_dir(), 'jsr');
+foreach ($inputs as $input) {
+  file_put_contents($file, $input[0]);
+  $rdr = new JSONReader(array(
+    JSONReader::ATTR_ENCODING  => $input[1],
+    JSONReader::ATTR_READ_BUFF => 3
+  ));
+  $rdr->open($file);
+  $out = array();
+  while ($rdr->read()) {
+    if ($rdr->tokenType & (JSONReader::VALUE | JSONReader::OBJECT_KEY)) {
+      $out[] = bin2hex($rdr->value);
+    }
+  }
+  echo implode(" ", $out), "\n";
+  $rdr->close();
+}
+unlink($file);
+?>
+--EXPECT--
+6b 636166c3a9 f09f9880 31
+6b 636166c3a9 f09f9880 31
+6b 636166c3a9 f09f9880 31
+6b 636166c3a9 f09f9880 31
+6b 636166c3a9 f09f9880 31
+6b 636166c3a9 f09f9880 31
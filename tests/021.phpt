@@ -0,0 +1,45 @@
+--TEST--
+Test decoding of escaped Unicode characters and surrogate pairs
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$json = '["café", "中文", "😀", "🐶", "􏿿", "AB"]';
+
+foreach (array(1, 5, 4096) as $size) {
+  $rdr = new JSONReader();
+  foreach (str_split($json, $size) as $chunk) {
+    $rdr->feed($chunk);
+  }
+  $rdr->end();
+  $out = array();
+  while ($rdr->read()) {
+    if ($rdr->tokenType == JSONReader::STRING) {
+      $out[] = bin2hex($rdr->value);
+    }
+  }
+  echo implode(" ", $out), "\n";
+}
+
+$rdr = new JSONReader();
+$rdr->feed('["\ud83dA"]');
+$rdr->end();
+while ($rdr->read());
+
+foreach (array('["\udc00"]', '["\ud83d\u0041"]') as $json) {
+  $rdr = new JSONReader();
+  $rdr->feed($json);
+  $rdr->end();
+  while ($rdr->read());
+}
+?>
+--EXPECTF--
+636166c3a9 e4b8ade69687 f09f9880 f09f90b6 f48fbfbf 4142
+636166c3a9 e4b8ade69687 f09f9880 f09f90b6 f48fbfbf 4142
+636166c3a9 e4b8ade69687 f09f9880 f09f90b6 f48fbfbf 4142
+
+Warning: JSONReader::read(): parser error [#%d]: %s in %s on line %d
+
+Warning: JSONReader::read(): parser error [#%d]: unexpected low surrogate \uDC00 in %s on line %d
+
+Warning: JSONReader::read(): parser error [#%d]: expected a low surrogate after \uD83D, got \u0041 in %s on line %d
@@ -0,0 +1,28 @@
+--TEST--
+Test that unexpected array or object starts are rejected
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+foreach (array('{"a" {}}', '["a" [1]]', '{"a": 1 {', '[1, {"a": [true]}]') as $json) {
+  $rdr = new JSONReader(array(
+    JSONReader::ATTR_ERRMODE => JSONReader::ERRMODE_EXCEPT
+  ));
+  $rdr->feed($json);
+  $rdr->end();
+  try {
+    $count = 0;
+    while ($rdr->read()) {
+      $count++;
+    }
+    echo "OK: $count tokens\n";
+  } catch (JSONReaderException $e) {
+    echo "EX: {$e->getMessage()}\n";
+  }
+}
+?>
+--EXPECT--
+EX: Unexpected character in input: '{' (0x7b)
+EX: Unexpected character in input: '[' (0x5b)
+EX: Unexpected character in input: '{' (0x7b)
+OK: 9 tokens
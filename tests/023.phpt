@@ -0,0 +1,58 @@
+--TEST--
+Test reusing one reader for several documents with open() and feed()
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$file = tempnam(sys_get_temp_dir(), 'jsr');
+$rdr = new JSONReader(array(
+  JSONReader::ATTR_MAX_DEPTH     => 3,
+  JSONReader::ATTR_VALIDATE_UTF8 => JSONReader::UTF8_REJECT,
+  JSONReader::ATTR_ERRMODE       => JSONReader::ERRMODE_EXCEPT
+));
+
+$docs = array('[["a"]]', '[[["a"]]]', "[\"bad\xc3\"]", '{"b": [1, 2]}', '"c"');
+foreach ($docs as $i => $json) {
+  file_put_contents($file, $json);
+  $rdr->open($file);
+  /* Leave every other document half read before opening the next one */
+  $max = ($i % 2) ? 2 : -1;
+  $count = 0;
+  try {
+    while ($count != $max && $rdr->read()) {
+      $count++;
+    }
+    echo "$i: $count tokens\n";
+  } catch (JSONReaderException $e) {
+    echo "$i: EX: {$e->getMessage()}\n";
+  }
+  $rdr->close();
+}
+unlink($file);
+
+foreach ($docs as $i => $json) {
+  $rdr->feed($json);
+  $rdr->end();
+  $count = 0;
+  try {
+    while ($rdr->read()) {
+      $count++;
+    }
+    echo "$i: $count tokens\n";
+  } catch (JSONReaderException $e) {
+    echo "$i: EX: {$e->getMessage()}\n";
+  }
+  $rdr->close();
+}
+?>
+--EXPECTF--
+0: 5 tokens
+1: 2 tokens
+2: EX: Invalid UTF-8 sequence in string%s
+3: 2 tokens
+4: 1 tokens
+0: 5 tokens
+1: EX: maximal nesting level of 3 reached
+2: EX: Invalid UTF-8 sequence in string%s
+3: 7 tokens
+4: 1 tokens
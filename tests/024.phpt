@@ -0,0 +1,68 @@
+--TEST--
+Test skipping tokens using ATTR_TOKEN_MASK
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$json = '{"a": [1, 2.5, "x", true], "b": {"c": null, "d": "y"}, "e": 3}';
+$masks = array(
+  JSONReader::OBJECT_KEY | JSONReader::STRING,
+  JSONReader::NUMBER,
+  JSONReader::OBJECT_START | JSONReader::OBJECT_END,
+  0
+);
+
+foreach ($masks as $mask) {
+  $rdr = new JSONReader(array(JSONReader::ATTR_TOKEN_MASK => $mask));
+  $rdr->feed($json);
+  $rdr->end();
+  while ($rdr->read()) {
+    echo $rdr->tokenType, " ", $rdr->currentDepth, " ";
+    var_dump($rdr->value);
+  }
+  echo "--\n";
+}
+
+/* Masked out tokens are still validated */
+$rdr = new JSONReader(array(JSONReader::ATTR_TOKEN_MASK => JSONReader::STRING));
+$rdr->feed('["a", 1.e5, "b"]');
+$rdr->end();
+while ($rdr->read()) {
+  var_dump($rdr->value);
+}
+
+/* Masked out strings and object keys are not decoded */
+$rdr = new JSONReader(array(JSONReader::ATTR_TOKEN_MASK => JSONReader::NUMBER));
+$rdr->feed('{"k\q": "\x", "n": 7}');
+$rdr->end();
+while ($rdr->read()) {
+  var_dump($rdr->value);
+}
+
+$rdr = new JSONReader(array(JSONReader::ATTR_TOKEN_MASK => 1 << 20));
+?>
+--EXPECTF--
+512 1 string(1) "a"
+32 2 string(1) "x"
+512 1 string(1) "b"
+512 2 string(1) "c"
+512 2 string(1) "d"
+32 2 string(1) "y"
+512 1 string(1) "e"
+--
+8 2 int(1)
+16 2 float(2.5)
+8 1 int(3)
+--
+256 1 NULL
+256 2 NULL
+1024 1 NULL
+1024 0 NULL
+--
+--
+string(1) "a"
+
+Warning: JSONReader::read(): parser error [#%d]: Unexpected character in input: 'e' (0x65) in %s on line %d
+int(7)
+
+Warning: JSONReader::__construct(): invalid token mask attribute value: 1048576 in %s on line %d
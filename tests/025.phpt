@@ -0,0 +1,94 @@
+--TEST--
+Test reading record fields as columns using readColumns()
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$json = '[{"id": 1, "skip": {"a": ["]", "}"]}, "msg": "a", "ts": 1.5}, ' .
+        '{"msg": "b\"}", "id": 2, "tags": [1, [2]]}, ' .
+        '[1, 2], ' .
+        '{"id": 3, "msg": {"x": [true, null]}, "id": 4}]';
+
+$rdr = new JSONReader();
+$rdr->feed($json);
+$rdr->end();
+var_dump($rdr->readColumns(array('id', 'msg'), 2));
+var_dump($rdr->readColumns(array('id', 'msg')));
+var_dump($rdr->readColumns(array('id')));
+var_dump($rdr->read());
+
+/* Start reading from an array found inside the document */
+$rdr = new JSONReader();
+$rdr->feed('{"meta": {"n": 2}, "rows": [{"n": 1}, {"n": 2}]}');
+$rdr->end();
+while ($rdr->read() && $rdr->tokenType != JSONReader::ARRAY_START);
+var_dump($rdr->readColumns(array('n')));
+
+$rdr = new JSONReader();
+$rdr->feed('{"a": 1}');
+var_dump($rdr->readColumns(array('a')));
+$rdr->end();
+var_dump($rdr->readColumns(array('a')));
+?>
+--EXPECTF--
+array(2) {
+  ["id"]=>
+  array(2) {
+    [0]=>
+    int(1)
+    [1]=>
+    int(2)
+  }
+  ["msg"]=>
+  array(2) {
+    [0]=>
+    string(1) "a"
+    [1]=>
+    string(3) "b"}"
+  }
+}
+array(2) {
+  ["id"]=>
+  array(2) {
+    [0]=>
+    NULL
+    [1]=>
+    int(3)
+  }
+  ["msg"]=>
+  array(2) {
+    [0]=>
+    NULL
+    [1]=>
+    array(1) {
+      ["x"]=>
+      array(2) {
+        [0]=>
+        bool(true)
+        [1]=>
+        NULL
+      }
+    }
+  }
+}
+array(1) {
+  ["id"]=>
+  array(0) {
+  }
+}
+bool(false)
+array(1) {
+  ["n"]=>
+  array(2) {
+    [0]=>
+    int(1)
+    [1]=>
+    int(2)
+  }
+}
+
+Warning: JSONReader::readColumns(): cannot read columns from a non-blocking stream or before end() is called in %s on line %d
+bool(false)
+
+Warning: JSONReader::readColumns(): columns can only be read from an array of records in %s on line %d
+bool(false)
@@ -0,0 +1,131 @@
+--TEST--
+Test schema-guided record decoding using setSchema() and readRecord()
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$json = '[{"id": 1, "name": "a", "score": 2, "pos": {"x": 1.5, "y": -2e1}, "tags": ["t"]}, ' .
+        '{"name": "b", "id": 2, "extra": {"a": [1, "]"]}, "id": 7, "score": null}, ' .
+        '{"id": "3", "name": "c", "pos": {"x": [1], "y": 0}}, ' .
+        '{"id": 4, "pos": {"x": 0.25, "y": "0"}}, ' .
+        '5, ' .
+        '{"id": 6, "name": "f", "score": 0.1, "pos": {"y": 3}, "tags": null}]';
+
+$rdr = new JSONReader();
+var_dump($rdr->setSchema(array()));
+var_dump($rdr->setSchema(array('id' => 'int')));
+var_dump($rdr->setSchema(array(
+	'id'    => JSONReader::INT,
+	'name'  => JSONReader::STRING,
+	'score' => JSONReader::FLOAT | JSONReader::NULL,
+	'pos'   => array('x' => JSONReader::FLOAT, 'y' => JSONReader::NUMBER),
+	'tags'  => JSONReader::ARRAY_START | JSONReader::NULL
+)));
+
+$rdr->feed($json);
+$rdr->end();
+do {
+	$rec = $rdr->readRecord();
+	var_dump($rec);
+} while ($rdr->tokenType != JSONReader::ARRAY_END);
+var_dump($rdr->readRecord());
+
+/* Mismatches throw exceptions in exception mode */
+$rdr = new JSONReader(array(JSONReader::ATTR_ERRMODE => JSONReader::ERRMODE_EXCEPT));
+$rdr->setSchema(array('ok' => JSONReader::BOOLEAN));
+$rdr->feed('[{"ok": true}, {"ok": 1}, {"ok": false}]');
+$rdr->end();
+while (true) {
+	try {
+		if (($rec = $rdr->readRecord()) === false) break;
+		var_dump($rec);
+	} catch (JSONReaderException $e) {
+		var_dump($e->getCode() == JSONReader::ERR_SCHEMA, $e->getMessage());
+	}
+}
+
+$rdr = new JSONReader();
+$rdr->feed('{"a": 1}');
+$rdr->end();
+var_dump($rdr->readRecord());
+?>
+--EXPECTF--
+Warning: JSONReader::setSchema(): schema must have at least one field in %s on line %d
+bool(false)
+
+Warning: JSONReader::setSchema(): invalid type for schema field 'id' in %s on line %d
+bool(false)
+bool(true)
+array(5) {
+  ["id"]=>
+  int(1)
+  ["name"]=>
+  string(1) "a"
+  ["score"]=>
+  float(2)
+  ["pos"]=>
+  array(2) {
+    ["x"]=>
+    float(1.5)
+    ["y"]=>
+    float(-20)
+  }
+  ["tags"]=>
+  array(1) {
+    [0]=>
+    string(1) "t"
+  }
+}
+array(5) {
+  ["id"]=>
+  int(2)
+  ["name"]=>
+  string(1) "b"
+  ["score"]=>
+  NULL
+  ["pos"]=>
+  NULL
+  ["tags"]=>
+  NULL
+}
+
+Warning: JSONReader::readRecord(): schema mismatch at offset 166: unexpected string value for field 'id' in %s on line %d
+bool(false)
+
+Warning: JSONReader::readRecord(): schema mismatch at offset 246: unexpected string value for field 'y' in %s on line %d
+bool(false)
+
+Warning: JSONReader::readRecord(): schema mismatch at offset 251: unexpected integer value for record in %s on line %d
+bool(false)
+array(5) {
+  ["id"]=>
+  int(6)
+  ["name"]=>
+  string(1) "f"
+  ["score"]=>
+  float(0.1)
+  ["pos"]=>
+  array(2) {
+    ["x"]=>
+    NULL
+    ["y"]=>
+    int(3)
+  }
+  ["tags"]=>
+  NULL
+}
+bool(false)
+bool(false)
+array(1) {
+  ["ok"]=>
+  bool(true)
+}
+bool(true)
+string(69) "schema mismatch at offset 23: unexpected integer value for field 'ok'"
+array(1) {
+  ["ok"]=>
+  bool(false)
+}
+
+Warning: JSONReader::readRecord(): no schema was set, call setSchema() first in %s on line %d
+bool(false)
@@ -0,0 +1,88 @@
+--TEST--
+Test reading compressed streams using ATTR_COMPRESSION
+--SKIPIF--
+<?php 
+if (!extension_loaded("jsonreader")) print "skip"; 
+if (!extension_loaded("zlib")) print "skip zlib extension is needed to compress test data";
+$rdr = @new JSONReader(array(JSONReader::ATTR_COMPRESSION => JSONReader::COMPRESSION_AUTO));
+$err = error_get_last();
+if ($err && strpos($err['message'], 'zlib') !== false) print "skip jsonreader was built without zlib";
+?>
+--FILE--
+<?php
+$json = '[';
+for ($i = 0; $i < 500; $i++) {
+	$json .= ($i ? ', ' : '') . '{"id": ' . $i . ', "name": "' . str_repeat('n', $i % 20) . '"}';
+}
+$json .= ']';
+$half = strpos($json, '{"id": 250');
+
+function read_ids($data, $compression, $read_buff)
+{
+	$fp = fopen('php://memory', 'w+');
+	fwrite($fp, $data);
+	rewind($fp);
+
+	$rdr = new JSONReader(array(
+		JSONReader::ATTR_COMPRESSION => $compression,
+		JSONReader::ATTR_READ_BUFF   => $read_buff
+	));
+	$rdr->open($fp);
+	$sum = 0;
+	while ($rdr->read()) {
+		if ($rdr->tokenType == JSONReader::INT) $sum += $rdr->value;
+	}
+	return $sum;
+}
+
+foreach (array(1, 7, 4096) as $size) {
+	var_dump(read_ids(gzencode($json), JSONReader::COMPRESSION_GZIP, $size));
+	var_dump(read_ids(gzencode(substr($json, 0, $half)) . gzencode(substr($json, $half)), 
+		JSONReader::COMPRESSION_GZIP, $size));
+	var_dump(read_ids(gzcompress($json), JSONReader::COMPRESSION_AUTO, $size));
+	var_dump(read_ids(gzdeflate($json), JSONReader::COMPRESSION_DEFLATE, $size));
+}
+
+var_dump(read_ids($json, JSONReader::COMPRESSION_GZIP, 4096));
+
+/* Truncated streams and data after the end of a zlib stream are errors */
+var_dump(read_ids(substr(gzencode($json), 0, -4), JSONReader::COMPRESSION_GZIP, 4096));
+var_dump(read_ids(gzcompress($json) . 'x', JSONReader::COMPRESSION_ZLIB, 4096));
+
+$rdr = new JSONReader(array(JSONReader::ATTR_COMPRESSION => 10));
+
+$fp = fopen('php://memory', 'w+');
+fwrite($fp, gzencode($json));
+rewind($fp);
+$rdr = new JSONReader(array(JSONReader::ATTR_COMPRESSION => JSONReader::COMPRESSION_GZIP));
+$rdr->open($fp);
+$rdr->read();
+var_dump($rdr->resume($rdr->checkpoint()));
+?>
+--EXPECTF--
+int(124750)
+int(124750)
+int(124750)
+int(124750)
+int(124750)
+int(124750)
+int(124750)
+int(124750)
+int(124750)
+int(124750)
+int(124750)
+int(124750)
+
+Warning: JSONReader::read(): unable to decompress JSON stream: incorrect header check in %s on line %d
+int(0)
+
+Warning: JSONReader::read(): unexpected end of compressed stream in %s on line %d
+int(124750)
+
+Warning: JSONReader::read(): unexpected data after the end of compressed stream in %s on line %d
+int(124750)
+
+Warning: JSONReader::__construct(): invalid compression attribute value: 10 in %s on line %d
+
+Warning: JSONReader::resume(): cannot resume reading a compressed stream in %s on line %d
+bool(false)
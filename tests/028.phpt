@@ -0,0 +1,119 @@
+--TEST--
+Test writing JSON using JSONWriter
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+class Point { public $x = 1; public $y = 2.5; protected $hidden = 3; }
+
+$w = new JSONWriter();
+var_dump($w->startArray());
+$w->openMemory();
+$w->startObject();
+$w->writeKey('str');
+$w->writeValue("a \"quoted\"\\ \n\t\x01 é");
+$w->writeKey('nums');
+$w->writeValue(array(0, -42, PHP_INT_MAX, 0.1, 1.0, -2.5e-20, 1/3));
+$w->writeKey('map');
+$w->writeValue(array('b' => true, 'f' => false, 'n' => null, 3 => array()));
+$w->writeKey('obj');
+$w->writeValue(new Point());
+$w->writeKey('list');
+$w->startArray();
+$w->writeValue(1);
+$w->startObject();
+$w->end();
+$w->writeValue('x');
+$w->end();
+$w->end();
+$json = $w->outputMemory();
+echo $json, "\n";
+var_dump(json_decode($json, true) !== null);
+var_dump($w->close());
+
+/* Structure errors */
+$w->openMemory();
+var_dump($w->writeKey('a'));
+var_dump($w->end());
+$a = array(1);
+$a[] = &$a;
+var_dump($w->writeValue($a));
+$w->startObject();
+var_dump($w->writeValue(1));
+$w->writeKey('a');
+var_dump($w->writeKey('b'));
+var_dump($w->end());
+$w->writeValue(1);
+$w->end();
+var_dump($w->writeValue(2));
+echo $w->outputMemory(), "\n";
+
+$w->openMemory();
+$w->startArray();
+var_dump($w->close());
+
+$w = new JSONWriter(array(JSONWriter::ATTR_MAX_DEPTH => 2));
+$w->openMemory();
+$w->startArray();
+$w->startArray();
+var_dump($w->startArray());
+var_dump($w->writeValue(array(array(1))));
+var_dump($w->writeValue(INF));
+echo $w->outputMemory(), "\n";
+
+/* Streams with a small buffer */
+$fp = fopen('php://memory', 'w+');
+$w = new JSONWriter(array(JSONWriter::ATTR_WRITE_BUFF => 8));
+$w->open($fp);
+$w->startArray();
+for ($i = 0; $i < 5; $i++) {
+	$w->writeValue(array('id' => $i, 'name' => str_repeat('n', $i * 3)));
+}
+$w->end();
+var_dump($w->flush());
+rewind($fp);
+echo stream_get_contents($fp), "\n";
+?>
+--EXPECTF--
+Warning: JSONWriter::startArray(): trying to write but no stream was opened in %s on line %d
+bool(false)
+{"str":"a \"quoted\"\\ \n\t\u0001 é","nums":[0,-42,%d,0.1,1.0,-2.5e-20,0.3333333333333333],"map":{"b":true,"f":false,"n":null,"3":[]},"obj":{"x":1,"y":2.5},"list":[1,{},"x"]}
+bool(true)
+bool(true)
+
+Warning: JSONWriter::writeKey(): trying to write a key outside of an object in %s on line %d
+bool(false)
+
+Warning: JSONWriter::end(): there is no array or object to end in %s on line %d
+bool(false)
+
+Warning: JSONWriter::writeValue(): recursive arrays or objects can not be written in %s on line %d
+bool(false)
+
+Warning: JSONWriter::writeValue(): trying to write a value in an object without a key, call writeKey() first in %s on line %d
+bool(false)
+
+Warning: JSONWriter::writeKey(): trying to write a key before the value of the previous key in %s on line %d
+bool(false)
+
+Warning: JSONWriter::end(): trying to end an object after a key without a value in %s on line %d
+bool(false)
+
+Warning: JSONWriter::writeValue(): trying to write a value after the end of the JSON document in %s on line %d
+bool(false)
+{"a":1}
+
+Warning: JSONWriter::close(): closing an incomplete JSON document in %s on line %d
+bool(false)
+
+Warning: JSONWriter::startArray(): maximal nesting level of 2 reached in %s on line %d
+bool(false)
+
+Warning: JSONWriter::writeValue(): maximal nesting level of 2 reached in %s on line %d
+bool(false)
+
+Warning: JSONWriter::writeValue(): infinite or NaN values can not be written as JSON in %s on line %d
+bool(false)
+[[
+bool(true)
+[{"id":0,"name":""},{"id":1,"name":"nnn"},{"id":2,"name":"nnnnnn"},{"id":3,"name":"nnnnnnnnn"},{"id":4,"name":"nnnnnnnnnnnn"}]
@@ -0,0 +1,109 @@
+--TEST--
+Test rewriting JSON using JSONReader::transformTo()
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+function transform($json, $rules)
+{
+	$rdr = new JSONReader();
+	$rdr->feed($json);
+	$rdr->end();
+	$w = new JSONWriter();
+	$w->openMemory();
+	var_dump($rdr->transformTo($w, $rules));
+	echo $w->outputMemory(), "\n";
+}
+
+transform('{"users": [{"id": 1, "name": "ann", "password": "x", "email": "a@b"}, ' .
+	'{"id": 2, "name": "bob", "tags": [1, 2], "email": null}], "meta": {"n" : 2}}', array(
+	'/users/*/password' => JSONReader::RULE_DROP,
+	'/users/*/email'    => JSONReader::RULE_REDACT,
+	'/users/*/name'     => function ($v, $path) { echo $path, "\n"; return strtoupper($v); },
+	'/meta'             => array(JSONReader::RULE_REPLACE, array('ok' => true))
+));
+
+/* Without matching rules, the input is copied as is */
+transform(' [1, {"a" : "é~"}, true ] ', array());
+transform('{"a/b": {"x~": 1, "y": 2}, "c": [3]}', array('/a~1b/x~0' => JSONReader::RULE_DROP));
+transform('[1,2,3]', array('' => function ($v, $path) { var_dump($path); return count($v); }));
+
+/* Large input copied across many read buffers */
+$items = array();
+for ($i = 0; $i < 300; $i++) {
+	$items[] = '{"id": ' . $i . ', "s": "' . str_repeat('\\"x', $i % 7) . '", "n": [' . $i . ']}';
+}
+$json = '[' . implode(', ', $items) . ']';
+$fp = fopen('php://memory', 'w+');
+fwrite($fp, $json);
+rewind($fp);
+$rdr = new JSONReader(array(JSONReader::ATTR_READ_BUFF => 7));
+$rdr->open($fp);
+$w = new JSONWriter();
+$w->openMemory();
+$rdr->transformTo($w, array('/1/n' => JSONReader::RULE_DROP));
+$items[1] = '{"id":1,"s":"\\"x"}';
+var_dump($w->outputMemory() === '[' . implode(',', $items) . ']');
+
+/* Transforming the value of the current key, inside a writer's document */
+$rdr = new JSONReader();
+$rdr->feed('{"a": 1, "b": {"c": [1, 2, 3], "d": "x"}, "e": 2}');
+$rdr->end();
+$rdr->read();
+$rdr->read();
+$rdr->read();
+$rdr->read();
+$w->openMemory();
+$w->startObject();
+$w->writeKey('b');
+var_dump($rdr->transformTo($w, array('/c/1' => JSONReader::RULE_DROP)));
+$w->end();
+echo $w->outputMemory(), "\n";
+$rdr->read();
+var_dump($rdr->value);
+
+/* Errors */
+$rdr = new JSONReader();
+$rdr->feed('{"a": 1}');
+var_dump($rdr->transformTo($w, array()));
+$rdr->end();
+var_dump($rdr->transformTo(new stdClass(), array()));
+var_dump($rdr->transformTo($w, array('a' => JSONReader::RULE_DROP)));
+var_dump($rdr->transformTo($w, array('/a~2' => JSONReader::RULE_DROP)));
+var_dump($rdr->transformTo($w, array('/a' => 42)));
+var_dump($rdr->transformTo($w, array('' => JSONReader::RULE_DROP)));
+?>
+--EXPECTF--
+/users/0/name
+/users/1/name
+bool(true)
+{"users":[{"id":1,"name":"ANN","email":"[REDACTED]"},{"id":2,"name":"BOB","tags":[1, 2],"email":"[REDACTED]"}],"meta":{"ok":true}}
+bool(true)
+[1, {"a" : "é~"}, true ]
+bool(true)
+{"a/b":{"y":2},"c":[3]}
+string(0) ""
+bool(true)
+3
+bool(true)
+bool(true)
+{"b":{"c":[1,3],"d":"x"}}
+string(1) "e"
+
+Warning: JSONReader::transformTo(): cannot transform from a non-blocking stream or before end() is called in %s on line %d
+bool(false)
+
+Warning: JSONReader::transformTo(): expecting a JSONWriter object in %s on line %d
+bool(false)
+
+Warning: JSONReader::transformTo(): invalid path 'a', paths must be empty or start with '/' in %s on line %d
+bool(false)
+
+Warning: JSONReader::transformTo(): invalid path '/a~2', '~' must be followed by '0' or '1' in %s on line %d
+bool(false)
+
+Warning: JSONReader::transformTo(): invalid rule for path '/a' in %s on line %d
+bool(false)
+
+Warning: JSONReader::transformTo(): the root value can not be dropped in %s on line %d
+bool(false)
@@ -0,0 +1,66 @@
+--TEST--
+Test reading the raw JSON text of values using JSONReader::readRaw()
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$json = '[{"id": 1,  "msg": "aé\"b"}, 1.50E+3, "x\/y", true, null, [ ], {"n": [1, {"m": "]}"}]}]';
+
+$rdr = new JSONReader();
+$rdr->feed($json);
+$rdr->end();
+var_dump($rdr->readRaw());
+while ($rdr->read()) {
+	if (($rdr->tokenType & JSONReader::VALUE && $rdr->currentDepth == 1) ||
+		(($rdr->tokenType == JSONReader::ARRAY_START || $rdr->tokenType == JSONReader::OBJECT_START) && 
+		$rdr->currentDepth == 2)) {
+		var_dump($rdr->readRaw());
+	}
+}
+
+/* Values spanning many read buffers */
+$items = array();
+for ($i = 0; $i < 200; $i++) {
+	$items[] = '{"id" : ' . $i . ', "s": "' . str_repeat('\\"x', $i % 9) . '"}';
+}
+$fp = fopen('php://memory', 'w+');
+fwrite($fp, '{"items": [' . implode(",\n", $items) . '], "n": 12345678901234567890}');
+rewind($fp);
+$rdr = new JSONReader(array(JSONReader::ATTR_READ_BUFF => 5));
+$rdr->open($fp);
+$raw = array();
+while ($rdr->read()) {
+	if ($rdr->tokenType == JSONReader::OBJECT_START && $rdr->currentDepth == 3) {
+		$raw[] = $rdr->readRaw();
+	}
+	if ($rdr->tokenType & JSONReader::NUMBER && $rdr->currentDepth == 1) {
+		var_dump($rdr->readRaw());
+	}
+}
+var_dump($raw === $items);
+
+/* Arrays and objects need all data */
+$rdr = new JSONReader();
+$rdr->feed('[1, [2]');
+$rdr->read();
+$rdr->read();
+var_dump($rdr->readRaw());
+$rdr->read();
+var_dump($rdr->readRaw());
+?>
+--EXPECTF--
+Warning: JSONReader::readRaw(): the reader is not at the start of a value in %s on line %d
+bool(false)
+string(27) "{"id": 1,  "msg": "aé\"b"}"
+string(7) "1.50E+3"
+string(6) ""x\/y""
+string(4) "true"
+string(4) "null"
+string(3) "[ ]"
+string(23) "{"n": [1, {"m": "]}"}]}"
+string(20) "12345678901234567890"
+bool(true)
+string(1) "1"
+
+Warning: JSONReader::readRaw(): cannot read raw arrays, objects or streamed strings from a non-blocking stream or before end() is called in %s on line %d
+bool(false)
@@ -0,0 +1,89 @@
+--TEST--
+Test decoding strings on demand with ATTR_LAZY_STRINGS
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$json = <<<'JSON'
+{"a": "plain", "b\n": "esc \"q\" é 😀 \\", "c": ["x", "\t", ""], "dA": 1}
+JSON;
+
+function read_values($json, $attrs)
+{
+	$fp = fopen('php://memory', 'w+');
+	fwrite($fp, $json);
+	rewind($fp);
+	$rdr = new JSONReader($attrs);
+	$rdr->open($fp);
+	$values = array();
+	while ($rdr->read()) {
+		$values[] = array($rdr->tokenType, $rdr->value);
+	}
+	return $values;
+}
+
+$eager = read_values($json, array());
+foreach (array(3, 4096) as $size) {
+	$lazy = read_values($json, array(
+		JSONReader::ATTR_LAZY_STRINGS => true,
+		JSONReader::ATTR_READ_BUFF    => $size
+	));
+	var_dump($lazy === $eager);
+}
+var_dump($lazy[3][1], $lazy[4][1], $lazy[11][1]);
+
+/* Invalid escape sequences are only found when the value is read */
+$rdr = new JSONReader(array(JSONReader::ATTR_LAZY_STRINGS => true));
+$rdr->feed('["ok", "\q", "after"]');
+$rdr->end();
+while ($rdr->read()) {
+	echo $rdr->tokenType, "\n";
+}
+$rdr->close();
+$rdr->feed('["ok", "\q", "after"]');
+$rdr->end();
+while ($rdr->read()) {
+	var_dump($rdr->value);
+}
+
+/* Strings which are skipped are never decoded */
+$rdr = new JSONReader(array(JSONReader::ATTR_LAZY_STRINGS => true));
+$rdr->feed('[{"id": 1, "note": "\x", "name": "né"}, {"name": "b", "id": 2}]');
+$rdr->end();
+var_dump($rdr->readColumns(array('id', 'name')));
+?>
+--EXPECTF--
+bool(true)
+bool(true)
+string(2) "b
+"
+string(17) "esc "q" é 😀 \"
+string(2) "dA"
+64
+32
+32
+32
+128
+NULL
+string(2) "ok"
+
+Warning: %sparser error [#%d]: Unexpected character in input: 'q' (0x71) in %s on line %d
+NULL
+string(5) "after"
+NULL
+array(2) {
+  ["id"]=>
+  array(2) {
+    [0]=>
+    int(1)
+    [1]=>
+    int(2)
+  }
+  ["name"]=>
+  array(2) {
+    [0]=>
+    string(3) "né"
+    [1]=>
+    string(1) "b"
+  }
+}
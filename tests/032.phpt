@@ -0,0 +1,73 @@
+--TEST--
+Test reading numbers as strings with ATTR_NUMBER_MODE
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$json = '[1, -0, 1.10, 1E3, 0.1, 0.0, 12345678901234567890123, ' .
+	'3.141592653589793238, 1e400, 1e-400]';
+
+foreach (array(JSONReader::NUMBER_STRING, JSONReader::NUMBER_AUTO) as $mode) {
+	$rdr = new JSONReader(array(JSONReader::ATTR_NUMBER_MODE => $mode));
+	$rdr->feed($json);
+	$rdr->end();
+	while ($rdr->read()) {
+		if ($rdr->tokenType & JSONReader::NUMBER) {
+			echo ($rdr->tokenType == JSONReader::INT ? 'int   ' : 'float '); 
+			var_dump($rdr->value);
+		}
+	}
+}
+
+/* Overflowing numbers are errors in native mode */
+$rdr = new JSONReader();
+$rdr->feed('[1.5, 12345678901234567890123]');
+$rdr->end();
+$rdr->read();
+$rdr->read();
+var_dump($rdr->value);
+$rdr->read();
+var_dump($rdr->value);
+
+/* Schema float fields get the number text too */
+$rdr = new JSONReader(array(JSONReader::ATTR_NUMBER_MODE => JSONReader::NUMBER_STRING));
+$rdr->setSchema(array('a' => JSONReader::FLOAT, 'b' => JSONReader::FLOAT));
+$rdr->feed('[{"a": 2, "b": 1.50}]');
+$rdr->end();
+var_dump($rdr->readRecord());
+
+$rdr = new JSONReader(array(JSONReader::ATTR_NUMBER_MODE => 5));
+?>
+--EXPECTF--
+int   string(1) "1"
+int   string(2) "-0"
+float string(4) "1.10"
+float string(3) "1E3"
+float string(3) "0.1"
+float string(3) "0.0"
+int   string(23) "12345678901234567890123"
+float string(20) "3.141592653589793238"
+float string(5) "1e400"
+float string(6) "1e-400"
+int   int(1)
+int   int(0)
+float float(1.1)
+float float(1000)
+float float(0.1)
+float float(0)
+int   string(23) "12345678901234567890123"
+float string(20) "3.141592653589793238"
+float string(5) "1e400"
+float string(6) "1e-400"
+float(1.5)
+
+Warning: %s in %s on line %d
+NULL
+array(2) {
+  ["a"]=>
+  string(1) "2"
+  ["b"]=>
+  string(4) "1.50"
+}
+
+Warning: JSONReader::__construct(): invalid number mode attribute value: 5 in %s on line %d
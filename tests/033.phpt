@@ -0,0 +1,150 @@
+--TEST--
+Test reading strings in chunks with ATTR_STREAM_STRINGS
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$key = '';
+$rdr = new JSONReader(array(JSONReader::ATTR_STREAM_STRINGS => true));
+$rdr->feed('{"a": "abc\\"déf\\u20ac", "b": "", "c": [1, "xyz"], "d": "skipped", "e": 2}');
+$rdr->end();
+while ($rdr->read()) {
+	switch ($rdr->tokenType) {
+		case JSONReader::OBJECT_KEY:
+			$key = $rdr->value;
+			break;
+
+		case JSONReader::STRING_START:
+			echo "$key: ";
+			var_dump($rdr->value);
+			if ($key == 'd') {
+				/* left to be skipped by read() */
+				break;
+			}
+			while (($chunk = $rdr->readStringChunk(4)) !== false) {
+				var_dump($chunk);
+			}
+			var_dump($rdr->readStringChunk());
+			break;
+
+		default:
+			echo "$key: ", $rdr->tokenType, "\n";
+			break;
+	}
+}
+
+/* Copying a large string across many read buffers, decoding base64 */
+$data = '';
+for ($i = 0; $i < 30000; $i++) {
+	$data .= chr($i % 251);
+}
+$json = '{"id": 7, "data": "' . chunk_split(base64_encode($data), 76, '\\n') . '", "n": 1}';
+$fp = fopen('php://memory', 'w+');
+fwrite($fp, $json);
+rewind($fp);
+$rdr = new JSONReader(array(JSONReader::ATTR_STREAM_STRINGS => true, JSONReader::ATTR_READ_BUFF => 100));
+$rdr->open($fp);
+$out = fopen('php://memory', 'w+');
+while ($rdr->read()) {
+	if ($rdr->tokenType == JSONReader::STRING_START) {
+		var_dump($rdr->copyStringTo($out, true));
+	}
+}
+rewind($out);
+var_dump(stream_get_contents($out) === $data);
+
+/* Values read as a whole still include streamed strings */
+$rdr = new JSONReader(array(JSONReader::ATTR_STREAM_STRINGS => true));
+$rdr->feed('[{"a": "x", "b": ["y"], "c": "z"}, "w", {"a": "xyz"}]');
+$rdr->end();
+var_dump($rdr->readColumns(array('a', 'b')));
+
+$rdr = new JSONReader(array(JSONReader::ATTR_STREAM_STRINGS => true));
+$rdr->feed('["a\\nb"]');
+$rdr->end();
+$rdr->read();
+$rdr->read();
+var_dump($rdr->readRaw());
+
+/* Maximal token size */
+$rdr = new JSONReader(array(JSONReader::ATTR_MAX_TOKEN_SIZE => 5));
+$rdr->feed('["abcde", 12345, "abcdef"]');
+$rdr->end();
+while ($rdr->read()) {
+	var_dump($rdr->value);
+}
+
+/* Errors */
+$rdr = new JSONReader(array(JSONReader::ATTR_STREAM_STRINGS => true));
+$rdr->feed('["!!", 1]');
+$rdr->end();
+$rdr->read();
+var_dump($rdr->readStringChunk());
+$rdr->read();
+var_dump($rdr->readStringChunk(0));
+var_dump($rdr->copyStringTo($out, true));
+$rdr->read();
+var_dump($rdr->value);
+$rdr = new JSONReader(array(JSONReader::ATTR_MAX_TOKEN_SIZE => -1));
+?>
+--EXPECTF--
+: 256
+a: NULL
+string(4) "abc""
+string(4) "déf"
+string(3) "€"
+bool(false)
+b: NULL
+bool(false)
+c: 64
+c: 8
+c: NULL
+string(3) "xyz"
+bool(false)
+c: 128
+d: NULL
+e: 8
+e: 1024
+int(30000)
+bool(true)
+array(2) {
+  ["a"]=>
+  array(3) {
+    [0]=>
+    string(1) "x"
+    [1]=>
+    NULL
+    [2]=>
+    string(3) "xyz"
+  }
+  ["b"]=>
+  array(3) {
+    [0]=>
+    array(1) {
+      [0]=>
+      string(1) "y"
+    }
+    [1]=>
+    NULL
+    [2]=>
+    NULL
+  }
+}
+string(6) ""a\nb""
+NULL
+string(5) "abcde"
+int(12345)
+
+Warning: JSONReader::read(): parser error [#%d]: token is larger than the maximal token size of 5 bytes in %s on line %d
+
+Warning: JSONReader::readStringChunk(): the reader is not at the start of a streamed string in %s on line %d
+bool(false)
+
+Warning: JSONReader::readStringChunk(): chunk size must be greater than 0, 0 given in %s on line %d
+bool(false)
+
+Warning: JSONReader::copyStringTo(): the string is not valid base64 data in %s on line %d
+bool(false)
+int(1)
+
+Warning: JSONReader::__construct(): max token size must be 0 (no limit) or more, -1 given in %s on line %d
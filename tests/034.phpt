@@ -0,0 +1,112 @@
+--TEST--
+Test event-driven parsing using JSONReader::parse()
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader") || !extension_loaded("json")) print "skip"; ?>
+--FILE--
+<?php
+$json = '{"users": [{"id": 1, "name": "ann", "tags": ["a", "b"]}, ' .
+	'{"id": 2, "name": "bob", "tags": []}], "meta": {"n": 2, "next": null}}';
+
+function show($value, $path, $type)
+{
+	echo $path, ' ', $type, ' ', json_encode($value), "\n";
+}
+
+/* Path handlers get whole values */
+$rdr = new JSONReader();
+$rdr->feed($json);
+$rdr->end();
+var_dump($rdr->parse(array(
+	'/users/*/name' => 'show',
+	'/users/1/tags' => 'show',
+	'/meta'         => 'show'
+)));
+
+/* Token type handlers get the tokens of values no path handler matched */
+$rdr = new JSONReader();
+$rdr->feed($json);
+$rdr->end();
+var_dump($rdr->parse(array(
+	'/users/0'           => 'show',
+	JSONReader::INT      => 'show',
+	JSONReader::OBJECT_KEY | JSONReader::ARRAY_END => 'show'
+)));
+
+/* Returning FALSE stops parsing, and reading can go on from there */
+$rdr = new JSONReader();
+$rdr->feed('[1, 2, 3, 4]');
+$rdr->end();
+var_dump($rdr->parse(array(
+	JSONReader::INT => function ($v) { echo $v, "\n"; return $v < 2; }
+)));
+$rdr->read();
+var_dump($rdr->value);
+
+/* Parsing the value of the current key */
+$rdr = new JSONReader();
+$rdr->feed('{"a": {"b": [1, {"c": true}]}, "d": "x"}');
+$rdr->end();
+$rdr->read();
+$rdr->read();
+var_dump($rdr->parse(array('/b/1/c' => 'show')));
+var_dump($rdr->parse(array('' => 'show')));
+$rdr->read();
+var_dump($rdr->parse(array('' => 'show')));
+
+/* Errors */
+$rdr = new JSONReader();
+$rdr->feed('[1]');
+var_dump($rdr->parse(array()));
+$rdr->end();
+var_dump($rdr->parse(array('a' => 'show')));
+var_dump($rdr->parse(array(4096 => 'show')));
+var_dump($rdr->parse(array(JSONReader::INT => 42)));
+try {
+	$rdr->parse(array('/0' => function () { throw new Exception('thrown'); }));
+} catch (Exception $e) {
+	echo $e->getMessage(), "\n";
+}
+?>
+--EXPECTF--
+/users/0/name 32 "ann"
+/users/1/name 32 "bob"
+/users/1/tags 64 []
+/meta 256 {"n":2,"next":null}
+int(4)
+/users 512 "users"
+/users/0 256 {"id":1,"name":"ann","tags":["a","b"]}
+/users/1/id 512 "id"
+/users/1/id 8 2
+/users/1/name 512 "name"
+/users/1/tags 512 "tags"
+/users/1/tags 128 null
+/users 128 null
+/meta 512 "meta"
+/meta/n 512 "n"
+/meta/n 8 2
+/meta/next 512 "next"
+int(12)
+1
+2
+int(2)
+int(3)
+/b/1/c 4 true
+int(1)
+
+Warning: JSONReader::parse(): the reader is not at the start of a value in %s on line %d
+bool(false)
+ 32 "x"
+int(1)
+
+Warning: JSONReader::parse(): cannot parse from a non-blocking stream or before end() is called in %s on line %d
+bool(false)
+
+Warning: JSONReader::parse(): invalid path 'a', paths must be empty or start with '/' in %s on line %d
+bool(false)
+
+Warning: JSONReader::parse(): invalid token type 4096 in %s on line %d
+bool(false)
+
+Warning: JSONReader::parse(): invalid handler for token type 8 in %s on line %d
+bool(false)
+thrown
@@ -0,0 +1,60 @@
+--TEST--
+Test resuming from a checkpoint taken right after the opening quote of a string
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+<?php if (!function_exists("stream_socket_pair")) print "skip no stream_socket_pair()"; ?>
+--FILE--
+<?php
+$docs = array(
+  '[12345, "a string value", "x"]',
+  '{"k": 1, "a long object key": "v"}'
+);
+$file = tempnam(sys_get_temp_dir(), 'jsr');
+
+foreach ($docs as $doc) {
+  /* The stream only has data up to the quote, so the read buffer ends there */
+  list($in, $out) = stream_socket_pair(STREAM_PF_UNIX, STREAM_SOCK_STREAM, STREAM_IPPROTO_IP);
+  stream_set_blocking($in, 0);
+  $rdr = new JSONReader(array(JSONReader::ATTR_NONBLOCK => true, JSONReader::ATTR_READ_BUFF => 9));
+  $rdr->open($in);
+  fwrite($out, substr($doc, 0, strpos($doc, '"', 8) + 1));
+  while (($ret = $rdr->read()) === true) {
+    echo $rdr->tokenType, " ", var_export($rdr->value, true), "\n";
+  }
+  var_dump($ret === JSONReader::NEED_DATA);
+  $checkpoint = $rdr->checkpoint();
+  $rdr->close();
+  fclose($out);
+
+  /* Resume on a reader whose parser already has token memory from reading 
+     a whole document */
+  file_put_contents($file, $doc);
+  $rdr = new JSONReader(array(JSONReader::ATTR_READ_BUFF => 9));
+  $rdr->open($file);
+  while ($rdr->read());
+  $rdr->close();
+  $rdr->open($file);
+  var_dump($rdr->resume($checkpoint));
+  while ($rdr->read()) {
+    echo $rdr->tokenType, " ", var_export($rdr->value, true), "\n";
+  }
+  $rdr->close();
+}
+unlink($file);
+?>
+--EXPECT--
+64 NULL
+8 12345
+bool(true)
+bool(true)
+32 'a string value'
+32 'x'
+128 NULL
+256 NULL
+512 'k'
+8 1
+bool(true)
+bool(true)
+512 'a long object key'
+32 'v'
+1024 NULL
@@ -0,0 +1,106 @@
+--TEST--
+Test reading and resuming documents nested deeper than 64 levels
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+/* 100 levels, mixing objects and arrays, with values at each level */
+$depth = 100;
+$json = '';
+for ($i = 1; $i <= $depth; $i++) {
+  $json .= ($i % 3 ? '[' . $i . ', ' : '{"n": ' . $i . ', "k' . $i . '": ');
+}
+$json .= '"leaf"';
+for ($i = $depth; $i >= 1; $i--) {
+  $json .= ($i % 3 ? ', ' . $i . ']' : ', "m": ' . $i . '}');
+}
+$file = tempnam(sys_get_temp_dir(), 'jsr');
+file_put_contents($file, $json);
+
+function trace($rdr)
+{
+  return $rdr->tokenType . ' ' . $rdr->currentDepth . ' ' . 
+    $rdr->currentStruct . ' ' . var_export($rdr->value, true) . "\n";
+}
+
+$attrs = array(JSONReader::ATTR_MAX_DEPTH => 128, JSONReader::ATTR_READ_BUFF => 16);
+
+/* Whole document at once */
+$rdr = new JSONReader($attrs);
+$rdr->open($file);
+$full = '';
+$max = 0;
+while ($rdr->read()) {
+  $full .= trace($rdr);
+  $max = max($max, $rdr->currentDepth);
+  if ($rdr->value === 'leaf') {
+    echo trace($rdr);
+  }
+}
+var_dump($max);
+$rdr->close();
+
+/* Checkpoint at level 80 on the way down, and resume in a new reader */
+$rdr = new JSONReader($attrs);
+$rdr->open($file);
+$part = '';
+while ($rdr->read()) {
+  $part .= trace($rdr);
+  if ($rdr->currentDepth == 80) break;
+}
+echo trace($rdr);
+$checkpoint = $rdr->checkpoint();
+$rdr->close();
+
+$rdr = new JSONReader($attrs);
+$rdr->open($file);
+var_dump($rdr->resume($checkpoint));
+while ($rdr->read()) {
+  $part .= trace($rdr);
+}
+$rdr->close();
+var_dump($part === $full);
+
+/* The same checkpoint taken on the way up, past level 64 again */
+$rdr = new JSONReader($attrs);
+$rdr->open($file);
+$part = '';
+$seen_leaf = false;
+while ($rdr->read()) {
+  $part .= trace($rdr);
+  if ($rdr->value === 'leaf') $seen_leaf = true;
+  if ($seen_leaf && $rdr->currentDepth == 70) break;
+}
+$checkpoint = $rdr->checkpoint();
+$rdr->close();
+
+$rdr = new JSONReader($attrs);
+$rdr->open($file);
+var_dump($rdr->resume($checkpoint));
+while ($rdr->read()) {
+  $part .= trace($rdr);
+}
+$rdr->close();
+var_dump($part === $full);
+
+/* The default maximal depth of 64 is too low for this document */
+$rdr = new JSONReader(array(JSONReader::ATTR_READ_BUFF => 16));
+$rdr->open($file);
+var_dump($rdr->resume($checkpoint));
+while ($rdr->read());
+$rdr->close();
+unlink($file);
+?>
+--EXPECTF--
+32 100 %d 'leaf'
+int(100)
+64 80 %d NULL
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+
+Warning: JSONReader::resume(): parser error [#%d]: snapshot nesting level exceeds maximal nesting level of 64 in %s on line %d
+bool(false)
+
+Warning: JSONReader::read(): parser error [#%d]: maximal nesting level of 64 reached in %s on line %d
@@ -0,0 +1,60 @@
+--TEST--
+Test resuming from a corrupted checkpoint
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$file = tempnam(sys_get_temp_dir(), 'jsr');
+file_put_contents($file, '[1, "two", 3]');
+
+$rdr = new JSONReader();
+$rdr->open($file);
+$rdr->read();
+$rdr->read();
+$checkpoint = $rdr->checkpoint();
+
+/* Replace one of the 8 byte little endian header fields */
+function set_field($checkpoint, $field, $value)
+{
+  return substr_replace($checkpoint, pack('V', $value) . "\0\0\0\0", 4 + 8 * $field, 8);
+}
+
+/* Half-read token with nothing saved for it */
+$bad = set_field(set_field($checkpoint, 3, 1), 4, 100000);
+var_dump($rdr->resume($bad));
+
+/* Object key half-read inside an array */
+$bad = set_field(set_field(set_field($checkpoint, 2, 512), 3, 1), 4, 0);
+$bad = set_field($bad, 1, 32);
+var_dump($rdr->resume($bad));
+
+/* Expecting a colon inside an array */
+var_dump($rdr->resume(set_field($checkpoint, 1, 1 << 17)));
+
+/* Not a single token type */
+var_dump($rdr->resume(set_field($checkpoint, 2, 3)));
+
+/* The reader is left as it was */
+var_dump($rdr->resume($checkpoint));
+while ($rdr->read()) {
+  echo $rdr->tokenType, " ", var_export($rdr->value, true), "\n";
+}
+$rdr->close();
+unlink($file);
+?>
+--EXPECTF--
+Warning: JSONReader::resume(): parser error [#%d]: snapshot data is corrupt in %s on line %d
+bool(false)
+
+Warning: JSONReader::resume(): parser error [#%d]: snapshot parser state is corrupt in %s on line %d
+bool(false)
+
+Warning: JSONReader::resume(): parser error [#%d]: snapshot parser state is corrupt in %s on line %d
+bool(false)
+
+Warning: JSONReader::resume(): parser error [#%d]: snapshot parser state is corrupt in %s on line %d
+bool(false)
+bool(true)
+32 'two'
+8 3
+128 NULL
@@ -0,0 +1,45 @@
+--TEST--
+Test reading lazy strings after the reader needs more data
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$rdr = new JSONReader(array(JSONReader::ATTR_LAZY_STRINGS => true));
+$rdr->feed('["abc", "d\"e"');
+$rdr->read();
+$rdr->read();
+$rdr->read();
+var_dump($rdr->read() === JSONReader::NEED_DATA);
+var_dump($rdr->tokenType == JSONReader::STRING, $rdr->value);
+$rdr->feed('  ');
+var_dump($rdr->read() === JSONReader::NEED_DATA);
+var_dump($rdr->value);
+$rdr->feed(', "x');
+var_dump($rdr->read() === JSONReader::NEED_DATA);
+$rdr->feed('yz" ');
+$rdr->read();
+$rdr->feed(']');
+$rdr->end();
+var_dump($rdr->value);
+$rdr->read();
+var_dump($rdr->tokenType == JSONReader::ARRAY_END, $rdr->read());
+
+/* A top-level string document, read to its end */
+$rdr = new JSONReader(array(JSONReader::ATTR_LAZY_STRINGS => true));
+$rdr->feed('"abc"');
+$rdr->end();
+var_dump($rdr->read(), $rdr->read(), $rdr->value);
+?>
+--EXPECT--
+bool(true)
+bool(true)
+string(3) "d"e"
+bool(true)
+string(3) "d"e"
+bool(true)
+string(3) "xyz"
+bool(true)
+bool(false)
+bool(true)
+bool(false)
+string(3) "abc"
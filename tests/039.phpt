@@ -0,0 +1,36 @@
+--TEST--
+Test reading raw scalar values after the reader needs more data
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+$rdr = new JSONReader();
+$rdr->feed('[true, "a\/b"');
+$rdr->read();
+$rdr->read();
+$rdr->read();
+var_dump($rdr->read() === JSONReader::NEED_DATA);
+var_dump($rdr->readRaw(), $rdr->value);
+$rdr->feed(' ,  -1.5e');
+var_dump($rdr->read() === JSONReader::NEED_DATA);
+$rdr->feed('3 ]');
+$rdr->end();
+$rdr->read();
+var_dump($rdr->readRaw(), $rdr->value);
+
+/* A top-level value, read to its end */
+$rdr = new JSONReader();
+$rdr->feed('"x\ty" ');
+$rdr->end();
+var_dump($rdr->read(), $rdr->read(), $rdr->readRaw());
+?>
+--EXPECT--
+bool(true)
+string(6) ""a\/b""
+string(3) "a/b"
+bool(true)
+string(6) "-1.5e3"
+float(-1500)
+bool(true)
+bool(false)
+string(6) ""x\ty""
@@ -0,0 +1,27 @@
+--TEST--
+Test ending fed UTF-16 and UTF-32 input with a top level number
+--SKIPIF--
+<?php if (!extension_loaded("jsonreader")) print "skip"; ?>
+--FILE--
+<?php
+foreach (array('v*', 'n*', 'V*', 'N*') as $format) {
+  $rdr = new JSONReader();
+  $rdr->feed(call_user_func_array('pack', array_merge(array($format), 
+    array_map('ord', str_split('-12.5')))));
+  $rdr->end();
+  var_dump($rdr->read(), $rdr->value, $rdr->read());
+}
+?>
+--EXPECT--
+bool(true)
+float(-12.5)
+bool(false)
+bool(true)
+float(-12.5)
+bool(false)
+bool(true)
+float(-12.5)
+bool(false)
+bool(true)
+float(-12.5)
+bool(false)